@@ -0,0 +1,77 @@
+#include "Budget.hpp"
+
+#include <algorithm>
+#include <format>
+
+namespace budget {
+    uint64_t estimate(const Layout& layout)
+    {
+        const auto pixels = static_cast<uint64_t>(layout.w) * layout.h;
+        auto bytes = layout.fixed_bytes;
+        for (const auto& s : layout.screens) {
+            const auto samples = std::max(s.samples, 1u);
+            bytes += pixels * (s.color_bytes + layout.depth_bytes) * samples;
+            if (samples > 1) {
+                // Multisampled render targets are resolved to a texture for compositing
+                bytes += pixels * s.color_bytes;
+            }
+            bytes += pixels * s.color_bytes * s.extra_textures;
+        }
+        return bytes;
+    }
+
+    Decision fit(const Layout& layout, uint64_t budget_bytes)
+    {
+        auto d = Decision { layout, {}, 0, budget_bytes, false };
+        auto sides = std::ranges::subrange(d.layout.screens.begin() + std::min<size_t>(1, d.layout.screens.size()), d.layout.screens.end());
+
+        while ((d.estimated_bytes = estimate(d.layout)) > budget_bytes && !sides.empty()) {
+            const auto max_samples = std::ranges::max(sides, {}, &Screen::samples).samples;
+            if (max_samples > 2) {
+                for (auto& s : sides) {
+                    s.samples = s.samples > 2 ? std::max(s.samples / 2, 2u) : s.samples;
+                }
+                d.steps.push_back(ReduceSideMsaa);
+            } else if (max_samples > 1) {
+                for (auto& s : sides) {
+                    s.samples = 1;
+                }
+                d.steps.push_back(DisableSideMsaa);
+            } else if (d.layout.allow_16bit_color && std::ranges::any_of(sides, [](const Screen& s) { return s.color_bytes > 2; })) {
+                for (auto& s : sides) {
+                    s.color_bytes = std::min(s.color_bytes, 2u);
+                }
+                d.steps.push_back(SideColor16Bit);
+            } else {
+                break;
+            }
+        }
+        d.fits = d.estimated_bytes <= budget_bytes;
+        return d;
+    }
+
+    const char* to_string(Step step)
+    {
+        switch (step) {
+            case ReduceSideMsaa: return "side MSAA reduced";
+            case DisableSideMsaa: return "side MSAA off";
+            case SideColor16Bit: return "side 16-bit color";
+            default: return "";
+        }
+    }
+
+    std::string describe(const Decision& decision)
+    {
+        constexpr uint64_t MB = 1024 * 1024;
+        auto ret = std::format("{} MB of {} MB", decision.estimated_bytes / MB, decision.budget_bytes / MB);
+        for (const auto step : { ReduceSideMsaa, DisableSideMsaa, SideColor16Bit }) {
+            if (std::ranges::find(decision.steps, step) != decision.steps.end()) {
+                ret += std::format(", {}", to_string(step));
+            }
+        }
+        if (!decision.fits) {
+            ret += ", does not fit";
+        }
+        return ret;
+    }
+}
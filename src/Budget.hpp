@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Video memory budget for the render targets created by the plugin.
+// The cost of the configured layout is estimated before the render targets are created,
+// and if it doesn't fit, the side screen settings are downgraded in a fixed order:
+//  1. Halve the side screen MSAA sample counts, down to 2x
+//  2. Disable side screen MSAA
+//  3. Use a 16-bit color format on the side screens
+// The primary screen is never downgraded.
+namespace budget {
+    struct Screen {
+        // Sample count, 1 without multisampling
+        uint32_t samples;
+        uint32_t color_bytes;
+        // Single sampled textures of the size and color format of the render target that are allocated besides it,
+        // i.e. the history image of reprojection and interlacing and the upscaled image
+        uint32_t extra_textures = 0;
+    };
+
+    struct Layout {
+        // Size of the render target of each screen
+        uint32_t w, h;
+        uint32_t depth_bytes;
+        // Screens, the first one is the primary screen
+        std::vector<Screen> screens;
+        // Memory used regardless of the screen settings, i.e. the swapchain
+        uint64_t fixed_bytes;
+        // Whether the 16-bit color format can be used on the side screens
+        bool allow_16bit_color;
+    };
+
+    enum Step {
+        ReduceSideMsaa,
+        DisableSideMsaa,
+        SideColor16Bit,
+    };
+
+    struct Decision {
+        Layout layout;
+        std::vector<Step> steps;
+        uint64_t estimated_bytes;
+        uint64_t budget_bytes;
+        bool fits;
+    };
+
+    // Estimated memory use of the render targets, including the multisample resolve textures and the extra textures
+    uint64_t estimate(const Layout& layout);
+
+    // Downgrade the layout until it fits in the budget, or there is nothing left to downgrade
+    Decision fit(const Layout& layout, uint64_t budget_bytes);
+
+    const char* to_string(Step step);
+
+    // Short summary of the decision for the menu
+    std::string describe(const Decision& decision);
+}
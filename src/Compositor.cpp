@@ -0,0 +1,255 @@
+#include "Compositor.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+
+namespace compositor {
+    const char* const vertex_shader_source = R"(
+struct Vertex {
+    float4 pos : POSITION;
+    float2 uv : TEXCOORD0;
+    float4 params : TEXCOORD1;
+    float2 texel : TEXCOORD2;
+    float4 bounds : TEXCOORD3;
+};
+
+Vertex main(Vertex v)
+{
+    return v;
+}
+)";
+
+    const char* const pixel_shader_source = R"(
+sampler2D source0 : register(s0);
+sampler2D source1 : register(s1);
+sampler2D source2 : register(s2);
+sampler2D source3 : register(s3);
+
+float3 fetch(float source, float2 uv)
+{
+    // The source is the same for the whole quad, so the branches are coherent
+    if (source < 0.5) {
+        return tex2Dlod(source0, float4(uv, 0.0, 0.0)).rgb;
+    } else if (source < 1.5) {
+        return tex2Dlod(source1, float4(uv, 0.0, 0.0)).rgb;
+    } else if (source < 2.5) {
+        return tex2Dlod(source2, float4(uv, 0.0, 0.0)).rgb;
+    }
+    return tex2Dlod(source3, float4(uv, 0.0, 0.0)).rgb;
+}
+
+float fxaa_luma(float3 c)
+{
+    return dot(c, float3(0.299, 0.587, 0.114));
+}
+
+float3 fetch_clamped(float source, float2 uv, float4 bounds)
+{
+    return fetch(source, clamp(uv, bounds.xy, bounds.zw));
+}
+
+// Fast approximate anti-aliasing, same as fxaa::apply
+float3 fxaa(float source, float2 uv, float2 texel, float4 bounds, float3 m)
+{
+    float luma_m = fxaa_luma(m);
+    float luma_nw = fxaa_luma(fetch_clamped(source, uv + float2(-0.5, -0.5) * texel, bounds));
+    float luma_ne = fxaa_luma(fetch_clamped(source, uv + float2(0.5, -0.5) * texel, bounds));
+    float luma_sw = fxaa_luma(fetch_clamped(source, uv + float2(-0.5, 0.5) * texel, bounds));
+    float luma_se = fxaa_luma(fetch_clamped(source, uv + float2(0.5, 0.5) * texel, bounds));
+
+    float luma_min = min(luma_m, min(min(luma_nw, luma_ne), min(luma_sw, luma_se)));
+    float luma_max = max(luma_m, max(max(luma_nw, luma_ne), max(luma_sw, luma_se)));
+    if (luma_max - luma_min < max(0.03125, luma_max * 0.125)) {
+        return m;
+    }
+
+    // Blur along the edge, which is perpendicular to the luma gradient
+    float2 dir = float2(-((luma_nw + luma_ne) - (luma_sw + luma_se)), (luma_nw + luma_sw) - (luma_ne + luma_se));
+    float dir_reduce = max((luma_nw + luma_ne + luma_sw + luma_se) * (0.25 * 0.125), 0.0078125);
+    float rcp_dir_min = 1.0 / (min(abs(dir.x), abs(dir.y)) + dir_reduce);
+    dir = clamp(dir * rcp_dir_min, -8.0, 8.0) * texel;
+
+    float3 rgb_a = 0.5 * (fetch_clamped(source, uv + dir * (1.0 / 3.0 - 0.5), bounds) + fetch_clamped(source, uv + dir * (2.0 / 3.0 - 0.5), bounds));
+    float3 rgb_b = 0.5 * rgb_a + 0.25 * (fetch_clamped(source, uv - dir * 0.5, bounds) + fetch_clamped(source, uv + dir * 0.5, bounds));
+
+    // The wider blur may have crossed to another edge
+    float luma_b = fxaa_luma(rgb_b);
+    return (luma_b < luma_min || luma_b > luma_max) ? rgb_a : rgb_b;
+}
+
+float4 main(float2 uv : TEXCOORD0, float4 params : TEXCOORD1, float2 texel : TEXCOORD2, float4 bounds : TEXCOORD3) : COLOR
+{
+    float3 e = fetch(params.x, uv);
+    if (params.w > 0.0) {
+        e = fxaa(params.x, uv, texel, bounds, e);
+    } else if (params.y > 0.0) {
+        // Contrast adaptive sharpening, same as upscale::rcas
+        //   b
+        // d e f
+        //   h
+        float3 b = fetch(params.x, clamp(uv + float2(0.0, -texel.y), bounds.xy, bounds.zw));
+        float3 d = fetch(params.x, clamp(uv + float2(-texel.x, 0.0), bounds.xy, bounds.zw));
+        float3 f = fetch(params.x, clamp(uv + float2(texel.x, 0.0), bounds.xy, bounds.zw));
+        float3 h = fetch(params.x, clamp(uv + float2(0.0, texel.y), bounds.xy, bounds.zw));
+
+        float3 mn4 = min(min(b, d), min(f, h));
+        float3 mx4 = max(max(b, d), max(f, h));
+        float3 hit_min = min(mn4, e) / max(4.0 * mx4, 1.0e-5);
+        float3 hit_max = (1.0 - max(mx4, e)) / min(4.0 * mn4 - 4.0, -1.0e-5);
+        float3 lobe3 = max(-hit_min, hit_max);
+        float lobe = max(-0.1875, min(max(lobe3.r, max(lobe3.g, lobe3.b)), 0.0)) * params.y;
+        e = saturate((lobe * (b + d + f + h) + e) / (4.0 * lobe + 1.0));
+    }
+    return float4(e * params.z, 1.0);
+}
+)";
+
+    Rect scale_rect(const Rect& rect, double scale)
+    {
+        if (scale == 1.0) {
+            return rect;
+        }
+        const auto s = [scale](int32_t v) { return static_cast<int32_t>(std::lround(v * scale)); };
+        return { s(rect.left), s(rect.top), s(rect.right), s(rect.bottom) };
+    }
+
+    Placement place(const Rect& visible, double scale, int32_t x, int32_t y, int32_t xmin)
+    {
+        const auto dstx = x + std::abs(xmin);
+        return {
+            .src = scale_rect(visible, scale),
+            .dst = { dstx, y, dstx + visible.w(), y + visible.h() },
+        };
+    }
+
+    bool covers(std::span<const Rect> rects, int32_t target_w, int32_t target_h)
+    {
+        // The target is cut into columns at the left and right edges of the rects, and each column must be
+        // covered from top to bottom by the rects that span it
+        std::vector<int32_t> xs { 0, target_w };
+        for (const auto& r : rects) {
+            xs.push_back(std::clamp(r.left, 0, target_w));
+            xs.push_back(std::clamp(r.right, 0, target_w));
+        }
+        std::ranges::sort(xs);
+        std::vector<std::pair<int32_t, int32_t>> spans;
+        for (size_t i = 0; i + 1 < xs.size(); ++i) {
+            if (xs[i] == xs[i + 1]) {
+                continue;
+            }
+            spans.clear();
+            for (const auto& r : rects) {
+                if (r.left <= xs[i] && r.right >= xs[i + 1] && r.top < r.bottom) {
+                    spans.emplace_back(r.top, r.bottom);
+                }
+            }
+            std::ranges::sort(spans);
+            auto y = 0;
+            for (const auto& [top, bottom] : spans) {
+                if (top > y) {
+                    break;
+                }
+                y = std::max(y, bottom);
+            }
+            if (y < target_h) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    std::optional<PassClip> pass_clip(const Rect& visible, double scale, int32_t surface_w, int32_t surface_h)
+    {
+        if (visible.left <= 0 && visible.top <= 0 && visible.right >= surface_w && visible.bottom >= surface_h) {
+            return std::nullopt;
+        }
+
+        // Clip space is the same with a reduced resolution, only the scissor rect is in pixels
+        auto ret = PassClip { .scissor = place(visible, scale, 0, 0, 0).src };
+
+        // Visible area in normalized device coordinates
+        const auto l = 2.0f * visible.left / surface_w - 1.0f;
+        const auto r = 2.0f * visible.right / surface_w - 1.0f;
+        const auto t = 1.0f - 2.0f * visible.top / surface_h;
+        const auto b = 1.0f - 2.0f * visible.bottom / surface_h;
+        if (visible.left > 0) {
+            ret.planes.push_back({ 1.0f, 0.0f, 0.0f, -l });
+        }
+        if (visible.right < surface_w) {
+            ret.planes.push_back({ -1.0f, 0.0f, 0.0f, r });
+        }
+        if (visible.top > 0) {
+            ret.planes.push_back({ 0.0f, -1.0f, 0.0f, t });
+        }
+        if (visible.bottom < surface_h) {
+            ret.planes.push_back({ 0.0f, 1.0f, 0.0f, -b });
+        }
+        return ret;
+    }
+
+    std::vector<Vertex> build_vertices(std::span<const Layer> layers, uint32_t target_w, uint32_t target_h)
+    {
+        std::vector<Vertex> ret;
+        ret.reserve(layers.size() * 6);
+
+        const auto tw = static_cast<float>(target_w);
+        const auto th = static_cast<float>(target_h);
+        for (const auto& l : layers) {
+            const auto texel_w = 1.0f / static_cast<float>(l.source_w);
+            const auto texel_h = 1.0f / static_cast<float>(l.source_h);
+
+            // Pixel centers are at integer coordinates in D3D9, so the quad is moved by half a pixel
+            const auto x0 = (static_cast<float>(l.dst.left) - 0.5f) / tw * 2.0f - 1.0f;
+            const auto x1 = (static_cast<float>(l.dst.right) - 0.5f) / tw * 2.0f - 1.0f;
+            const auto y0 = 1.0f - (static_cast<float>(l.dst.top) - 0.5f) / th * 2.0f;
+            const auto y1 = 1.0f - (static_cast<float>(l.dst.bottom) - 0.5f) / th * 2.0f;
+            const auto u0 = static_cast<float>(l.src.left) * texel_w;
+            const auto u1 = static_cast<float>(l.src.right) * texel_w;
+            const auto v0 = static_cast<float>(l.src.top) * texel_h;
+            const auto v1 = static_cast<float>(l.src.bottom) * texel_h;
+
+            const auto vertex = [&](float x, float y, float u, float v) {
+                return Vertex {
+                    x, y, 0.5f, 1.0f,
+                    u, v,
+                    static_cast<float>(l.source), l.sharpness, l.brightness, l.antialias ? 1.0f : 0.0f,
+                    texel_w, texel_h,
+                    u0 + 0.5f * texel_w, v0 + 0.5f * texel_h, u1 - 0.5f * texel_w, v1 - 0.5f * texel_h
+                };
+            };
+            const auto top_left = vertex(x0, y0, u0, v0);
+            const auto top_right = vertex(x1, y0, u1, v0);
+            const auto bottom_left = vertex(x0, y1, u0, v1);
+            const auto bottom_right = vertex(x1, y1, u1, v1);
+            ret.insert(ret.end(), { top_left, top_right, bottom_left, bottom_left, top_right, bottom_right });
+        }
+        return ret;
+    }
+
+    bool compose(Device& device, std::span<const Layer> layers, uint32_t target_w, uint32_t target_h)
+    {
+        if (layers.empty()) {
+            return true;
+        }
+        if (target_w == 0 || target_h == 0) {
+            return false;
+        }
+
+        uint32_t bound = 0;
+        for (const auto& l : layers) {
+            if (l.source >= MAX_SOURCES || l.source_w == 0 || l.source_h == 0 || l.src.w() <= 0 || l.src.h() <= 0 || l.dst.w() <= 0 || l.dst.h() <= 0) {
+                return false;
+            }
+            if (!(bound & (1u << l.source))) {
+                if (!device.bind_source(l.source)) {
+                    return false;
+                }
+                bound |= 1u << l.source;
+            }
+        }
+
+        const auto vertices = build_vertices(layers, target_w, target_h);
+        return device.draw_triangles(vertices.data(), static_cast<uint32_t>(vertices.size() / 3));
+    }
+}
@@ -0,0 +1,104 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <vector>
+
+// Composes the camera images into the final frame with a single draw call.
+// Every camera is a textured quad, and scaling, sharpening, anti-aliasing and color correction
+// are done per quad in the same pixel shader.
+//
+// The compositor only builds the geometry and talks to the GPU through the Device
+// interface, so it can be run against a stand-in device without D3D.
+namespace compositor {
+    // Number of source textures that can be used in one draw, one per sampler
+    constexpr uint32_t MAX_SOURCES = 4;
+
+    struct Rect {
+        int32_t left, top, right, bottom;
+
+        int32_t w() const { return right - left; }
+        int32_t h() const { return bottom - top; }
+    };
+
+    // Area of a render target scaled to the resolution a camera is rendered at
+    Rect scale_rect(const Rect& rect, double scale);
+
+    // Where a camera's image is shown: the area of its render target that Present reads and the area of the back
+    // buffer it is composed to
+    struct Placement {
+        Rect src;
+        Rect dst;
+    };
+
+    // `visible` is the shown area of the camera's render target at the full resolution, and `scale` the resolution
+    // the camera is rendered at. The screen is placed at `x`, `y`, moved right by the leftmost screen `xmin`.
+    Placement place(const Rect& visible, double scale, int32_t x, int32_t y, int32_t xmin);
+
+    // Check if the union of the rects covers all of a target of the given size. The rects may overlap and extend
+    // past the target.
+    bool covers(std::span<const Rect> rects, int32_t target_w, int32_t target_h);
+
+    // Clipping of a camera pass to the area Present reads, so that the pixels that are cropped away are never
+    // shaded: the scissor rect in the pixels of the reduced resolution, and user clip planes in clip space for the
+    // cropped edges, where dot(plane, position) >= 0 is kept
+    struct PassClip {
+        Rect scissor;
+        std::vector<std::array<float, 4>> planes;
+    };
+
+    // Nothing if no edge of the render target is cropped
+    std::optional<PassClip> pass_clip(const Rect& visible, double scale, int32_t surface_w, int32_t surface_h);
+
+    struct Layer {
+        // Index of the source texture, also the sampler it is bound to
+        uint32_t source;
+        // Size of the source texture
+        uint32_t source_w, source_h;
+        // Area of the source texture that is drawn to the area of the target
+        Rect src;
+        Rect dst;
+        // Contrast adaptive sharpening amount, 0 is off and 1 the sharpest
+        float sharpness = 0.0f;
+        // Color multiplier
+        float brightness = 1.0f;
+        // Fast approximate anti-aliasing, see fxaa::apply. Replaces the sharpening.
+        bool antialias = false;
+    };
+
+    struct Vertex {
+        // Clip space position
+        float x, y, z, w;
+        // Source texture coordinates
+        float u, v;
+        // Source index, sharpness, brightness, anti-aliasing
+        float source, sharpness, brightness, antialias;
+        // Size of a source texel in texture coordinates
+        float texel_w, texel_h;
+        // Texture coordinates of the outermost texel centers of the source area, for clamping the sharpening
+        float min_u, min_v, max_u, max_v;
+    };
+
+    // Triangle list of the quads of the layers, with the positions mapped to a target of the given size
+    std::vector<Vertex> build_vertices(std::span<const Layer> layers, uint32_t target_w, uint32_t target_h);
+
+    class Device {
+    public:
+        virtual ~Device() = default;
+
+        // Bind the source texture with the given index to the sampler of the same index
+        virtual bool bind_source(uint32_t index) = 0;
+        virtual bool draw_triangles(const Vertex* vertices, uint32_t triangle_count) = 0;
+    };
+
+    // Draw all layers with one draw call. Returns false if the layers are invalid or a device call fails.
+    bool compose(Device& device, std::span<const Layer> layers, uint32_t target_w, uint32_t target_h);
+
+    // HLSL sources of the compositing shaders.
+    // The vertex shader passes the vertices through as they are. The pixel shader
+    // samples source textures s0-s3 with the bilinear filter.
+    extern const char* const vertex_shader_source;
+    extern const char* const pixel_shader_source;
+}
@@ -12,6 +12,12 @@
 
 #include <d3d9.h>
 
+#include "DrawFilter.hpp"
+#include "Interlace.hpp"
+#include "Latency.hpp"
+#include "Offscreen.hpp"
+#include "Panorama.hpp"
+#include "RBR.hpp"
 #include "Util.hpp"
 
 #include <vec2.hpp>
@@ -29,28 +35,131 @@ struct CameraConfig {
     double angle_adjustment;
     double fov;
 
+    // Quality profile, zero values mean that the game's setting is used as is
+    double far_plane = 0.0;
+    double mip_lod_bias = 0.0;
+    int max_anisotropy = 0;
+    // Anti-aliasing sample count, overrides anti_alias_center_screen_only. 1 means no anti-aliasing.
+    // Lowered to the highest count the device supports.
+    int msaa = 0;
+    // Fraction of the resolution the camera is rendered at, only used for the side screens.
+    // The image is upscaled to the screen when compositing.
+    double render_scale = 1.0;
+    // Color multiplier applied when composing the image to the screen
+    double brightness = 1.0;
+
     auto operator<=>(const CameraConfig&) const = default;
 
     constexpr int& x() { return extent.x; }
     constexpr int& y() { return extent.y; }
     constexpr int& w() { return extent[2]; }
     constexpr int& h() { return extent[3]; }
+
+    // Area of the camera's render target that is shown on the screen
+    RECT visible_rect() const
+    {
+        return { crop.x, crop.y, crop.x + extent[2], crop.y + extent[3] };
+    }
 };
 
 struct Config {
     std::vector<CameraConfig> cameras;
     double fov;
     bool aa_center_screen_only = true;
+    // Post-process anti-aliasing for the side screens that are rendered without multisampling
+    bool side_monitors_fxaa = false;
     bool side_monitors_half_hz = true;
     bool side_monitors_half_hz_btb_only = true;
+    // With side_monitors_half_hz, each side monitor is rendered once in this many frames
+    int side_monitors_frame_divisor = 2;
+    bool side_monitors_reprojection = false;
+    // Keep showing the last side screen images while the camera and the scene stand still in the pause, the menus
+    // and the replays, and don't render the side screens at all when loading
+    bool reuse_static_side_images = false;
+    // Render only half of the side monitor pixels per pass and fill in the rest from the previous image
+    interlace::Mode side_monitors_interlace = interlace::Off;
+    // Order of the camera passes, the latency optimized order renders the primary screen last
+    rbr::PassOrder camera_pass_order = rbr::ConfigOrder;
+    // Wait after Present until the next frame is due at this frame rate, before the game samples the input
+    bool frame_limiter = false;
+    int frame_limit_fps = 60;
+    // Wait before each frame until the GPU has fewer than this many frames unfinished
+    bool limit_frames_in_flight = false;
+    int max_frames_in_flight = 2;
+    bool clip_to_visible_area = true;
+    bool skip_redundant_clears = false;
+    // Upscale the cameras rendered at a reduced resolution with the edge adaptive upscaler
+    // instead of a bilinear stretch, and sharpen by this many stops (0 is the sharpest)
+    bool edge_adaptive_upscaling = true;
+    double upscaling_sharpness = 0.25;
+    panorama::Mode panorama_mode = panorama::Off;
+    // Downgrade the side screen settings if the render targets don't fit in the video memory,
+    // leaving this much for the game's own textures
+    bool vram_budget = true;
+    int vram_reserve_mb = 512;
+    // Count the D3D9 device calls per camera pass, for the statistics menu
+    bool d3d_profiler = false;
+    // Count the draws of each camera pass that are outside of the camera's frustum
+    bool draw_analyzer = false;
+    // Skip the draws that are outside of the camera of the pass
+    bool frustum_culling = false;
+    bool rotate_game_camera = false;
+    // Skip the offscreen passes (shadow and environment maps) that an earlier camera pass of the frame rendered,
+    // except the ones rendering into a target of these sizes
+    bool skip_repeated_offscreen_passes = false;
+    std::vector<offscreen::Target> offscreen_always_render;
+    // Upload the writes to the dynamic vertex and index buffers only if the buffer does not hold the data already
+    bool deduplicate_uploads = false;
+    // Keep the vertex shader constants the game sets and upload them at the next draw, in as few calls as possible
+    bool batch_shader_constants = false;
+    // Test the draws of the side screens with at least this many primitives with occlusion queries while
+    // using the cockpit camera, and skip the hidden ones for this many frames before testing them again
+    bool occlusion_queries = false;
+    int occlusion_min_primitives = 500;
+    int occlusion_retest_frames = 8;
+    // Rasterize the opaque draws with at least this many primitives on the CPU, and skip the draws behind them
+    bool software_occlusion = false;
+    int software_occluder_min_primitives = 200;
+    std::vector<drawfilter::Rule> draw_filter;
 
     Config& operator=(const Config& rhs)
     {
         cameras = rhs.cameras;
         fov = rhs.fov;
         aa_center_screen_only = rhs.aa_center_screen_only;
+        side_monitors_fxaa = rhs.side_monitors_fxaa;
         side_monitors_half_hz = rhs.side_monitors_half_hz;
         side_monitors_half_hz_btb_only = rhs.side_monitors_half_hz_btb_only;
+        side_monitors_frame_divisor = rhs.side_monitors_frame_divisor;
+        side_monitors_reprojection = rhs.side_monitors_reprojection;
+        reuse_static_side_images = rhs.reuse_static_side_images;
+        side_monitors_interlace = rhs.side_monitors_interlace;
+        camera_pass_order = rhs.camera_pass_order;
+        frame_limiter = rhs.frame_limiter;
+        frame_limit_fps = rhs.frame_limit_fps;
+        limit_frames_in_flight = rhs.limit_frames_in_flight;
+        max_frames_in_flight = rhs.max_frames_in_flight;
+        clip_to_visible_area = rhs.clip_to_visible_area;
+        skip_redundant_clears = rhs.skip_redundant_clears;
+        edge_adaptive_upscaling = rhs.edge_adaptive_upscaling;
+        upscaling_sharpness = rhs.upscaling_sharpness;
+        panorama_mode = rhs.panorama_mode;
+        vram_budget = rhs.vram_budget;
+        vram_reserve_mb = rhs.vram_reserve_mb;
+        d3d_profiler = rhs.d3d_profiler;
+        draw_analyzer = rhs.draw_analyzer;
+        frustum_culling = rhs.frustum_culling;
+        rotate_game_camera = rhs.rotate_game_camera;
+        skip_repeated_offscreen_passes = rhs.skip_repeated_offscreen_passes;
+        offscreen_always_render = rhs.offscreen_always_render;
+        deduplicate_uploads = rhs.deduplicate_uploads;
+        batch_shader_constants = rhs.batch_shader_constants;
+        occlusion_queries = rhs.occlusion_queries;
+        occlusion_min_primitives = rhs.occlusion_min_primitives;
+        occlusion_retest_frames = rhs.occlusion_retest_frames;
+        software_occlusion = rhs.software_occlusion;
+        software_occluder_min_primitives = rhs.software_occluder_min_primitives;
+        draw_filter = rhs.draw_filter;
         return *this;
     }
 
@@ -59,8 +168,142 @@ struct Config {
         return cameras == rhs.cameras
             && fov == rhs.fov
             && aa_center_screen_only == rhs.aa_center_screen_only
+            && side_monitors_fxaa == rhs.side_monitors_fxaa
             && side_monitors_half_hz == rhs.side_monitors_half_hz
-            && side_monitors_half_hz_btb_only == rhs.side_monitors_half_hz_btb_only;
+            && side_monitors_half_hz_btb_only == rhs.side_monitors_half_hz_btb_only
+            && side_monitors_frame_divisor == rhs.side_monitors_frame_divisor
+            && side_monitors_reprojection == rhs.side_monitors_reprojection
+            && reuse_static_side_images == rhs.reuse_static_side_images
+            && side_monitors_interlace == rhs.side_monitors_interlace
+            && camera_pass_order == rhs.camera_pass_order
+            && frame_limiter == rhs.frame_limiter
+            && frame_limit_fps == rhs.frame_limit_fps
+            && limit_frames_in_flight == rhs.limit_frames_in_flight
+            && max_frames_in_flight == rhs.max_frames_in_flight
+            && clip_to_visible_area == rhs.clip_to_visible_area
+            && skip_redundant_clears == rhs.skip_redundant_clears
+            && edge_adaptive_upscaling == rhs.edge_adaptive_upscaling
+            && upscaling_sharpness == rhs.upscaling_sharpness
+            && panorama_mode == rhs.panorama_mode
+            && vram_budget == rhs.vram_budget
+            && vram_reserve_mb == rhs.vram_reserve_mb
+            && d3d_profiler == rhs.d3d_profiler
+            && draw_analyzer == rhs.draw_analyzer
+            && frustum_culling == rhs.frustum_culling
+            && rotate_game_camera == rhs.rotate_game_camera
+            && skip_repeated_offscreen_passes == rhs.skip_repeated_offscreen_passes
+            && offscreen_always_render == rhs.offscreen_always_render
+            && deduplicate_uploads == rhs.deduplicate_uploads
+            && batch_shader_constants == rhs.batch_shader_constants
+            && occlusion_queries == rhs.occlusion_queries
+            && occlusion_min_primitives == rhs.occlusion_min_primitives
+            && occlusion_retest_frames == rhs.occlusion_retest_frames
+            && software_occlusion == rhs.software_occlusion
+            && software_occluder_min_primitives == rhs.software_occluder_min_primitives
+            && draw_filter == rhs.draw_filter;
+    }
+
+    static toml::table draw_filter_rule_to_toml(const drawfilter::Rule& rule)
+    {
+        toml::table tbl {
+            { "action", rule.action == drawfilter::Skip ? "skip" : "pass" },
+        };
+        if (rule.shader_index != drawfilter::ANY) {
+            tbl.insert("shader", static_cast<int64_t>(rule.shader_index));
+        }
+        if (rule.shader_hash != 0) {
+            tbl.insert("shader_hash", static_cast<int64_t>(rule.shader_hash));
+        }
+        if (rule.primitive_types != drawfilter::ANY) {
+            toml::array types;
+            for (uint32_t i = 0; i < 32; ++i) {
+                if ((rule.primitive_types >> i) & 1) {
+                    types.push_back(drawfilter::primitive_type_to_string(i));
+                }
+            }
+            tbl.insert("primitive_types", types);
+        }
+        if (rule.min_primitives != 0) {
+            tbl.insert("min_primitives", static_cast<int64_t>(rule.min_primitives));
+        }
+        if (rule.max_primitives != UINT32_MAX) {
+            tbl.insert("max_primitives", static_cast<int64_t>(rule.max_primitives));
+        }
+        if (rule.cameras != drawfilter::ANY) {
+            toml::array cams;
+            for (uint32_t i = 0; i < 32; ++i) {
+                if ((rule.cameras >> i) & 1) {
+                    cams.push_back(static_cast<int64_t>(i));
+                }
+            }
+            tbl.insert("cameras", cams);
+        }
+        if (rule.game_modes != drawfilter::ANY) {
+            toml::array modes;
+            for (uint32_t i = 0; i < 32; ++i) {
+                if ((rule.game_modes >> i) & 1) {
+                    modes.push_back(rbr::to_string(static_cast<rbr::GameMode>(i)));
+                }
+            }
+            tbl.insert("game_modes", modes);
+        }
+        if (rule.stages != drawfilter::AnyStage) {
+            tbl.insert("stage", rule.stages == drawfilter::BTBStage ? "btb" : "rbr");
+        }
+        if (rule.draws != drawfilter::AnyDraw) {
+            tbl.insert("draw", rule.draws == drawfilter::Indexed ? "indexed" : "nonindexed");
+        }
+        return tbl;
+    }
+
+    static drawfilter::Rule draw_filter_rule_from_toml(toml::table& tbl)
+    {
+        auto rule = drawfilter::Rule {};
+        rule.action = tbl["action"].value_or("skip") == std::string("pass") ? drawfilter::Pass : drawfilter::Skip;
+        rule.shader_index = static_cast<uint32_t>(tbl["shader"].value_or(static_cast<int64_t>(drawfilter::ANY)));
+        rule.shader_hash = static_cast<uint32_t>(tbl["shader_hash"].value_or(int64_t { 0 }));
+        rule.min_primitives = static_cast<uint32_t>(tbl["min_primitives"].value_or(int64_t { 0 }));
+        rule.max_primitives = static_cast<uint32_t>(tbl["max_primitives"].value_or(static_cast<int64_t>(UINT32_MAX)));
+
+        if (auto types = tbl["primitive_types"].as_array()) {
+            rule.primitive_types = 0;
+            types->for_each([&rule](const toml::value<std::string>& v) {
+                if (auto type = drawfilter::primitive_type_from_string(v.get())) {
+                    rule.primitive_types |= 1u << *type;
+                } else {
+                    dbg(std::format("Unknown primitive type in draw filter rule: {}", v.get()));
+                }
+            });
+        }
+        if (auto cams = tbl["cameras"].as_array()) {
+            rule.cameras = 0;
+            cams->for_each([&rule](const toml::value<int64_t>& v) {
+                rule.cameras |= 1u << (v.get() & 31);
+            });
+        }
+        if (auto modes = tbl["game_modes"].as_array()) {
+            rule.game_modes = 0;
+            modes->for_each([&rule](const toml::value<std::string>& v) {
+                if (auto mode = rbr::game_mode_from_string(v.get())) {
+                    rule.game_modes |= 1u << *mode;
+                } else {
+                    dbg(std::format("Unknown game mode in draw filter rule: {}", v.get()));
+                }
+            });
+        }
+        const std::string stage = tbl["stage"].value_or("any");
+        if (stage == "btb") {
+            rule.stages = drawfilter::BTBStage;
+        } else if (stage == "rbr") {
+            rule.stages = drawfilter::RBRStage;
+        }
+        const std::string draw = tbl["draw"].value_or("any");
+        if (draw == "indexed") {
+            rule.draws = drawfilter::Indexed;
+        } else if (draw == "nonindexed") {
+            rule.draws = drawfilter::NonIndexed;
+        }
+        return rule;
     }
 
     bool write(const std::filesystem::path& path) const
@@ -81,14 +324,63 @@ struct Config {
                 { "translatex", cam.translation.x },
                 { "translatey", cam.translation.y },
                 { "angle", cam.angle_adjustment },
+                { "far_plane", cam.far_plane },
+                { "mip_lod_bias", cam.mip_lod_bias },
+                { "max_anisotropy", cam.max_anisotropy },
+                { "msaa", cam.msaa },
+                { "render_scale", cam.render_scale },
+                { "brightness", cam.brightness },
                 { "primary", i == 0 } });
         }
+        auto rules = toml::array {};
+        for (const auto& rule : draw_filter) {
+            rules.push_back(draw_filter_rule_to_toml(rule));
+        }
         toml::table out {
             { "anti_alias_center_screen_only", aa_center_screen_only },
+            { "side_monitors_fxaa", side_monitors_fxaa },
             { "side_monitors_half_hz", side_monitors_half_hz },
             { "side_monitors_half_hz_btb_only", side_monitors_half_hz_btb_only },
+            { "side_monitors_frame_divisor", side_monitors_frame_divisor },
+            { "side_monitors_reprojection", side_monitors_reprojection },
+            { "reuse_static_side_images", reuse_static_side_images },
+            { "side_monitors_interlace", interlace::to_string(side_monitors_interlace) },
+            { "camera_pass_order", rbr::to_string(camera_pass_order) },
+            { "frame_limiter", frame_limiter },
+            { "frame_limit_fps", frame_limit_fps },
+            { "limit_frames_in_flight", limit_frames_in_flight },
+            { "max_frames_in_flight", max_frames_in_flight },
+            { "clip_to_visible_area", clip_to_visible_area },
+            { "skip_redundant_clears", skip_redundant_clears },
+            { "edge_adaptive_upscaling", edge_adaptive_upscaling },
+            { "upscaling_sharpness", upscaling_sharpness },
+            { "panorama_projection", panorama::to_string(panorama_mode) },
+            { "vram_budget", vram_budget },
+            { "vram_reserve_mb", vram_reserve_mb },
+            { "d3d_profiler", d3d_profiler },
+            { "draw_analyzer", draw_analyzer },
+            { "frustum_culling", frustum_culling },
+            { "rotate_game_camera", rotate_game_camera },
+            { "skip_repeated_offscreen_passes", skip_repeated_offscreen_passes },
+            { "deduplicate_uploads", deduplicate_uploads },
+            { "batch_shader_constants", batch_shader_constants },
+            { "occlusion_queries", occlusion_queries },
+            { "occlusion_min_primitives", occlusion_min_primitives },
+            { "occlusion_retest_frames", occlusion_retest_frames },
+            { "software_occlusion", software_occlusion },
+            { "software_occluder_min_primitives", software_occluder_min_primitives },
             { "screen", toml::array { cams } },
         };
+        if (!rules.empty()) {
+            out.insert("draw_filter", rules);
+        }
+        if (!offscreen_always_render.empty()) {
+            auto targets = toml::array {};
+            for (const auto& target : offscreen_always_render) {
+                targets.push_back(offscreen::to_string(target));
+            }
+            out.insert("offscreen_always_render", targets);
+        }
 
         f << out;
         f.close();
@@ -149,6 +441,12 @@ struct Config {
                     0.0,
                     tbl["angle"].value_or(0.0),
                     tbl["fov"].value_or(0.0),
+                    tbl["far_plane"].value_or(0.0),
+                    tbl["mip_lod_bias"].value_or(0.0),
+                    tbl["max_anisotropy"].value_or(0),
+                    std::clamp(tbl["msaa"].value_or(0), 0, 16),
+                    std::clamp(tbl["render_scale"].value_or(1.0), 0.5, 1.0),
+                    std::clamp(tbl["brightness"].value_or(1.0), 0.0, 2.0),
                 };
 
                 if (primary) {
@@ -160,8 +458,52 @@ struct Config {
         }
 
         cfg.aa_center_screen_only = parsed["anti_alias_center_screen_only"].value_or(true);
+        cfg.side_monitors_fxaa = parsed["side_monitors_fxaa"].value_or(false);
         cfg.side_monitors_half_hz = parsed["side_monitors_half_hz"].value_or(true);
         cfg.side_monitors_half_hz_btb_only = parsed["side_monitors_half_hz_btb_only"].value_or(true);
+        cfg.side_monitors_frame_divisor = std::clamp(parsed["side_monitors_frame_divisor"].value_or(2), 2, 4);
+        cfg.side_monitors_reprojection = parsed["side_monitors_reprojection"].value_or(false);
+        cfg.reuse_static_side_images = parsed["reuse_static_side_images"].value_or(false);
+        cfg.side_monitors_interlace = interlace::from_string(parsed["side_monitors_interlace"].value_or("off"));
+        cfg.camera_pass_order = rbr::pass_order_from_string(parsed["camera_pass_order"].value_or("config"));
+        cfg.frame_limiter = parsed["frame_limiter"].value_or(false);
+        cfg.frame_limit_fps = std::clamp(parsed["frame_limit_fps"].value_or(60), 20, 500);
+        cfg.limit_frames_in_flight = parsed["limit_frames_in_flight"].value_or(false);
+        cfg.max_frames_in_flight = std::clamp(parsed["max_frames_in_flight"].value_or(2), 1, static_cast<int>(latency::MAX_FRAMES_IN_FLIGHT));
+        cfg.clip_to_visible_area = parsed["clip_to_visible_area"].value_or(true);
+        cfg.skip_redundant_clears = parsed["skip_redundant_clears"].value_or(false);
+        cfg.edge_adaptive_upscaling = parsed["edge_adaptive_upscaling"].value_or(true);
+        cfg.upscaling_sharpness = std::clamp(parsed["upscaling_sharpness"].value_or(0.25), 0.0, 2.0);
+        cfg.panorama_mode = panorama::from_string(parsed["panorama_projection"].value_or("off"));
+        cfg.vram_budget = parsed["vram_budget"].value_or(true);
+        cfg.vram_reserve_mb = std::max(parsed["vram_reserve_mb"].value_or(512), 0);
+        cfg.d3d_profiler = parsed["d3d_profiler"].value_or(false);
+        cfg.draw_analyzer = parsed["draw_analyzer"].value_or(false);
+        cfg.frustum_culling = parsed["frustum_culling"].value_or(false);
+        cfg.rotate_game_camera = parsed["rotate_game_camera"].value_or(false);
+        cfg.skip_repeated_offscreen_passes = parsed["skip_repeated_offscreen_passes"].value_or(false);
+        cfg.deduplicate_uploads = parsed["deduplicate_uploads"].value_or(false);
+        cfg.batch_shader_constants = parsed["batch_shader_constants"].value_or(false);
+        cfg.occlusion_queries = parsed["occlusion_queries"].value_or(false);
+        cfg.occlusion_min_primitives = std::max(parsed["occlusion_min_primitives"].value_or(500), 1);
+        cfg.occlusion_retest_frames = std::clamp(parsed["occlusion_retest_frames"].value_or(8), 1, 60);
+        cfg.software_occlusion = parsed["software_occlusion"].value_or(false);
+        cfg.software_occluder_min_primitives = std::max(parsed["software_occluder_min_primitives"].value_or(200), 1);
+        if (auto targets = parsed["offscreen_always_render"].as_array()) {
+            targets->for_each([&cfg](const toml::value<std::string>& v) {
+                if (auto target = offscreen::target_from_string(v.get())) {
+                    cfg.offscreen_always_render.push_back(*target);
+                } else {
+                    dbg(std::format("Unknown offscreen render target size: {}", v.get()));
+                }
+            });
+        }
+
+        if (auto rules = parsed["draw_filter"]; rules.is_array_of_tables()) {
+            rules.as_array()->for_each([&cfg](toml::table& tbl) {
+                cfg.draw_filter.push_back(draw_filter_rule_from_toml(tbl));
+            });
+        }
 
         if (cfg.cameras.empty()) {
             cfg.cameras.emplace_back(CameraConfig {
@@ -0,0 +1,25 @@
+#include "Constants.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+namespace constants {
+    bool RegisterFile::set(uint32_t start, const float* data, uint32_t count)
+    {
+        if (start >= REGISTER_COUNT || count > REGISTER_COUNT - start) {
+            return false;
+        }
+        if (count == 0) {
+            return true;
+        }
+        std::memcpy(registers[start].data(), data, count * sizeof(registers[0]));
+        for (auto i = start; i < start + count;) {
+            const auto bit = i % 64;
+            const auto n = std::min(64 - bit, start + count - i);
+            const auto mask = n == 64 ? ~uint64_t { 0 } : ((uint64_t { 1 } << n) - 1) << bit;
+            dirty[i / 64] |= mask;
+            i += n;
+        }
+        return true;
+    }
+}
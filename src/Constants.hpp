@@ -0,0 +1,61 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstdint>
+
+// Batching of the vertex shader float constants. The game sets the constants a few registers at a time,
+// so the registers are kept in a copy of the register file and only the ranges set since the last draw
+// are uploaded right before the next draw, as few calls as possible.
+namespace constants {
+    // Float constant registers of vs_2_0 and vs_3_0
+    constexpr uint32_t REGISTER_COUNT = 256;
+
+    class RegisterFile {
+        alignas(16) std::array<std::array<float, 4>, REGISTER_COUNT> registers {};
+        // One bit per register set since the last flush
+        std::array<uint64_t, REGISTER_COUNT / 64> dirty {};
+
+    public:
+        // Returns false if the registers are out of range, then the caller has to flush and set them itself
+        bool set(uint32_t start, const float* data, uint32_t count);
+
+        bool is_dirty() const
+        {
+            return std::ranges::any_of(dirty, [](uint64_t bits) { return bits != 0; });
+        }
+
+        // Calls `upload(start, data, count)` for each contiguous range of the registers set since
+        // the last flush, and returns the number of calls
+        template <typename F>
+        uint32_t flush(F&& upload)
+        {
+            auto calls = uint32_t { 0 };
+            for (auto start = find(0, true); start < REGISTER_COUNT;) {
+                const auto end = find(start, false);
+                upload(start, registers[start].data(), end - start);
+                calls++;
+                start = find(end, true);
+            }
+            dirty = {};
+            return calls;
+        }
+
+    private:
+        // First register from `from` on whose dirty bit is `value`, or REGISTER_COUNT
+        uint32_t find(uint32_t from, bool value) const
+        {
+            for (auto word = from / 64; word < dirty.size(); ++word) {
+                auto bits = value ? dirty[word] : ~dirty[word];
+                if (word == from / 64) {
+                    bits &= ~uint64_t { 0 } << (from % 64);
+                }
+                if (bits) {
+                    return word * 64 + static_cast<uint32_t>(std::countr_zero(bits));
+                }
+            }
+            return REGISTER_COUNT;
+        }
+    };
+}
@@ -0,0 +1,154 @@
+#include "Culling.hpp"
+
+#include <cmath>
+#include <cstring>
+
+#include <common.hpp>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#endif
+
+namespace culling {
+    std::optional<Aabb> bounds(const uint8_t* vertices, uint32_t count, uint32_t stride, uint32_t offset)
+    {
+        if (!vertices || count == 0) {
+            return std::nullopt;
+        }
+        auto box = Aabb { glm::vec3(INFINITY), glm::vec3(-INFINITY) };
+        for (uint32_t i = 0; i < count; ++i) {
+            glm::vec3 p;
+            std::memcpy(&p, vertices + static_cast<size_t>(i) * stride + offset, sizeof(p));
+            if (!std::isfinite(p.x) || !std::isfinite(p.y) || !std::isfinite(p.z)) {
+                return std::nullopt;
+            }
+            box.min = glm::min(box.min, p);
+            box.max = glm::max(box.max, p);
+        }
+        return box;
+    }
+
+    Frustum frustum_from_clip(const glm::mat4& m)
+    {
+        // glm matrices are column major, row i of the matrix is m[0][i], m[1][i], m[2][i], m[3][i]
+        const auto row = [&m](int i) { return glm::vec4(m[0][i], m[1][i], m[2][i], m[3][i]); };
+        const glm::vec4 planes[8] = {
+            row(3) + row(0), // left
+            row(3) - row(0), // right
+            row(3) + row(1), // bottom
+            row(3) - row(1), // top
+            row(2), // near
+            row(3) - row(2), // far
+            { 0.0f, 0.0f, 0.0f, 1.0f },
+            { 0.0f, 0.0f, 0.0f, 1.0f },
+        };
+        auto f = Frustum {};
+        for (size_t i = 0; i < 8; ++i) {
+            f.x[i] = planes[i].x;
+            f.y[i] = planes[i].y;
+            f.z[i] = planes[i].z;
+            f.w[i] = planes[i].w;
+        }
+        return f;
+    }
+
+    bool is_outside_scalar(const Frustum& f, const Aabb& box)
+    {
+        // The corner of the box furthest along the plane normal is at center + sign(normal) * extent
+        const auto c = (box.min + box.max) * 0.5f;
+        const auto e = (box.max - box.min) * 0.5f;
+        for (size_t i = 0; i < 8; ++i) {
+            const auto d = f.x[i] * c.x + f.y[i] * c.y + f.z[i] * c.z + f.w[i];
+            const auto r = std::abs(f.x[i]) * e.x + std::abs(f.y[i]) * e.y + std::abs(f.z[i]) * e.z;
+            if (d + r < 0.0f) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool is_outside(const Frustum& f, const Aabb& box)
+    {
+#if defined(__AVX__)
+        // All 8 planes in one go
+        const auto c = (box.min + box.max) * 0.5f;
+        const auto e = (box.max - box.min) * 0.5f;
+        const auto x = _mm256_load_ps(f.x);
+        const auto y = _mm256_load_ps(f.y);
+        const auto z = _mm256_load_ps(f.z);
+        const auto abs_mask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+
+        auto d = _mm256_add_ps(_mm256_mul_ps(x, _mm256_set1_ps(c.x)), _mm256_load_ps(f.w));
+        d = _mm256_add_ps(d, _mm256_mul_ps(y, _mm256_set1_ps(c.y)));
+        d = _mm256_add_ps(d, _mm256_mul_ps(z, _mm256_set1_ps(c.z)));
+        auto r = _mm256_mul_ps(_mm256_and_ps(x, abs_mask), _mm256_set1_ps(e.x));
+        r = _mm256_add_ps(r, _mm256_mul_ps(_mm256_and_ps(y, abs_mask), _mm256_set1_ps(e.y)));
+        r = _mm256_add_ps(r, _mm256_mul_ps(_mm256_and_ps(z, abs_mask), _mm256_set1_ps(e.z)));
+        const auto outside = _mm256_cmp_ps(_mm256_add_ps(d, r), _mm256_setzero_ps(), _CMP_LT_OQ);
+        return _mm256_movemask_ps(outside) != 0;
+#else
+        return is_outside_scalar(f, box);
+#endif
+    }
+
+    uint32_t vertex_count(uint32_t primitive_type, uint32_t primitive_count)
+    {
+        // D3DPRIMITIVETYPE values
+        switch (primitive_type) {
+            case 1: // D3DPT_POINTLIST
+                return primitive_count;
+            case 2: // D3DPT_LINELIST
+                return primitive_count * 2;
+            case 3: // D3DPT_LINESTRIP
+                return primitive_count + 1;
+            case 4: // D3DPT_TRIANGLELIST
+                return primitive_count * 3;
+            case 5: // D3DPT_TRIANGLESTRIP
+            case 6: // D3DPT_TRIANGLEFAN
+                return primitive_count + 2;
+            default:
+                return 0;
+        }
+    }
+
+    size_t VertexRangeHash::operator()(const VertexRange& r) const
+    {
+        auto h = std::hash<const void*> {}(r.buffer);
+        for (const auto v : { r.first_vertex, r.vertex_count, r.stride, r.position_offset }) {
+            h ^= std::hash<uint32_t> {}(v) + 0x9e3779b9 + (h << 6) + (h >> 2);
+        }
+        return h;
+    }
+
+    void BoundsCache::insert(const VertexRange& range, const Aabb& box)
+    {
+        if (range_count >= MAX_CACHED_RANGES) {
+            clear();
+        }
+        auto& ranges = buffers[range.buffer];
+        const auto previous = ranges.size();
+        ranges[range] = box;
+        range_count += ranges.size() - previous;
+    }
+
+    void BoundsCache::invalidate(const void* buffer, uint32_t offset, uint32_t size)
+    {
+        const auto it = buffers.find(buffer);
+        if (it == buffers.end()) {
+            return;
+        }
+        if (offset == 0 && size == 0) {
+            range_count -= it->second.size();
+            buffers.erase(it);
+            return;
+        }
+        const auto end = size == 0 ? UINT64_MAX : static_cast<uint64_t>(offset) + size;
+        range_count -= std::erase_if(it->second, [offset, end](const auto& entry) {
+            // The position offset includes the offset of the vertex stream, so the range may reach a bit further
+            const auto& r = entry.first;
+            const auto first = static_cast<uint64_t>(r.first_vertex) * r.stride;
+            const auto last = first + static_cast<uint64_t>(r.vertex_count) * r.stride + r.position_offset;
+            return first < end && last > offset;
+        });
+    }
+}
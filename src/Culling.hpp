@@ -0,0 +1,92 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <unordered_map>
+
+#include <mat4x4.hpp>
+#include <vec3.hpp>
+
+// Visibility of draw calls against the frustum of a camera.
+// RBR culls the scene against a widened FoV that covers all screens, so each camera pass
+// submits draws that end up outside of that camera's view. The bounds of the vertex ranges
+// of the draws are cached, so that a draw can be tested with its transformation alone.
+namespace culling {
+    struct Aabb {
+        glm::vec3 min;
+        glm::vec3 max;
+    };
+
+    // Bounds of `count` vertices with a float3 position `offset` bytes into each `stride` sized vertex.
+    // Returns nothing if there are no vertices or the positions are not finite.
+    std::optional<Aabb> bounds(const uint8_t* vertices, uint32_t count, uint32_t stride, uint32_t offset);
+
+    // Planes of the D3D clip volume (-w <= x <= w, -w <= y <= w, 0 <= z <= w) in object space,
+    // as a structure of arrays for testing all planes at once. dot(plane, pos) >= 0 is inside.
+    // The last two planes are padding that everything is inside of.
+    struct Frustum {
+        alignas(32) float x[8];
+        alignas(32) float y[8];
+        alignas(32) float z[8];
+        alignas(32) float w[8];
+    };
+
+    Frustum frustum_from_clip(const glm::mat4& clip_from_object);
+
+    // Whether the box is fully outside of one of the planes. Boxes crossing the corners
+    // of the frustum may be reported as visible. Uses AVX if the build targets it.
+    bool is_outside(const Frustum& frustum, const Aabb& box);
+    bool is_outside_scalar(const Frustum& frustum, const Aabb& box);
+
+    // Number of vertices used by a draw call of a D3DPRIMITIVETYPE
+    uint32_t vertex_count(uint32_t primitive_type, uint32_t primitive_count);
+
+    // Vertex range of a draw call in a vertex buffer
+    struct VertexRange {
+        const void* buffer;
+        uint32_t first_vertex;
+        uint32_t vertex_count;
+        uint32_t stride;
+        uint32_t position_offset;
+
+        bool operator==(const VertexRange&) const = default;
+    };
+
+    struct VertexRangeHash {
+        size_t operator()(const VertexRange& r) const;
+    };
+
+    // Vertex ranges cached at most, about 60 bytes each with the hash map overhead
+    constexpr size_t MAX_CACHED_RANGES = 1 << 16;
+
+    // Bounds of the vertex ranges that have been drawn, grouped by the vertex buffer
+    // so that the ranges can be dropped when the buffer is written to or released
+    class BoundsCache {
+        std::unordered_map<const void*, std::unordered_map<VertexRange, Aabb, VertexRangeHash>> buffers;
+        size_t range_count = 0;
+
+    public:
+        const Aabb* find(const VertexRange& range) const
+        {
+            const auto buffer = buffers.find(range.buffer);
+            if (buffer == buffers.end()) {
+                return nullptr;
+            }
+            const auto it = buffer->second.find(range);
+            return it != buffer->second.end() ? &it->second : nullptr;
+        }
+        // Drops all the ranges if there are too many of them
+        void insert(const VertexRange& range, const Aabb& box);
+
+        // Drop the ranges of a buffer overlapping the bytes from `offset` to `offset + size`,
+        // a size of 0 meaning the rest of the buffer
+        void invalidate(const void* buffer, uint32_t offset, uint32_t size);
+        void clear()
+        {
+            buffers.clear();
+            range_count = 0;
+        }
+        size_t size() const { return range_count; }
+    };
+}
@@ -0,0 +1,86 @@
+#include "DrawAnalyzer.hpp"
+
+#include <bit>
+#include <format>
+#include <unordered_map>
+
+namespace drawanalyzer {
+    // Draws are matched across the passes by what they draw
+    struct DrawKey {
+        culling::VertexRange range;
+        uint32_t shader_hash;
+        uint32_t primitive_type;
+        uint32_t primitives;
+
+        bool operator==(const DrawKey&) const = default;
+    };
+
+    struct DrawKeyHash {
+        size_t operator()(const DrawKey& k) const
+        {
+            auto h = culling::VertexRangeHash {}(k.range);
+            for (const auto v : { k.shader_hash, k.primitive_type, k.primitives }) {
+                h ^= std::hash<uint32_t> {}(v) + 0x9e3779b9 + (h << 6) + (h >> 2);
+            }
+            return h;
+        }
+    };
+
+    Report analyze(const std::vector<Draw>& draws)
+    {
+        struct Passes {
+            uint32_t drawn;
+            uint32_t visible;
+        };
+        auto report = Report {};
+        auto shared = std::unordered_map<DrawKey, Passes, DrawKeyHash> {};
+        for (const auto& d : draws) {
+            if (d.pass >= PASS_COUNT) {
+                continue;
+            }
+            auto& p = report.passes[d.pass];
+            p.draws++;
+            p.primitives += d.primitives;
+            if (!d.analyzed) {
+                continue;
+            }
+            p.analyzed++;
+            if (d.outside) {
+                p.outside++;
+                p.wasted_primitives += d.primitives;
+            }
+            auto& s = shared[{ d.range, d.shader_hash, d.primitive_type, d.primitives }];
+            s.drawn |= 1 << d.pass;
+            s.visible |= static_cast<uint32_t>(!d.outside) << d.pass;
+        }
+        for (const auto& [key, s] : shared) {
+            if (std::has_single_bit(s.drawn)) {
+                continue;
+            }
+            report.shared_draws++;
+            if (!s.visible) {
+                report.outside_every_pass++;
+            }
+        }
+        return report;
+    }
+
+    void Analyzer::end_frame()
+    {
+        last_report = analyze(draws);
+        draws.clear();
+    }
+
+    std::vector<std::string> describe(const Report& report)
+    {
+        constexpr const char* names[] = { "primary", "left", "right" };
+        auto ret = std::vector<std::string> {};
+        for (size_t i = 0; i < PASS_COUNT; ++i) {
+            const auto& p = report.passes[i];
+            ret.push_back(std::format("{}: {} of {} analyzed draws outside, {} of {} primitives wasted ({} draws not analyzed)",
+                names[i], p.outside, p.analyzed, p.wasted_primitives, p.primitives, p.draws - p.analyzed));
+        }
+        ret.push_back(std::format("{} of {} draws shared by several passes are outside of every camera", report.outside_every_pass, report.shared_draws));
+        return ret;
+    }
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include "Culling.hpp"
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Measures how many draws of each camera pass end up outside of the camera's frustum,
+// i.e. the work wasted because RBR culls against the widened FoV.
+// The draws of a frame are recorded and compared at the end of the frame, also across the passes:
+// a draw that is outside of every camera that drew it is wasted regardless of the camera setup.
+namespace drawanalyzer {
+    constexpr size_t PASS_COUNT = 3;
+
+    struct Draw {
+        uint32_t pass;
+        uint32_t shader_index;
+        uint32_t shader_hash;
+        uint32_t primitive_type;
+        uint32_t primitives;
+        culling::VertexRange range;
+        // Whether the bounds of the vertex range were known, and then if they were outside of the frustum
+        bool analyzed;
+        bool outside;
+    };
+
+    struct PassStats {
+        uint32_t draws;
+        uint32_t analyzed;
+        uint32_t outside;
+        uint64_t primitives;
+        uint64_t wasted_primitives;
+    };
+
+    struct Report {
+        std::array<PassStats, PASS_COUNT> passes;
+        // Analyzed draws that are drawn in more than one pass, and the ones of them outside of every camera
+        uint32_t shared_draws;
+        uint32_t outside_every_pass;
+    };
+
+    class Analyzer {
+        std::vector<Draw> draws;
+        Report last_report {};
+
+    public:
+        void record(const Draw& draw) { draws.push_back(draw); }
+
+        // Compares the draws of the frame and starts a new one
+        void end_frame();
+
+        const Report& report() const { return last_report; }
+    };
+
+    Report analyze(const std::vector<Draw>& draws);
+    std::vector<std::string> describe(const Report& report);
+}
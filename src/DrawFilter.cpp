@@ -0,0 +1,85 @@
+#include "DrawFilter.hpp"
+
+#include <array>
+
+namespace drawfilter {
+    // Shader #39 causes strange "shadows" on BTB stages
+    // Probably some projection matrix issue, but changing the projection matrix like
+    // we do normally had no effect, so on BTB stages we just won't draw this primitive with this shader.
+    // The shadows are drawn with DrawPrimitive, the shader's indexed draws are left alone.
+    static constexpr Rule btb_shadow_rule = {
+        .action = Skip,
+        .shader_index = 39,
+        .stages = BTBStage,
+        .draws = NonIndexed,
+    };
+
+    static constexpr auto primitive_type_names = std::to_array<std::string_view>({
+        "",
+        "pointlist",
+        "linelist",
+        "linestrip",
+        "trianglelist",
+        "trianglestrip",
+        "trianglefan",
+    });
+
+    uint32_t hash_bytecode(const uint32_t* fn, size_t length)
+    {
+        uint32_t hash = 2166136261u;
+        for (size_t i = 0; i < length; ++i) {
+            for (int b = 0; b < 4; ++b) {
+                hash ^= (fn[i] >> (b * 8)) & 0xff;
+                hash *= 16777619u;
+            }
+        }
+        return hash;
+    }
+
+    std::optional<uint32_t> primitive_type_from_string(std::string_view str)
+    {
+        for (size_t i = 1; i < primitive_type_names.size(); ++i) {
+            if (primitive_type_names[i] == str) {
+                return static_cast<uint32_t>(i);
+            }
+        }
+        return std::nullopt;
+    }
+
+    const char* primitive_type_to_string(uint32_t type)
+    {
+        if (type == 0 || type >= primitive_type_names.size()) {
+            return "";
+        }
+        return primitive_type_names[type].data();
+    }
+
+    void Table::compile(const std::vector<Rule>& user_rules)
+    {
+        rules = user_rules;
+        // The built-in rule comes last so that users can override it with a pass rule
+        rules.push_back(btb_shadow_rule);
+        active.clear();
+        selection.reset();
+    }
+
+    void Table::select(uint32_t camera, uint32_t game_mode, bool btb)
+    {
+        const auto stage = btb ? BTBStage : RBRStage;
+        selection = Selection { camera, game_mode, btb };
+        active.clear();
+        for (const auto& r : rules) {
+            if (((r.cameras >> (camera & 31)) & 1) && ((r.game_modes >> (game_mode & 31)) & 1) && (r.stages & stage)) {
+                active.push_back({
+                    r.shader_index,
+                    r.shader_hash,
+                    r.primitive_types,
+                    r.min_primitives,
+                    r.max_primitives,
+                    r.draws,
+                    r.action == Skip ? 1u : 0u,
+                });
+            }
+        }
+    }
+}
@@ -0,0 +1,123 @@
+#pragma once
+
+#include <compare>
+#include <cstdint>
+#include <optional>
+#include <string_view>
+#include <vector>
+
+// Rules for skipping draw calls, i.e. expensive effects on the side screens.
+// The rules are compiled into a table that is narrowed down to the rules matching the current
+// camera, game mode and stage type whenever those change, so the per draw call check only
+// needs to look at the shader, the draw call, the primitive type and the primitive count.
+namespace drawfilter {
+    // Index for shaders that are not one of the base game shaders
+    constexpr uint32_t NO_SHADER_INDEX = UINT32_MAX;
+    constexpr uint32_t ANY = UINT32_MAX;
+
+    enum Action : uint32_t {
+        Pass = 0,
+        Skip = 1,
+    };
+
+    enum StageType : uint32_t {
+        RBRStage = 1,
+        BTBStage = 2,
+        AnyStage = RBRStage | BTBStage,
+    };
+
+    // DrawPrimitive and DrawIndexedPrimitive
+    enum DrawKind : uint32_t {
+        NonIndexed = 1,
+        Indexed = 2,
+        AnyDraw = NonIndexed | Indexed,
+    };
+
+    struct Rule {
+        Action action = Skip;
+        // Index of the base game shader, ANY matches all shaders
+        uint32_t shader_index = ANY;
+        // Hash of the shader bytecode, 0 matches all shaders
+        uint32_t shader_hash = 0;
+        // Bitmasks of D3DPRIMITIVETYPE, RenderTarget and rbr::GameMode values
+        uint32_t primitive_types = ANY;
+        uint32_t cameras = ANY;
+        uint32_t game_modes = ANY;
+        uint32_t min_primitives = 0;
+        uint32_t max_primitives = UINT32_MAX;
+        uint32_t stages = AnyStage;
+        uint32_t draws = AnyDraw;
+
+        auto operator<=>(const Rule&) const = default;
+    };
+
+    struct ShaderInfo {
+        uint32_t index = NO_SHADER_INDEX;
+        uint32_t hash = 0;
+    };
+
+    // FNV-1a hash of the shader bytecode
+    uint32_t hash_bytecode(const uint32_t* fn, size_t length);
+
+    std::optional<uint32_t> primitive_type_from_string(std::string_view str);
+    const char* primitive_type_to_string(uint32_t type);
+
+    class Table {
+        struct Entry {
+            uint32_t shader_index;
+            uint32_t shader_hash;
+            uint32_t primitive_types;
+            uint32_t min_primitives;
+            uint32_t max_primitives;
+            uint32_t draws;
+            uint32_t skip;
+        };
+        struct Selection {
+            uint32_t camera;
+            uint32_t game_mode;
+            bool btb;
+
+            bool operator==(const Selection&) const = default;
+        };
+
+        std::vector<Rule> rules;
+        std::vector<Entry> active;
+        std::optional<Selection> selection;
+
+    public:
+        // Rules are evaluated in order and the first matching rule decides.
+        // Draw calls not matching any rule are passed.
+        void compile(const std::vector<Rule>& user_rules);
+
+        // Select the rules that apply to the given camera, game mode and stage type
+        void select(uint32_t camera, uint32_t game_mode, bool btb);
+
+        // Select the rules again for the camera of the last selection if the game mode or the stage type
+        // has changed since. Cheap enough to be called on every draw call.
+        void update(uint32_t game_mode, bool btb)
+        {
+            if (selection && (selection->game_mode != game_mode || selection->btb != btb)) {
+                select(selection->camera, game_mode, btb);
+            }
+        }
+
+        bool empty() const { return active.empty(); }
+
+        bool should_skip(const ShaderInfo& shader, bool indexed, uint32_t primitive_type, uint32_t primitive_count) const
+        {
+            const auto draw = indexed ? Indexed : NonIndexed;
+            // Go through the rules backwards so that the first matching rule is the one that sticks
+            uint32_t skip = 0;
+            for (auto it = active.crbegin(); it != active.crend(); ++it) {
+                const auto match = static_cast<uint32_t>(it->shader_index == ANY || it->shader_index == shader.index)
+                    & static_cast<uint32_t>(it->shader_hash == 0 || it->shader_hash == shader.hash)
+                    & ((it->primitive_types >> (primitive_type & 31)) & 1)
+                    & static_cast<uint32_t>(primitive_count >= it->min_primitives)
+                    & static_cast<uint32_t>(primitive_count <= it->max_primitives)
+                    & static_cast<uint32_t>((it->draws & draw) != 0);
+                skip = match ? it->skip : skip;
+            }
+            return skip != 0;
+        }
+    };
+}
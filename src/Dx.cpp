@@ -1,212 +1,2422 @@
 #include "Dx.hpp"
+#include "Budget.hpp"
+#include "Compositor.hpp"
+#include "Constants.hpp"
+#include "Culling.hpp"
+#include "DrawAnalyzer.hpp"
+#include "DrawFilter.hpp"
 #include "Globals.hpp"
 #include "IPlugin.h"
+#include "Interlace.hpp"
+#include "Latency.hpp"
+#include "Occlusion.hpp"
+#include "Offscreen.hpp"
+#include "Pacing.hpp"
+#include "Profiler.hpp"
 #include "RBR.hpp"
+#include "Rasterizer.hpp"
+#include "Reprojection.hpp"
+#include "Upload.hpp"
+#include "Upscale.hpp"
 #include "Util.hpp"
 #include "Version.hpp"
 
+#include <array>
+#include <bit>
+#include <chrono>
+#include <cstring>
+#include <d3dcompiler.h>
 #include <gtx/matrix_decompose.hpp>
+#include <numeric>
 #include <ranges>
+#include <tuple>
+#include <type_traits>
+#include <unordered_map>
 
 // Compilation unit global variables
 namespace g {
     static std::vector<std::tuple<IDirect3DSurface9*, IDirect3DSurface9*>> surfaces;
+
+    // Textures of the camera render targets, null for multisampled render targets
+    static std::vector<IDirect3DTexture9*> camera_textures;
+
+    // Multisampling and formats of the camera render targets, after validating the configured sample counts
+    // and fitting the video memory budget
+    static std::vector<D3DMULTISAMPLE_TYPE> camera_msaa;
+    static std::vector<D3DFORMAT> camera_formats;
+    static D3DFORMAT camera_depth_format;
+
+    // Summary of the video memory budget decision
+    static std::string vram_report;
+
+    // Panoramic projection mode the device was created with
+    static panorama::Mode active_panorama_mode;
+
+    // Render target spanning all screens, used with the panoramic projection
+    static std::tuple<IDirect3DSurface9*, IDirect3DSurface9*> panorama_surface;
+
+    // Set when something can't be drawn in the panoramic pass. The screens are rendered in passes of their
+    // own from the next frame on.
+    static bool panorama_fallback_requested;
+    static bool panorama_fallback;
+
+    // Vertex shaders rewritten to use the panoramic projection, and the original shaders that are used instead
+    // after falling back
+    static std::unordered_map<IDirect3DVertexShader9*, IDirect3DVertexShader9*> panorama_shaders;
+
+    // Base game shader index and bytecode hash of all created vertex shaders, for the draw filter rules
+    static std::unordered_map<IDirect3DVertexShader9*, drawfilter::ShaderInfo> shader_info;
+
+    // Draw filter rules from the config
+    static drawfilter::Table draw_filter;
+
+    // Bounds of the drawn vertex ranges and the draws of the frame, for the draw analyzer
+    static culling::BoundsCache vertex_bounds;
+    static drawanalyzer::Analyzer draw_analysis;
+
+    // Offscreen passes of the camera passes of the frame
+    static offscreen::Tracker offscreen_passes;
+
+    // Writes to the dynamic vertex and index buffers, and the size of the buffers locked
+    // in the frame if they are dynamic
+    static upload::Deduplicator uploads;
+    static std::unordered_map<const void*, std::optional<UINT>> dynamic_buffers;
+    // The device may be used from several threads, so the buffer locks are not deduplicated
+    static bool multithreaded_device;
+
+    // Vertex shader constants set since the last draw, uploaded at the next one
+    static constants::RegisterFile vs_constants;
+
+    // Camera surface of the current camera pass of the game, null outside of the passes
+    static IDirect3DSurface9* pass_surface;
+
+    // The whole device state, saved before the plugin draws and restored after
+    static IDirect3DStateBlock9* device_state;
+
+    // Draws of the side passes hidden behind the cockpit, the queries they are tested with,
+    // and whether the draws of the current pass are tested
+    static occlusion::Tracker occluded_draws;
+    static std::array<IDirect3DQuery9*, occlusion::QUERY_COUNT> occlusion_queries;
+    static bool occlusion_queries_failed;
+    static bool occlusion_pass;
+
+    // Occluders drawn so far in the camera pass, and the triangles of the draws used as occluders
+    static rasterizer::DepthBuffer occluder_depth { 256, 144 };
+    static rasterizer::MeshCache occluder_meshes;
+
+    // Start times of the camera passes rendered in the frame, for the time from each pass to Present
+    static std::array<std::optional<std::chrono::steady_clock::time_point>, 3> pass_start_times;
+
+    // Wait after Present until the next frame is due, the timer it sleeps on and the frame times it measured
+    static pacing::Limiter frame_limiter;
+    static HANDLE frame_limiter_timer;
+    static std::optional<pacing::FrameTimes> frame_times;
+
+    // Frames presented and not yet finished by the GPU, and the event queries issued after them
+    static latency::FrameQueries<IDirect3DQuery9> frames_in_flight;
 }
 
-namespace dx {
-    namespace shader {
-        static M4 current_projection_matrix;
-        static M4 current_projection_matrix_inverse;
+namespace dx {
+    namespace shader {
+        static M4 current_projection_matrix;
+        static M4 current_projection_matrix_inverse;
+        // Object to clip space transformation of the current camera, as set for the base game shaders
+        static std::optional<M4> current_clip_from_object;
+        // Frustum planes of the transformation, computed when needed
+        static std::optional<culling::Frustum> current_frustum;
+    }
+
+    // The runtime may have different buffer implementations for the memory pools, so Lock and Unlock
+    // are hooked for each implementation when a buffer of it is first drawn
+    template <typename Vtbl>
+    struct BufferHooks {
+        std::array<Hook<decltype(Vtbl::Lock)>, 4> lock;
+        std::array<Hook<decltype(Vtbl::Unlock)>, 4> unlock;
+        size_t count;
+        // Whether the implementation of the dynamic buffers is hooked
+        bool dynamic_hooked;
+
+        template <typename Buffer>
+        std::optional<size_t> find(Buffer* buffer) const
+        {
+            const auto fn = get_vtable<Vtbl>(buffer)->Lock;
+            for (size_t i = 0; i < count; ++i) {
+                if (lock[i].src == fn) {
+                    return i;
+                }
+            }
+            return std::nullopt;
+        }
+    };
+
+    namespace vertexbuffer {
+        static BufferHooks<IDirect3DVertexBuffer9Vtbl> hooks;
+
+        // Position element of the vertex declarations that have been drawn with, and the number of
+        // declarations kept at most. The game creates a handful of them when a stage is loaded.
+        static std::unordered_map<IDirect3DVertexDeclaration9*, std::optional<std::tuple<UINT, UINT>>> position_elements;
+        constexpr size_t MAX_POSITION_ELEMENTS = 1024;
+    }
+
+    namespace indexbuffer {
+        static BufferHooks<IDirect3DIndexBuffer9Vtbl> hooks;
+    }
+
+    // The deferred shader constants must be on the device before a state block reads or writes them,
+    // so Capture and Apply are hooked when the first state block is created
+    namespace stateblock {
+        static Hook<decltype(IDirect3DStateBlock9Vtbl::Capture)> capture;
+        static Hook<decltype(IDirect3DStateBlock9Vtbl::Apply)> apply;
+        static bool hook_failed;
+        // Whether the device is recording a state block, which the constants set must go into
+        static bool recording;
+    }
+
+    namespace fixedfunction {
+        static D3DMATRIX current_projection_matrix;
+        static D3DMATRIX current_view_matrix;
+    }
+
+    namespace history {
+        // View matrix of the game camera, if the game has set one in any of the passes of the current or the
+        // previous frame, and the Presents since. The game does not have to set it, as the base game shaders
+        // take it in c0, and the passes of a frame may run before the pass that sets it.
+        static std::optional<M4> game_view;
+        static uint32_t game_view_age;
+        // View matrix set by the game in the current pass, rotated if the game camera was rotated for the pass
+        static std::optional<M4> pass_view;
+        // Hash of the inputs of the last primary pass, and whether the current pass is hashed
+        static uint32_t scene_hash;
+        static bool is_hashing_scene;
+
+        // Last rendered image of a camera and the orientation of its view at the time, if it was known
+        struct Image {
+            IDirect3DTexture9* texture;
+            std::optional<glm::mat3> orientation;
+        };
+        static Image images[3];
+
+        // The first texture coordinates sample the history image with a homography,
+        // the second ones sample the tiled interlace pattern
+        struct Vertex {
+            float x, y, z, rhw;
+            float u, v, q;
+            float pattern_u, pattern_v;
+        };
+        constexpr DWORD VERTEX_FVF = D3DFVF_XYZRHW | D3DFVF_TEX2 | D3DFVF_TEXCOORDSIZE3(0) | D3DFVF_TEXCOORDSIZE2(1);
+    }
+
+    namespace composite {
+        // Compositing shaders, compiled on first use
+        static bool initialized;
+        static IDirect3DVertexShader9* vertex_shader;
+        static IDirect3DPixelShader9* pixel_shader;
+        static IDirect3DPixelShader9* easu_shader;
+
+        // Resolved images of the multisampled cameras and the upscaled images of the reduced resolution cameras
+        static IDirect3DTexture9* resolved[3];
+        static IDirect3DTexture9* upscaled[3];
+
+        constexpr DWORD VERTEX_FVF = D3DFVF_XYZW | D3DFVF_TEX4 | D3DFVF_TEXCOORDSIZE2(0) | D3DFVF_TEXCOORDSIZE4(1) | D3DFVF_TEXCOORDSIZE2(2) | D3DFVF_TEXCOORDSIZE4(3);
+        static_assert(sizeof(compositor::Vertex) == 18 * sizeof(float));
+
+        // Compositor device drawing with the D3D device. The shaders and render states are set by the caller.
+        class Device : public compositor::Device {
+            std::array<IDirect3DTexture9*, compositor::MAX_SOURCES> textures;
+
+        public:
+            explicit Device(const std::array<IDirect3DTexture9*, compositor::MAX_SOURCES>& textures)
+                : textures(textures)
+            {
+            }
+
+            bool bind_source(uint32_t index) override
+            {
+                return textures[index] && g::d3d_dev->SetTexture(index, textures[index]) == D3D_OK;
+            }
+
+            bool draw_triangles(const compositor::Vertex* vertices, uint32_t triangle_count) override
+            {
+                return g::d3d_dev->DrawPrimitiveUP(D3DPT_TRIANGLELIST, triangle_count, vertices, sizeof(compositor::Vertex)) == D3D_OK;
+            }
+        };
+    }
+
+    namespace interlaced {
+        // Alpha masks of the pixels skipped with each parity, tiled over the render target
+        static IDirect3DTexture9* patterns[2];
+        static interlace::Mode pattern_mode;
+
+        // Parity of the next pass of each camera
+        static uint32_t parity[3];
+
+        // Camera whose pass is being rendered with the mask, which is drawn again when the game clears the depth
+        static std::optional<RenderTarget> masked_pass;
+    }
+
+    namespace clip {
+        // User clip planes that cut away the part of the render target that is not visible, at the highest indices
+        // so that the game's planes keep theirs. The planes are in clip space, so they are only enabled while
+        // a vertex shader is in use.
+        static DWORD plane_mask;
+        // Scissor rect of the visible area, while the pass is clipped to it
+        static std::optional<RECT> scissor;
+
+        // Clip planes, scissor test and scissor rect set by the game. Ours are applied on top of them.
+        static DWORD game_planes;
+        static DWORD game_scissor_test;
+        static std::optional<RECT> game_scissor_rect;
+
+        // Clip planes enabled on the device
+        static DWORD enabled_planes;
+    }
+
+    namespace sampler {
+        constexpr DWORD SAMPLER_COUNT = 16;
+
+        // Sampler state values requested by the game, before the camera quality profile is applied
+        static DWORD lod_bias[SAMPLER_COUNT];
+        static DWORD max_anisotropy[SAMPLER_COUNT] = { 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1 };
+    }
+
+    using rbr::GameMode;
+
+    LRESULT CALLBACK wnd_proc(HWND hWindow, UINT uMsg, WPARAM wParam, LPARAM lParam)
+    {
+        switch (uMsg) {
+            case WM_CLOSE:
+                DestroyWindow(hWindow);
+                break;
+            case WM_DESTROY:
+                PostQuitMessage(0);
+                break;
+            default:
+                return DefWindowProc(hWindow, uMsg, wParam, lParam);
+        }
+        return 0;
+    }
+
+    // Renders the screens in passes of their own from the next frame on
+    static void fall_back_from_panorama(const std::string& reason)
+    {
+        if (!g::panorama_fallback_requested) {
+            dbg(std::format("Falling back from the panoramic projection: {}", reason));
+            g::panorama_fallback_requested = true;
+        }
+    }
+
+    HRESULT __stdcall CreateVertexShader(IDirect3DDevice9* This, const DWORD* pFunction, IDirect3DVertexShader9** ppShader)
+    {
+        static int i = 0;
+        const auto shader_info = drawfilter::ShaderInfo {
+            .index = i < 40 ? static_cast<uint32_t>(i) : drawfilter::NO_SHADER_INDEX,
+            .hash = drawfilter::hash_bytecode(reinterpret_cast<const uint32_t*>(pFunction), panorama::bytecode_length(reinterpret_cast<const uint32_t*>(pFunction))),
+        };
+        auto ret = g::hooks::create_vertex_shader.call(g::d3d_dev, pFunction, ppShader);
+        if (ret == D3D_OK) {
+            g::shader_info[*ppShader] = shader_info;
+        }
+        if (i < 40) {
+            // These are the base game shaders for RBR that need
+            // to be patched with the VR projection.
+            g::base_game_shaders.push_back(*ppShader);
+        }
+        if (ret == D3D_OK && i < 40 && is_panorama_enabled() && !g::panorama_fallback_requested) {
+            // The game gets the panoramic version, and the original is kept for falling back
+            IDirect3DVertexShader9* shader = nullptr;
+            if (const auto rewritten = panorama::rewrite_vertex_shader(reinterpret_cast<const uint32_t*>(pFunction), g::active_panorama_mode); !rewritten) {
+                fall_back_from_panorama(std::format("shader {} is not supported by the panoramic projection", i));
+            } else if (g::hooks::create_vertex_shader.call(g::d3d_dev, reinterpret_cast<const DWORD*>(rewritten->bytecode.data()), &shader) != D3D_OK) {
+                fall_back_from_panorama(std::format("could not create the panoramic version of shader {}", i));
+            } else {
+                g::panorama_shaders[shader] = *ppShader;
+                g::shader_info[shader] = shader_info;
+                g::base_game_shaders.push_back(shader);
+                *ppShader = shader;
+            }
+        }
+        i++;
+        return ret;
+    }
+
+    // Adjust a sampler state value requested by the game with the quality profile of the current camera
+    static DWORD apply_quality_profile(D3DSAMPLERSTATETYPE type, DWORD value)
+    {
+        const auto& cam = g::cfg.cameras[g::current_render_target.value_or(RenderTarget::Primary)];
+        if (type == D3DSAMP_MIPMAPLODBIAS && cam.mip_lod_bias != 0.0) {
+            return std::bit_cast<DWORD>(std::bit_cast<float>(value) + static_cast<float>(cam.mip_lod_bias));
+        } else if (type == D3DSAMP_MAXANISOTROPY && cam.max_anisotropy > 0) {
+            return std::min<DWORD>(value, cam.max_anisotropy);
+        }
+        return value;
+    }
+
+    // The game may set the sampler states only once, so they are re-applied for every camera pass
+    static void apply_sampler_quality_profiles()
+    {
+        const auto has_profiles = std::ranges::any_of(g::cfg.cameras, [](const CameraConfig& c) {
+            return c.mip_lod_bias != 0.0 || c.max_anisotropy > 0;
+        });
+        if (!has_profiles) {
+            return;
+        }
+        for (DWORD i = 0; i < sampler::SAMPLER_COUNT; ++i) {
+            g::hooks::set_sampler_state.call(g::d3d_dev, i, D3DSAMP_MIPMAPLODBIAS, apply_quality_profile(D3DSAMP_MIPMAPLODBIAS, sampler::lod_bias[i]));
+            g::hooks::set_sampler_state.call(g::d3d_dev, i, D3DSAMP_MAXANISOTROPY, apply_quality_profile(D3DSAMP_MAXANISOTROPY, sampler::max_anisotropy[i]));
+        }
+    }
+
+    static void enable_clip_planes(bool has_vertex_shader)
+    {
+        const auto planes = clip::game_planes | (has_vertex_shader ? clip::plane_mask : 0);
+        if (planes != clip::enabled_planes) {
+            g::hooks::set_render_state.call(g::d3d_dev, D3DRS_CLIPPLANEENABLE, planes);
+            clip::enabled_planes = planes;
+        }
+    }
+
+    // Scissor test of the visible area, within the game's scissor rect if it has the test enabled
+    static void apply_scissor()
+    {
+        auto rect = clip::scissor;
+        if (clip::game_scissor_test && clip::game_scissor_rect) {
+            if (rect) {
+                rect->left = std::max(rect->left, clip::game_scissor_rect->left);
+                rect->top = std::max(rect->top, clip::game_scissor_rect->top);
+                rect->right = std::max(rect->left, std::min(rect->right, clip::game_scissor_rect->right));
+                rect->bottom = std::max(rect->top, std::min(rect->bottom, clip::game_scissor_rect->bottom));
+            } else {
+                rect = clip::game_scissor_rect;
+            }
+        }
+        if (rect) {
+            g::hooks::set_scissor_rect.call(g::d3d_dev, &rect.value());
+        }
+        g::hooks::set_render_state.call(g::d3d_dev, D3DRS_SCISSORTESTENABLE, clip::scissor || clip::game_scissor_test ? TRUE : FALSE);
+    }
+
+    static bool has_vertex_shader()
+    {
+        IDirect3DVertexShader9* shader = nullptr;
+        g::d3d_dev->GetVertexShader(&shader);
+        if (shader) {
+            shader->Release();
+        }
+        return shader != nullptr;
+    }
+
+    // Resolution scale of a camera. The primary camera and the panoramic projection always use the full resolution.
+    static double get_render_scale(RenderTarget tgt)
+    {
+        if (tgt == RenderTarget::Primary || is_panorama_enabled()) {
+            return 1.0;
+        }
+        return g::cfg.cameras[tgt].render_scale;
+    }
+
+    static compositor::Rect to_compositor_rect(const RECT& r)
+    {
+        return { r.left, r.top, r.right, r.bottom };
+    }
+
+    static RECT from_compositor_rect(const compositor::Rect& r)
+    {
+        return { r.left, r.top, r.right, r.bottom };
+    }
+
+    static RECT scale_rect(const RECT& rect, double scale)
+    {
+        return from_compositor_rect(compositor::scale_rect(to_compositor_rect(rect), scale));
+    }
+
+    // Area of the camera's render target that Present reads, and where it goes in the back buffer.
+    // The camera pass is clipped to the same area in set_visible_area.
+    static compositor::Placement place_camera(RenderTarget tgt, LONG xmin)
+    {
+        const auto& c = g::cfg.cameras[tgt];
+        return compositor::place(to_compositor_rect(c.visible_rect()), get_render_scale(tgt), c.extent[0], c.extent[1], xmin);
+    }
+
+    // Size of the part of the camera's render target that is rendered to
+    static glm::ivec2 get_render_size(RenderTarget tgt)
+    {
+        const auto rect = scale_rect({ 0, 0, g::cfg.cameras[0].w(), g::cfg.cameras[0].h() }, get_render_scale(tgt));
+        return { rect.right, rect.bottom };
+    }
+
+    // Restrict rendering to the part of the render target that is shown on the screen,
+    // so that the pixels that are cropped away in Present are never shaded
+    static void set_visible_area(RenderTarget tgt, bool enable)
+    {
+        const auto surface_w = g::cfg.cameras[0].w();
+        const auto surface_h = g::cfg.cameras[0].h();
+        const auto pass_clip = compositor::pass_clip(to_compositor_rect(g::cfg.cameras[tgt].visible_rect()), get_render_scale(tgt), surface_w, surface_h);
+
+        clip::plane_mask = 0;
+        clip::scissor.reset();
+        if (enable && pass_clip && g::cfg.clip_to_visible_area && !is_panorama_enabled()) {
+            clip::scissor = from_compositor_rect(pass_clip->scissor);
+            D3DCAPS9 caps;
+            const auto max_planes = g::d3d_dev->GetDeviceCaps(&caps) == D3D_OK ? caps.MaxUserClipPlanes : 0;
+            if (pass_clip->planes.size() <= max_planes) {
+                for (const auto& [i, plane] : std::views::enumerate(pass_clip->planes)) {
+                    const auto index = max_planes - 1 - static_cast<DWORD>(i);
+                    g::d3d_dev->SetClipPlane(index, plane.data());
+                    clip::plane_mask |= 1 << index;
+                }
+            }
+        }
+        apply_scissor();
+        enable_clip_planes(has_vertex_shader());
+    }
+
+    // Clear flags for a camera pass. Depth and stencil are always cleared together,
+    // so that the driver can use a fast clear on combined depth/stencil surfaces.
+    static DWORD get_clear_flags()
+    {
+        constexpr DWORD all = D3DCLEAR_TARGET | D3DCLEAR_ZBUFFER | D3DCLEAR_STENCIL;
+        if (!g::cfg.skip_redundant_clears) {
+            return all;
+        }
+
+        // When driving the sky covers the whole screen, so clearing the color is wasted work.
+        // In menus and when loading, the scene may not cover everything.
+        const auto mode = rbr::get_game_mode();
+        if (mode == GameMode::Driving || mode == GameMode::Replay || mode == GameMode::Pause || mode == GameMode::PreStage) {
+            g::frame_stats.clears_avoided++;
+            return D3DCLEAR_ZBUFFER | D3DCLEAR_STENCIL;
+        }
+        return all;
+    }
+
+    // Check if the cameras composited in Present cover the whole back buffer
+    static bool composite_covers_back_buffer(LONG w, LONG h)
+    {
+        const auto xmin = std::min_element(g::cfg.cameras.cbegin(), g::cfg.cameras.cend(), [](const auto& a, const auto& b) { return a.extent[0] < b.extent[0]; })->extent[0];
+        std::vector<compositor::Rect> screens;
+        for (const auto& c : g::cfg.cameras) {
+            const auto x = c.extent[0] + std::abs(xmin);
+            screens.push_back({ x, c.extent[1], x + c.extent[2], c.extent[1] + c.extent[3] });
+        }
+        return compositor::covers(screens, w, h);
+    }
+
+    bool is_panorama_enabled()
+    {
+        return std::get<0>(g::panorama_surface) != nullptr && !g::panorama_fallback;
+    }
+
+    // Render targets of the cameras, which are only created when the screens are rendered in passes of their own
+    static bool create_camera_render_targets()
+    {
+        auto ret = true;
+        for (const auto& [i, c] : std::views::enumerate(g::cfg.cameras)) {
+            // Make all render targets the size of the main window
+            // If the side screens are smaller, the view will be cropped
+            ret &= create_render_target(
+                g::d3d_dev,
+                &std::get<0>(g::surfaces[i]),
+                &std::get<1>(g::surfaces[i]),
+                g::camera_formats[i],
+                g::camera_depth_format,
+                g::camera_msaa[i],
+                g::cfg.cameras[0].w(),
+                g::cfg.cameras[0].h(),
+                &g::camera_textures[i]);
+        }
+        return ret;
+    }
+
+    // Switches to the passes of their own between frames, after something was drawn that the panoramic pass can't
+    static void apply_panorama_fallback()
+    {
+        if (!g::panorama_fallback_requested || g::panorama_fallback || !std::get<0>(g::panorama_surface)) {
+            return;
+        }
+        g::panorama_fallback = true;
+        if (!create_camera_render_targets()) {
+            dbg("Failed to create the camera render targets");
+        }
+        // The game may keep a rewritten shader set
+        IDirect3DVertexShader9* shader;
+        if (g::d3d_dev->GetVertexShader(&shader) == D3D_OK && shader) {
+            if (const auto it = g::panorama_shaders.find(shader); it != g::panorama_shaders.end()) {
+                g::hooks::set_vertex_shader.call(g::d3d_dev, it->second);
+            }
+            shader->Release();
+        }
+    }
+
+    void set_render_target(RenderTarget tgt, bool clear)
+    {
+        const auto& surface = (is_panorama_enabled() && tgt == RenderTarget::Primary) ? g::panorama_surface : g::surfaces[tgt];
+        IDirect3DSurface9* rt = std::get<0>(surface);
+        IDirect3DSurface9* dt = std::get<1>(surface);
+
+        if (rt && dt) {
+            if (g::d3d_dev->SetRenderTarget(0, rt) != D3D_OK) {
+                dbg("Failed to set render target");
+            }
+            if (g::d3d_dev->SetDepthStencilSurface(dt) != D3D_OK) {
+                dbg("Failed to set depth surface");
+            }
+            // Setting the render target resets the viewport to the whole surface
+            if (const auto scale = get_render_scale(tgt); scale != 1.0) {
+                const auto size = get_render_size(tgt);
+                const auto viewport = D3DVIEWPORT9 { 0, 0, static_cast<DWORD>(size.x), static_cast<DWORD>(size.y), 0.0f, 1.0f };
+                g::hooks::set_viewport.call(g::d3d_dev, &viewport);
+            }
+            // The render target is not cleared when it's restored after the camera passes,
+            // and the rest of the frame (i.e. the HUD) may draw anywhere on it
+            set_visible_area(tgt, clear);
+            if (clear && g::d3d_dev->Clear(0, nullptr, get_clear_flags(), 0, 1.0, 0) != D3D_OK) {
+                dbg("Failed to clear surface");
+            }
+            g::current_render_target = tgt;
+            shader::current_clip_from_object.reset();
+            shader::current_frustum.reset();
+            g::draw_filter.select(tgt, rbr::get_game_mode(), rbr::is_on_btb_stage());
+            apply_sampler_quality_profiles();
+        }
+    }
+
+    // Uploads the vertex shader constants set since the last draw
+    static void flush_shader_constants()
+    {
+        g::frame_stats.shader_constant_uploads += g::vs_constants.flush([](uint32_t start, const float* data, uint32_t count) {
+            g::hooks::set_vertex_shader_constant_f.call(g::d3d_dev, start, data, count);
+        });
+    }
+
+    static ID3DBlob* compile_shader(const char* source, const char* profile)
+    {
+        // The compiler is loaded at runtime, so that the plugin works without it with the upscaler disabled
+        static const auto compile = [] {
+            const auto dll = LoadLibraryA("d3dcompiler_47.dll");
+            return dll ? reinterpret_cast<pD3DCompile>(GetProcAddress(dll, "D3DCompile")) : nullptr;
+        }();
+        if (!compile) {
+            dbg("Could not load d3dcompiler_47.dll");
+            return nullptr;
+        }
+
+        ID3DBlob* code = nullptr;
+        ID3DBlob* errors = nullptr;
+        const auto ret = compile(source, strlen(source), nullptr, nullptr, nullptr, "main", profile, D3DCOMPILE_OPTIMIZATION_LEVEL3, 0, &code, &errors);
+        if (FAILED(ret)) {
+            dbg(std::format("Failed to compile {} shader: {}", profile, errors ? static_cast<const char*>(errors->GetBufferPointer()) : ""));
+        }
+        if (errors) {
+            errors->Release();
+        }
+        return SUCCEEDED(ret) ? code : nullptr;
+    }
+
+    static bool init_compositor()
+    {
+        if (composite::initialized) {
+            return composite::pixel_shader != nullptr;
+        }
+        composite::initialized = true;
+
+        auto vs = compile_shader(compositor::vertex_shader_source, "vs_3_0");
+        auto ps = compile_shader(compositor::pixel_shader_source, "ps_3_0");
+        auto easu = compile_shader(upscale::easu_shader_source, "ps_3_0");
+        auto ok = vs && ps && easu
+            && g::hooks::create_vertex_shader.call(g::d3d_dev, static_cast<const DWORD*>(vs->GetBufferPointer()), &composite::vertex_shader) == D3D_OK
+            && g::d3d_dev->CreatePixelShader(static_cast<const DWORD*>(ps->GetBufferPointer()), &composite::pixel_shader) == D3D_OK
+            && g::d3d_dev->CreatePixelShader(static_cast<const DWORD*>(easu->GetBufferPointer()), &composite::easu_shader) == D3D_OK;
+        for (auto blob : { vs, ps, easu }) {
+            if (blob) {
+                blob->Release();
+            }
+        }
+        if (!ok) {
+            dbg("Shader compositor is not available, using StretchRect");
+            composite::pixel_shader = nullptr;
+        }
+        return ok;
+    }
+
+    static void set_source_filter(D3DTEXTUREFILTERTYPE filter)
+    {
+        for (DWORD i = 0; i < compositor::MAX_SOURCES; ++i) {
+            g::hooks::set_sampler_state.call(g::d3d_dev, i, D3DSAMP_MINFILTER, filter);
+            g::hooks::set_sampler_state.call(g::d3d_dev, i, D3DSAMP_MAGFILTER, filter);
+            g::hooks::set_sampler_state.call(g::d3d_dev, i, D3DSAMP_MIPFILTER, D3DTEXF_NONE);
+            g::hooks::set_sampler_state.call(g::d3d_dev, i, D3DSAMP_ADDRESSU, D3DTADDRESS_CLAMP);
+            g::hooks::set_sampler_state.call(g::d3d_dev, i, D3DSAMP_ADDRESSV, D3DTADDRESS_CLAMP);
+            g::hooks::set_sampler_state.call(g::d3d_dev, i, D3DSAMP_SRGBTEXTURE, FALSE);
+        }
+    }
+
+    // Texture with the image of a camera. Multisampled render targets are resolved to a texture first.
+    static IDirect3DTexture9* get_camera_texture(RenderTarget tgt, const RECT& src)
+    {
+        if (g::camera_textures[tgt]) {
+            return g::camera_textures[tgt];
+        }
+
+        auto& resolved = composite::resolved[tgt];
+        if (!resolved) {
+            D3DSURFACE_DESC desc;
+            std::get<0>(g::surfaces[tgt])->GetDesc(&desc);
+            if (g::d3d_dev->CreateTexture(desc.Width, desc.Height, 1, D3DUSAGE_RENDERTARGET, desc.Format, D3DPOOL_DEFAULT, &resolved, nullptr) != D3D_OK) {
+                dbg("Failed to create resolve texture");
+                resolved = nullptr;
+                return nullptr;
+            }
+        }
+
+        IDirect3DSurface9* surface;
+        resolved->GetSurfaceLevel(0, &surface);
+        if (g::d3d_dev->StretchRect(std::get<0>(g::surfaces[tgt]), &src, surface, &src, D3DTEXF_NONE) != D3D_OK) {
+            dbg("Failed to resolve camera image");
+        }
+        surface->Release();
+        return resolved;
+    }
+
+    // Upscale the reduced resolution image of a camera from `src` in `texture` to a texture of the size of the screen.
+    // The upscaled image is sharpened when it is composed.
+    static IDirect3DTexture9* upscale_camera(RenderTarget tgt, IDirect3DTexture9* texture, const RECT& src, uint32_t dst_w, uint32_t dst_h)
+    {
+        auto& upscaled = composite::upscaled[tgt];
+        if (!upscaled) {
+            D3DSURFACE_DESC desc;
+            texture->GetLevelDesc(0, &desc);
+            if (g::d3d_dev->CreateTexture(dst_w, dst_h, 1, D3DUSAGE_RENDERTARGET, desc.Format, D3DPOOL_DEFAULT, &upscaled, nullptr) != D3D_OK) {
+                dbg("Failed to create upscaling texture");
+                upscaled = nullptr;
+                return nullptr;
+            }
+        }
+
+        D3DSURFACE_DESC desc;
+        texture->GetLevelDesc(0, &desc);
+        const float constants[] = {
+            static_cast<float>(src.right - src.left), static_cast<float>(src.bottom - src.top), 1.0f / static_cast<float>(desc.Width), 1.0f / static_cast<float>(desc.Height),
+            static_cast<float>(src.right - src.left) / static_cast<float>(dst_w), static_cast<float>(src.bottom - src.top) / static_cast<float>(dst_h), static_cast<float>(src.left), static_cast<float>(src.top)
+        };
+
+        IDirect3DSurface9* surface;
+        upscaled->GetSurfaceLevel(0, &surface);
+        g::d3d_dev->SetRenderTarget(0, surface);
+        surface->Release();
+        g::d3d_dev->SetPixelShader(composite::easu_shader);
+        g::d3d_dev->SetPixelShaderConstantF(0, constants, 2);
+        set_source_filter(D3DTEXF_POINT);
+
+        // EASU only looks at the pixel position, so the quad just has to cover the whole target
+        const auto layer = compositor::Layer {
+            .source = 0,
+            .source_w = desc.Width,
+            .source_h = desc.Height,
+            .src = to_compositor_rect(src),
+            .dst = { 0, 0, static_cast<int32_t>(dst_w), static_cast<int32_t>(dst_h) },
+        };
+        auto device = composite::Device({ texture });
+        if (!compositor::compose(device, std::span(&layer, 1), dst_w, dst_h)) {
+            dbg("Failed to upscale camera image");
+            return nullptr;
+        }
+        return upscaled;
+    }
+
+    // Saves the whole device state into a state block that is created once, as creating one costs about as
+    // much as capturing it. Lights the game enables after the block is created are not saved.
+    static IDirect3DStateBlock9* save_device_state()
+    {
+        if (!g::device_state) {
+            if (g::d3d_dev->CreateStateBlock(D3DSBT_ALL, &g::device_state) != D3D_OK) {
+                g::device_state = nullptr;
+            }
+            return g::device_state;
+        }
+        return g::device_state->Capture() == D3D_OK ? g::device_state : nullptr;
+    }
+
+    // Compose all cameras into the back buffer with one draw call. Returns false if the compositor
+    // is not available, and the cameras should be copied with StretchRect instead.
+    static bool compose_cameras(IDirect3DSurface9* back_buffer, LONG xmin)
+    {
+        if (!init_compositor()) {
+            return false;
+        }
+
+        auto state = save_device_state();
+        if (!state) {
+            dbg("Failed to save render state for compositing");
+            return false;
+        }
+
+        g::d3d_dev->SetVertexShader(composite::vertex_shader);
+        g::d3d_dev->SetFVF(composite::VERTEX_FVF);
+        g::d3d_dev->SetDepthStencilSurface(nullptr);
+        g::d3d_dev->SetRenderState(D3DRS_ZENABLE, D3DZB_FALSE);
+        g::d3d_dev->SetRenderState(D3DRS_ZWRITEENABLE, FALSE);
+        g::d3d_dev->SetRenderState(D3DRS_ALPHABLENDENABLE, FALSE);
+        g::d3d_dev->SetRenderState(D3DRS_ALPHATESTENABLE, FALSE);
+        g::d3d_dev->SetRenderState(D3DRS_STENCILENABLE, FALSE);
+        g::hooks::set_render_state.call(g::d3d_dev, D3DRS_SCISSORTESTENABLE, FALSE);
+        g::d3d_dev->SetRenderState(D3DRS_CULLMODE, D3DCULL_NONE);
+        g::d3d_dev->SetRenderState(D3DRS_FOGENABLE, FALSE);
+        g::d3d_dev->SetRenderState(D3DRS_SRGBWRITEENABLE, FALSE);
+        g::d3d_dev->SetRenderState(D3DRS_COLORWRITEENABLE, 0xf);
+
+        std::array<IDirect3DTexture9*, compositor::MAX_SOURCES> textures = {};
+        std::vector<compositor::Layer> layers;
+        for (const auto& [i, c] : std::views::enumerate(g::cfg.cameras)) {
+            const auto tgt = static_cast<RenderTarget>(i);
+            const auto scale = get_render_scale(tgt);
+            const auto placement = place_camera(tgt, xmin);
+            const auto src = from_compositor_rect(placement.src);
+            const auto dst = from_compositor_rect(placement.dst);
+
+            auto texture = get_camera_texture(tgt, src);
+            if (!texture) {
+                continue;
+            }
+            D3DSURFACE_DESC desc;
+            texture->GetLevelDesc(0, &desc);
+            auto layer = compositor::Layer {
+                .source = static_cast<uint32_t>(i),
+                .source_w = desc.Width,
+                .source_h = desc.Height,
+                .src = to_compositor_rect(src),
+                .dst = to_compositor_rect(dst),
+                .brightness = static_cast<float>(c.brightness),
+            };
+            if (scale != 1.0 && g::cfg.edge_adaptive_upscaling) {
+                if (auto upscaled = upscale_camera(tgt, texture, src, c.w(), c.h())) {
+                    texture = upscaled;
+                    layer.source_w = c.w();
+                    layer.source_h = c.h();
+                    layer.src = { 0, 0, c.w(), c.h() };
+                    layer.sharpness = upscale::sharpness_from_stops(static_cast<float>(g::cfg.upscaling_sharpness));
+                }
+            }
+            // The edge adaptive upscaler already smooths the edges of the upscaled screens
+            layer.antialias = g::cfg.side_monitors_fxaa && tgt != RenderTarget::Primary && g::camera_msaa[i] < D3DMULTISAMPLE_2_SAMPLES && layer.sharpness == 0.0f;
+            textures[i] = texture;
+            layers.push_back(layer);
+        }
+
+        D3DSURFACE_DESC back_buffer_desc;
+        back_buffer->GetDesc(&back_buffer_desc);
+        g::d3d_dev->SetRenderTarget(0, back_buffer);
+        g::d3d_dev->SetPixelShader(composite::pixel_shader);
+        set_source_filter(D3DTEXF_LINEAR);
+        auto device = composite::Device(textures);
+        const auto ok = compositor::compose(device, layers, back_buffer_desc.Width, back_buffer_desc.Height);
+        if (!ok) {
+            dbg("Failed to compose cameras");
+        }
+
+        state->Apply();
+        g::d3d_dev->SetRenderTarget(0, g::original_render_target);
+        g::d3d_dev->SetDepthStencilSurface(g::original_depth_stencil_target);
+        return ok;
+    }
+
+    static bool create_occlusion_queries()
+    {
+        if (g::occlusion_queries[0] || g::occlusion_queries_failed) {
+            return !g::occlusion_queries_failed;
+        }
+        for (auto& query : g::occlusion_queries) {
+            if (g::d3d_dev->CreateQuery(D3DQUERYTYPE_OCCLUSION, &query) != D3D_OK) {
+                dbg("Could not create occlusion queries");
+                for (auto& q : g::occlusion_queries) {
+                    if (q) {
+                        q->Release();
+                        q = nullptr;
+                    }
+                }
+                g::occlusion_queries_failed = true;
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Reads the results of the occlusion queries the GPU has finished
+    static void poll_occlusion_queries()
+    {
+        if (!g::occlusion_queries[0]) {
+            return;
+        }
+        const auto results = g::occluded_draws.poll([](uint32_t i) -> std::optional<uint32_t> {
+            DWORD pixels;
+            switch (g::occlusion_queries[i]->GetData(&pixels, sizeof(pixels), 0)) {
+                case S_OK:
+                    return pixels;
+                case S_FALSE:
+                    return std::nullopt;
+                default:
+                    // The draw is not known to be hidden
+                    return UINT32_MAX;
+            }
+        });
+        g::frame_stats.occlusion_results += results.read;
+        g::frame_stats.occlusion_hits += results.occluded;
+    }
+
+    static int64_t now_ns()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+#ifndef CREATE_WAITABLE_TIMER_HIGH_RESOLUTION
+#define CREATE_WAITABLE_TIMER_HIGH_RESOLUTION 0x00000002
+#endif
+
+    // Sleeps on a high resolution waitable timer if the system has them, as Sleep rounds up to the timer resolution
+    static void sleep_ns(int64_t ns)
+    {
+        if (!g::frame_limiter_timer) [[unlikely]] {
+            g::frame_limiter_timer = CreateWaitableTimerExW(nullptr, nullptr, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS);
+            if (!g::frame_limiter_timer) {
+                dbg("Could not create a high resolution timer, the frame limiter spins longer");
+                g::frame_limiter_timer = INVALID_HANDLE_VALUE;
+            }
+        }
+        if (g::frame_limiter_timer != INVALID_HANDLE_VALUE) {
+            // A negative due time is relative, in 100 ns units
+            LARGE_INTEGER due;
+            due.QuadPart = -(ns / 100);
+            if (SetWaitableTimer(g::frame_limiter_timer, &due, 0, nullptr, nullptr, FALSE)) {
+                WaitForSingleObject(g::frame_limiter_timer, INFINITE);
+                return;
+            }
+        }
+        Sleep(static_cast<DWORD>(ns / 1'000'000));
+    }
+
+    static_assert(latency::ISSUE_END == D3DISSUE_END && latency::GET_DATA_FLUSH == D3DGETDATA_FLUSH);
+    static_assert(latency::RESULT_OK == D3D_OK && latency::RESULT_PENDING == S_FALSE);
+
+    static bool create_frame_queries()
+    {
+        if (g::frames_in_flight.has_failed()) {
+            return false;
+        }
+        if (!g::frames_in_flight.create(g::d3d_dev, D3DQUERYTYPE_EVENT)) {
+            dbg("Could not create event queries, not limiting the frames in flight");
+            return false;
+        }
+        return true;
+    }
+
+    // Marks the end of the frame presented now, and waits until the GPU has finished enough of the earlier
+    // frames, before the game samples the input for the next one
+    static void limit_frames_in_flight()
+    {
+        if (!g::cfg.limit_frames_in_flight || !create_frame_queries()) {
+            g::frames_in_flight.reset();
+            return;
+        }
+        const auto wait = g::frames_in_flight.present(static_cast<uint32_t>(g::cfg.max_frames_in_flight), now_ns, [] { Sleep(0); });
+        if (wait.timed_out) {
+            dbg("Timed out waiting for the GPU to finish a frame");
+        }
+        g::frame_stats.frames_in_flight = wait.frames_in_flight;
+        g::frame_stats.frames_in_flight_wait_ms = static_cast<float>(wait.wait_ns) / 1e6f;
+        g::frame_stats.present_to_gpu_finish_ms = static_cast<float>(g::frames_in_flight.latency().value_or(0)) / 1e6f;
+    }
+
+    // Waits for the next frame after Present, before the game samples the input and the camera for it
+    static void pace_frame()
+    {
+        const auto fps = g::cfg.frame_limiter ? static_cast<double>(g::cfg.frame_limit_fps) : 0.0;
+        if (auto times = g::frame_limiter.wait(fps, now_ns, sleep_ns)) {
+            g::frame_times = times;
+            if (g::cfg.frame_limiter) {
+                dbg(std::format("Frame times: {}", pacing::to_string(times.value())));
+            }
+        }
+    }
+
+    HRESULT __stdcall Present(IDirect3DDevice9* This, const RECT* pSourceRect, const RECT* pDestRect, HWND hDestWindowOverride, const RGNDATA* pDirtyRegion)
+    {
+        flush_shader_constants();
+        if (g::d3d_dev->SetRenderTarget(0, g::original_render_target) != D3D_OK) {
+            dbg("Failed to reset render target to original");
+        }
+        if (g::d3d_dev->SetDepthStencilSurface(g::original_depth_stencil_target) != D3D_OK) {
+            dbg("Failed to reset depth stencil surface to original");
+        }
+
+        IDirect3DSurface9* back_buffer;
+        auto buf = g::swapchain->GetBackBuffer(0, D3DBACKBUFFER_TYPE_MONO, &back_buffer);
+
+        D3DSURFACE_DESC back_buffer_desc;
+        back_buffer->GetDesc(&back_buffer_desc);
+        const auto covered = is_panorama_enabled() || composite_covers_back_buffer(back_buffer_desc.Width, back_buffer_desc.Height);
+        if (g::cfg.skip_redundant_clears && covered) {
+            g::frame_stats.clears_avoided++;
+        } else if (g::d3d_dev->Clear(0, nullptr, D3DCLEAR_STENCIL | D3DCLEAR_TARGET | D3DCLEAR_ZBUFFER, 0, 1.0, 0) != D3D_OK) {
+            dbg("Failed to clear surface");
+        }
+
+        auto xmin = std::min_element(g::cfg.cameras.cbegin(), g::cfg.cameras.cend(), [](const auto& a, const auto& b) { return a.extent[0] < b.extent[0]; })->extent[0];
+        if (is_panorama_enabled()) {
+            // The panorama surface is already the size of the back buffer
+            g::d3d_dev->StretchRect(std::get<0>(g::panorama_surface), nullptr, back_buffer, nullptr, D3DTEXF_NONE);
+        } else if (!compose_cameras(back_buffer, xmin)) {
+            for (const auto& [i, c] : std::views::enumerate(g::cfg.cameras)) {
+                const auto scale = get_render_scale(static_cast<RenderTarget>(i));
+                const auto placement = place_camera(static_cast<RenderTarget>(i), xmin);
+                RECT src = from_compositor_rect(placement.src);
+                RECT dst = from_compositor_rect(placement.dst);
+                auto source = std::get<0>(g::surfaces[i]);
+                IDirect3DSurface9* resolved = nullptr;
+                if (scale != 1.0 && g::camera_msaa[i] != D3DMULTISAMPLE_NONE) {
+                    // Multisampled surfaces can't be stretched, so they are resolved first
+                    if (auto texture = get_camera_texture(static_cast<RenderTarget>(i), src); texture && texture->GetSurfaceLevel(0, &resolved) == D3D_OK) {
+                        source = resolved;
+                    }
+                }
+                g::d3d_dev->StretchRect(source, &src, back_buffer, &dst, scale == 1.0 ? D3DTEXF_NONE : D3DTEXF_LINEAR);
+                if (resolved) {
+                    resolved->Release();
+                }
+            }
+        }
+        back_buffer->Release();
+
+        const auto present_time = std::chrono::steady_clock::now();
+        for (auto&& [start, ms] : std::views::zip(g::pass_start_times, g::frame_stats.pass_to_present_ms)) {
+            ms = start ? std::chrono::duration<float, std::milli>(present_time - start.value()).count() : 0.0f;
+            start.reset();
+        }
+
+        auto ret = g::swapchain->Present(nullptr, nullptr, nullptr, nullptr, 0);
+
+        g::original_render_target->Release();
+        g::original_depth_stencil_target->Release();
+
+        poll_occlusion_queries();
+        g::occluded_draws.end_frame();
+
+        g::previous_frame_stats = g::frame_stats;
+        g::frame_stats = {};
+        if (history::game_view_age++ > 0) {
+            history::game_view.reset();
+        }
+        if (g::cfg.draw_analyzer) {
+            g::draw_analysis.end_frame();
+        }
+        g::offscreen_passes.end_frame();
+        g::uploads.end_frame();
+        g::dynamic_buffers.clear();
+        apply_panorama_fallback();
+
+        limit_frames_in_flight();
+        pace_frame();
+        return ret;
+    }
+
+    float get_camera_angle(RenderTarget tgt)
+    {
+        auto angle = static_cast<float>(g::cfg.cameras[tgt].angle);
+        angle += static_cast<float>(glm::radians(g::cfg.cameras[tgt].angle_adjustment));
+        return tgt == RenderTarget::Right ? -angle : angle;
+    }
+
+    static M4 get_rotation_matrix(std::optional<RenderTarget> tgt = g::current_render_target)
+    {
+        float angle = 0.0;
+        auto main_menu_camera_tweak = glm::identity<M4>();
+        if (rbr::is_rendering_3d()) {
+            if (rbr::get_game_mode() == GameMode::MainMenu) {
+                // The main menu camera looks weird. This is an attempt to make it look like normal.
+                main_menu_camera_tweak = glm::translate(glm::mat4x4(1.0f), glm::vec3(0, -1.5f, 2.0f)) * glm::mat4_cast(glm::angleAxis(glm::radians(-20.0f), glm::vec3 { 1, 0, 0 }));
+            }
+            // If the game camera itself is rotated for the pass, the game's matrices already include the rotation
+            if (!rbr::is_camera_rotated()) {
+                angle = get_camera_angle(tgt.value());
+            }
+        }
+        return glm::rotate(glm::identity<M4>(), angle, { 0, 1, 0 }) * main_menu_camera_tweak;
+    }
+
+    static M4 get_translation_matrix(std::optional<RenderTarget> tgt = g::current_render_target)
+    {
+        if (rbr::is_rendering_3d()) {
+            return glm::translate(glm::identity<M4>(), g::cfg.cameras[tgt.value()].translation);
+        } else {
+            return glm::identity<M4>();
+        }
+    }
+
+    // Mixes an input of the primary pass into the scene hash: the shader constants and the transformations
+    // of all draws, and the draws themselves
+    static void hash_scene_input(const void* data, size_t bytes)
+    {
+        if (history::is_hashing_scene && data) {
+            history::scene_hash = (history::scene_hash ^ drawfilter::hash_bytecode(static_cast<const uint32_t*>(data), bytes / sizeof(uint32_t))) * 16777619u;
+        }
+    }
+
+    template <typename T>
+    static void hash_scene_input(const T& value)
+    {
+        hash_scene_input(&value, sizeof(value));
+    }
+
+    static HRESULT set_shader_constants(UINT StartRegister, const float* pConstantData, UINT Vector4fCount)
+    {
+        if (g::cfg.batch_shader_constants && !stateblock::recording && !stateblock::hook_failed) {
+            g::frame_stats.shader_constant_sets++;
+            if (g::vs_constants.set(StartRegister, pConstantData, Vector4fCount)) {
+                return D3D_OK;
+            }
+        }
+        // The constants set before must not overwrite these at the next draw
+        if (g::vs_constants.is_dirty()) {
+            flush_shader_constants();
+        }
+        return g::hooks::set_vertex_shader_constant_f.call(g::d3d_dev, StartRegister, pConstantData, Vector4fCount);
+    }
+
+    HRESULT __stdcall SetVertexShaderConstantF(IDirect3DDevice9* This, UINT StartRegister, const float* pConstantData, UINT Vector4fCount)
+    {
+        hash_scene_input(std::array { StartRegister, Vector4fCount });
+        hash_scene_input(pConstantData, Vector4fCount * 4 * sizeof(float));
+        IDirect3DVertexShader9* shader;
+        if (auto ret = g::d3d_dev->GetVertexShader(&shader); ret != D3D_OK) {
+            dbg("Could not get vertex shader");
+            return ret;
+        }
+
+        auto is_base_shader = true;
+        if (rbr::is_on_btb_stage()) {
+            is_base_shader = std::find(g::base_game_shaders.cbegin(), g::base_game_shaders.cend(), shader) != g::base_game_shaders.end();
+        }
+        if (shader)
+            shader->Release();
+
+        if (is_base_shader && Vector4fCount == 4) {
+            const auto panorama_shader = g::panorama_shaders.find(shader);
+            if (StartRegister == 0 && is_panorama_enabled() && panorama_shader != g::panorama_shaders.end()) {
+                // The rewritten shader does the projection itself, so it only needs the view space transformation
+                const auto orig = glm::transpose(m4_from_shader_constant_ptr(pConstantData));
+                const auto mv = glm::transpose(get_translation_matrix() * get_rotation_matrix() * shader::current_projection_matrix_inverse * orig);
+                return set_shader_constants(StartRegister, glm::value_ptr(mv), Vector4fCount);
+            } else if (StartRegister == 0) {
+                const auto orig = glm::transpose(m4_from_shader_constant_ptr(pConstantData));
+                const auto mv = shader::current_projection_matrix_inverse * orig;
+                const auto clip_from_object = g::projection_matrix[g::current_render_target.value_or(RenderTarget::Primary)] * get_translation_matrix() * get_rotation_matrix() * mv;
+                if (!stateblock::recording) {
+                    shader::current_clip_from_object = clip_from_object;
+                    shader::current_frustum.reset();
+                }
+                const auto mvp = glm::transpose(clip_from_object);
+                return set_shader_constants(StartRegister, glm::value_ptr(mvp), Vector4fCount);
+            } else if (StartRegister == 20) {
+                // Sky/fog
+                const auto orig = glm::transpose(m4_from_shader_constant_ptr(pConstantData));
+                const auto m = glm::transpose(get_translation_matrix() * get_rotation_matrix() * orig);
+                return set_shader_constants(StartRegister, glm::value_ptr(m), Vector4fCount);
+            }
+        }
+        return set_shader_constants(StartRegister, pConstantData, Vector4fCount);
+    }
+
+    HRESULT __stdcall GetVertexShaderConstantF(IDirect3DDevice9* This, UINT StartRegister, float* pConstantData, UINT Vector4fCount)
+    {
+        flush_shader_constants();
+        return g::hooks::get_vertex_shader_constant_f.call(This, StartRegister, pConstantData, Vector4fCount);
+    }
+
+    HRESULT __stdcall StateBlock_Capture(IDirect3DStateBlock9* This)
+    {
+        flush_shader_constants();
+        return stateblock::capture.call(This);
+    }
+
+    HRESULT __stdcall StateBlock_Apply(IDirect3DStateBlock9* This)
+    {
+        // The constants set before the Apply must not overwrite the ones it sets, and
+        // the transformation it may set is not known
+        flush_shader_constants();
+        shader::current_clip_from_object.reset();
+        shader::current_frustum.reset();
+        const auto ret = stateblock::apply.call(This);
+        if (ret != D3D_OK) {
+            return ret;
+        }
+
+        // The block may set the clip planes and the scissor test. Our own block restores the state it saved,
+        // which already had our clipping on top of the game's.
+        DWORD planes = 0;
+        g::d3d_dev->GetRenderState(D3DRS_CLIPPLANEENABLE, &planes);
+        clip::enabled_planes = planes;
+        if (This != g::device_state) {
+            clip::game_planes = planes & ~clip::plane_mask;
+            if (!clip::scissor) {
+                DWORD scissor_test = FALSE;
+                g::d3d_dev->GetRenderState(D3DRS_SCISSORTESTENABLE, &scissor_test);
+                clip::game_scissor_test = scissor_test;
+                if (RECT rect; g::d3d_dev->GetScissorRect(&rect) == D3D_OK) {
+                    clip::game_scissor_rect = rect;
+                }
+            }
+            if (clip::scissor) {
+                apply_scissor();
+            }
+        }
+        enable_clip_planes(has_vertex_shader());
+        return ret;
+    }
+
+    static void hook_state_block(IDirect3DStateBlock9* state)
+    {
+        if (stateblock::capture.src || stateblock::hook_failed) {
+            if (stateblock::capture.src && stateblock::capture.src != get_vtable<IDirect3DStateBlock9Vtbl>(state)->Capture) {
+                // Another implementation, whose Capture and Apply would not see the deferred constants
+                dbg("Unknown state block implementation, not batching the shader constants");
+                flush_shader_constants();
+                stateblock::hook_failed = true;
+            }
+            return;
+        }
+        const auto vtable = get_vtable<IDirect3DStateBlock9Vtbl>(state);
+        try {
+            stateblock::capture = Hook(vtable->Capture, StateBlock_Capture);
+            stateblock::apply = Hook(vtable->Apply, StateBlock_Apply);
+        } catch (const std::runtime_error& e) {
+            dbg(std::format("Could not hook state block Capture and Apply, not batching the shader constants: {}", e.what()));
+            flush_shader_constants();
+            stateblock::hook_failed = true;
+        }
+    }
+
+    HRESULT __stdcall CreateStateBlock(IDirect3DDevice9* This, D3DSTATEBLOCKTYPE Type, IDirect3DStateBlock9** ppSB)
+    {
+        // Captures the state right away
+        flush_shader_constants();
+        const auto ret = g::hooks::create_state_block.call(This, Type, ppSB);
+        if (ret == D3D_OK && ppSB && *ppSB) {
+            hook_state_block(*ppSB);
+        }
+        return ret;
+    }
+
+    HRESULT __stdcall BeginStateBlock(IDirect3DDevice9* This)
+    {
+        // The constants set before must not be recorded, and the ones set while recording must
+        flush_shader_constants();
+        const auto ret = g::hooks::begin_state_block.call(This);
+        stateblock::recording = ret == D3D_OK;
+        return ret;
+    }
+
+    HRESULT __stdcall EndStateBlock(IDirect3DDevice9* This, IDirect3DStateBlock9** ppSB)
+    {
+        stateblock::recording = false;
+        const auto ret = g::hooks::end_state_block.call(This, ppSB);
+        if (ret == D3D_OK && ppSB && *ppSB) {
+            hook_state_block(*ppSB);
+        }
+        return ret;
+    }
+
+    HRESULT __stdcall SetTransform(IDirect3DDevice9* This, D3DTRANSFORMSTATETYPE State, const D3DMATRIX* pMatrix)
+    {
+        hash_scene_input(State);
+        hash_scene_input(pMatrix, sizeof(D3DMATRIX));
+        if (rbr::is_rendering_3d() && State == D3DTS_PROJECTION) {
+            shader::current_projection_matrix = m4_from_d3d(*pMatrix);
+            shader::current_projection_matrix_inverse = glm::inverse(shader::current_projection_matrix);
+            fixedfunction::current_projection_matrix = d3d_from_m4(g::projection_matrix[g::current_render_target.value_or(RenderTarget::Primary)]);
+            return g::hooks::set_transform.call(g::d3d_dev, State, &fixedfunction::current_projection_matrix);
+        } else if (rbr::is_rendering_3d() && State == D3DTS_VIEW) {
+            history::pass_view = m4_from_d3d(*pMatrix);
+            // A rotated game camera is turned by the angle of the screen, which is taken off again
+            history::game_view = history::pass_view;
+            history::game_view_age = 0;
+            if (rbr::is_camera_rotated() && g::current_render_target) {
+                history::game_view = glm::rotate(glm::identity<M4>(), -get_camera_angle(g::current_render_target.value()), { 0, 1, 0 }) * history::pass_view.value();
+            }
+            fixedfunction::current_view_matrix = d3d_from_m4(get_translation_matrix() * get_rotation_matrix() * m4_from_d3d(*pMatrix));
+            return g::hooks::set_transform.call(g::d3d_dev, State, &fixedfunction::current_view_matrix);
+        }
+
+        return g::hooks::set_transform.call(g::d3d_dev, State, pMatrix);
+    }
+
+    HRESULT __stdcall SetVertexShader(IDirect3DDevice9* This, IDirect3DVertexShader9* pShader)
+    {
+        if (clip::plane_mask) {
+            enable_clip_planes(pShader != nullptr);
+        }
+        if (const auto it = g::panorama_shaders.find(pShader); it != g::panorama_shaders.end()) {
+            if (g::panorama_fallback) {
+                pShader = it->second;
+            } else if (!stateblock::recording) {
+                // No base game shader reads the projection registers, but the game's other shaders may
+                const auto constants = panorama::constants(g::active_panorama_mode, g::panorama_projection);
+                set_shader_constants(panorama::CONSTANT_REGISTER, constants.data(), panorama::CONSTANT_COUNT);
+            }
+        }
+        return g::hooks::set_vertex_shader.call(g::d3d_dev, pShader);
+    }
+
+    HRESULT __stdcall SetRenderState(IDirect3DDevice9* This, D3DRENDERSTATETYPE State, DWORD Value)
+    {
+        // A state block being recorded gets the game's own values
+        if (stateblock::recording) {
+            return g::hooks::set_render_state.call(g::d3d_dev, State, Value);
+        }
+        if (State == D3DRS_CLIPPLANEENABLE) {
+            clip::game_planes = Value;
+            enable_clip_planes(has_vertex_shader());
+            return D3D_OK;
+        } else if (State == D3DRS_SCISSORTESTENABLE) {
+            clip::game_scissor_test = Value;
+            apply_scissor();
+            return D3D_OK;
+        }
+        return g::hooks::set_render_state.call(g::d3d_dev, State, Value);
+    }
+
+    HRESULT __stdcall SetScissorRect(IDirect3DDevice9* This, const RECT* pRect)
+    {
+        if (!stateblock::recording && pRect) {
+            clip::game_scissor_rect = *pRect;
+            if (clip::scissor) {
+                apply_scissor();
+                return D3D_OK;
+            }
+        }
+        return g::hooks::set_scissor_rect.call(g::d3d_dev, pRect);
+    }
+
+    HRESULT __stdcall SetSamplerState(IDirect3DDevice9* This, DWORD Sampler, D3DSAMPLERSTATETYPE Type, DWORD Value)
+    {
+        if (Sampler < sampler::SAMPLER_COUNT) {
+            if (Type == D3DSAMP_MIPMAPLODBIAS) {
+                sampler::lod_bias[Sampler] = Value;
+            } else if (Type == D3DSAMP_MAXANISOTROPY) {
+                sampler::max_anisotropy[Sampler] = Value;
+            }
+        }
+        return g::hooks::set_sampler_state.call(g::d3d_dev, Sampler, Type, apply_quality_profile(Type, Value));
+    }
+
+    HRESULT __stdcall SetViewport(IDirect3DDevice9* This, const D3DVIEWPORT9* pViewport)
+    {
+        // Cameras rendered at a reduced resolution render to the top left part of their render target
+        if (rbr::is_rendering_3d() && g::current_render_target && pViewport) {
+            if (const auto scale = get_render_scale(g::current_render_target.value()); scale != 1.0) {
+                const auto s = [scale](DWORD v) { return static_cast<DWORD>(std::lround(v * scale)); };
+                const auto viewport = D3DVIEWPORT9 { s(pViewport->X), s(pViewport->Y), s(pViewport->Width), s(pViewport->Height), pViewport->MinZ, pViewport->MaxZ };
+                return g::hooks::set_viewport.call(g::d3d_dev, &viewport);
+            }
+        }
+        return g::hooks::set_viewport.call(g::d3d_dev, pViewport);
+    }
+
+    std::optional<glm::mat4> get_camera_view_projection(RenderTarget tgt)
+    {
+        if (!history::game_view) {
+            return std::nullopt;
+        }
+        return g::projection_matrix[tgt] * get_translation_matrix(tgt) * get_rotation_matrix(tgt) * history::game_view.value();
+    }
+
+    // Orientation of the view of a camera in the current frame, from the view matrix the game has set,
+    // or from the game camera if it has not set one in this frame
+    static std::optional<glm::mat3> get_camera_orientation(RenderTarget tgt)
+    {
+        const auto game = history::game_view ? std::optional(glm::mat3(history::game_view.value())) : rbr::get_camera_orientation();
+        if (!game) {
+            return std::nullopt;
+        }
+        return glm::mat3(get_rotation_matrix(tgt)) * game.value();
+    }
+
+    uint32_t get_scene_hash()
+    {
+        return history::scene_hash;
+    }
+
+    void clear_camera(RenderTarget tgt)
+    {
+        // Outside of the driving modes the color is cleared too
+        set_render_target(tgt);
+    }
+
+    void save_reprojection_history(RenderTarget tgt)
+    {
+        auto& image = history::images[tgt];
+        if (!image.texture) {
+            D3DSURFACE_DESC desc;
+            std::get<0>(g::surfaces[tgt])->GetDesc(&desc);
+            if (g::d3d_dev->CreateTexture(desc.Width, desc.Height, 1, D3DUSAGE_RENDERTARGET, desc.Format, D3DPOOL_DEFAULT, &image.texture, nullptr) != D3D_OK) {
+                dbg("Failed to create reprojection texture");
+                image.texture = nullptr;
+                return;
+            }
+        }
+
+        IDirect3DSurface9* surface;
+        image.texture->GetSurfaceLevel(0, &surface);
+        if (g::d3d_dev->StretchRect(std::get<0>(g::surfaces[tgt]), nullptr, surface, nullptr, D3DTEXF_NONE) != D3D_OK) {
+            dbg("Failed to copy reprojection history");
+        }
+        surface->Release();
+        image.orientation = get_camera_orientation(tgt);
+    }
+
+    // Draw a screen sized quad to the current render target with the fixed function pipeline.
+    // Stage 0 samples `texture` through the homography and stage 1 samples `pattern`,
+    // whose alpha limits the quad to the pixels skipped by an interlaced pass.
+    // Without a texture only the depth of the pattern pixels is written.
+    static void draw_screen_quad(RenderTarget tgt, IDirect3DTexture9* texture, const glm::mat3& homography, IDirect3DTexture9* pattern, const char* what)
+    {
+        const auto size = get_render_size(tgt);
+        const auto w = size.x;
+        const auto h = size.y;
+
+        // Texture coordinates are interpolated linearly in screen space and divided by q,
+        // which is exactly what is needed for a homography
+        const auto vertex = [&](float x, float y) {
+            const auto q = homography * glm::vec3(x, y, 1.0f);
+            const auto tile = static_cast<float>(interlace::PATTERN_SIZE);
+            return history::Vertex { x - 0.5f, y - 0.5f, 0.0f, 1.0f, q.x, q.y, q.z, x / tile, y / tile };
+        };
+        const history::Vertex quad[] = {
+            vertex(0.0f, 0.0f),
+            vertex(static_cast<float>(w), 0.0f),
+            vertex(0.0f, static_cast<float>(h)),
+            vertex(static_cast<float>(w), static_cast<float>(h)),
+        };
+
+        auto state = save_device_state();
+        if (!state) {
+            dbg(std::format("Failed to save render state for {}", what));
+            return;
+        }
+
+        g::d3d_dev->SetVertexShader(nullptr);
+        g::d3d_dev->SetPixelShader(nullptr);
+        g::d3d_dev->SetFVF(history::VERTEX_FVF);
+        if (texture) {
+            g::d3d_dev->SetTexture(0, texture);
+            g::d3d_dev->SetTextureStageState(0, D3DTSS_COLOROP, D3DTOP_SELECTARG1);
+            g::d3d_dev->SetTextureStageState(0, D3DTSS_COLORARG1, D3DTA_TEXTURE);
+            g::d3d_dev->SetTextureStageState(0, D3DTSS_ALPHAOP, D3DTOP_SELECTARG1);
+            g::d3d_dev->SetTextureStageState(0, D3DTSS_ALPHAARG1, D3DTA_TEXTURE);
+            g::d3d_dev->SetTextureStageState(0, D3DTSS_TEXCOORDINDEX, 0);
+            g::d3d_dev->SetTextureStageState(0, D3DTSS_TEXTURETRANSFORMFLAGS, D3DTTFF_COUNT3 | D3DTTFF_PROJECTED);
+            g::hooks::set_sampler_state.call(g::d3d_dev, 0, D3DSAMP_MINFILTER, D3DTEXF_LINEAR);
+            g::hooks::set_sampler_state.call(g::d3d_dev, 0, D3DSAMP_MAGFILTER, D3DTEXF_LINEAR);
+            g::hooks::set_sampler_state.call(g::d3d_dev, 0, D3DSAMP_MIPFILTER, D3DTEXF_NONE);
+            g::hooks::set_sampler_state.call(g::d3d_dev, 0, D3DSAMP_ADDRESSU, D3DTADDRESS_CLAMP);
+            g::hooks::set_sampler_state.call(g::d3d_dev, 0, D3DSAMP_ADDRESSV, D3DTADDRESS_CLAMP);
+            g::hooks::set_sampler_state.call(g::d3d_dev, 0, D3DSAMP_SRGBTEXTURE, FALSE);
+        }
+
+        // The pattern goes to the stage after the texture, and only its alpha is used
+        const DWORD pattern_stage = texture ? 1 : 0;
+        if (pattern) {
+            g::d3d_dev->SetTexture(pattern_stage, pattern);
+            g::d3d_dev->SetTextureStageState(pattern_stage, D3DTSS_COLOROP, D3DTOP_SELECTARG1);
+            g::d3d_dev->SetTextureStageState(pattern_stage, D3DTSS_COLORARG1, texture ? D3DTA_CURRENT : D3DTA_TEXTURE);
+            g::d3d_dev->SetTextureStageState(pattern_stage, D3DTSS_ALPHAOP, D3DTOP_SELECTARG1);
+            g::d3d_dev->SetTextureStageState(pattern_stage, D3DTSS_ALPHAARG1, D3DTA_TEXTURE);
+            g::d3d_dev->SetTextureStageState(pattern_stage, D3DTSS_TEXCOORDINDEX, 1);
+            g::d3d_dev->SetTextureStageState(pattern_stage, D3DTSS_TEXTURETRANSFORMFLAGS, D3DTTFF_DISABLE);
+            g::hooks::set_sampler_state.call(g::d3d_dev, pattern_stage, D3DSAMP_MINFILTER, D3DTEXF_POINT);
+            g::hooks::set_sampler_state.call(g::d3d_dev, pattern_stage, D3DSAMP_MAGFILTER, D3DTEXF_POINT);
+            g::hooks::set_sampler_state.call(g::d3d_dev, pattern_stage, D3DSAMP_MIPFILTER, D3DTEXF_NONE);
+            g::hooks::set_sampler_state.call(g::d3d_dev, pattern_stage, D3DSAMP_ADDRESSU, D3DTADDRESS_WRAP);
+            g::hooks::set_sampler_state.call(g::d3d_dev, pattern_stage, D3DSAMP_ADDRESSV, D3DTADDRESS_WRAP);
+            g::d3d_dev->SetRenderState(D3DRS_ALPHATESTENABLE, TRUE);
+            g::d3d_dev->SetRenderState(D3DRS_ALPHAREF, 0x80);
+            g::d3d_dev->SetRenderState(D3DRS_ALPHAFUNC, D3DCMP_GREATEREQUAL);
+        } else {
+            g::d3d_dev->SetRenderState(D3DRS_ALPHATESTENABLE, FALSE);
+        }
+        const auto last_stage = pattern ? pattern_stage + 1 : pattern_stage;
+        g::d3d_dev->SetTexture(last_stage, nullptr);
+        g::d3d_dev->SetTextureStageState(last_stage, D3DTSS_COLOROP, D3DTOP_DISABLE);
+
+        if (texture) {
+            g::d3d_dev->SetRenderState(D3DRS_ZENABLE, D3DZB_FALSE);
+            g::d3d_dev->SetRenderState(D3DRS_ZWRITEENABLE, FALSE);
+            g::d3d_dev->SetRenderState(D3DRS_COLORWRITEENABLE, 0xf);
+        } else {
+            // Depth of 0 makes the depth test reject everything the game draws on these pixels
+            g::d3d_dev->SetRenderState(D3DRS_ZENABLE, D3DZB_TRUE);
+            g::d3d_dev->SetRenderState(D3DRS_ZFUNC, D3DCMP_ALWAYS);
+            g::d3d_dev->SetRenderState(D3DRS_ZWRITEENABLE, TRUE);
+            g::d3d_dev->SetRenderState(D3DRS_COLORWRITEENABLE, 0);
+        }
+        g::d3d_dev->SetRenderState(D3DRS_ALPHABLENDENABLE, FALSE);
+        g::d3d_dev->SetRenderState(D3DRS_STENCILENABLE, FALSE);
+        g::d3d_dev->SetRenderState(D3DRS_CULLMODE, D3DCULL_NONE);
+        g::d3d_dev->SetRenderState(D3DRS_LIGHTING, FALSE);
+        g::d3d_dev->SetRenderState(D3DRS_FOGENABLE, FALSE);
+        g::d3d_dev->SetRenderState(D3DRS_SRGBWRITEENABLE, FALSE);
+
+        if (g::d3d_dev->DrawPrimitiveUP(D3DPT_TRIANGLESTRIP, 2, quad, sizeof(history::Vertex)) != D3D_OK) {
+            dbg(std::format("Failed to draw {}", what));
+        }
+
+        state->Apply();
+    }
+
+    // Homography from the pixels of the current view of a camera to its history image.
+    // With a reduced resolution the image is in the top left part of the history texture.
+    static glm::mat3 get_history_homography(RenderTarget tgt)
+    {
+        const auto& image = history::images[tgt];
+        const auto size = get_render_size(tgt);
+        const auto fraction = glm::vec2(size) / glm::vec2(g::cfg.cameras[0].w(), g::cfg.cameras[0].h());
+        const auto uv_scale = glm::mat3(
+            fraction.x, 0.0f, 0.0f,
+            0.0f, fraction.y, 0.0f,
+            0.0f, 0.0f, 1.0f);
+        // Without the orientations the image is shown as it is
+        const auto current = get_camera_orientation(tgt);
+        const auto old_view = glm::mat4(image.orientation.value_or(current.value_or(glm::mat3(1.0f))));
+        const auto new_view = current && image.orientation ? glm::mat4(current.value()) : old_view;
+        return uv_scale * reprojection::homography(old_view, new_view, g::projection_matrix[tgt], size.x, size.y);
+    }
+
+    // Warp the last rendered image of a camera with the rotation the camera has made since it was rendered
+    void reproject(RenderTarget tgt)
+    {
+        const auto& image = history::images[tgt];
+        if (!image.texture) {
+            return;
+        }
+
+        set_render_target(tgt, false);
+        draw_screen_quad(tgt, image.texture, get_history_homography(tgt), nullptr, "reprojected image");
+    }
+
+    static bool create_interlace_patterns(interlace::Mode mode)
+    {
+        for (auto& pattern : interlaced::patterns) {
+            if (pattern) {
+                pattern->Release();
+                pattern = nullptr;
+            }
+        }
+
+        for (uint32_t parity = 0; parity < 2; ++parity) {
+            auto& pattern = interlaced::patterns[parity];
+            if (g::d3d_dev->CreateTexture(interlace::PATTERN_SIZE, interlace::PATTERN_SIZE, 1, 0, D3DFMT_A8R8G8B8, D3DPOOL_MANAGED, &pattern, nullptr) != D3D_OK) {
+                dbg("Failed to create interlace pattern");
+                pattern = nullptr;
+                return false;
+            }
+
+            D3DLOCKED_RECT rect;
+            if (pattern->LockRect(0, &rect, nullptr, 0) != D3D_OK) {
+                dbg("Failed to lock interlace pattern");
+                return false;
+            }
+            const auto mask = interlace::skipped_pixel_mask(mode, parity);
+            for (uint32_t y = 0; y < interlace::PATTERN_SIZE; ++y) {
+                auto row = reinterpret_cast<uint32_t*>(static_cast<uint8_t*>(rect.pBits) + y * rect.Pitch);
+                for (uint32_t x = 0; x < interlace::PATTERN_SIZE; ++x) {
+                    row[x] = static_cast<uint32_t>(mask[y * interlace::PATTERN_SIZE + x]) << 24;
+                }
+            }
+            pattern->UnlockRect(0);
+        }
+        interlaced::pattern_mode = mode;
+        return true;
+    }
+
+    // Mask out the pixels skipped by this pass of the camera, before the game renders it
+    bool begin_interlaced_pass(RenderTarget tgt)
+    {
+        const auto mode = g::cfg.side_monitors_interlace;
+        if (mode == interlace::Off || tgt == RenderTarget::Primary || is_panorama_enabled()) {
+            return false;
+        }
+        if ((!interlaced::patterns[0] || interlaced::pattern_mode != mode) && !create_interlace_patterns(mode)) {
+            return false;
+        }
+
+        draw_screen_quad(tgt, nullptr, glm::mat3(1.0f), interlaced::patterns[interlaced::parity[tgt] & 1], "interlace mask");
+        interlaced::masked_pass = tgt;
+        return true;
+    }
+
+    // Fill in the skipped pixels from the previous image of the camera and save the result for the next pass
+    void end_interlaced_pass(RenderTarget tgt)
+    {
+        auto& parity = interlaced::parity[tgt];
+        interlaced::masked_pass.reset();
+        set_render_target(tgt, false);
+        if (const auto& image = history::images[tgt]; image.texture) {
+            draw_screen_quad(tgt, image.texture, get_history_homography(tgt), interlaced::patterns[parity & 1], "interlaced reconstruction");
+        }
+        save_reprojection_history(tgt);
+        parity ^= 1;
+    }
+
+    HRESULT __stdcall BTB_SetRenderTarget(IDirect3DDevice9* This, DWORD RenderTargetIndex, IDirect3DSurface9* pRenderTarget)
+    {
+        // This was found purely by luck after testing all kinds of things.
+        // For some reason, if this call is called with the original This pointer (from RBRRX)
+        // plugins switching the render target (i.e. RBRHUD) will cause the stage geometry
+        // to not be rendered at all. Routing the call to the D3D device created by openRBRTriples,
+        // it seems to work correctly.
+        return g::d3d_dev->SetRenderTarget(RenderTargetIndex, pRenderTarget);
+    }
+
+    void begin_game_pass(RenderTarget tgt)
+    {
+        IDirect3DSurface9* surface;
+        if (g::d3d_dev->GetRenderTarget(0, &surface) != D3D_OK) {
+            dbg("Could not get the camera render target");
+            return;
+        }
+        g::pass_start_times[tgt] = std::chrono::steady_clock::now();
+        history::pass_view.reset();
+        g::offscreen_passes.begin_camera_pass(tgt, surface);
+        g::pass_surface = surface;
+        surface->Release();
+
+        // Only the cockpit hides a large part of the side screens, and stays in place from frame to frame
+        if (g::cfg.occlusion_queries && tgt != RenderTarget::Primary && rbr::is_using_cockpit_camera() && create_occlusion_queries()) {
+            g::occlusion_pass = true;
+            g::occluded_draws.begin_pass();
+        } else if (!rbr::is_using_cockpit_camera()) {
+            g::occluded_draws.reset();
+        }
+        if (g::cfg.software_occlusion) {
+            g::occluder_depth.clear();
+        }
+        // The scene is only compared in the game modes where it may stand still
+        const auto mode = rbr::get_game_mode();
+        history::is_hashing_scene = g::cfg.reuse_static_side_images && tgt == RenderTarget::Primary
+            && (mode == GameMode::Pause || mode == GameMode::MainMenu || mode == GameMode::Replay);
+        if (history::is_hashing_scene) {
+            history::scene_hash = 2166136261u;
+        }
+    }
+
+    void end_game_pass()
+    {
+        g::offscreen_passes.end_camera_pass();
+        g::pass_surface = nullptr;
+        g::occlusion_pass = false;
+        history::is_hashing_scene = false;
+    }
+
+    // Whether the game is drawing into the camera surface of its pass, not into an offscreen surface
+    static bool is_drawing_to_pass_surface()
+    {
+        IDirect3DSurface9* surface;
+        if (!g::pass_surface || g::d3d_dev->GetRenderTarget(0, &surface) != D3D_OK) {
+            return false;
+        }
+        surface->Release();
+        return surface == g::pass_surface;
+    }
+
+    const std::vector<offscreen::Pass>& get_offscreen_passes()
+    {
+        return g::offscreen_passes.last_frame();
+    }
+
+    const std::optional<pacing::FrameTimes>& get_frame_times()
+    {
+        return g::frame_times;
+    }
+
+    HRESULT __stdcall SetRenderTarget(IDirect3DDevice9* This, DWORD RenderTargetIndex, IDirect3DSurface9* pRenderTarget)
+    {
+        if (RenderTargetIndex == 0 && g::cfg.skip_repeated_offscreen_passes) {
+            auto target = offscreen::Target {};
+            if (D3DSURFACE_DESC desc; pRenderTarget && pRenderTarget->GetDesc(&desc) == D3D_OK) {
+                target = { desc.Width, desc.Height };
+            }
+            g::offscreen_passes.set_render_target(pRenderTarget, target, g::cfg.offscreen_always_render);
+            if (g::offscreen_passes.is_skipping()) {
+                g::frame_stats.offscreen_passes_skipped++;
+            }
+        }
+        return g::hooks::set_render_target.call(This, RenderTargetIndex, pRenderTarget);
+    }
+
+    HRESULT __stdcall Clear(IDirect3DDevice9* This, DWORD Count, const D3DRECT* pRects, DWORD Flags, D3DCOLOR Color, float Z, DWORD Stencil)
+    {
+        // Clearing would erase the image of the earlier pass that the skipped offscreen pass reuses
+        if (g::cfg.skip_repeated_offscreen_passes && g::offscreen_passes.is_skipping()) {
+            return D3D_OK;
+        }
+        const auto ret = g::hooks::clear.call(This, Count, pRects, Flags, Color, Z, Stencil);
+
+        // Clearing the depth of an interlaced pass erases the mask, so it's drawn again
+        if (const auto tgt = interlaced::masked_pass; ret == D3D_OK && tgt && (Flags & D3DCLEAR_ZBUFFER) && is_drawing_to_pass_surface()) {
+            draw_screen_quad(tgt.value(), nullptr, glm::mat3(1.0f), interlaced::patterns[interlaced::parity[tgt.value()] & 1], "interlace mask");
+        }
+        return ret;
+    }
+
+    // Counts a draw for the offscreen pass detection, returns true if the draw should be skipped
+    static bool skip_offscreen_draw(UINT primitive_count)
+    {
+        if (!g::cfg.skip_repeated_offscreen_passes || !g::offscreen_passes.draw(primitive_count)) {
+            return false;
+        }
+        g::frame_stats.offscreen_draws_skipped++;
+        g::frame_stats.offscreen_primitives_skipped += primitive_count;
+        return true;
+    }
+
+    static drawfilter::ShaderInfo get_current_shader_info()
+    {
+        auto info = drawfilter::ShaderInfo {};
+        IDirect3DVertexShader9* shader;
+        if (g::d3d_dev->GetVertexShader(&shader) == D3D_OK && shader) {
+            if (auto it = g::shader_info.find(shader); it != g::shader_info.end()) {
+                info = it->second;
+            }
+            shader->Release();
+        }
+        return info;
+    }
+
+    static bool should_skip_drawing(bool indexed, D3DPRIMITIVETYPE type, UINT primitive_count)
+    {
+        // The game mode and the stage type may change between the camera passes
+        g::draw_filter.update(rbr::get_game_mode(), rbr::is_on_btb_stage());
+        if (g::draw_filter.empty()) {
+            return false;
+        }
+        return g::draw_filter.should_skip(get_current_shader_info(), indexed, type, primitive_count);
+    }
+
+    // Draws an expensive draw of a side pass inside an occlusion query, or skips it if it was hidden
+    // in the previous frames. The offscreen passes are drawn as they are.
+    template <typename F>
+    static HRESULT draw_occlusion_tested(bool indexed, INT base_vertex, UINT first, UINT primitive_count, F&& draw)
+    {
+        if (!g::occlusion_pass || primitive_count < static_cast<UINT>(g::cfg.occlusion_min_primitives) || !g::current_render_target || !is_drawing_to_pass_surface()) {
+            return draw();
+        }
+
+        const auto info = get_current_shader_info();
+        auto key = occlusion::Key {
+            .camera = static_cast<uint32_t>(g::current_render_target.value()),
+            .shader_index = info.index,
+            .shader_hash = info.hash,
+            .base_vertex = base_vertex,
+            .primitives = primitive_count,
+            .first = first,
+        };
+        // Only the addresses are kept, the references are released right away
+        IDirect3DVertexBuffer9* vb;
+        UINT offset, stride;
+        if (g::d3d_dev->GetStreamSource(0, &vb, &offset, &stride) == D3D_OK && vb) {
+            key.vertex_buffer = vb;
+            vb->Release();
+        }
+        IDirect3DIndexBuffer9* ib;
+        if (indexed && g::d3d_dev->GetIndices(&ib) == D3D_OK && ib) {
+            key.index_buffer = ib;
+            ib->Release();
+        }
+        const auto decision = g::occluded_draws.draw(key, static_cast<uint32_t>(g::cfg.occlusion_retest_frames));
+        if (decision.skip) {
+            g::frame_stats.occlusion_draws_skipped++;
+            g::frame_stats.occlusion_primitives_skipped += primitive_count;
+            return D3D_OK;
+        }
+        if (!decision.query) {
+            return draw();
+        }
+        auto query = g::occlusion_queries[decision.query.value()];
+        query->Issue(D3DISSUE_BEGIN);
+        const auto ret = draw();
+        query->Issue(D3DISSUE_END);
+        g::frame_stats.occlusion_queries++;
+        return ret;
+    }
+
+    // Stream and byte offset of the float3 position of the current vertex declaration
+    static std::optional<std::tuple<UINT, UINT>> get_position_element()
+    {
+        IDirect3DVertexDeclaration9* decl = nullptr;
+        if (g::d3d_dev->GetVertexDeclaration(&decl) != D3D_OK || !decl) {
+            return std::nullopt;
+        }
+        if (auto it = vertexbuffer::position_elements.find(decl); it != vertexbuffer::position_elements.end()) {
+            decl->Release();
+            return it->second;
+        }
+        D3DVERTEXELEMENT9 elements[MAXD3DDECLLENGTH + 1];
+        UINT count = MAXD3DDECLLENGTH + 1;
+        auto ret = std::optional<std::tuple<UINT, UINT>> {};
+        if (decl->GetDeclaration(elements, &count) == D3D_OK) {
+            for (UINT i = 0; i < count && elements[i].Stream != 0xff; ++i) {
+                const auto& e = elements[i];
+                if (e.Usage == D3DDECLUSAGE_POSITION && e.UsageIndex == 0 && (e.Type == D3DDECLTYPE_FLOAT3 || e.Type == D3DDECLTYPE_FLOAT4)) {
+                    ret = { e.Stream, e.Offset };
+                    break;
+                }
+            }
+        }
+        if (vertexbuffer::position_elements.size() >= vertexbuffer::MAX_POSITION_ELEMENTS) {
+            vertexbuffer::position_elements.clear();
+        }
+        vertexbuffer::position_elements[decl] = ret;
+        decl->Release();
+        return ret;
+    }
+
+    // Whether the current vertices are already transformed to screen space, so that the fixed function pipeline
+    // does not project them
+    static bool is_pretransformed()
+    {
+        if (DWORD fvf; g::d3d_dev->GetFVF(&fvf) == D3D_OK && fvf != 0) {
+            return (fvf & D3DFVF_POSITION_MASK) == D3DFVF_XYZRHW;
+        }
+        IDirect3DVertexDeclaration9* decl = nullptr;
+        if (g::d3d_dev->GetVertexDeclaration(&decl) != D3D_OK || !decl) {
+            return false;
+        }
+        D3DVERTEXELEMENT9 elements[MAXD3DDECLLENGTH + 1];
+        UINT count = MAXD3DDECLLENGTH + 1;
+        auto ret = false;
+        if (decl->GetDeclaration(elements, &count) == D3D_OK) {
+            for (UINT i = 0; i < count && elements[i].Stream != 0xff; ++i) {
+                ret |= elements[i].Usage == D3DDECLUSAGE_POSITIONT;
+            }
+        }
+        decl->Release();
+        return ret;
+    }
+
+    // The draws of the panoramic pass that are not projected by a rewritten shader would be seen on the center
+    // screen only: the fixed function draws, which use the projection set with SetTransform, and the draws with
+    // the shaders that are not rewritten, like the ones BTB creates after the base game shaders
+    static void check_panorama_draw()
+    {
+        if (!is_panorama_enabled() || g::panorama_fallback_requested || !rbr::is_rendering_3d()) {
+            return;
+        }
+        IDirect3DVertexShader9* shader;
+        if (g::d3d_dev->GetVertexShader(&shader) != D3D_OK) {
+            return;
+        }
+        if (shader) {
+            const auto rewritten = g::panorama_shaders.contains(shader);
+            shader->Release();
+            if (!rewritten) {
+                fall_back_from_panorama("a draw with a vertex shader that is not rewritten");
+            }
+        } else if (!is_pretransformed()) {
+            fall_back_from_panorama("a fixed function draw");
+        }
+    }
+
+    // Size of a buffer if it's dynamic
+    template <typename Buffer>
+    static std::optional<UINT> get_dynamic_buffer_size(Buffer* buffer)
+    {
+        if (const auto it = g::dynamic_buffers.find(buffer); it != g::dynamic_buffers.end()) {
+            return it->second;
+        }
+        using Desc = std::conditional_t<std::is_same_v<Buffer, IDirect3DVertexBuffer9>, D3DVERTEXBUFFER_DESC, D3DINDEXBUFFER_DESC>;
+        auto ret = std::optional<UINT> {};
+        if (Desc desc; buffer->GetDesc(&desc) == D3D_OK && (desc.Usage & D3DUSAGE_DYNAMIC)) {
+            ret = desc.Size;
+        }
+        g::dynamic_buffers[buffer] = ret;
+        return ret;
     }
 
-    namespace fixedfunction {
-        static D3DMATRIX current_projection_matrix;
-        static D3DMATRIX current_view_matrix;
+    template <typename Vtbl, typename Buffer>
+    static void write_buffer(const BufferHooks<Vtbl>& hooks, size_t i, Buffer* buffer, const upload::Write& write)
+    {
+        void* data;
+        if (hooks.lock[i].call(buffer, write.offset, write.size, &data, write.flags) != D3D_OK) {
+            dbg("Could not lock a dynamic buffer");
+            return;
+        }
+        std::memcpy(data, write.data, write.size);
+        hooks.unlock[i].call(buffer);
     }
 
-    using rbr::GameMode;
+    template <typename Vtbl, typename Buffer>
+    static HRESULT lock_buffer(const BufferHooks<Vtbl>& hooks, Buffer* This, UINT OffsetToLock, UINT SizeToLock, void** ppbData, DWORD Flags)
+    {
+        const auto i = hooks.find(This);
+        if (!i) {
+            return D3DERR_INVALIDCALL;
+        }
+        if (!(Flags & D3DLOCK_READONLY) && !g::multithreaded_device && (g::cfg.deduplicate_uploads || !g::uploads.empty())) {
+            if (const auto size = get_dynamic_buffer_size(This)) {
+                auto flush = std::optional<upload::Write> {};
+                if (!g::cfg.deduplicate_uploads) {
+                    flush = g::uploads.forget(This);
+                } else if (auto staging = g::uploads.lock(This, size.value(), OffsetToLock, SizeToLock, Flags, flush)) {
+                    *ppbData = staging;
+                    return D3D_OK;
+                }
+                if (flush) {
+                    write_buffer(hooks, i.value(), This, flush.value());
+                }
+            }
+        }
+        return hooks.lock[i.value()].call(This, OffsetToLock, SizeToLock, ppbData, Flags);
+    }
 
-    LRESULT CALLBACK wnd_proc(HWND hWindow, UINT uMsg, WPARAM wParam, LPARAM lParam)
+    template <typename Vtbl, typename Buffer>
+    static HRESULT unlock_buffer(const BufferHooks<Vtbl>& hooks, Buffer* This)
     {
-        switch (uMsg) {
-            case WM_CLOSE:
-                DestroyWindow(hWindow);
-                break;
-            case WM_DESTROY:
-                PostQuitMessage(0);
-                break;
-            default:
-                return DefWindowProc(hWindow, uMsg, wParam, lParam);
+        const auto i = hooks.find(This);
+        if (!i) {
+            return D3DERR_INVALIDCALL;
         }
-        return 0;
+        const auto result = g::uploads.unlock(This);
+        if (!result.intercepted) {
+            return hooks.unlock[i.value()].call(This);
+        }
+        if (result.bytes_skipped > 0) {
+            g::frame_stats.uploads_skipped++;
+            g::frame_stats.upload_bytes_skipped += result.bytes_skipped;
+        }
+        if (result.write) {
+            write_buffer(hooks, i.value(), This, result.write.value());
+        }
+        return D3D_OK;
     }
 
-    HRESULT __stdcall CreateVertexShader(IDirect3DDevice9* This, const DWORD* pFunction, IDirect3DVertexShader9** ppShader)
+    HRESULT __stdcall VertexBuffer_Lock(IDirect3DVertexBuffer9* This, UINT OffsetToLock, UINT SizeToLock, void** ppbData, DWORD Flags)
     {
-        static int i = 0;
-        auto ret = g::hooks::create_vertex_shader.call(g::d3d_dev, pFunction, ppShader);
-        if (i < 40) {
-            // These are the base game shaders for RBR that need
-            // to be patched with the VR projection.
-            g::base_game_shaders.push_back(*ppShader);
+        // Writing to the buffer invalidates the cached bounds of the ranges written to
+        if (!(Flags & D3DLOCK_READONLY)) {
+            const auto discard = (Flags & D3DLOCK_DISCARD) != 0;
+            g::vertex_bounds.invalidate(This, discard ? 0 : OffsetToLock, discard ? 0 : SizeToLock);
+            g::occluder_meshes.invalidate(This);
         }
-        i++;
-        return ret;
+        return lock_buffer(vertexbuffer::hooks, This, OffsetToLock, SizeToLock, ppbData, Flags);
     }
 
-    void set_render_target(RenderTarget tgt, bool clear)
+    HRESULT __stdcall VertexBuffer_Unlock(IDirect3DVertexBuffer9* This)
     {
-        const auto& surface = g::surfaces[tgt];
-        IDirect3DSurface9* rt = std::get<0>(surface);
-        IDirect3DSurface9* dt = std::get<1>(surface);
+        return unlock_buffer(vertexbuffer::hooks, This);
+    }
 
-        if (rt && dt) {
-            if (g::d3d_dev->SetRenderTarget(0, rt) != D3D_OK) {
-                dbg("Failed to set render target");
-            }
-            if (g::d3d_dev->SetDepthStencilSurface(dt) != D3D_OK) {
-                dbg("Failed to set depth surface");
-            }
-            if (clear && g::d3d_dev->Clear(0, nullptr, D3DCLEAR_TARGET | D3DCLEAR_ZBUFFER | D3DCLEAR_STENCIL, 0, 1.0, 0) != D3D_OK) {
-                dbg("Failed to clear surface");
-            }
-            g::current_render_target = tgt;
+    HRESULT __stdcall IndexBuffer_Lock(IDirect3DIndexBuffer9* This, UINT OffsetToLock, UINT SizeToLock, void** ppbData, DWORD Flags)
+    {
+        if (!(Flags & D3DLOCK_READONLY)) {
+            g::occluder_meshes.invalidate(This);
         }
+        return lock_buffer(indexbuffer::hooks, This, OffsetToLock, SizeToLock, ppbData, Flags);
     }
 
-    HRESULT __stdcall Present(IDirect3DDevice9* This, const RECT* pSourceRect, const RECT* pDestRect, HWND hDestWindowOverride, const RGNDATA* pDirtyRegion)
+    HRESULT __stdcall IndexBuffer_Unlock(IDirect3DIndexBuffer9* This)
     {
-        if (g::d3d_dev->SetRenderTarget(0, g::original_render_target) != D3D_OK) {
-            dbg("Failed to reset render target to original");
+        return unlock_buffer(indexbuffer::hooks, This);
+    }
+
+    template <typename Vtbl, typename Buffer>
+    static bool hook_buffer(BufferHooks<Vtbl>& hooks, Buffer* buffer, decltype(Vtbl::Lock) lock, decltype(Vtbl::Unlock) unlock)
+    {
+        if (hooks.find(buffer)) {
+            return true;
         }
-        if (g::d3d_dev->SetDepthStencilSurface(g::original_depth_stencil_target) != D3D_OK) {
-            dbg("Failed to reset depth stencil surface to original");
+        if (hooks.count == hooks.lock.size()) {
+            return false;
         }
-        if (g::d3d_dev->Clear(0, nullptr, D3DCLEAR_STENCIL | D3DCLEAR_TARGET | D3DCLEAR_ZBUFFER, 0, 1.0, 0) != D3D_OK) {
-            dbg("Failed to clear surface");
+        const auto vtable = get_vtable<Vtbl>(buffer);
+        try {
+            hooks.lock[hooks.count] = Hook(vtable->Lock, lock);
+            hooks.unlock[hooks.count] = Hook(vtable->Unlock, unlock);
+            hooks.count++;
+            return true;
+        } catch (const std::runtime_error& e) {
+            dbg(std::format("Could not hook buffer Lock and Unlock: {}", e.what()));
+            // Lock without its Unlock would not find its original function, the hook is disabled when `failed` goes out of scope
+            Hook<decltype(Vtbl::Lock)> failed;
+            failed = std::move(hooks.lock[hooks.count]);
+            return false;
         }
+    }
 
-        IDirect3DSurface9* back_buffer;
-        auto buf = g::swapchain->GetBackBuffer(0, D3DBACKBUFFER_TYPE_MONO, &back_buffer);
+    // Hook the implementation of a vertex buffer, so that the cached bounds of its ranges stay up to date
+    static bool hook_vertex_buffer_lock(IDirect3DVertexBuffer9* vb)
+    {
+        return hook_buffer(vertexbuffer::hooks, vb, VertexBuffer_Lock, VertexBuffer_Unlock);
+    }
 
-        auto xmin = std::min_element(g::cfg.cameras.cbegin(), g::cfg.cameras.cend(), [](const auto& a, const auto& b) { return a.extent[0] < b.extent[0]; })->extent[0];
-        for (const auto& [i, c] : std::views::enumerate(g::cfg.cameras)) {
-            RECT src = { c.crop.x, c.crop.y, c.crop.x + c.w(), c.crop.y + c.h() };
-            const auto dstx = c.extent[0] + std::abs(xmin);
-            RECT dst = { dstx, c.extent[1], dstx + c.w(), c.extent[1] + c.h() };
-            g::d3d_dev->StretchRect(std::get<0>(g::surfaces[i]), &src, back_buffer, &dst, D3DTEXF_NONE);
+    // The dynamic buffers are hooked when one of them is first drawn
+    static void hook_dynamic_buffers(bool indexed)
+    {
+        if (!g::cfg.deduplicate_uploads) {
+            return;
         }
-        back_buffer->Release();
+        if (!vertexbuffer::hooks.dynamic_hooked) {
+            IDirect3DVertexBuffer9* vb;
+            UINT offset, stride;
+            if (g::d3d_dev->GetStreamSource(0, &vb, &offset, &stride) == D3D_OK && vb) {
+                if (get_dynamic_buffer_size(vb)) {
+                    vertexbuffer::hooks.dynamic_hooked = hook_buffer(vertexbuffer::hooks, vb, VertexBuffer_Lock, VertexBuffer_Unlock);
+                }
+                vb->Release();
+            }
+        }
+        if (indexed && !indexbuffer::hooks.dynamic_hooked) {
+            IDirect3DIndexBuffer9* ib;
+            if (g::d3d_dev->GetIndices(&ib) == D3D_OK && ib) {
+                if (get_dynamic_buffer_size(ib)) {
+                    indexbuffer::hooks.dynamic_hooked = hook_buffer(indexbuffer::hooks, ib, IndexBuffer_Lock, IndexBuffer_Unlock);
+                }
+                ib->Release();
+            }
+        }
+    }
 
-        auto ret = g::swapchain->Present(nullptr, nullptr, nullptr, nullptr, 0);
+    // The caches are keyed by the address of the objects, which a new object may reuse once the old one
+    // is released. Whatever is cached for the address is dropped when an object is created at it.
+    HRESULT __stdcall CreateVertexBuffer(IDirect3DDevice9* This, UINT Length, DWORD Usage, DWORD FVF, D3DPOOL Pool, IDirect3DVertexBuffer9** ppVertexBuffer, HANDLE* pSharedHandle)
+    {
+        const auto ret = g::hooks::create_vertex_buffer.call(This, Length, Usage, FVF, Pool, ppVertexBuffer, pSharedHandle);
+        if (ret == D3D_OK && ppVertexBuffer && *ppVertexBuffer) {
+            g::vertex_bounds.invalidate(*ppVertexBuffer, 0, 0);
+            g::occluder_meshes.invalidate(*ppVertexBuffer);
+        }
+        return ret;
+    }
 
-        g::original_render_target->Release();
-        g::original_depth_stencil_target->Release();
+    HRESULT __stdcall CreateIndexBuffer(IDirect3DDevice9* This, UINT Length, DWORD Usage, D3DFORMAT Format, D3DPOOL Pool, IDirect3DIndexBuffer9** ppIndexBuffer, HANDLE* pSharedHandle)
+    {
+        const auto ret = g::hooks::create_index_buffer.call(This, Length, Usage, Format, Pool, ppIndexBuffer, pSharedHandle);
+        if (ret == D3D_OK && ppIndexBuffer && *ppIndexBuffer) {
+            g::occluder_meshes.invalidate(*ppIndexBuffer);
+        }
+        return ret;
+    }
 
+    HRESULT __stdcall CreateVertexDeclaration(IDirect3DDevice9* This, const D3DVERTEXELEMENT9* pVertexElements, IDirect3DVertexDeclaration9** ppDecl)
+    {
+        const auto ret = g::hooks::create_vertex_declaration.call(This, pVertexElements, ppDecl);
+        if (ret == D3D_OK && ppDecl && *ppDecl) {
+            vertexbuffer::position_elements.erase(*ppDecl);
+        }
         return ret;
     }
 
-    static M4 get_rotation_matrix()
+    // The game recreates its default pool resources after a Reset
+    HRESULT __stdcall Reset(IDirect3DDevice9* This, D3DPRESENT_PARAMETERS* pPresentationParameters)
     {
-        float angle = 0.0;
-        auto main_menu_camera_tweak = glm::identity<M4>();
-        if (rbr::is_rendering_3d()) {
-            if (rbr::get_game_mode() == GameMode::MainMenu) {
-                // The main menu camera looks weird. This is an attempt to make it look like normal.
-                main_menu_camera_tweak = glm::translate(glm::mat4x4(1.0f), glm::vec3(0, -1.5f, 2.0f)) * glm::mat4_cast(glm::angleAxis(glm::radians(-20.0f), glm::vec3 { 1, 0, 0 }));
+        g::vertex_bounds.clear();
+        vertexbuffer::position_elements.clear();
+        g::occluder_meshes.clear();
+        if (g::device_state) {
+            g::device_state->Release();
+            g::device_state = nullptr;
+        }
+        // The render states go back to their defaults
+        clip::plane_mask = 0;
+        clip::scissor.reset();
+        clip::game_planes = 0;
+        clip::game_scissor_test = FALSE;
+        clip::game_scissor_rect.reset();
+        clip::enabled_planes = 0;
+        return g::hooks::reset.call(This, pPresentationParameters);
+    }
+
+    // Object space bounds of a vertex range of the current vertex buffer.
+    // The bounds are read from the vertex buffer the first time the range is drawn.
+    static std::optional<culling::Aabb> get_vertex_bounds(UINT first_vertex, UINT vertex_count, culling::VertexRange& range)
+    {
+        const auto position = get_position_element();
+        if (!position || vertex_count == 0) {
+            return std::nullopt;
+        }
+        const auto [stream, element_offset] = position.value();
+        IDirect3DVertexBuffer9* vb = nullptr;
+        UINT stream_offset, stride;
+        if (g::d3d_dev->GetStreamSource(stream, &vb, &stream_offset, &stride) != D3D_OK || !vb) {
+            return std::nullopt;
+        }
+        range = { vb, first_vertex, vertex_count, stride, stream_offset + element_offset };
+
+        auto ret = std::optional<culling::Aabb> {};
+        if (const auto cached = g::vertex_bounds.find(range)) {
+            ret = *cached;
+        } else if (D3DVERTEXBUFFER_DESC desc; vb->GetDesc(&desc) == D3D_OK && !(desc.Usage & D3DUSAGE_WRITEONLY)) {
+            void* data;
+            const auto offset = stream_offset + first_vertex * stride;
+            if (offset + vertex_count * stride <= desc.Size && vb->Lock(offset, vertex_count * stride, &data, D3DLOCK_READONLY) == D3D_OK) {
+                ret = culling::bounds(static_cast<const uint8_t*>(data), vertex_count, stride, element_offset);
+                vb->Unlock();
+                // The bounds can only be cached if writes to the buffer are seen
+                if (ret && hook_vertex_buffer_lock(vb)) {
+                    g::vertex_bounds.insert(range, ret.value());
+                }
             }
-            angle = static_cast<float>(g::cfg.cameras[g::current_render_target.value()].angle);
-            angle += static_cast<float>(glm::radians(g::cfg.cameras[g::current_render_target.value()].angle_adjustment));
-            if (g::current_render_target.value() == RenderTarget::Right) {
-                angle = -angle;
+        }
+        vb->Release();
+        return ret;
+    }
+
+    // Test a draw of a camera pass against the camera's frustum, for the draw analyzer and the frustum culling.
+    // Returns true if the draw should be skipped.
+    static bool cull_draw(D3DPRIMITIVETYPE type, UINT first_vertex, UINT vertex_count, UINT primitive_count)
+    {
+        if ((!g::cfg.draw_analyzer && !g::cfg.frustum_culling && !g::cfg.software_occlusion) || !rbr::is_rendering_3d() || !g::current_render_target || is_panorama_enabled()) {
+            return false;
+        }
+        auto draw = drawanalyzer::Draw {
+            .pass = static_cast<uint32_t>(g::current_render_target.value()),
+            .shader_index = drawfilter::NO_SHADER_INDEX,
+            .primitive_type = static_cast<uint32_t>(type),
+            .primitives = primitive_count,
+        };
+        IDirect3DVertexShader9* shader;
+        if (g::d3d_dev->GetVertexShader(&shader) == D3D_OK && shader) {
+            if (auto it = g::shader_info.find(shader); it != g::shader_info.end()) {
+                draw.shader_index = it->second.index;
+                draw.shader_hash = it->second.hash;
             }
+            shader->Release();
         }
-        return glm::rotate(glm::identity<M4>(), angle, { 0, 1, 0 }) * main_menu_camera_tweak;
+        auto occluded = false;
+        // Only the base game shaders are known to use the transformation set in c0-c3
+        if (draw.shader_index != drawfilter::NO_SHADER_INDEX && shader::current_clip_from_object) {
+            if (const auto box = get_vertex_bounds(first_vertex, vertex_count, draw.range)) {
+                if (!shader::current_frustum) {
+                    shader::current_frustum = culling::frustum_from_clip(shader::current_clip_from_object.value());
+                }
+                draw.analyzed = true;
+                draw.outside = culling::is_outside(shader::current_frustum.value(), box.value());
+                occluded = g::cfg.software_occlusion && !draw.outside && is_drawing_to_pass_surface()
+                    && g::occluder_depth.is_occluded(shader::current_clip_from_object.value(), box.value());
+            }
+        }
+        if (g::cfg.draw_analyzer) {
+            g::draw_analysis.record(draw);
+        }
+        if (g::cfg.frustum_culling && draw.outside) {
+            g::frame_stats.draws_culled++;
+            g::frame_stats.primitives_culled += primitive_count;
+            return true;
+        }
+        if (occluded) {
+            g::frame_stats.draws_occluded++;
+            g::frame_stats.primitives_occluded += primitive_count;
+            return true;
+        }
+        return false;
     }
 
-    static M4 get_translation_matrix()
+    // Object space triangles of a draw, read from its buffers the first time it is drawn.
+    // Returns nothing if the buffers can't be read.
+    static rasterizer::Mesh read_occluder_mesh(IDirect3DVertexBuffer9* vb, IDirect3DIndexBuffer9* ib, const rasterizer::MeshKey& key, UINT stream_offset, UINT element_offset)
     {
-        if (rbr::is_rendering_3d()) {
-            return glm::translate(glm::identity<M4>(), g::cfg.cameras[g::current_render_target.value()].translation);
-        } else {
-            return glm::identity<M4>();
+        D3DVERTEXBUFFER_DESC vb_desc;
+        if (vb->GetDesc(&vb_desc) != D3D_OK || (vb_desc.Usage & D3DUSAGE_WRITEONLY)) {
+            return {};
+        }
+        const auto offset = static_cast<int64_t>(stream_offset) + (static_cast<int64_t>(key.base_vertex) + key.first_vertex) * key.stride;
+        const auto size = static_cast<int64_t>(key.vertex_count) * key.stride;
+        void* data;
+        if (offset < 0 || offset + size > vb_desc.Size || vb->Lock(static_cast<UINT>(offset), static_cast<UINT>(size), &data, D3DLOCK_READONLY) != D3D_OK) {
+            return {};
         }
+        auto positions = std::vector<glm::vec3>(key.vertex_count);
+        for (UINT i = 0; i < key.vertex_count; ++i) {
+            std::memcpy(&positions[i], static_cast<const uint8_t*>(data) + static_cast<size_t>(i) * key.stride + element_offset, sizeof(glm::vec3));
+        }
+        vb->Unlock();
+
+        const auto index_count = key.primitive_type == D3DPT_TRIANGLELIST ? key.primitive_count * 3 : key.primitive_count + 2;
+        auto indices = std::vector<uint32_t>(index_count);
+        if (!ib) {
+            std::iota(indices.begin(), indices.end(), 0);
+            return rasterizer::assemble(key.primitive_type, key.primitive_count, positions, indices);
+        }
+        D3DINDEXBUFFER_DESC ib_desc;
+        if (ib->GetDesc(&ib_desc) != D3D_OK || (ib_desc.Usage & D3DUSAGE_WRITEONLY)) {
+            return {};
+        }
+        const auto index_size = ib_desc.Format == D3DFMT_INDEX32 ? 4u : 2u;
+        if ((static_cast<uint64_t>(key.start_index) + index_count) * index_size > ib_desc.Size
+            || ib->Lock(key.start_index * index_size, index_count * index_size, &data, D3DLOCK_READONLY) != D3D_OK) {
+            return {};
+        }
+        for (UINT i = 0; i < index_count; ++i) {
+            auto index = uint32_t { 0 };
+            std::memcpy(&index, static_cast<const uint8_t*>(data) + static_cast<size_t>(i) * index_size, index_size);
+            // Relative to the start of the vertex range, the indices outside of it make the mesh invalid
+            indices[i] = index >= key.first_vertex ? index - key.first_vertex : UINT32_MAX;
+        }
+        ib->Unlock();
+        return rasterizer::assemble(key.primitive_type, key.primitive_count, positions, indices);
     }
 
-    HRESULT __stdcall SetVertexShaderConstantF(IDirect3DDevice9* This, UINT StartRegister, const float* pConstantData, UINT Vector4fCount)
+    static const rasterizer::Mesh* get_occluder_mesh(D3DPRIMITIVETYPE type, INT base_vertex, UINT first_vertex, UINT vertex_count, std::optional<UINT> start_index, UINT primitive_count)
     {
-        IDirect3DVertexShader9* shader;
-        if (auto ret = g::d3d_dev->GetVertexShader(&shader); ret != D3D_OK) {
-            dbg("Could not get vertex shader");
-            return ret;
+        const auto position = get_position_element();
+        if (!position || vertex_count == 0) {
+            return nullptr;
+        }
+        const auto [stream, element_offset] = position.value();
+        IDirect3DVertexBuffer9* vb = nullptr;
+        UINT stream_offset, stride;
+        if (g::d3d_dev->GetStreamSource(stream, &vb, &stream_offset, &stride) != D3D_OK || !vb) {
+            return nullptr;
+        }
+        IDirect3DIndexBuffer9* ib = nullptr;
+        if (start_index && (g::d3d_dev->GetIndices(&ib) != D3D_OK || !ib)) {
+            vb->Release();
+            return nullptr;
         }
+        const auto key = rasterizer::MeshKey {
+            .vertex_buffer = vb,
+            .index_buffer = ib,
+            .base_vertex = base_vertex,
+            .first_vertex = first_vertex,
+            .vertex_count = vertex_count,
+            .start_index = start_index.value_or(0),
+            .primitive_type = static_cast<uint32_t>(type),
+            .primitive_count = primitive_count,
+            .stride = stride,
+            .position_offset = stream_offset + element_offset,
+        };
+        auto mesh = g::occluder_meshes.find(key);
+        // The mesh can only be cached if writes to the buffers are seen
+        if (!mesh && hook_vertex_buffer_lock(vb) && (!ib || hook_buffer(indexbuffer::hooks, ib, IndexBuffer_Lock, IndexBuffer_Unlock))) {
+            mesh = &g::occluder_meshes.insert(key, read_occluder_mesh(vb, ib, key, stream_offset, element_offset));
+        }
+        vb->Release();
+        if (ib) {
+            ib->Release();
+        }
+        return mesh;
+    }
 
-        auto is_base_shader = true;
-        if (rbr::is_on_btb_stage()) {
-            is_base_shader = std::find(g::base_game_shaders.cbegin(), g::base_game_shaders.cend(), shader) != g::base_game_shaders.end();
+    // Draws a large opaque draw of a camera pass into the occluder depth buffer,
+    // so that the draws after it can be tested against it
+    static void draw_occluder(D3DPRIMITIVETYPE type, INT base_vertex, UINT first_vertex, UINT vertex_count, std::optional<UINT> start_index, UINT primitive_count)
+    {
+        if (!g::cfg.software_occlusion || !g::pass_surface || !rbr::is_rendering_3d() || is_panorama_enabled()
+            || primitive_count < static_cast<UINT>(g::cfg.software_occluder_min_primitives)
+            || (type != D3DPT_TRIANGLELIST && type != D3DPT_TRIANGLESTRIP) || !shader::current_clip_from_object) {
+            return;
         }
-        if (shader)
-            shader->Release();
+        if (get_current_shader_info().index == drawfilter::NO_SHADER_INDEX) {
+            return;
+        }
+        // Blended and alpha tested draws have holes, and the draws that don't write depth are not solid
+        DWORD z_write, alpha_test, alpha_blend;
+        if (g::d3d_dev->GetRenderState(D3DRS_ZWRITEENABLE, &z_write) != D3D_OK || !z_write
+            || g::d3d_dev->GetRenderState(D3DRS_ALPHATESTENABLE, &alpha_test) != D3D_OK || alpha_test
+            || g::d3d_dev->GetRenderState(D3DRS_ALPHABLENDENABLE, &alpha_blend) != D3D_OK || alpha_blend) {
+            return;
+        }
+        if (!is_drawing_to_pass_surface()) {
+            return;
+        }
+        if (const auto mesh = get_occluder_mesh(type, base_vertex, first_vertex, vertex_count, start_index, primitive_count); mesh && !mesh->empty()) {
+            g::occluder_depth.draw(shader::current_clip_from_object.value(), *mesh);
+            g::frame_stats.occluders_drawn++;
+            g::frame_stats.occluder_triangles += static_cast<uint32_t>(mesh->size() / 3);
+        }
+    }
 
-        if (is_base_shader && Vector4fCount == 4) {
-            if (StartRegister == 0) {
-                const auto orig = glm::transpose(m4_from_shader_constant_ptr(pConstantData));
-                const auto mv = shader::current_projection_matrix_inverse * orig;
-                const auto mvp = glm::transpose(g::projection_matrix[g::current_render_target.value_or(RenderTarget::Primary)] * get_translation_matrix() * get_rotation_matrix() * mv);
-                return g::hooks::set_vertex_shader_constant_f.call(g::d3d_dev, StartRegister, glm::value_ptr(mvp), Vector4fCount);
-            } else if (StartRegister == 20) {
-                // Sky/fog
-                const auto orig = glm::transpose(m4_from_shader_constant_ptr(pConstantData));
-                const auto m = glm::transpose(get_translation_matrix() * get_rotation_matrix() * orig);
-                return g::hooks::set_vertex_shader_constant_f.call(g::d3d_dev, StartRegister, glm::value_ptr(m), Vector4fCount);
-            }
+    HRESULT __stdcall DrawPrimitive(IDirect3DDevice9* This, D3DPRIMITIVETYPE PrimitiveType, UINT StartVertex, UINT PrimitiveCount)
+    {
+        hash_scene_input(std::array<UINT, 3> { PrimitiveType, StartVertex, PrimitiveCount });
+        hook_dynamic_buffers(false);
+        check_panorama_draw();
+        if (skip_offscreen_draw(PrimitiveCount)) {
+            return 0;
         }
-        return g::hooks::set_vertex_shader_constant_f.call(g::d3d_dev, StartRegister, pConstantData, Vector4fCount);
+        if (should_skip_drawing(false, PrimitiveType, PrimitiveCount)) {
+            return 0;
+        }
+        if (cull_draw(PrimitiveType, StartVertex, culling::vertex_count(PrimitiveType, PrimitiveCount), PrimitiveCount)) {
+            return 0;
+        }
+        flush_shader_constants();
+        const auto ret = draw_occlusion_tested(false, 0, StartVertex, PrimitiveCount, [&] {
+            return g::hooks::draw_primitive.call(This, PrimitiveType, StartVertex, PrimitiveCount);
+        });
+        draw_occluder(PrimitiveType, 0, StartVertex, culling::vertex_count(PrimitiveType, PrimitiveCount), std::nullopt, PrimitiveCount);
+        return ret;
     }
 
-    HRESULT __stdcall SetTransform(IDirect3DDevice9* This, D3DTRANSFORMSTATETYPE State, const D3DMATRIX* pMatrix)
+    HRESULT __stdcall DrawIndexedPrimitive(IDirect3DDevice9* This, D3DPRIMITIVETYPE PrimitiveType, INT BaseVertexIndex, UINT MinVertexIndex, UINT NumVertices, UINT startIndex, UINT primCount)
     {
-        if (rbr::is_rendering_3d() && State == D3DTS_PROJECTION) {
-            shader::current_projection_matrix = m4_from_d3d(*pMatrix);
-            shader::current_projection_matrix_inverse = glm::inverse(shader::current_projection_matrix);
-            fixedfunction::current_projection_matrix = d3d_from_m4(g::projection_matrix[g::current_render_target.value_or(RenderTarget::Primary)]);
-            return g::hooks::set_transform.call(g::d3d_dev, State, &fixedfunction::current_projection_matrix);
-        } else if (rbr::is_rendering_3d() && State == D3DTS_VIEW) {
-            fixedfunction::current_view_matrix = d3d_from_m4(get_translation_matrix() * get_rotation_matrix() * m4_from_d3d(*pMatrix));
-            return g::hooks::set_transform.call(g::d3d_dev, State, &fixedfunction::current_view_matrix);
+        hash_scene_input(std::array<UINT, 6> { PrimitiveType, static_cast<UINT>(BaseVertexIndex), MinVertexIndex, NumVertices, startIndex, primCount });
+        hook_dynamic_buffers(true);
+        check_panorama_draw();
+        if (skip_offscreen_draw(primCount)) {
+            return 0;
+        }
+        if (should_skip_drawing(true, PrimitiveType, primCount)) {
+            return 0;
+        }
+        if (cull_draw(PrimitiveType, BaseVertexIndex + MinVertexIndex, NumVertices, primCount)) {
+            return 0;
+        }
+        flush_shader_constants();
+        const auto ret = draw_occlusion_tested(true, BaseVertexIndex, startIndex, primCount, [&] {
+            return g::hooks::draw_indexed_primitive.call(This, PrimitiveType, BaseVertexIndex, MinVertexIndex, NumVertices, startIndex, primCount);
+        });
+        draw_occluder(PrimitiveType, BaseVertexIndex, MinVertexIndex, NumVertices, startIndex, primCount);
+        return ret;
+    }
+
+    HRESULT __stdcall DrawPrimitiveUP(IDirect3DDevice9* This, D3DPRIMITIVETYPE PrimitiveType, UINT PrimitiveCount, const void* pVertexStreamZeroData, UINT VertexStreamZeroStride)
+    {
+        // The vertices of the draws from memory are often written for each frame, i.e. the particles
+        hash_scene_input(std::array<UINT, 2> { PrimitiveType, PrimitiveCount });
+        hash_scene_input(pVertexStreamZeroData, culling::vertex_count(PrimitiveType, PrimitiveCount) * VertexStreamZeroStride);
+        check_panorama_draw();
+        if (skip_offscreen_draw(PrimitiveCount)) {
+            return 0;
         }
+        flush_shader_constants();
+        return g::hooks::draw_primitive_up.call(This, PrimitiveType, PrimitiveCount, pVertexStreamZeroData, VertexStreamZeroStride);
+    }
 
-        return g::hooks::set_transform.call(g::d3d_dev, State, pMatrix);
+    HRESULT __stdcall DrawIndexedPrimitiveUP(IDirect3DDevice9* This, D3DPRIMITIVETYPE PrimitiveType, UINT MinVertexIndex, UINT NumVertices, UINT PrimitiveCount, const void* pIndexData, D3DFORMAT IndexDataFormat, const void* pVertexStreamZeroData, UINT VertexStreamZeroStride)
+    {
+        hash_scene_input(std::array<UINT, 3> { PrimitiveType, NumVertices, PrimitiveCount });
+        if (pVertexStreamZeroData) {
+            hash_scene_input(static_cast<const uint8_t*>(pVertexStreamZeroData) + MinVertexIndex * VertexStreamZeroStride, NumVertices * VertexStreamZeroStride);
+        }
+        hash_scene_input(pIndexData, culling::vertex_count(PrimitiveType, PrimitiveCount) * (IndexDataFormat == D3DFMT_INDEX32 ? 4 : 2));
+        check_panorama_draw();
+        if (skip_offscreen_draw(PrimitiveCount)) {
+            return 0;
+        }
+        flush_shader_constants();
+        return g::hooks::draw_indexed_primitive_up.call(This, PrimitiveType, MinVertexIndex, NumVertices, PrimitiveCount, pIndexData, IndexDataFormat, pVertexStreamZeroData, VertexStreamZeroStride);
     }
 
-    HRESULT __stdcall BTB_SetRenderTarget(IDirect3DDevice9* This, DWORD RenderTargetIndex, IDirect3DSurface9* pRenderTarget)
+    // Highest sample count up to the requested one that is supported for both the color and the depth format
+    static D3DMULTISAMPLE_TYPE get_supported_msaa(IDirect3D9* d3d, UINT adapter, D3DDEVTYPE device_type, const D3DPRESENT_PARAMETERS* pp, D3DMULTISAMPLE_TYPE requested)
     {
-        // This was found purely by luck after testing all kinds of things.
-        // For some reason, if this call is called with the original This pointer (from RBRRX)
-        // plugins switching the render target (i.e. RBRHUD) will cause the stage geometry
-        // to not be rendered at all. Routing the call to the D3D device created by openRBRTriples,
-        // it seems to work correctly.
-        return g::d3d_dev->SetRenderTarget(RenderTargetIndex, pRenderTarget);
+        if (requested < D3DMULTISAMPLE_2_SAMPLES) {
+            return requested;
+        }
+        for (auto samples = static_cast<int>(requested); samples >= D3DMULTISAMPLE_2_SAMPLES; --samples) {
+            const auto type = static_cast<D3DMULTISAMPLE_TYPE>(samples);
+            if (SUCCEEDED(d3d->CheckDeviceMultiSampleType(adapter, device_type, pp->BackBufferFormat, pp->Windowed, type, nullptr))
+                && SUCCEEDED(d3d->CheckDeviceMultiSampleType(adapter, device_type, pp->AutoDepthStencilFormat, pp->Windowed, type, nullptr))) {
+                return type;
+            }
+        }
+        return D3DMULTISAMPLE_NONE;
     }
 
-    HRESULT __stdcall DrawPrimitive(IDirect3DDevice9* This, D3DPRIMITIVETYPE PrimitiveType, UINT StartVertex, UINT PrimitiveCount)
+    static uint32_t bytes_per_pixel(D3DFORMAT format)
     {
-        if (rbr::is_on_btb_stage()) {
-            IDirect3DVertexShader9* shader;
-            g::d3d_dev->GetVertexShader(&shader);
-
-            if (shader) {
-                // Shader #39 causes strange "shadows" on BTB stages
-                // Probably some projection matrix issue, but changing the projection matrix like
-                // we do normally had no effect, so on BTB stages we just won't draw this primitive with this shader.
-                auto should_skip_drawing = shader == g::base_game_shaders[39];
-                shader->Release();
-                if (should_skip_drawing) {
-                    return 0;
+        switch (format) {
+            case D3DFMT_R5G6B5:
+            case D3DFMT_X1R5G5B5:
+            case D3DFMT_A1R5G5B5:
+            case D3DFMT_D16:
+            case D3DFMT_D15S1:
+                return 2;
+            case D3DFMT_A16B16G16R16:
+            case D3DFMT_A16B16G16R16F:
+                return 8;
+            default:
+                return 4;
+        }
+    }
+
+    // Downgrade the side screen settings if the render targets would not fit in the available video memory.
+    // Updates the camera sample counts and `formats` (the color formats of the cameras).
+    static void fit_vram_budget(IDirect3D9* d3d, UINT adapter, D3DDEVTYPE device_type, const D3DPRESENT_PARAMETERS* pp, IDirect3DDevice9* dev, int total_width, std::vector<D3DFORMAT>& formats)
+    {
+        constexpr auto side_format_16bit = D3DFMT_R5G6B5;
+        const auto w = static_cast<uint64_t>(g::cfg.cameras[0].w());
+        const auto h = static_cast<uint64_t>(g::cfg.cameras[0].h());
+        const auto color_bytes = bytes_per_pixel(pp->BackBufferFormat);
+        const auto depth_bytes = bytes_per_pixel(pp->AutoDepthStencilFormat);
+        // The render target formats are checked against the format of the display mode, which is not necessarily
+        // the back buffer format, and is unknown in the presentation parameters in windowed mode
+        D3DDISPLAYMODE mode;
+        const auto display_format = SUCCEEDED(d3d->GetAdapterDisplayMode(adapter, &mode)) ? mode.Format : D3DFMT_UNKNOWN;
+
+        auto layout = budget::Layout {
+            .w = static_cast<uint32_t>(w),
+            .h = static_cast<uint32_t>(h),
+            .depth_bytes = depth_bytes,
+            // The swapchain spans all screens
+            .fixed_bytes = static_cast<uint64_t>(total_width) * h * color_bytes,
+            .allow_16bit_color = display_format != D3DFMT_UNKNOWN
+                && SUCCEEDED(d3d->CheckDeviceFormat(adapter, device_type, display_format, D3DUSAGE_RENDERTARGET, D3DRTYPE_TEXTURE, side_format_16bit))
+                && SUCCEEDED(d3d->CheckDepthStencilMatch(adapter, device_type, display_format, side_format_16bit, pp->AutoDepthStencilFormat)),
+        };
+        if (g::cfg.panorama_mode != panorama::Off) {
+            const auto samples = std::max<uint64_t>(pp->MultiSampleType, 1);
+            layout.fixed_bytes += static_cast<uint64_t>(total_width) * h * (color_bytes + depth_bytes) * samples;
+        }
+        // The camera render targets are also counted with the panoramic projection, as they are created if it falls back
+        for (const auto& [i, msaa] : std::views::enumerate(g::camera_msaa)) {
+            auto screen = budget::Screen { std::max<uint32_t>(msaa, 1), color_bytes };
+            if (i > 0) {
+                // History image of reprojection and interlacing, see save_reprojection_history
+                if (g::cfg.side_monitors_reprojection || g::cfg.side_monitors_interlace != interlace::Off) {
+                    screen.extra_textures++;
                 }
+                // Upscaled image of a reduced resolution screen, see upscale_camera
+                if (g::cfg.edge_adaptive_upscaling && g::cfg.cameras[i].render_scale != 1.0) {
+                    screen.extra_textures++;
+                }
+            }
+            layout.screens.push_back(screen);
+        }
+
+        // Leave room for the game's own textures
+        const auto available = static_cast<uint64_t>(dev->GetAvailableTextureMem());
+        const auto reserve = static_cast<uint64_t>(g::cfg.vram_reserve_mb) * 1024 * 1024;
+        const auto decision = budget::fit(layout, available > reserve ? available - reserve : 0);
+
+        for (size_t i = 1; i < decision.layout.screens.size(); ++i) {
+            const auto& screen = decision.layout.screens[i];
+            if (screen.samples != std::max<uint32_t>(g::camera_msaa[i], 1)) {
+                g::camera_msaa[i] = screen.samples > 1 ? get_supported_msaa(d3d, adapter, device_type, pp, static_cast<D3DMULTISAMPLE_TYPE>(screen.samples)) : D3DMULTISAMPLE_NONE;
+            }
+            if (screen.color_bytes != color_bytes) {
+                formats[i] = side_format_16bit;
             }
         }
-        return g::hooks::draw_primitive.call(This, PrimitiveType, StartVertex, PrimitiveCount);
+        g::vram_report = budget::describe(decision);
+        dbg(std::format("Video memory budget: {}", g::vram_report));
+    }
+
+    const std::string& get_vram_report()
+    {
+        return g::vram_report;
+    }
+
+    const std::optional<M4>& get_pass_view()
+    {
+        return history::pass_view;
+    }
+
+    const drawanalyzer::Report& get_draw_analysis()
+    {
+        return g::draw_analysis.report();
+    }
+
+    D3DMULTISAMPLE_TYPE get_camera_msaa(RenderTarget tgt)
+    {
+        return tgt < g::camera_msaa.size() ? g::camera_msaa[tgt] : D3DMULTISAMPLE_NONE;
     }
 
     HRESULT __stdcall CreateDevice(
@@ -226,10 +2436,15 @@ namespace dx {
             return ret;
         }
         *ppReturnedDeviceInterface = dev;
+        g::multithreaded_device = (BehaviorFlags & D3DCREATE_MULTITHREADED) != 0;
+        if (g::multithreaded_device) {
+            dbg("The device is multithreaded, dynamic buffer uploads are not deduplicated");
+        }
 
         const auto w = pPresentationParameters->BackBufferWidth;
         const auto h = pPresentationParameters->BackBufferHeight;
         g::cfg = g::saved_cfg = Config::from_path("Plugins", { 0, 0, w, h });
+        g::draw_filter.compile(g::cfg.draw_filter);
 
         auto windowClass = "window";
         HINSTANCE instance = GetModuleHandleA(nullptr);
@@ -264,37 +2479,81 @@ namespace dx {
             g::hooks::set_transform = Hook(devvtbl->SetTransform, SetTransform);
             g::hooks::present = Hook(devvtbl->Present, Present);
             g::hooks::create_vertex_shader = Hook(devvtbl->CreateVertexShader, CreateVertexShader);
+            g::hooks::set_vertex_shader = Hook(devvtbl->SetVertexShader, SetVertexShader);
             g::hooks::draw_primitive = Hook(devvtbl->DrawPrimitive, DrawPrimitive);
+            g::hooks::draw_indexed_primitive = Hook(devvtbl->DrawIndexedPrimitive, DrawIndexedPrimitive);
+            g::hooks::set_sampler_state = Hook(devvtbl->SetSamplerState, SetSamplerState);
+            g::hooks::set_viewport = Hook(devvtbl->SetViewport, SetViewport);
+            g::hooks::set_render_target = Hook(devvtbl->SetRenderTarget, SetRenderTarget);
+            g::hooks::clear = Hook(devvtbl->Clear, Clear);
+            g::hooks::draw_primitive_up = Hook(devvtbl->DrawPrimitiveUP, DrawPrimitiveUP);
+            g::hooks::draw_indexed_primitive_up = Hook(devvtbl->DrawIndexedPrimitiveUP, DrawIndexedPrimitiveUP);
+            g::hooks::create_vertex_buffer = Hook(devvtbl->CreateVertexBuffer, CreateVertexBuffer);
+            g::hooks::create_index_buffer = Hook(devvtbl->CreateIndexBuffer, CreateIndexBuffer);
+            g::hooks::create_vertex_declaration = Hook(devvtbl->CreateVertexDeclaration, CreateVertexDeclaration);
+            g::hooks::reset = Hook(devvtbl->Reset, Reset);
+            g::hooks::get_vertex_shader_constant_f = Hook(devvtbl->GetVertexShaderConstantF, GetVertexShaderConstantF);
+            g::hooks::create_state_block = Hook(devvtbl->CreateStateBlock, CreateStateBlock);
+            g::hooks::begin_state_block = Hook(devvtbl->BeginStateBlock, BeginStateBlock);
+            g::hooks::end_state_block = Hook(devvtbl->EndStateBlock, EndStateBlock);
+            g::hooks::set_render_state = Hook(devvtbl->SetRenderState, SetRenderState);
+            g::hooks::set_scissor_rect = Hook(devvtbl->SetScissorRect, SetScissorRect);
         } catch (const std::runtime_error& e) {
             dbg(e.what());
             MessageBoxA(hFocusWindow, e.what(), "Hooking failed", MB_OK);
         }
+        if (g::cfg.d3d_profiler && !profiler::install(dev)) {
+            dbg("Could not install the D3D call profiler");
+        }
 
         g::main_window = hFocusWindow;
         g::d3d_dev = dev;
 
         g::surfaces.resize(g::cfg.cameras.size());
-        auto total_width = 0;
+        g::camera_textures.resize(g::cfg.cameras.size());
+        g::camera_msaa.resize(g::cfg.cameras.size());
+        g::camera_formats.assign(g::cfg.cameras.size(), pPresentationParameters->BackBufferFormat);
+        g::camera_depth_format = pPresentationParameters->AutoDepthStencilFormat;
         for (const auto& [i, c] : std::views::enumerate(g::cfg.cameras)) {
             auto msaa = pPresentationParameters->MultiSampleType;
             if (g::cfg.aa_center_screen_only && i != RenderTarget::Primary) {
                 msaa = D3DMULTISAMPLE_NONE;
             }
+            if (c.msaa > 0) {
+                // Sample count from the camera quality profile, 1 means no anti-aliasing
+                msaa = c.msaa == 1 ? D3DMULTISAMPLE_NONE : static_cast<D3DMULTISAMPLE_TYPE>(c.msaa);
+            }
+            if (const auto supported = get_supported_msaa(This, Adapter, DeviceType, pPresentationParameters, msaa); supported != msaa) {
+                dbg(std::format("{}x anti-aliasing is not supported for screen {}, using {}x", static_cast<int>(msaa), i, static_cast<int>(supported)));
+                msaa = supported;
+            }
+            g::camera_msaa[i] = msaa;
+        }
 
-            // Make all render targets the size of the main window
-            // If the side screens are smaller, the view will be cropped
+        auto total_width = 0;
+        for (const auto& c : g::cfg.cameras) {
+            total_width += c.w();
+        }
+        if (g::cfg.vram_budget) {
+            fit_vram_budget(This, Adapter, DeviceType, pPresentationParameters, dev, total_width, g::camera_formats);
+        } else {
+            g::vram_report = "budget manager disabled";
+        }
+
+        g::active_panorama_mode = g::cfg.panorama_mode;
+        if (g::active_panorama_mode == panorama::Off) {
+            create_camera_render_targets();
+        } else {
+            // Everything is rendered in one pass into a surface the size of the whole window
             create_render_target(
                 dev,
-                &std::get<0>(g::surfaces[i]),
-                &std::get<1>(g::surfaces[i]),
+                &std::get<0>(g::panorama_surface),
+                &std::get<1>(g::panorama_surface),
                 pPresentationParameters->BackBufferFormat,
                 pPresentationParameters->AutoDepthStencilFormat,
-                msaa,
-                g::cfg.cameras[0].w(),
+                pPresentationParameters->MultiSampleType,
+                total_width,
                 g::cfg.cameras[0].h());
-
-            // Calculate total_width for creating a swapchain for a large (combined width) window
-            total_width += g::cfg.cameras[i].w();
         }
 
         pPresentationParameters->hDeviceWindow = g::main_window;
@@ -1,19 +1,70 @@
 #pragma once
 
+#include "DrawAnalyzer.hpp"
+#include "Offscreen.hpp"
+#include "Pacing.hpp"
 #include "RenderTarget.hpp"
 #include <d3d9.h>
+#include <string>
 
 namespace dx {
     void set_render_target(RenderTarget tgt, bool clear = true);
+    bool is_panorama_enabled();
+    D3DMULTISAMPLE_TYPE get_camera_msaa(RenderTarget tgt);
+    const std::string& get_vram_report();
+    const drawanalyzer::Report& get_draw_analysis();
+    // Rotation of a side camera around the vertical axis
+    float get_camera_angle(RenderTarget tgt);
+    // View matrix set by the game in the current camera pass, if it has set one
+    const std::optional<glm::mat4>& get_pass_view();
+    // Projection and view of a camera, known if the game has set its view in this or the previous frame
+    std::optional<glm::mat4> get_camera_view_projection(RenderTarget tgt);
+    // Hash of the shader constants, transformations and draws of the last primary pass, changes if anything
+    // in the scene moves. Dynamic vertex buffer contents are not included.
+    uint32_t get_scene_hash();
+    void clear_camera(RenderTarget tgt);
+    void save_reprojection_history(RenderTarget tgt);
+    void reproject(RenderTarget tgt);
+    bool begin_interlaced_pass(RenderTarget tgt);
+    void end_interlaced_pass(RenderTarget tgt);
+    // The game's render function is called for a camera pass, with the camera's surface as the render target
+    void begin_game_pass(RenderTarget tgt);
+    void end_game_pass();
+    const std::vector<offscreen::Pass>& get_offscreen_passes();
+    // Frame times of the last complete window of frames
+    const std::optional<pacing::FrameTimes>& get_frame_times();
 
     // Hooked functions
     HRESULT __stdcall CreateVertexShader(IDirect3DDevice9* This, const DWORD* pFunction, IDirect3DVertexShader9** ppShader);
+    HRESULT __stdcall SetVertexShader(IDirect3DDevice9* This, IDirect3DVertexShader9* pShader);
     HRESULT __stdcall Present(IDirect3DDevice9* This, const RECT* pSourceRect, const RECT* pDestRect, HWND hDestWindowOverride, const RGNDATA* pDirtyRegion);
     HRESULT __stdcall SetVertexShaderConstantF(IDirect3DDevice9* This, UINT StartRegister, const float* pConstantData, UINT Vector4fCount);
     HRESULT __stdcall SetTransform(IDirect3DDevice9* This, D3DTRANSFORMSTATETYPE State, const D3DMATRIX* pMatrix);
     HRESULT __stdcall BTB_SetRenderTarget(IDirect3DDevice9* This, DWORD RenderTargetIndex, IDirect3DSurface9* pRenderTarget);
     HRESULT __stdcall DrawPrimitive(IDirect3DDevice9* This, D3DPRIMITIVETYPE PrimitiveType, UINT StartVertex, UINT PrimitiveCount);
+    HRESULT __stdcall SetSamplerState(IDirect3DDevice9* This, DWORD Sampler, D3DSAMPLERSTATETYPE Type, DWORD Value);
+    HRESULT __stdcall SetViewport(IDirect3DDevice9* This, const D3DVIEWPORT9* pViewport);
     HRESULT __stdcall DrawIndexedPrimitive(IDirect3DDevice9* This, D3DPRIMITIVETYPE PrimitiveType, INT BaseVertexIndex, UINT MinVertexIndex, UINT NumVertices, UINT startIndex, UINT primCount);
+    HRESULT __stdcall DrawPrimitiveUP(IDirect3DDevice9* This, D3DPRIMITIVETYPE PrimitiveType, UINT PrimitiveCount, const void* pVertexStreamZeroData, UINT VertexStreamZeroStride);
+    HRESULT __stdcall DrawIndexedPrimitiveUP(IDirect3DDevice9* This, D3DPRIMITIVETYPE PrimitiveType, UINT MinVertexIndex, UINT NumVertices, UINT PrimitiveCount, const void* pIndexData, D3DFORMAT IndexDataFormat, const void* pVertexStreamZeroData, UINT VertexStreamZeroStride);
+    HRESULT __stdcall SetRenderTarget(IDirect3DDevice9* This, DWORD RenderTargetIndex, IDirect3DSurface9* pRenderTarget);
+    HRESULT __stdcall Clear(IDirect3DDevice9* This, DWORD Count, const D3DRECT* pRects, DWORD Flags, D3DCOLOR Color, float Z, DWORD Stencil);
+    HRESULT __stdcall VertexBuffer_Lock(IDirect3DVertexBuffer9* This, UINT OffsetToLock, UINT SizeToLock, void** ppbData, DWORD Flags);
+    HRESULT __stdcall VertexBuffer_Unlock(IDirect3DVertexBuffer9* This);
+    HRESULT __stdcall IndexBuffer_Lock(IDirect3DIndexBuffer9* This, UINT OffsetToLock, UINT SizeToLock, void** ppbData, DWORD Flags);
+    HRESULT __stdcall IndexBuffer_Unlock(IDirect3DIndexBuffer9* This);
+    HRESULT __stdcall CreateVertexBuffer(IDirect3DDevice9* This, UINT Length, DWORD Usage, DWORD FVF, D3DPOOL Pool, IDirect3DVertexBuffer9** ppVertexBuffer, HANDLE* pSharedHandle);
+    HRESULT __stdcall CreateIndexBuffer(IDirect3DDevice9* This, UINT Length, DWORD Usage, D3DFORMAT Format, D3DPOOL Pool, IDirect3DIndexBuffer9** ppIndexBuffer, HANDLE* pSharedHandle);
+    HRESULT __stdcall CreateVertexDeclaration(IDirect3DDevice9* This, const D3DVERTEXELEMENT9* pVertexElements, IDirect3DVertexDeclaration9** ppDecl);
+    HRESULT __stdcall Reset(IDirect3DDevice9* This, D3DPRESENT_PARAMETERS* pPresentationParameters);
+    HRESULT __stdcall GetVertexShaderConstantF(IDirect3DDevice9* This, UINT StartRegister, float* pConstantData, UINT Vector4fCount);
+    HRESULT __stdcall CreateStateBlock(IDirect3DDevice9* This, D3DSTATEBLOCKTYPE Type, IDirect3DStateBlock9** ppSB);
+    HRESULT __stdcall BeginStateBlock(IDirect3DDevice9* This);
+    HRESULT __stdcall EndStateBlock(IDirect3DDevice9* This, IDirect3DStateBlock9** ppSB);
+    HRESULT __stdcall StateBlock_Capture(IDirect3DStateBlock9* This);
+    HRESULT __stdcall StateBlock_Apply(IDirect3DStateBlock9* This);
+    HRESULT __stdcall SetRenderState(IDirect3DDevice9* This, D3DRENDERSTATETYPE State, DWORD Value);
+    HRESULT __stdcall SetScissorRect(IDirect3DDevice9* This, const RECT* pRect);
     HRESULT __stdcall CreateDevice(IDirect3D9* This, UINT Adapter, D3DDEVTYPE DeviceType, HWND hFocusWindow, DWORD BehaviorFlags, D3DPRESENT_PARAMETERS* pPresentationParameters, IDirect3DDevice9** ppReturnedDeviceInterface);
     IDirect3D9* __stdcall Direct3DCreate9(UINT SDKVersion);
 }
\ No newline at end of file
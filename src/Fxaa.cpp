@@ -0,0 +1,100 @@
+#include "Fxaa.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+
+namespace fxaa {
+    using Color = std::array<float, 3>;
+
+    static Color unpack(uint32_t p)
+    {
+        return {
+            static_cast<float>((p >> 16) & 0xff) / 255.0f,
+            static_cast<float>((p >> 8) & 0xff) / 255.0f,
+            static_cast<float>(p & 0xff) / 255.0f,
+        };
+    }
+
+    static uint32_t pack(const Color& c)
+    {
+        const auto channel = [](float v) { return static_cast<uint32_t>(std::lround(std::clamp(v, 0.0f, 1.0f) * 255.0f)); };
+        return 0xff000000u | (channel(c[0]) << 16) | (channel(c[1]) << 8) | channel(c[2]);
+    }
+
+    static float luma(const Color& c)
+    {
+        return 0.299f * c[0] + 0.587f * c[1] + 0.114f * c[2];
+    }
+
+    // Bilinear sample at pixel coordinates, pixel centers are at integers.
+    // The position is clamped to the outermost pixel centers like the texture coordinates in the shader.
+    static Color sample(const uint32_t* src, uint32_t w, uint32_t h, float x, float y)
+    {
+        x = std::clamp(x, 0.0f, static_cast<float>(w - 1));
+        y = std::clamp(y, 0.0f, static_cast<float>(h - 1));
+        const auto x0 = static_cast<uint32_t>(x);
+        const auto y0 = static_cast<uint32_t>(y);
+        const auto x1 = std::min(x0 + 1, w - 1);
+        const auto y1 = std::min(y0 + 1, h - 1);
+        const auto fx = x - static_cast<float>(x0);
+        const auto fy = y - static_cast<float>(y0);
+
+        const auto a = unpack(src[y0 * w + x0]);
+        const auto b = unpack(src[y0 * w + x1]);
+        const auto c = unpack(src[y1 * w + x0]);
+        const auto d = unpack(src[y1 * w + x1]);
+        Color ret;
+        for (int ch = 0; ch < 3; ++ch) {
+            const auto top = a[ch] + (b[ch] - a[ch]) * fx;
+            const auto bottom = c[ch] + (d[ch] - c[ch]) * fx;
+            ret[ch] = top + (bottom - top) * fy;
+        }
+        return ret;
+    }
+
+    void apply(const uint32_t* src, uint32_t* dst, uint32_t w, uint32_t h)
+    {
+        for (uint32_t y = 0; y < h; ++y) {
+            for (uint32_t x = 0; x < w; ++x) {
+                const auto px = static_cast<float>(x);
+                const auto py = static_cast<float>(y);
+                const auto m = unpack(src[y * w + x]);
+                const auto luma_m = luma(m);
+                const auto luma_nw = luma(sample(src, w, h, px - 0.5f, py - 0.5f));
+                const auto luma_ne = luma(sample(src, w, h, px + 0.5f, py - 0.5f));
+                const auto luma_sw = luma(sample(src, w, h, px - 0.5f, py + 0.5f));
+                const auto luma_se = luma(sample(src, w, h, px + 0.5f, py + 0.5f));
+
+                const auto luma_min = std::min({ luma_m, luma_nw, luma_ne, luma_sw, luma_se });
+                const auto luma_max = std::max({ luma_m, luma_nw, luma_ne, luma_sw, luma_se });
+                if (luma_max - luma_min < std::max(EDGE_THRESHOLD_MIN, luma_max * EDGE_THRESHOLD)) {
+                    dst[y * w + x] = pack(m);
+                    continue;
+                }
+
+                // Blur along the edge, which is perpendicular to the luma gradient
+                auto dir_x = -((luma_nw + luma_ne) - (luma_sw + luma_se));
+                auto dir_y = (luma_nw + luma_sw) - (luma_ne + luma_se);
+                const auto dir_reduce = std::max((luma_nw + luma_ne + luma_sw + luma_se) * (0.25f * REDUCE_MUL), REDUCE_MIN);
+                const auto rcp_dir_min = 1.0f / (std::min(std::abs(dir_x), std::abs(dir_y)) + dir_reduce);
+                dir_x = std::clamp(dir_x * rcp_dir_min, -SPAN_MAX, SPAN_MAX);
+                dir_y = std::clamp(dir_y * rcp_dir_min, -SPAN_MAX, SPAN_MAX);
+
+                const auto a0 = sample(src, w, h, px + dir_x * (1.0f / 3.0f - 0.5f), py + dir_y * (1.0f / 3.0f - 0.5f));
+                const auto a1 = sample(src, w, h, px + dir_x * (2.0f / 3.0f - 0.5f), py + dir_y * (2.0f / 3.0f - 0.5f));
+                const auto b0 = sample(src, w, h, px - dir_x * 0.5f, py - dir_y * 0.5f);
+                const auto b1 = sample(src, w, h, px + dir_x * 0.5f, py + dir_y * 0.5f);
+                Color rgb_a, rgb_b;
+                for (int ch = 0; ch < 3; ++ch) {
+                    rgb_a[ch] = 0.5f * (a0[ch] + a1[ch]);
+                    rgb_b[ch] = 0.5f * rgb_a[ch] + 0.25f * (b0[ch] + b1[ch]);
+                }
+
+                // The wider blur may have crossed to another edge
+                const auto luma_b = luma(rgb_b);
+                dst[y * w + x] = pack(luma_b < luma_min || luma_b > luma_max ? rgb_a : rgb_b);
+            }
+        }
+    }
+}
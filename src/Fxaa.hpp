@@ -0,0 +1,20 @@
+#pragma once
+
+#include <cstdint>
+
+// Fast approximate anti-aliasing (FXAA, console variant) for the screens rendered without
+// multisampling. The compositor pixel shader runs the same filter per screen, this is
+// the CPU reference of it.
+namespace fxaa {
+    // Edges with a smaller luma contrast than this are left alone
+    constexpr float EDGE_THRESHOLD = 1.0f / 8.0f;
+    constexpr float EDGE_THRESHOLD_MIN = 1.0f / 32.0f;
+    // Limits of the blur along the edge, in pixels
+    constexpr float REDUCE_MUL = 1.0f / 8.0f;
+    constexpr float REDUCE_MIN = 1.0f / 128.0f;
+    constexpr float SPAN_MAX = 8.0f;
+
+    // Filter a w * h image. Pixels are packed as 0xAARRGGBB like D3DFMT_A8R8G8B8,
+    // alpha is not filtered and is set to opaque.
+    void apply(const uint32_t* src, uint32_t* dst, uint32_t w, uint32_t h);
+}
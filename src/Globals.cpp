@@ -16,6 +16,9 @@ namespace g {
     IDirect3DSurface9* original_depth_stencil_target;
     uint8_t* btb_track_status_ptr;
     M4 projection_matrix[3];
+    panorama::Projection panorama_projection;
+    FrameStats frame_stats;
+    FrameStats previous_frame_stats;
     IDirect3DSwapChain9* swapchain;
 
     namespace hooks {
@@ -26,8 +29,26 @@ namespace g {
         Hook<decltype(IDirect3DDevice9Vtbl::SetTransform)> set_transform;
         Hook<decltype(IDirect3DDevice9Vtbl::Present)> present;
         Hook<decltype(IDirect3DDevice9Vtbl::CreateVertexShader)> create_vertex_shader;
+        Hook<decltype(IDirect3DDevice9Vtbl::SetVertexShader)> set_vertex_shader;
         Hook<decltype(IDirect3DDevice9Vtbl::SetRenderTarget)> btb_set_render_target;
         Hook<decltype(IDirect3DDevice9Vtbl::DrawPrimitive)> draw_primitive;
+        Hook<decltype(IDirect3DDevice9Vtbl::DrawIndexedPrimitive)> draw_indexed_primitive;
+        Hook<decltype(IDirect3DDevice9Vtbl::SetSamplerState)> set_sampler_state;
+        Hook<decltype(IDirect3DDevice9Vtbl::SetViewport)> set_viewport;
+        Hook<decltype(IDirect3DDevice9Vtbl::SetRenderTarget)> set_render_target;
+        Hook<decltype(IDirect3DDevice9Vtbl::Clear)> clear;
+        Hook<decltype(IDirect3DDevice9Vtbl::DrawPrimitiveUP)> draw_primitive_up;
+        Hook<decltype(IDirect3DDevice9Vtbl::DrawIndexedPrimitiveUP)> draw_indexed_primitive_up;
+        Hook<decltype(IDirect3DDevice9Vtbl::CreateVertexBuffer)> create_vertex_buffer;
+        Hook<decltype(IDirect3DDevice9Vtbl::CreateIndexBuffer)> create_index_buffer;
+        Hook<decltype(IDirect3DDevice9Vtbl::CreateVertexDeclaration)> create_vertex_declaration;
+        Hook<decltype(IDirect3DDevice9Vtbl::Reset)> reset;
+        Hook<decltype(IDirect3DDevice9Vtbl::GetVertexShaderConstantF)> get_vertex_shader_constant_f;
+        Hook<decltype(IDirect3DDevice9Vtbl::CreateStateBlock)> create_state_block;
+        Hook<decltype(IDirect3DDevice9Vtbl::BeginStateBlock)> begin_state_block;
+        Hook<decltype(IDirect3DDevice9Vtbl::EndStateBlock)> end_state_block;
+        Hook<decltype(IDirect3DDevice9Vtbl::SetRenderState)> set_render_state;
+        Hook<decltype(IDirect3DDevice9Vtbl::SetScissorRect)> set_scissor_rect;
 
         // RBR functions
         Hook<decltype(&rbr::render)> render;
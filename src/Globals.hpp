@@ -5,6 +5,7 @@
 #include "Hook.hpp"
 #include "RBR.hpp"
 #include "RenderTarget.hpp"
+#include "Stats.hpp"
 
 #include <optional>
 
@@ -60,6 +61,15 @@ namespace g {
     // Custom projection matrix used by the plugin
     extern M4 projection_matrix[3];
 
+    // Parameters for the panoramic projection shader code, updated with the projection matrices
+    extern panorama::Projection panorama_projection;
+
+    // Performance counters of the frame being rendered
+    extern FrameStats frame_stats;
+
+    // Performance counters of the last presented frame
+    extern FrameStats previous_frame_stats;
+
     // Swapchain used to render all windows into one
     extern IDirect3DSwapChain9* swapchain;
 
@@ -72,8 +82,26 @@ namespace g {
         extern Hook<decltype(IDirect3DDevice9Vtbl::SetTransform)> set_transform;
         extern Hook<decltype(IDirect3DDevice9Vtbl::Present)> present;
         extern Hook<decltype(IDirect3DDevice9Vtbl::CreateVertexShader)> create_vertex_shader;
+        extern Hook<decltype(IDirect3DDevice9Vtbl::SetVertexShader)> set_vertex_shader;
         extern Hook<decltype(IDirect3DDevice9Vtbl::SetRenderTarget)> btb_set_render_target;
         extern Hook<decltype(IDirect3DDevice9Vtbl::DrawPrimitive)> draw_primitive;
+        extern Hook<decltype(IDirect3DDevice9Vtbl::DrawIndexedPrimitive)> draw_indexed_primitive;
+        extern Hook<decltype(IDirect3DDevice9Vtbl::SetSamplerState)> set_sampler_state;
+        extern Hook<decltype(IDirect3DDevice9Vtbl::SetViewport)> set_viewport;
+        extern Hook<decltype(IDirect3DDevice9Vtbl::SetRenderTarget)> set_render_target;
+        extern Hook<decltype(IDirect3DDevice9Vtbl::Clear)> clear;
+        extern Hook<decltype(IDirect3DDevice9Vtbl::DrawPrimitiveUP)> draw_primitive_up;
+        extern Hook<decltype(IDirect3DDevice9Vtbl::DrawIndexedPrimitiveUP)> draw_indexed_primitive_up;
+        extern Hook<decltype(IDirect3DDevice9Vtbl::CreateVertexBuffer)> create_vertex_buffer;
+        extern Hook<decltype(IDirect3DDevice9Vtbl::CreateIndexBuffer)> create_index_buffer;
+        extern Hook<decltype(IDirect3DDevice9Vtbl::CreateVertexDeclaration)> create_vertex_declaration;
+        extern Hook<decltype(IDirect3DDevice9Vtbl::Reset)> reset;
+        extern Hook<decltype(IDirect3DDevice9Vtbl::GetVertexShaderConstantF)> get_vertex_shader_constant_f;
+        extern Hook<decltype(IDirect3DDevice9Vtbl::CreateStateBlock)> create_state_block;
+        extern Hook<decltype(IDirect3DDevice9Vtbl::BeginStateBlock)> begin_state_block;
+        extern Hook<decltype(IDirect3DDevice9Vtbl::EndStateBlock)> end_state_block;
+        extern Hook<decltype(IDirect3DDevice9Vtbl::SetRenderState)> set_render_state;
+        extern Hook<decltype(IDirect3DDevice9Vtbl::SetScissorRect)> set_scissor_rect;
 
         // RBR functions
         extern Hook<decltype(&rbr::render)> render;
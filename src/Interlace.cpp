@@ -0,0 +1,43 @@
+#include "Interlace.hpp"
+
+namespace interlace {
+    std::array<uint8_t, PATTERN_SIZE * PATTERN_SIZE> skipped_pixel_mask(Mode mode, uint32_t parity)
+    {
+        std::array<uint8_t, PATTERN_SIZE * PATTERN_SIZE> ret;
+        for (uint32_t y = 0; y < PATTERN_SIZE; ++y) {
+            for (uint32_t x = 0; x < PATTERN_SIZE; ++x) {
+                ret[y * PATTERN_SIZE + x] = is_rendered(mode, parity, x, y) ? 0 : 0xff;
+            }
+        }
+        return ret;
+    }
+
+    void reconstruct(Mode mode, uint32_t parity, const uint32_t* current, const uint32_t* previous, uint32_t* out, uint32_t w, uint32_t h)
+    {
+        for (uint32_t y = 0; y < h; ++y) {
+            for (uint32_t x = 0; x < w; ++x) {
+                const auto i = y * w + x;
+                out[i] = is_rendered(mode, parity, x, y) ? current[i] : previous[i];
+            }
+        }
+    }
+
+    const char* to_string(Mode mode)
+    {
+        switch (mode) {
+            case Lines: return "lines";
+            case Checkerboard: return "checkerboard";
+            default: return "off";
+        }
+    }
+
+    Mode from_string(std::string_view str)
+    {
+        if (str == "lines") {
+            return Lines;
+        } else if (str == "checkerboard") {
+            return Checkerboard;
+        }
+        return Off;
+    }
+}
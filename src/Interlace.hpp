@@ -0,0 +1,43 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <string_view>
+
+// Interlaced rendering of the side monitors. Each side pass renders only half of the pixels,
+// alternating between the halves, and the other half is filled in from the previous image.
+// The halves are made of whole 2x2 pixel quads: the GPU shades pixels in quads, so masking single
+// pixels out of a quad would save nothing.
+namespace interlace {
+    enum Mode : uint32_t {
+        Off = 0,
+        Lines = 1,
+        Checkerboard = 2,
+    };
+
+    // Pixels are rendered or skipped in QUAD_SIZE x QUAD_SIZE blocks, and the pattern repeats every two blocks
+    constexpr uint32_t QUAD_SIZE = 2;
+    constexpr uint32_t PATTERN_SIZE = 2 * QUAD_SIZE;
+
+    // Check if a pixel is rendered in a pass with the given parity
+    constexpr bool is_rendered(Mode mode, uint32_t parity, uint32_t x, uint32_t y)
+    {
+        const auto qx = x / QUAD_SIZE;
+        const auto qy = y / QUAD_SIZE;
+        switch (mode) {
+            case Lines: return ((qy & 1) ^ (parity & 1)) == 0;
+            case Checkerboard: return (((qx ^ qy) & 1) ^ (parity & 1)) == 0;
+            default: return true;
+        }
+    }
+
+    // Alpha mask of the pixels that are not rendered with the given parity, row by row
+    std::array<uint8_t, PATTERN_SIZE * PATTERN_SIZE> skipped_pixel_mask(Mode mode, uint32_t parity);
+
+    // CPU reference of the reconstruction: the rendered pixels come from `current`
+    // and the rest from `previous`. All images are w * h pixels.
+    void reconstruct(Mode mode, uint32_t parity, const uint32_t* current, const uint32_t* previous, uint32_t* out, uint32_t w, uint32_t h);
+
+    const char* to_string(Mode mode);
+    Mode from_string(std::string_view str);
+}
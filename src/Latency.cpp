@@ -0,0 +1,20 @@
+#include "Latency.hpp"
+
+namespace latency {
+    std::optional<uint32_t> FrameQueue::present(int64_t now)
+    {
+        if (count == QUERY_COUNT) {
+            return std::nullopt;
+        }
+        const auto query = (first + count) % QUERY_COUNT;
+        present_times[query] = now;
+        count++;
+        return query;
+    }
+
+    void FrameQueue::reset()
+    {
+        first = 0;
+        count = 0;
+    }
+}
@@ -0,0 +1,140 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <optional>
+
+// Limit of the frames queued to the GPU. An event query is issued after each Present, and before the next
+// frame is started the CPU waits until no more than `max_frames - 1` of the earlier frames are unfinished,
+// so that the driver does not buffer frames whose input is already old when they are shown.
+// Does not depend on D3D: the clock is given by the caller, and the queries are D3D9 style objects of
+// a type given by the caller.
+namespace latency {
+    // Largest limit, and the event queries in the ring with one to spare
+    constexpr uint32_t MAX_FRAMES_IN_FLIGHT = 3;
+    constexpr uint32_t QUERY_COUNT = MAX_FRAMES_IN_FLIGHT + 1;
+
+    // A query that has not signaled in this long is given up on, i.e. when the device is lost
+    constexpr int64_t TIMEOUT_NS = 100'000'000;
+
+    // Values of D3DISSUE_END and D3DGETDATA_FLUSH, and the results of GetData: S_OK when the query
+    // has signaled and S_FALSE while it's pending
+    constexpr uint32_t ISSUE_END = 1;
+    constexpr uint32_t GET_DATA_FLUSH = 1;
+    constexpr long RESULT_OK = 0;
+    constexpr long RESULT_PENDING = 1;
+
+    struct Wait {
+        // Frames unfinished when the wait started, the time waited and whether the wait gave up
+        uint32_t frames_in_flight;
+        int64_t wait_ns;
+        bool timed_out;
+    };
+
+    class FrameQueue {
+        // Present times of the frames in flight, in a ring with one query per entry
+        std::array<int64_t, QUERY_COUNT> present_times {};
+        uint32_t first = 0;
+        uint32_t count = 0;
+        // Time from Present until the GPU was seen to finish the last finished frame
+        std::optional<int64_t> latency_ns;
+
+    public:
+        // Query to issue at the end of the frame presented now, or nothing if all of them are in flight
+        std::optional<uint32_t> present(int64_t now);
+
+        // Waits until fewer than `max_frames` frames are unfinished. `is_signaled(query)` polls a query,
+        // and `idle()` is called between the polls. The frames that finished before the wait are also
+        // read, to keep the latency estimate current.
+        template <typename Now, typename IsSignaled, typename Idle>
+        Wait wait(uint32_t max_frames, Now&& now, IsSignaled&& is_signaled, Idle&& idle)
+        {
+            const auto start = now();
+            auto ret = Wait { count, 0, false };
+            while (count > 0) {
+                if (is_signaled(first)) {
+                    latency_ns = now() - present_times[first];
+                    first = (first + 1) % QUERY_COUNT;
+                    count--;
+                } else if (count < max_frames) {
+                    break;
+                } else if (now() - start > TIMEOUT_NS) {
+                    reset();
+                    ret.timed_out = true;
+                    break;
+                } else {
+                    idle();
+                }
+            }
+            ret.wait_ns = now() - start;
+            return ret;
+        }
+
+        // An upper bound, as the queries are only polled once per frame unless the CPU waits for them
+        std::optional<int64_t> latency() const { return latency_ns; }
+
+        // Forgets the frames in flight, i.e. when the queries are released
+        void reset();
+    };
+
+    // The frame queue with an event query per entry. `Query` has the Issue, GetData and Release methods of
+    // IDirect3DQuery9, and the device passed to `create` the CreateQuery method of IDirect3DDevice9.
+    template <typename Query>
+    class FrameQueries {
+        std::array<Query*, QUERY_COUNT> queries {};
+        bool failed = false;
+        FrameQueue queue;
+
+    public:
+        // Creates the queries on first use. If any of them can't be created, the ones that were are released
+        // and it's not tried again.
+        template <typename Device, typename QueryType>
+        bool create(Device* device, QueryType event_type)
+        {
+            if (queries[0] || failed) {
+                return !failed;
+            }
+            for (auto& query : queries) {
+                if (device->CreateQuery(event_type, &query) != RESULT_OK) {
+                    query = nullptr;
+                    release();
+                    failed = true;
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        bool has_failed() const { return failed; }
+
+        // Issues the query of the frame presented now and waits as FrameQueue::wait does. Errors of GetData,
+        // i.e. a lost device, count as signaled so that they don't hold the frame.
+        template <typename Now, typename Idle>
+        Wait present(uint32_t max_frames, Now&& now, Idle&& idle)
+        {
+            if (const auto query = queue.present(now())) {
+                queries[query.value()]->Issue(ISSUE_END);
+            }
+            return queue.wait(
+                max_frames, now,
+                [this](uint32_t query) { return queries[query]->GetData(nullptr, 0, GET_DATA_FLUSH) != RESULT_PENDING; },
+                idle);
+        }
+
+        std::optional<int64_t> latency() const { return queue.latency(); }
+
+        // Forgets the frames in flight, i.e. when the limit is turned off
+        void reset() { queue.reset(); }
+
+        void release()
+        {
+            for (auto& query : queries) {
+                if (query) {
+                    query->Release();
+                    query = nullptr;
+                }
+            }
+            queue.reset();
+        }
+    };
+}
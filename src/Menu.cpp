@@ -1,6 +1,10 @@
 #include "Menu.hpp"
 #include "Config.hpp"
+#include "Dx.hpp"
 #include "Globals.hpp"
+#include "Latency.hpp"
+#include "Pacing.hpp"
+#include "Profiler.hpp"
 
 #include <array>
 #include <format>
@@ -69,6 +73,41 @@ static void toggle_side_monitor_setting(bool forward)
     }
 }
 
+static void toggle_profiler()
+{
+    g::cfg.d3d_profiler = !g::cfg.d3d_profiler;
+    if (g::cfg.d3d_profiler) {
+        if (!profiler::install(g::d3d_dev)) {
+            g::cfg.d3d_profiler = false;
+        }
+    } else {
+        profiler::uninstall();
+    }
+}
+
+// Per pass values of the last profiled frame, the camera passes first and then the work outside of them
+template <typename F>
+static std::string format_passes(F value)
+{
+    const auto& frame = profiler::last_frame();
+    auto ret = std::string {};
+    for (size_t pass = 0; pass < profiler::OUTSIDE_PASSES; ++pass) {
+        ret += std::format("{}{}", pass == 0 ? "" : " / ", value(frame, pass));
+    }
+    return ret + std::format(" + {} outside", value(frame, profiler::OUTSIDE_PASSES));
+}
+
+// How much the side screens add to the work of the primary screen
+static double side_screen_overhead(uint32_t (*value)(const profiler::Frame&, size_t))
+{
+    const auto& frame = profiler::last_frame();
+    const auto primary = value(frame, RenderTarget::Primary);
+    if (primary == 0) {
+        return 0.0;
+    }
+    return 100.0 * (value(frame, RenderTarget::Left) + value(frame, RenderTarget::Right)) / primary;
+}
+
 // clang-format off
 static class Menu main_menu = { "openRBRTriples", {
   { .text = [] { return std::format("Run side monitors with half FPS: {}", g::cfg.side_monitors_half_hz ? (g::cfg.side_monitors_half_hz_btb_only ? "BTB only" : "ON") : "OFF"); },
@@ -79,12 +118,152 @@ static class Menu main_menu = { "openRBRTriples", {
     .right_action = [] { toggle_side_monitor_setting(true); },
     .select_action = [] { toggle_side_monitor_setting(true); },
   },
+  { .text = [] { return std::format("Side monitor frame rate: 1/{}", g::cfg.side_monitors_frame_divisor); },
+    .long_text = {"How often the side monitors are rendered when running them with reduced FPS."},
+    .left_action = [] { g::cfg.side_monitors_frame_divisor = std::max(2, g::cfg.side_monitors_frame_divisor - 1); },
+    .right_action = [] { g::cfg.side_monitors_frame_divisor = std::min(4, g::cfg.side_monitors_frame_divisor + 1); },
+    .visible = [] { return g::cfg.side_monitors_half_hz; },
+  },
+  { .text = [] { return std::format("Reproject skipped side monitor frames: {}", g::cfg.side_monitors_reprojection ? "ON" : "OFF"); },
+    .long_text = {"Rotate the last image of a side monitor with the camera", "on frames where it is not rendered. Reduces judder when turning."},
+    .left_action = [] { Toggle(g::cfg.side_monitors_reprojection); },
+    .right_action = [] { Toggle(g::cfg.side_monitors_reprojection); },
+    .select_action = [] { Toggle(g::cfg.side_monitors_reprojection); },
+    .visible = [] { return g::cfg.side_monitors_half_hz; },
+  },
+  { .text = [] { return std::format("Reuse static side monitor images: {}", g::cfg.reuse_static_side_images ? "ON" : "OFF"); },
+    .long_text = {"Show the last side monitor images while nothing moves in the pause, menus and replays,", "and don't render the side monitors when loading."},
+    .left_action = [] { Toggle(g::cfg.reuse_static_side_images); },
+    .right_action = [] { Toggle(g::cfg.reuse_static_side_images); },
+    .select_action = [] { Toggle(g::cfg.reuse_static_side_images); },
+  },
+  { .text = [] { return std::format("Interlaced side monitors: {}", interlace::to_string(g::cfg.side_monitors_interlace)); },
+    .long_text = {"Render only every other line or pixel of the side monitors on each frame", "and fill in the rest from the previous frame."},
+    .left_action = [] { g::cfg.side_monitors_interlace = static_cast<interlace::Mode>((g::cfg.side_monitors_interlace + 2) % 3); },
+    .right_action = [] { g::cfg.side_monitors_interlace = static_cast<interlace::Mode>((g::cfg.side_monitors_interlace + 1) % 3); },
+    .select_action = [] { g::cfg.side_monitors_interlace = static_cast<interlace::Mode>((g::cfg.side_monitors_interlace + 1) % 3); },
+  },
+  { .text = [] { return std::format("Camera pass order: {}", rbr::to_string(g::cfg.camera_pass_order)); },
+    .long_text = {"Render the side monitors first and the center screen last,", "so that the center screen shows the newest image."},
+    .left_action = [] { g::cfg.camera_pass_order = static_cast<rbr::PassOrder>((g::cfg.camera_pass_order + 1) % 2); },
+    .right_action = [] { g::cfg.camera_pass_order = static_cast<rbr::PassOrder>((g::cfg.camera_pass_order + 1) % 2); },
+    .select_action = [] { g::cfg.camera_pass_order = static_cast<rbr::PassOrder>((g::cfg.camera_pass_order + 1) % 2); },
+  },
+  { .text = [] { return std::format("Frame limiter: {}", g::cfg.frame_limiter ? "ON" : "OFF"); },
+    .long_text = {"Start the frames at even intervals and sample the input right before each frame.", "Smooths the frame times when the side monitors take turns."},
+    .left_action = [] { Toggle(g::cfg.frame_limiter); },
+    .right_action = [] { Toggle(g::cfg.frame_limiter); },
+    .select_action = [] { Toggle(g::cfg.frame_limiter); },
+  },
+  { .text = [] { return std::format("Frame limit: {} FPS", g::cfg.frame_limit_fps); },
+    .long_text = {"Frame rate of the frame limiter."},
+    .left_action = [] { g::cfg.frame_limit_fps = std::max(20, g::cfg.frame_limit_fps - 1); },
+    .right_action = [] { g::cfg.frame_limit_fps = std::min(500, g::cfg.frame_limit_fps + 1); },
+    .visible = [] { return g::cfg.frame_limiter; },
+  },
+  { .text = [] { return std::format("Limit frames in flight: {}", g::cfg.limit_frames_in_flight ? "ON" : "OFF"); },
+    .long_text = {"Wait for the GPU before starting a frame, so that the driver does not queue", "frames with old input. Lowers the input latency when the GPU is the bottleneck."},
+    .left_action = [] { Toggle(g::cfg.limit_frames_in_flight); },
+    .right_action = [] { Toggle(g::cfg.limit_frames_in_flight); },
+    .select_action = [] { Toggle(g::cfg.limit_frames_in_flight); },
+  },
+  { .text = [] { return std::format("Max frames in flight: {}", g::cfg.max_frames_in_flight); },
+    .long_text = {"1 has the lowest latency, but the CPU and the GPU don't work at the same time.", "2 keeps the frame rate in most cases."},
+    .left_action = [] { g::cfg.max_frames_in_flight = std::max(1, g::cfg.max_frames_in_flight - 1); },
+    .right_action = [] { g::cfg.max_frames_in_flight = std::min(static_cast<int>(latency::MAX_FRAMES_IN_FLIGHT), g::cfg.max_frames_in_flight + 1); },
+    .visible = [] { return g::cfg.limit_frames_in_flight; },
+  },
   { .text = [] { return std::format("Limit anti-aliasing to center screen: {}", g::cfg.aa_center_screen_only ? "ON" : "OFF"); },
     .long_text = {"If anti-aliasing is enabled, apply it to center screen only.", "This will improve performance on cost of graphics on side monitors.", "Requires game restart to take an effect."},
     .left_action = [] { Toggle(g::cfg.aa_center_screen_only); },
     .right_action = [] { Toggle(g::cfg.aa_center_screen_only); },
     .select_action = [] { Toggle(g::cfg.aa_center_screen_only); },
   },
+  { .text = [] { return std::format("FXAA on side screens: {}", g::cfg.side_monitors_fxaa ? "ON" : "OFF"); },
+    .long_text = {"Cheap post-process anti-aliasing for the side screens", "that are rendered without multisampling."},
+    .left_action = [] { Toggle(g::cfg.side_monitors_fxaa); },
+    .right_action = [] { Toggle(g::cfg.side_monitors_fxaa); },
+    .select_action = [] { Toggle(g::cfg.side_monitors_fxaa); },
+  },
+  { .text = [] { return std::format("Panoramic projection: {}", panorama::to_string(g::cfg.panorama_mode)); },
+    .long_text = {"Render all screens in one pass by projecting the scene in the vertex shaders.", "Cylindrical has no seams, planar matches flat monitors.", "Requires game restart to take an effect."},
+    .left_action = [] { g::cfg.panorama_mode = static_cast<panorama::Mode>((g::cfg.panorama_mode + 2) % 3); },
+    .right_action = [] { g::cfg.panorama_mode = static_cast<panorama::Mode>((g::cfg.panorama_mode + 1) % 3); },
+    .select_action = [] { g::cfg.panorama_mode = static_cast<panorama::Mode>((g::cfg.panorama_mode + 1) % 3); },
+  },
+  { .text = [] { return std::format("Edge adaptive upscaling: {}", g::cfg.edge_adaptive_upscaling ? "ON" : "OFF"); },
+    .long_text = {"Upscale and sharpen the side screens rendered at a reduced resolution", "(render_scale in the config). If disabled, a plain bilinear stretch is used."},
+    .left_action = [] { Toggle(g::cfg.edge_adaptive_upscaling); },
+    .right_action = [] { Toggle(g::cfg.edge_adaptive_upscaling); },
+    .select_action = [] { Toggle(g::cfg.edge_adaptive_upscaling); },
+  },
+  { .text = [] { return std::format("Upscaling sharpness: {:.2f}", g::cfg.upscaling_sharpness); },
+    .long_text = {"Amount of sharpening after upscaling, in stops. 0 is the sharpest."},
+    .left_action = [] { g::cfg.upscaling_sharpness = std::max(0.0, g::cfg.upscaling_sharpness - 0.25); },
+    .right_action = [] { g::cfg.upscaling_sharpness = std::min(2.0, g::cfg.upscaling_sharpness + 0.25); },
+    .visible = [] { return g::cfg.edge_adaptive_upscaling; },
+  },
+  { .text = [] { return std::format("Skip redundant clears: {}", g::cfg.skip_redundant_clears ? "ON" : "OFF"); },
+    .long_text = {"Skip clearing the color of the screens when the scene covers them anyway."},
+    .left_action = [] { Toggle(g::cfg.skip_redundant_clears); },
+    .right_action = [] { Toggle(g::cfg.skip_redundant_clears); },
+    .select_action = [] { Toggle(g::cfg.skip_redundant_clears); },
+  },
+  { .text = [] { return std::format("Frustum culling: {}", g::cfg.frustum_culling ? "ON" : "OFF"); },
+    .long_text = {"Skip the draws that are outside of the camera of each screen.", "The game culls against the FoV of all screens combined."},
+    .left_action = [] { Toggle(g::cfg.frustum_culling); },
+    .right_action = [] { Toggle(g::cfg.frustum_culling); },
+    .select_action = [] { Toggle(g::cfg.frustum_culling); },
+  },
+  { .text = [] { return std::format("Rotate the game camera: {}", g::cfg.rotate_game_camera ? "ON" : "OFF"); },
+    .long_text = {"Turn the game camera towards each screen, so that the game culls the objects", "against the FoV of the screen instead of all screens combined."},
+    .left_action = [] { Toggle(g::cfg.rotate_game_camera); },
+    .right_action = [] { Toggle(g::cfg.rotate_game_camera); },
+    .select_action = [] { Toggle(g::cfg.rotate_game_camera); },
+  },
+  { .text = [] { return std::format("Skip repeated offscreen passes: {}", g::cfg.skip_repeated_offscreen_passes ? "ON" : "OFF"); },
+    .long_text = {"Render the shadow and environment maps only in the first camera pass of the frame.", "Add the view dependent ones to offscreen_always_render in the config file."},
+    .left_action = [] { Toggle(g::cfg.skip_repeated_offscreen_passes); },
+    .right_action = [] { Toggle(g::cfg.skip_repeated_offscreen_passes); },
+    .select_action = [] { Toggle(g::cfg.skip_repeated_offscreen_passes); },
+  },
+  { .text = [] { return std::format("Deduplicate buffer uploads: {}", g::cfg.deduplicate_uploads ? "ON" : "OFF"); },
+    .long_text = {"Upload the particles, rain and dust of each camera pass only if they changed.", "Keeps a copy of the dynamic vertex and index buffers in memory."},
+    .left_action = [] { Toggle(g::cfg.deduplicate_uploads); },
+    .right_action = [] { Toggle(g::cfg.deduplicate_uploads); },
+    .select_action = [] { Toggle(g::cfg.deduplicate_uploads); },
+  },
+  { .text = [] { return std::format("Batch shader constants: {}", g::cfg.batch_shader_constants ? "ON" : "OFF"); },
+    .long_text = {"Upload the vertex shader constants the game sets right before the next draw,", "merging the adjacent registers into one call."},
+    .left_action = [] { Toggle(g::cfg.batch_shader_constants); },
+    .right_action = [] { Toggle(g::cfg.batch_shader_constants); },
+    .select_action = [] { Toggle(g::cfg.batch_shader_constants); },
+  },
+  { .text = [] { return std::format("Occlusion queries: {}", g::cfg.occlusion_queries ? "ON" : "OFF"); },
+    .long_text = {"Skip the draws of the side screens that were hidden behind the cockpit in the previous frames.", "Hidden objects are tested again every few frames, so they may appear a few frames late."},
+    .left_action = [] { Toggle(g::cfg.occlusion_queries); },
+    .right_action = [] { Toggle(g::cfg.occlusion_queries); },
+    .select_action = [] { Toggle(g::cfg.occlusion_queries); },
+  },
+  { .text = [] { return std::format("Software occlusion culling: {}", g::cfg.software_occlusion ? "ON" : "OFF"); },
+    .long_text = {"Draw the large opaque objects into a small depth buffer on the CPU,", "and skip the draws behind them."},
+    .left_action = [] { Toggle(g::cfg.software_occlusion); },
+    .right_action = [] { Toggle(g::cfg.software_occlusion); },
+    .select_action = [] { Toggle(g::cfg.software_occlusion); },
+  },
+  { .text = [] { return std::format("D3D call profiler: {}", profiler::is_installed() ? "ON" : "OFF"); },
+    .long_text = {"Count the D3D9 device calls of each screen, shown in the statistics.", "Adds a small cost to every call while enabled."},
+    .left_action = [] { toggle_profiler(); },
+    .right_action = [] { toggle_profiler(); },
+    .select_action = [] { toggle_profiler(); },
+  },
+  { .text = [] { return std::format("Draw call analyzer: {}", g::cfg.draw_analyzer ? "ON" : "OFF"); },
+    .long_text = {"Count the draws of each screen that are outside of its camera, shown in the statistics.", "Reads the vertex buffers, so it's slow while enabled."},
+    .left_action = [] { Toggle(g::cfg.draw_analyzer); },
+    .right_action = [] { Toggle(g::cfg.draw_analyzer); },
+    .select_action = [] { Toggle(g::cfg.draw_analyzer); },
+  },
+  { .text = id("Statistics"), .long_text = {"Performance counters of the last frame."}, .select_action = [] { select_menu(2); } },
   { .text = id("Licenses"), .long_text = {"License information of open source libraries used in the plugin's implementation."}, .select_action = [] { select_menu(1); } },
   { .text = id("Save the current config to openRBRTriples.toml"),
     .color = [] { return (g::cfg == g::saved_cfg) ? std::make_tuple(0.5f, 0.5f, 0.5f, 1.0f) : std::make_tuple(1.0f, 1.0f, 1.0f, 1.0f); },
@@ -98,11 +277,160 @@ static class Menu main_menu = { "openRBRTriples", {
 
 static LicenseMenu license_menu;
 
+static class Menu stats_menu = { "openRBRTriples statistics", {
+  { .text = [] { return std::format("Clears avoided: {}", g::previous_frame_stats.clears_avoided); },
+    .menu_color = IRBRGame::EMenuColors::MENU_TEXT,
+    .position = Menu::menu_items_start_pos,
+  },
+  { .text = [] {
+      const auto& ms = g::previous_frame_stats.pass_to_present_ms;
+      return std::format("Pass start to Present: {:.2f} / {:.2f} / {:.2f} ms", ms[RenderTarget::Primary], ms[RenderTarget::Left], ms[RenderTarget::Right]);
+    },
+    .menu_color = IRBRGame::EMenuColors::MENU_TEXT,
+  },
+  { .text = [] {
+      const auto& times = dx::get_frame_times();
+      return std::format("Frame times: {}", times ? pacing::to_string(times.value()) : "measuring");
+    },
+    .menu_color = IRBRGame::EMenuColors::MENU_TEXT,
+  },
+  { .text = [] {
+      const auto& s = g::previous_frame_stats;
+      return std::format("Frames in flight: {}, waited {:.2f} ms, GPU finished {:.1f} ms after Present", s.frames_in_flight, s.frames_in_flight_wait_ms, s.present_to_gpu_finish_ms);
+    },
+    .menu_color = IRBRGame::EMenuColors::MENU_TEXT,
+    .visible = [] { return g::cfg.limit_frames_in_flight; },
+  },
+  { .text = [] { return std::format("Side passes reused: {}", g::previous_frame_stats.side_passes_reused); },
+    .menu_color = IRBRGame::EMenuColors::MENU_TEXT,
+    .visible = [] { return g::cfg.reuse_static_side_images; },
+  },
+  { .text = [] { return std::format("Draws culled: {} ({} primitives)", g::previous_frame_stats.draws_culled, g::previous_frame_stats.primitives_culled); },
+    .menu_color = IRBRGame::EMenuColors::MENU_TEXT,
+    .visible = [] { return g::cfg.frustum_culling; },
+  },
+  { .text = [] {
+      const auto& s = g::previous_frame_stats;
+      return std::format("Offscreen passes skipped: {} ({} draws, {} primitives)", s.offscreen_passes_skipped, s.offscreen_draws_skipped, s.offscreen_primitives_skipped);
+    },
+    .menu_color = IRBRGame::EMenuColors::MENU_TEXT,
+    .visible = [] { return g::cfg.skip_repeated_offscreen_passes; },
+  },
+  { .text = [] { return std::format("Buffer uploads skipped: {} ({} kB)", g::previous_frame_stats.uploads_skipped, g::previous_frame_stats.upload_bytes_skipped / 1024); },
+    .menu_color = IRBRGame::EMenuColors::MENU_TEXT,
+    .visible = [] { return g::cfg.deduplicate_uploads; },
+  },
+  { .text = [] { return std::format("Shader constant calls: {} set, {} uploaded", g::previous_frame_stats.shader_constant_sets, g::previous_frame_stats.shader_constant_uploads); },
+    .menu_color = IRBRGame::EMenuColors::MENU_TEXT,
+    .visible = [] { return g::cfg.batch_shader_constants; },
+  },
+  { .text = [] {
+      const auto& s = g::previous_frame_stats;
+      const auto hit_rate = s.occlusion_results ? 100.0 * s.occlusion_hits / s.occlusion_results : 0.0;
+      return std::format("Occlusion queries: {} ({:.0f}% hidden), draws skipped: {} ({} primitives)", s.occlusion_queries, hit_rate, s.occlusion_draws_skipped, s.occlusion_primitives_skipped);
+    },
+    .menu_color = IRBRGame::EMenuColors::MENU_TEXT,
+    .visible = [] { return g::cfg.occlusion_queries; },
+  },
+  { .text = [] {
+      const auto& s = g::previous_frame_stats;
+      return std::format("Occluders: {} ({} triangles), draws occluded: {} ({} primitives)", s.occluders_drawn, s.occluder_triangles, s.draws_occluded, s.primitives_occluded);
+    },
+    .menu_color = IRBRGame::EMenuColors::MENU_TEXT,
+    .visible = [] { return g::cfg.software_occlusion; },
+  },
+  { .text = id("Write the offscreen passes to the debug log"),
+    .select_action = [] {
+        for (const auto& line : offscreen::describe(dx::get_offscreen_passes())) {
+            dbg(line);
+        }
+    },
+    .visible = [] { return g::cfg.skip_repeated_offscreen_passes; },
+  },
+  { .text = [] {
+      auto samples = std::string {};
+      for (size_t i = 0; i < g::cfg.cameras.size(); ++i) {
+          const auto msaa = dx::get_camera_msaa(static_cast<RenderTarget>(i));
+          samples += std::format("{}{}", i == 0 ? "" : " / ", msaa < D3DMULTISAMPLE_2_SAMPLES ? std::string("off") : std::format("{}x", static_cast<int>(msaa)));
+      }
+      return std::format("Anti-aliasing: {}", samples);
+    },
+    .menu_color = IRBRGame::EMenuColors::MENU_TEXT,
+  },
+  { .text = [] { return std::format("Video memory: {}", dx::get_vram_report()); },
+    .menu_color = IRBRGame::EMenuColors::MENU_TEXT,
+  },
+  { .text = [] { return std::format("D3D calls: {}", format_passes([](const auto& f, size_t pass) { return f.total(pass).calls; })); },
+    .menu_color = IRBRGame::EMenuColors::MENU_TEXT,
+    .visible = [] { return profiler::is_installed(); },
+  },
+  { .text = [] { return std::format("Draw calls: {}", format_passes([](const auto& f, size_t pass) { return f.draws(pass).calls; })); },
+    .menu_color = IRBRGame::EMenuColors::MENU_TEXT,
+    .visible = [] { return profiler::is_installed(); },
+  },
+  { .text = [] { return std::format("Primitives: {}", format_passes([](const auto& f, size_t pass) { return f.draws(pass).primitives; })); },
+    .menu_color = IRBRGame::EMenuColors::MENU_TEXT,
+    .visible = [] { return profiler::is_installed(); },
+  },
+  { .text = [] { return std::format("Device time: {} ms", format_passes([](const auto& f, size_t pass) { return std::format("{:.2f}", profiler::ticks_to_ms(f.total(pass).ticks)); })); },
+    .menu_color = IRBRGame::EMenuColors::MENU_TEXT,
+    .visible = [] { return profiler::is_installed(); },
+  },
+  { .text = [] {
+      return std::format("Side screens add {:.0f}% calls and {:.0f}% draws to the primary pass",
+          side_screen_overhead([](const profiler::Frame& f, size_t pass) -> uint32_t { return f.total(pass).calls; }),
+          side_screen_overhead([](const profiler::Frame& f, size_t pass) -> uint32_t { return f.draws(pass).calls; }));
+    },
+    .menu_color = IRBRGame::EMenuColors::MENU_TEXT,
+    .visible = [] { return profiler::is_installed(); },
+  },
+  { .text = id("Write the D3D call profile to the debug log"),
+    .long_text = {"Per method breakdown of the last frame, readable with DebugView."},
+    .select_action = [] {
+        for (const auto& line : profiler::report(profiler::last_frame())) {
+            dbg(line);
+        }
+    },
+    .visible = [] { return profiler::is_installed(); },
+  },
+  { .text = [] {
+      const auto& p = dx::get_draw_analysis().passes;
+      return std::format("Draws outside the camera: {}/{} / {}/{} / {}/{}", p[0].outside, p[0].analyzed, p[1].outside, p[1].analyzed, p[2].outside, p[2].analyzed);
+    },
+    .menu_color = IRBRGame::EMenuColors::MENU_TEXT,
+    .visible = [] { return g::cfg.draw_analyzer; },
+  },
+  { .text = [] {
+      const auto& p = dx::get_draw_analysis().passes;
+      return std::format("Wasted primitives: {} / {} / {}", p[0].wasted_primitives, p[1].wasted_primitives, p[2].wasted_primitives);
+    },
+    .menu_color = IRBRGame::EMenuColors::MENU_TEXT,
+    .visible = [] { return g::cfg.draw_analyzer; },
+  },
+  { .text = [] {
+      const auto& r = dx::get_draw_analysis();
+      return std::format("Draws outside every camera: {} of {} shared", r.outside_every_pass, r.shared_draws);
+    },
+    .menu_color = IRBRGame::EMenuColors::MENU_TEXT,
+    .visible = [] { return g::cfg.draw_analyzer; },
+  },
+  { .text = id("Write the draw analysis to the debug log"),
+    .select_action = [] {
+        for (const auto& line : drawanalyzer::describe(dx::get_draw_analysis())) {
+            dbg(line);
+        }
+    },
+    .visible = [] { return g::cfg.draw_analyzer; },
+  },
+  { .text = id("Back"), .left_action = [] { select_menu(0); }, .select_action = [] { select_menu(0); } },
+}};
+
 // clang-format on
 
 static constexpr auto menus = std::to_array<class Menu*>({
     &main_menu,
     &license_menu,
+    &stats_menu,
 });
 
 Menu* g::menu = menus[0];
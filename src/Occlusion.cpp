@@ -0,0 +1,45 @@
+#include "Occlusion.hpp"
+
+namespace occlusion {
+    // Frames a draw is remembered for after it was last seen
+    constexpr uint64_t FORGET_FRAMES = 120;
+
+    void Tracker::begin_pass()
+    {
+        occurrences.clear();
+    }
+
+    Decision Tracker::draw(Key key, uint32_t retest_frames)
+    {
+        key.occurrence = 0;
+        key.occurrence = occurrences[key]++;
+
+        auto& e = entries[key];
+        e.seen_frame = frame;
+        if (e.occluded && frame - e.tested_frame < retest_frames) {
+            return { true, std::nullopt };
+        }
+        if (e.pending || slots_used == QUERY_COUNT) {
+            return { false, std::nullopt };
+        }
+        const auto query = (first_slot + slots_used) % QUERY_COUNT;
+        slots[query] = { key, frame };
+        slots_used++;
+        e.pending = true;
+        return { false, query };
+    }
+
+    void Tracker::end_frame()
+    {
+        frame++;
+        std::erase_if(entries, [this](const auto& entry) {
+            return !entry.second.pending && frame - entry.second.seen_frame > FORGET_FRAMES;
+        });
+    }
+
+    void Tracker::reset()
+    {
+        entries.clear();
+        occurrences.clear();
+    }
+}
@@ -0,0 +1,123 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <unordered_map>
+
+// Skipping of the draws that were hidden behind the cockpit in the previous frames. The expensive draws
+// of the side passes are drawn inside occlusion queries, and a draw whose query found no visible pixels
+// is skipped in the following frames until it is tested again. The query results are read from a ring
+// of queries, oldest first, without waiting for the ones the GPU has not finished.
+namespace occlusion {
+    // Queries in flight
+    constexpr uint32_t QUERY_COUNT = 128;
+
+    // Identifies a draw across the frames. It leaves out the transformation in c0 to c3, which the game sets
+    // with the view and the projection baked in and so changes whenever the camera moves. Draws of the same
+    // geometry at different places are told apart by their order in the pass instead.
+    struct Key {
+        uint32_t camera;
+        uint32_t shader_index;
+        uint32_t shader_hash;
+        const void* vertex_buffer;
+        // Null for draws without indices
+        const void* index_buffer;
+        int32_t base_vertex;
+        uint32_t primitives;
+        // First vertex or index of the draw
+        uint32_t first;
+        // Draws with the same key in the pass before this one
+        uint32_t occurrence;
+
+        bool operator==(const Key&) const = default;
+    };
+
+    struct KeyHash {
+        size_t operator()(const Key& key) const
+        {
+            auto h = std::hash<const void*> {}(key.vertex_buffer) * 31 + std::hash<const void*> {}(key.index_buffer);
+            for (const auto v : { key.camera, key.shader_index, key.shader_hash, static_cast<uint32_t>(key.base_vertex), key.primitives, key.first, key.occurrence }) {
+                h = h * 31 + std::hash<uint32_t> {}(v);
+            }
+            return h;
+        }
+    };
+
+    struct Decision {
+        bool skip;
+        // Query to draw inside of, if any
+        std::optional<uint32_t> query;
+    };
+
+    struct Results {
+        uint32_t read;
+        uint32_t occluded;
+    };
+
+    class Tracker {
+        struct Entry {
+            bool occluded;
+            bool pending;
+            // Frame of the query the result is from
+            uint64_t tested_frame;
+            uint64_t seen_frame;
+        };
+        struct Slot {
+            Key key;
+            uint64_t frame;
+        };
+
+        uint64_t frame = 0;
+        std::unordered_map<Key, Entry, KeyHash> entries;
+        std::unordered_map<Key, uint32_t, KeyHash> occurrences;
+        std::array<Slot, QUERY_COUNT> slots {};
+        uint32_t first_slot = 0;
+        uint32_t slots_used = 0;
+
+    public:
+        // Draws are counted per camera pass to tell apart the draws with the same key
+        void begin_pass();
+
+        // Decides how to draw. An occluded draw is skipped for `retest_frames` frames after its query,
+        // the other draws are queried unless there's a query in flight for them already.
+        Decision draw(Key key, uint32_t retest_frames);
+
+        // Reads the results of the queries in the order they were issued. `get_pixels(query)` returns the
+        // visible pixel count, or nothing if the query has not finished.
+        template <typename F>
+        Results poll(F&& get_pixels)
+        {
+            auto ret = Results {};
+            while (slots_used > 0) {
+                const auto pixels = get_pixels(first_slot);
+                if (!pixels) {
+                    break;
+                }
+                const auto& slot = slots[first_slot];
+                if (auto it = entries.find(slot.key); it != entries.end()) {
+                    it->second.pending = false;
+                    it->second.occluded = pixels.value() == 0;
+                    it->second.tested_frame = slot.frame;
+                    ret.occluded += it->second.occluded;
+                }
+                ret.read++;
+                first_slot = (first_slot + 1) % QUERY_COUNT;
+                slots_used--;
+            }
+            return ret;
+        }
+
+        // Forgets the draws that were not seen in a while
+        void end_frame();
+        // Forgets all the draws, i.e. when the camera changes. The queries in flight are still read.
+        void reset();
+
+        // Draws remembered
+        size_t size() const
+        {
+            return entries.size();
+        }
+    };
+}
@@ -0,0 +1,112 @@
+#include "Offscreen.hpp"
+
+#include <algorithm>
+#include <charconv>
+#include <format>
+
+namespace offscreen {
+    std::string to_string(const Target& target)
+    {
+        return std::format("{}x{}", target.width, target.height);
+    }
+
+    std::optional<Target> target_from_string(std::string_view str)
+    {
+        const auto x = str.find('x');
+        if (x == std::string_view::npos) {
+            return std::nullopt;
+        }
+        auto ret = Target {};
+        const auto w = str.substr(0, x);
+        const auto h = str.substr(x + 1);
+        if (std::from_chars(w.data(), w.data() + w.size(), ret.width).ec != std::errc {}
+            || std::from_chars(h.data(), h.data() + h.size(), ret.height).ec != std::errc {}) {
+            return std::nullopt;
+        }
+        return ret;
+    }
+
+    void Tracker::begin_camera_pass(uint32_t camera_index, const void* surface)
+    {
+        in_camera_pass = true;
+        camera = camera_index;
+        camera_surface = surface;
+        scene_started = false;
+        skipping = false;
+        current.reset();
+        used_in_camera_pass.clear();
+    }
+
+    void Tracker::end_camera_pass()
+    {
+        in_camera_pass = false;
+        skipping = false;
+        current.reset();
+        camera_passes++;
+    }
+
+    void Tracker::set_render_target(const void* surface, const Target& target, const std::vector<Target>& always_render)
+    {
+        if (!in_camera_pass) {
+            return;
+        }
+        skipping = false;
+        current.reset();
+        if (surface == camera_surface) {
+            return;
+        }
+
+        const auto first_use = used_in_camera_pass.insert(surface).second;
+        if (camera_passes == 0) {
+            auto& use = first_pass_uses[surface];
+            use.count++;
+            use.after_scene |= scene_started;
+        } else if (first_use && !scene_started && std::ranges::find(always_render, target) == always_render.end()) {
+            // A surface written to more than once in the first pass, or after the scene, may not hold what this pass needs
+            const auto use = first_pass_uses.find(surface);
+            skipping = use != first_pass_uses.end() && use->second.count == 1 && !use->second.after_scene;
+        }
+        current = passes.size();
+        passes.push_back({ .target = target, .camera = camera, .skipped = skipping });
+    }
+
+    bool Tracker::draw(uint32_t primitives)
+    {
+        if (!in_camera_pass) {
+            return false;
+        }
+        if (!current) {
+            scene_started = true;
+            return false;
+        }
+        auto& pass = passes[current.value()];
+        pass.draws++;
+        pass.primitives += primitives;
+        return skipping;
+    }
+
+    void Tracker::end_frame()
+    {
+        last_passes = std::move(passes);
+        passes.clear();
+        first_pass_uses.clear();
+        camera_passes = 0;
+        in_camera_pass = false;
+        skipping = false;
+        current.reset();
+    }
+
+    std::vector<std::string> describe(const std::vector<Pass>& passes)
+    {
+        constexpr const char* names[] = { "primary", "left", "right" };
+        auto ret = std::vector<std::string> {};
+        for (const auto& p : passes) {
+            ret.push_back(std::format("{} camera: {} render target, {} draws, {} primitives{}",
+                p.camera < std::size(names) ? names[p.camera] : "?", to_string(p.target), p.draws, p.primitives, p.skipped ? ", skipped" : ""));
+        }
+        if (passes.empty()) {
+            ret.push_back("No offscreen passes in the last frame");
+        }
+        return ret;
+    }
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+// Offscreen passes of the game, i.e. the shadow and environment maps rendered into other surfaces
+// than the camera's during a camera pass. The game renders them again in every camera pass, so the
+// passes after the first one can skip the ones that were already rendered in the frame and sample
+// the first pass's result instead.
+namespace offscreen {
+    // Size of an offscreen render target, identifies the effect in the list of the ones to always render
+    struct Target {
+        uint32_t width;
+        uint32_t height;
+
+        bool operator==(const Target&) const = default;
+    };
+
+    // "<width>x<height>"
+    std::string to_string(const Target& target);
+    std::optional<Target> target_from_string(std::string_view str);
+
+    // An offscreen pass, from switching to an offscreen surface to switching away from it
+    struct Pass {
+        Target target;
+        // Screen of the camera pass
+        uint32_t camera;
+        uint32_t draws;
+        uint64_t primitives;
+        bool skipped;
+    };
+
+    class Tracker {
+        // Uses of an offscreen surface in the first camera pass of the frame
+        struct FirstPassUse {
+            uint32_t count;
+            bool after_scene;
+        };
+
+        bool in_camera_pass = false;
+        const void* camera_surface = nullptr;
+        uint32_t camera = 0;
+        uint32_t camera_passes = 0;
+        // Set when something is drawn to the camera surface, the offscreen passes after that may sample the scene
+        bool scene_started = false;
+        bool skipping = false;
+        std::optional<size_t> current;
+        std::unordered_map<const void*, FirstPassUse> first_pass_uses;
+        std::unordered_set<const void*> used_in_camera_pass;
+        std::vector<Pass> passes;
+        std::vector<Pass> last_passes;
+
+    public:
+        // A camera pass of the game starts with the camera's surface as the render target
+        void begin_camera_pass(uint32_t camera, const void* surface);
+        void end_camera_pass();
+
+        // Render target 0 was changed. Only the first use of a surface in a camera pass is skipped,
+        // and only if the first camera pass used it once, before drawing the scene.
+        void set_render_target(const void* surface, const Target& target, const std::vector<Target>& always_render);
+
+        // Counts a draw, returns whether it should be skipped
+        bool draw(uint32_t primitives);
+        // Whether the draws and the clears of the current offscreen pass are skipped
+        bool is_skipping() const { return skipping; }
+
+        // Starts a new frame
+        void end_frame();
+
+        // Offscreen passes of the last frame, in the order they were rendered
+        const std::vector<Pass>& last_frame() const { return last_passes; }
+    };
+
+    std::vector<std::string> describe(const std::vector<Pass>& passes);
+}
@@ -0,0 +1,40 @@
+#include "Pacing.hpp"
+
+#include <cmath>
+#include <format>
+
+namespace pacing {
+    std::string to_string(const FrameTimes& times)
+    {
+        return std::format("{} frames, {:.2f} ms mean, {:.3f} ms std dev, {:.2f}..{:.2f} ms",
+            times.frames, times.mean_ms, times.stddev_ms, times.min_ms, times.max_ms);
+    }
+
+    std::optional<FrameTimes> Limiter::record(int64_t time)
+    {
+        const auto previous = frame_start;
+        frame_start = time;
+        if (!previous) {
+            return std::nullopt;
+        }
+
+        const auto ms = static_cast<double>(time - previous.value()) / 1e6;
+        count++;
+        const auto delta = ms - mean;
+        mean += delta / count;
+        m2 += delta * (ms - mean);
+        min = std::min(min, ms);
+        max = std::max(max, ms);
+        if (count < WINDOW_FRAMES) {
+            return std::nullopt;
+        }
+
+        const auto ret = FrameTimes { count, mean, std::sqrt(m2 / count), min, max };
+        count = 0;
+        mean = 0.0;
+        m2 = 0.0;
+        min = std::numeric_limits<double>::max();
+        max = 0.0;
+        return ret;
+    }
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <optional>
+#include <string>
+
+// Frame pacing. After Present, the limiter waits until the next frame is due, so that the frames start at
+// even intervals and the game samples the input and the camera right after the wait, not a frame before
+// the image is shown. The wait sleeps until shortly before the deadline and spins the rest of the way, and
+// the time left for spinning follows how late the sleeps have woken up. Does not depend on the game or the
+// OS: the clock and the sleep are given by the caller, in nanoseconds.
+namespace pacing {
+    // Frames in a window of frame time statistics
+    constexpr uint32_t WINDOW_FRAMES = 600;
+
+    struct FrameTimes {
+        uint32_t frames;
+        double mean_ms;
+        double stddev_ms;
+        double min_ms;
+        double max_ms;
+    };
+
+    std::string to_string(const FrameTimes& times);
+
+    class Limiter {
+        // Time the next frame is due, and the start of the previous frame
+        std::optional<int64_t> deadline;
+        std::optional<int64_t> frame_start;
+        // Time before the deadline that is spun instead of slept
+        int64_t spin_ns = 2'000'000;
+
+        // Frame times of the current window, with Welford's running variance
+        uint32_t count = 0;
+        double mean = 0.0;
+        double m2 = 0.0;
+        double min = std::numeric_limits<double>::max();
+        double max = 0.0;
+
+    public:
+        static constexpr int64_t MIN_SPIN_NS = 200'000;
+        static constexpr int64_t MAX_SPIN_NS = 16'000'000;
+
+        // Waits until the next frame is due at `fps` frames per second, or not at all if it's 0. `now()` returns
+        // the time and `sleep(ns)` sleeps for about that long. Returns the frame time statistics of a window
+        // when it is complete.
+        template <typename Now, typename Sleep>
+        std::optional<FrameTimes> wait(double fps, Now&& now, Sleep&& sleep)
+        {
+            if (fps <= 0.0) {
+                deadline.reset();
+            } else if (const auto period = static_cast<int64_t>(1e9 / fps); !deadline || now() - deadline.value() > period) {
+                // Start over if the frame is late by more than a frame, instead of rushing the next ones
+                deadline = now() + period;
+            } else {
+                for (auto remaining = deadline.value() - now(); remaining > 0; remaining = deadline.value() - now()) {
+                    if (remaining > spin_ns) {
+                        const auto requested = remaining - spin_ns;
+                        const auto start = now();
+                        sleep(requested);
+                        const auto late = now() - start - requested;
+                        // Follows a late wake up at once, and shrinks back slowly
+                        spin_ns = std::clamp(std::max(late + MIN_SPIN_NS, spin_ns - spin_ns / 256), MIN_SPIN_NS, MAX_SPIN_NS);
+                    }
+                }
+                deadline = deadline.value() + period;
+            }
+            return record(now());
+        }
+
+        int64_t spin_time() const { return spin_ns; }
+
+    private:
+        std::optional<FrameTimes> record(int64_t time);
+    };
+}
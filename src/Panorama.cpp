@@ -0,0 +1,531 @@
+#include "Panorama.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <numbers>
+
+namespace panorama {
+    constexpr uint32_t END_TOKEN = 0x0000ffff;
+    constexpr uint32_t COMMENT_OPCODE = 0xfffe;
+    constexpr uint32_t VERTEX_SHADER_VERSION_MASK = 0xffff0000;
+    constexpr uint32_t VERTEX_SHADER_VERSION = 0xfffe0000;
+
+    enum Opcode : uint32_t {
+        MOV = 1,
+        ADD = 2,
+        MAD = 4,
+        MUL = 5,
+        RCP = 6,
+        RSQ = 7,
+        MIN = 10,
+        MAX = 11,
+        SLT = 12,
+        DCL = 31,
+        DEF = 81,
+        DEFI = 82,
+        DEFB = 83,
+    };
+
+    enum RegisterType : uint32_t {
+        TEMP = 0,
+        CONST = 2,
+        RASTOUT = 4,
+        OUTPUT = 6,
+    };
+
+    enum WriteMask : uint32_t {
+        X = 1,
+        Y = 2,
+        Z = 4,
+        W = 8,
+    };
+
+    constexpr uint32_t DECLUSAGE_POSITION = 0;
+    constexpr uint32_t SRCMOD_NEGATE = 1;
+    constexpr uint32_t SWIZZLE_XYZW = 0xe4;
+    // Register addressed with a0, followed by a token of the address register from shader model 2 on
+    constexpr uint32_t ADDRESS_RELATIVE = 1 << 13;
+
+    // Temporary and constant register counts guaranteed by each shader model
+    constexpr uint32_t MAX_TEMPS_SM2 = 12;
+    constexpr uint32_t MAX_TEMPS_SM3 = 32;
+    constexpr uint32_t MAX_CONSTANTS = 96;
+    static_assert(CONSTANT_REGISTER + CONSTANT_COUNT == MAX_CONSTANTS);
+
+    // Instruction slots of vs_1_1, vs_2_0 and vs_3_0
+    static uint32_t max_instruction_slots(uint32_t major)
+    {
+        return major >= 3 ? 512 : major == 2 ? 256 : 128;
+    }
+
+    // Parameter token count for shader model 1 instructions, which do not
+    // have the instruction length encoded in the opcode token.
+    static int sm1_parameter_count(uint32_t opcode)
+    {
+        switch (opcode) {
+            case 0: return 0; // nop
+            case 1: return 2; // mov
+            case 2: return 3; // add
+            case 3: return 3; // sub
+            case 4: return 4; // mad
+            case 5: return 3; // mul
+            case 6: return 2; // rcp
+            case 7: return 2; // rsq
+            case 8: return 3; // dp3
+            case 9: return 3; // dp4
+            case 10: return 3; // min
+            case 11: return 3; // max
+            case 12: return 3; // slt
+            case 13: return 3; // sge
+            case 14: return 2; // exp
+            case 15: return 2; // log
+            case 16: return 2; // lit
+            case 17: return 3; // dst
+            case 18: return 4; // lrp
+            case 19: return 2; // frc
+            case 20: return 3; // m4x4
+            case 21: return 3; // m4x3
+            case 22: return 3; // m3x4
+            case 23: return 3; // m3x3
+            case 24: return 3; // m3x2
+            case 31: return 2; // dcl
+            case 78: return 2; // expp
+            case 79: return 2; // logp
+            case 81: return 5; // def
+            default: return -1;
+        }
+    }
+
+    // Instruction slots taken by an instruction. Macro instructions expand to several, and the declarations
+    // take none.
+    static uint32_t instruction_slots(uint32_t major, uint32_t opcode)
+    {
+        switch (opcode) {
+            case 14: return major < 2 ? 10 : 1; // exp
+            case 15: return major < 2 ? 10 : 1; // log
+            case 16: return major < 2 ? 3 : 1; // lit
+            case 19: return major < 2 ? 3 : 1; // frc
+            case 20: return 4; // m4x4
+            case 21: return 3; // m4x3
+            case 22: return 4; // m3x4
+            case 23: return 3; // m3x3
+            case 24: return 2; // m3x2
+            case DCL:
+            case DEF:
+            case DEFI:
+            case DEFB: return 0;
+            default: return 1;
+        }
+    }
+
+    // Matrix macro instructions read consecutive constant registers
+    static uint32_t registers_read(uint32_t opcode, size_t param)
+    {
+        if (param != 2) {
+            return 1;
+        }
+        switch (opcode) {
+            case 20: return 4; // m4x4
+            case 21: return 3; // m4x3
+            case 22: return 4; // m3x4
+            case 23: return 3; // m3x3
+            case 24: return 2; // m3x2
+            default: return 1;
+        }
+    }
+
+    static constexpr uint32_t register_type(uint32_t token)
+    {
+        return ((token >> 28) & 0x7) | ((token >> 8) & 0x18);
+    }
+
+    static constexpr uint32_t register_number(uint32_t token)
+    {
+        return token & 0x7ff;
+    }
+
+    static constexpr uint32_t register_bits(uint32_t type, uint32_t reg)
+    {
+        return 0x80000000 | ((type & 0x7) << 28) | ((type & 0x18) << 8) | (reg & 0x7ff);
+    }
+
+    static constexpr uint32_t dst(uint32_t type, uint32_t reg, uint32_t mask)
+    {
+        return register_bits(type, reg) | (mask << 16);
+    }
+
+    // Source parameter that replicates one component (0 = x ... 3 = w)
+    static constexpr uint32_t src(uint32_t type, uint32_t reg, uint32_t component, bool negate = false)
+    {
+        return register_bits(type, reg) | ((component * 0x55) << 16) | ((negate ? SRCMOD_NEGATE : 0) << 24);
+    }
+
+    // Source parameter of all four components
+    static constexpr uint32_t src_vector(uint32_t type, uint32_t reg)
+    {
+        return register_bits(type, reg) | (SWIZZLE_XYZW << 16);
+    }
+
+    struct Instruction {
+        size_t offset;
+        uint32_t opcode;
+        size_t params;
+    };
+
+    // Split the shader into instructions. Comments are skipped.
+    static std::optional<std::vector<Instruction>> parse(const uint32_t* fn, size_t* length = nullptr)
+    {
+        if (!fn || (fn[0] & VERTEX_SHADER_VERSION_MASK) != VERTEX_SHADER_VERSION) {
+            return std::nullopt;
+        }
+        const auto major = (fn[0] >> 8) & 0xff;
+
+        std::vector<Instruction> ret;
+        // Guard against reading garbage forever if the end token is missing
+        constexpr size_t max_tokens = 1 << 16;
+        size_t i = 1;
+        while (i < max_tokens) {
+            const auto token = fn[i];
+            if (token == END_TOKEN) {
+                if (length) {
+                    *length = i + 1;
+                }
+                return ret;
+            }
+            const auto opcode = token & 0xffff;
+            if (opcode == COMMENT_OPCODE) {
+                i += 1 + ((token >> 16) & 0x7fff);
+                continue;
+            }
+            size_t params;
+            if (major >= 2) {
+                params = (token >> 24) & 0xf;
+            } else {
+                const auto count = sm1_parameter_count(opcode);
+                if (count < 0) {
+                    return std::nullopt;
+                }
+                params = count;
+            }
+            ret.push_back({ i, opcode, params });
+            i += 1 + params;
+        }
+        return std::nullopt;
+    }
+
+    size_t bytecode_length(const uint32_t* fn)
+    {
+        size_t length = 0;
+        if (!parse(fn, &length)) {
+            return 0;
+        }
+        return length;
+    }
+
+    // Appends instructions to the shader, encoding the instruction length when the shader model has it
+    struct Emitter {
+        std::vector<uint32_t>& out;
+        bool encode_length;
+        uint32_t instructions = 0;
+
+        void operator()(uint32_t opcode, std::initializer_list<uint32_t> params)
+        {
+            instructions++;
+            out.push_back(opcode | (encode_length ? static_cast<uint32_t>(params.size()) << 24 : 0));
+            out.insert(out.end(), params);
+        }
+    };
+
+    // Projects the view space position in `pos` into oPos onto a cylinder around the camera.
+    // tmp..tmp+2 are used as scratch registers.
+    static void emit_cylindrical(Emitter& e, uint32_t pos, uint32_t tmp, uint32_t c, uint32_t out_type, uint32_t out_reg)
+    {
+        const auto t1 = tmp;
+        const auto t2 = tmp + 1;
+        const auto t3 = tmp + 2;
+
+        // Polynomial approximation of atan2(x, z), see constants() for the coefficients
+        e(MAX, { dst(TEMP, t1, X), src(TEMP, pos, 0), src(TEMP, pos, 0, true) }); // |x|
+        e(MAX, { dst(TEMP, t1, Y), src(TEMP, pos, 2), src(TEMP, pos, 2, true) }); // |z|
+        e(MIN, { dst(TEMP, t1, Z), src(TEMP, t1, 0), src(TEMP, t1, 1) });
+        e(MAX, { dst(TEMP, t1, W), src(TEMP, t1, 0), src(TEMP, t1, 1) });
+        e(MAX, { dst(TEMP, t1, W), src(TEMP, t1, 3), src(CONST, c + 1, 3) }); // avoid division by zero
+        e(RCP, { dst(TEMP, t2, X), src(TEMP, t1, 3) });
+        e(MUL, { dst(TEMP, t2, X), src(TEMP, t1, 2), src(TEMP, t2, 0) }); // a = min / max
+        e(MUL, { dst(TEMP, t2, Y), src(TEMP, t2, 0), src(TEMP, t2, 0) }); // s = a^2
+        e(MAD, { dst(TEMP, t2, Z), src(TEMP, t2, 1), src(CONST, c + 1, 0), src(CONST, c + 1, 1) });
+        e(MAD, { dst(TEMP, t2, Z), src(TEMP, t2, 2), src(TEMP, t2, 1), src(CONST, c + 1, 2) });
+        e(MUL, { dst(TEMP, t2, Z), src(TEMP, t2, 2), src(TEMP, t2, 1) });
+        e(MAD, { dst(TEMP, t2, Z), src(TEMP, t2, 2), src(TEMP, t2, 0), src(TEMP, t2, 0) }); // atan(a)
+
+        // |z| < |x|: p = pi/2 - p
+        e(SLT, { dst(TEMP, t2, W), src(TEMP, t1, 1), src(TEMP, t1, 0) });
+        e(MAD, { dst(TEMP, t3, X), src(TEMP, t2, 2), src(CONST, c + 2, 1), src(CONST, c + 2, 3) });
+        e(MAD, { dst(TEMP, t2, Z), src(TEMP, t2, 3), src(TEMP, t3, 0), src(TEMP, t2, 2) });
+        // z < 0: p = pi - p
+        e(SLT, { dst(TEMP, t2, W), src(TEMP, pos, 2), src(CONST, c + 2, 0) });
+        e(MAD, { dst(TEMP, t3, X), src(TEMP, t2, 2), src(CONST, c + 2, 1), src(CONST, c + 2, 2) });
+        e(MAD, { dst(TEMP, t2, Z), src(TEMP, t2, 3), src(TEMP, t3, 0), src(TEMP, t2, 2) });
+        // x < 0: p = -p
+        e(SLT, { dst(TEMP, t2, W), src(TEMP, pos, 0), src(CONST, c + 2, 0) });
+        e(MUL, { dst(TEMP, t3, X), src(TEMP, t2, 2), src(CONST, c + 2, 1) });
+        e(MAD, { dst(TEMP, t2, Z), src(TEMP, t2, 3), src(TEMP, t3, 0), src(TEMP, t2, 2) }); // theta
+
+        // Distance from the cylinder axis is used as w
+        e(MUL, { dst(TEMP, t3, Y), src(TEMP, pos, 0), src(TEMP, pos, 0) });
+        e(MAD, { dst(TEMP, t3, Y), src(TEMP, pos, 2), src(TEMP, pos, 2), src(TEMP, t3, 1) });
+        e(RSQ, { dst(TEMP, t3, Z), src(TEMP, t3, 1) });
+        e(RCP, { dst(TEMP, t3, W), src(TEMP, t3, 2) }); // r
+
+        e(MUL, { dst(TEMP, t3, X), src(TEMP, t2, 2), src(CONST, c, 3) });
+        e(MUL, { dst(out_type, out_reg, X), src(TEMP, t3, 0), src(TEMP, t3, 3) });
+        e(MUL, { dst(out_type, out_reg, Y), src(TEMP, pos, 1), src(CONST, c, 2) });
+        e(MAD, { dst(out_type, out_reg, Z), src(TEMP, t3, 3), src(CONST, c, 0), src(CONST, c, 1) });
+        e(MOV, { dst(out_type, out_reg, W), src(TEMP, t3, 3) });
+    }
+
+    // Projects the view space position in `pos` into oPos onto the plane of the screen it is on, with the
+    // parameters of the screen's camera, see constants() for the layout.
+    static void emit_planar(Emitter& e, uint32_t pos, uint32_t tmp, uint32_t c, uint32_t out_type, uint32_t out_reg)
+    {
+        const auto t1 = tmp;
+        const auto t2 = tmp + 1;
+        const auto t3 = tmp + 2;
+
+        // Select the screen the vertex is on by the side of the boundary planes
+        e(MUL, { dst(TEMP, t1, X), src(TEMP, pos, 0), src(CONST, c + 1, 0) });
+        e(MAD, { dst(TEMP, t1, X), src(TEMP, pos, 2), src(CONST, c + 1, 1), src(TEMP, t1, 0) });
+        e(MUL, { dst(TEMP, t1, Y), src(TEMP, pos, 0), src(CONST, c + 1, 2) });
+        e(MAD, { dst(TEMP, t1, Y), src(TEMP, pos, 2), src(CONST, c + 1, 3), src(TEMP, t1, 1) });
+        e(SLT, { dst(TEMP, t1, Z), src(CONST, c, 2), src(TEMP, t1, 0) }); // right
+        e(SLT, { dst(TEMP, t1, W), src(TEMP, t1, 1), src(CONST, c, 2) }); // left
+        e(MAD, { dst(TEMP, t1, W), src(TEMP, t1, 3, true), src(TEMP, t1, 2), src(TEMP, t1, 3) }); // not both
+
+        // Parameters of the selected screen, from the center screen's and the differences of the others
+        e(MAD, { dst(TEMP, t2, X | Y | Z | W), src(TEMP, t1, 2), src_vector(CONST, c + 6), src_vector(CONST, c + 2) });
+        e(MAD, { dst(TEMP, t2, X | Y | Z | W), src(TEMP, t1, 3), src_vector(CONST, c + 4), src_vector(TEMP, t2) });
+        e(MAD, { dst(TEMP, t3, X | Y | Z | W), src(TEMP, t1, 2), src_vector(CONST, c + 7), src_vector(CONST, c + 3) });
+        e(MAD, { dst(TEMP, t3, X | Y | Z | W), src(TEMP, t1, 3), src_vector(CONST, c + 5), src_vector(TEMP, t3) });
+
+        // Position in the view space of the screen's camera
+        e(MUL, { dst(TEMP, t1, X), src(TEMP, pos, 0), src(TEMP, t2, 0) });
+        e(MAD, { dst(TEMP, t1, X), src(TEMP, pos, 2), src(TEMP, t2, 1), src(TEMP, t1, 0) }); // x cos + z sin
+        e(MUL, { dst(TEMP, t1, Y), src(TEMP, pos, 2), src(TEMP, t2, 0) });
+        e(MAD, { dst(TEMP, t1, Y), src(TEMP, pos, 0, true), src(TEMP, t2, 1), src(TEMP, t1, 1) }); // z cos - x sin
+
+        // Projected and moved to the place of the screen in clip space
+        e(MUL, { dst(TEMP, t1, W), src(TEMP, t1, 1), src(TEMP, t2, 3) });
+        e(MAD, { dst(out_type, out_reg, X), src(TEMP, t1, 0), src(TEMP, t2, 2), src(TEMP, t1, 3) });
+        e(MUL, { dst(TEMP, t1, W), src(TEMP, t1, 1), src(TEMP, t3, 1) });
+        e(MAD, { dst(out_type, out_reg, Y), src(TEMP, pos, 1), src(TEMP, t3, 0), src(TEMP, t1, 3) });
+        e(MAD, { dst(out_type, out_reg, Z), src(TEMP, t1, 1), src(CONST, c, 0), src(CONST, c, 1) });
+        e(MOV, { dst(out_type, out_reg, W), src(TEMP, t1, 1) });
+    }
+
+    std::optional<RewrittenShader> rewrite_vertex_shader(const uint32_t* fn, Mode mode)
+    {
+        if (mode == Off) {
+            return std::nullopt;
+        }
+
+        size_t length = 0;
+        const auto instructions = parse(fn, &length);
+        if (!instructions) {
+            return std::nullopt;
+        }
+
+        const auto major = (fn[0] >> 8) & 0xff;
+        const auto out_type = major >= 3 ? OUTPUT : RASTOUT;
+        std::optional<uint32_t> out_reg;
+        if (major < 3) {
+            out_reg = 0;
+        }
+
+        // Find the registers in use so that the injected code can use free ones
+        uint32_t temps = 0;
+        uint32_t constants = 0;
+        uint32_t slots = 0;
+        for (const auto& ins : *instructions) {
+            slots += instruction_slots(major, ins.opcode);
+            if (ins.opcode == DCL) {
+                if (major >= 3 && ins.params == 2) {
+                    const auto usage = fn[ins.offset + 1];
+                    const auto reg = fn[ins.offset + 2];
+                    if (register_type(reg) == OUTPUT && (usage & 0x1f) == DECLUSAGE_POSITION && ((usage >> 16) & 0xf) == 0) {
+                        out_reg = register_number(reg);
+                    }
+                }
+                continue;
+            }
+            // Parameter index without the address register tokens, for the matrix macros
+            size_t param = 0;
+            for (size_t p = 0; p < ins.params; ++p, ++param) {
+                const auto token = fn[ins.offset + 1 + p];
+                if ((ins.opcode == DEF || ins.opcode == DEFI || ins.opcode == DEFB) && p > 0) {
+                    // Immediate float values
+                    break;
+                }
+                if (!(token & 0x80000000)) {
+                    continue;
+                }
+                const auto type = register_type(token);
+                if (token & ADDRESS_RELATIVE) {
+                    if (type == CONST || type == out_type) {
+                        // Any register from the base on may be used
+                        return std::nullopt;
+                    }
+                    if (major >= 2) {
+                        // The address register token
+                        p++;
+                    }
+                }
+                if (type == TEMP) {
+                    temps = std::max(temps, register_number(token) + 1);
+                } else if (type == CONST) {
+                    constants = std::max(constants, register_number(token) + registers_read(ins.opcode, param));
+                }
+            }
+        }
+
+        if (!out_reg) {
+            return std::nullopt;
+        }
+
+        // One register for the position and three for scratch
+        const auto pos = temps;
+        const auto max_temps = major >= 3 ? MAX_TEMPS_SM3 : MAX_TEMPS_SM2;
+        if (pos + 4 > max_temps || constants > CONSTANT_REGISTER) {
+            return std::nullopt;
+        }
+
+        RewrittenShader ret;
+        ret.bytecode.assign(fn, fn + length - 1);
+
+        // Redirect all writes to the position output into the temporary register
+        for (const auto& ins : *instructions) {
+            if (ins.opcode == DCL || ins.opcode == DEF || ins.opcode == DEFI || ins.opcode == DEFB || ins.params == 0) {
+                continue;
+            }
+            auto& token = ret.bytecode[ins.offset + 1];
+            if (register_type(token) == out_type && register_number(token) == *out_reg) {
+                // Keep the write mask and result modifiers
+                token = (token & 0x0fff0000) | register_bits(TEMP, pos);
+            }
+        }
+
+        Emitter e { ret.bytecode, major >= 2 };
+        if (mode == Cylindrical) {
+            emit_cylindrical(e, pos, pos + 1, CONSTANT_REGISTER, out_type, *out_reg);
+        } else {
+            emit_planar(e, pos, pos + 1, CONSTANT_REGISTER, out_type, *out_reg);
+        }
+        if (slots + e.instructions > max_instruction_slots(major)) {
+            return std::nullopt;
+        }
+        ret.bytecode.push_back(END_TOKEN);
+
+        return ret;
+    }
+
+    static std::array<float, CONSTANT_COUNT * 4> cylindrical_constants(const Projection& projection, float a, float b)
+    {
+        constexpr auto pi = std::numbers::pi_v<float>;
+        const auto monitors = static_cast<float>(std::max(1u, projection.monitors));
+        const auto yscale = 1.0f / std::tan(projection.vertical_fov / 2.0f);
+        const auto xscale = 1.0f / (monitors * projection.monitor_fov / 2.0f);
+
+        // clang-format off
+        return {
+            a, b, yscale, xscale,
+            // atan(a) ~= a + a * s * ((c3 * s + c1) * s + c2), s = a^2
+            -0.0464964749f, 0.15931422f, -0.327622764f, 1e-6f,
+            0.0f, -2.0f, pi, pi / 2.0f,
+        };
+        // clang-format on
+    }
+
+    // c0: depth scale and offset, and zero
+    // c1: normals of the boundary planes of the right and the left screen, as x and z factors
+    // c2, c3: rotation, scale and offset of the center screen
+    // c4, c5 and c6, c7: the same for the left and the right screen, as differences from the center screen
+    static std::array<float, CONSTANT_COUNT * 4> planar_constants(const Projection& projection, float a, float b)
+    {
+        std::array<float, CONSTANT_COUNT * 4> ret {};
+        ret[0] = a;
+        ret[1] = b;
+
+        const auto screens = std::clamp(projection.monitors, 1u, MAX_SCREENS);
+        const auto center_angle = projection.screens[0].angle;
+        std::array<std::array<float, 8>, MAX_SCREENS> parameters;
+        // Directions of the left and right edges of the shown part of each screen, in radians to the right
+        std::array<std::array<float, 2>, MAX_SCREENS> edges;
+        for (uint32_t i = 0; i < screens; ++i) {
+            const auto& s = projection.screens[i];
+            // The center camera's rotation is already in the view of the pass
+            const auto angle = s.angle - center_angle;
+            // Clip space x of the shown part in the camera's image, and the image moved to the panorama in pixels
+            const auto left = 2.0f * s.crop_x / s.target_width - 1.0f;
+            const auto right = 2.0f * (s.crop_x + s.width) / s.target_width - 1.0f;
+            parameters[i] = {
+                std::cos(angle),
+                std::sin(angle),
+                s.xscale * s.target_width / projection.width,
+                (s.target_width + 2.0f * (s.x - s.crop_x)) / projection.width - 1.0f,
+                s.yscale * s.target_height / projection.height,
+                1.0f - (s.target_height + 2.0f * (s.y - s.crop_y)) / projection.height,
+                0.0f,
+                0.0f,
+            };
+            edges[i] = { -angle + std::atan(left / s.xscale), -angle + std::atan(right / s.xscale) };
+        }
+
+        // The vertices past the middle of the edges of two screens are projected to the side screen
+        const auto boundary = [&](uint32_t side, size_t offset, bool right) {
+            if (side >= screens) {
+                // Nothing is on the side
+                return;
+            }
+            const auto angle = right
+                ? (edges[0][1] + edges[side][0]) / 2.0f
+                : (edges[0][0] + edges[side][1]) / 2.0f;
+            ret[offset] = std::cos(angle);
+            ret[offset + 1] = -std::sin(angle);
+        };
+        boundary(2, 4, true);
+        boundary(1, 6, false);
+
+        std::copy(parameters[0].begin(), parameters[0].end(), ret.begin() + 8);
+        for (uint32_t i = 1; i < screens; ++i) {
+            for (size_t j = 0; j < 8; ++j) {
+                ret[8 + 8 * i + j] = parameters[i][j] - parameters[0][j];
+            }
+        }
+        return ret;
+    }
+
+    std::array<float, CONSTANT_COUNT * 4> constants(Mode mode, const Projection& projection)
+    {
+        const auto a = projection.z_far / (projection.z_far - projection.z_near);
+        const auto b = -projection.z_near * a;
+        return mode == Cylindrical ? cylindrical_constants(projection, a, b) : planar_constants(projection, a, b);
+    }
+
+    const char* to_string(Mode mode)
+    {
+        switch (mode) {
+            case Cylindrical: return "cylindrical";
+            case Planar: return "planar";
+            default: return "off";
+        }
+    }
+
+    Mode from_string(const std::string_view& str)
+    {
+        if (str == "cylindrical") {
+            return Cylindrical;
+        } else if (str == "planar") {
+            return Planar;
+        }
+        return Off;
+    }
+}
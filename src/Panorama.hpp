@@ -0,0 +1,84 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <optional>
+#include <string_view>
+#include <vector>
+
+// Vertex shader rewriting for single pass panoramic rendering.
+// The rewritten shader writes the view space position into a temporary register
+// instead of the output position, and projects it to all screens at once
+// with code that is appended to the end of the shader.
+// This file does not depend on D3D so the rewriter can be run offline on captured shader blobs.
+namespace panorama {
+    enum Mode : uint32_t {
+        Off = 0,
+        Cylindrical = 1,
+        Planar = 2,
+    };
+
+    // Number of vec4 constant registers used by the injected projection code
+    constexpr uint32_t CONSTANT_COUNT = 8;
+    // First of the constant registers the injected code reads. They are the last ones of the 96 registers of
+    // vs_1_1 and the same for all the rewritten shaders, so they can be set once for all of them. Shaders that
+    // read these registers themselves are not rewritten.
+    constexpr uint32_t CONSTANT_REGISTER = 96 - CONSTANT_COUNT;
+
+    // Screens of the planar projection: the center screen, then the left and right ones
+    constexpr uint32_t MAX_SCREENS = 3;
+
+    struct RewrittenShader {
+        std::vector<uint32_t> bytecode;
+    };
+
+    // Camera of a screen in the planar projection. The screen shows the part of the camera's image that it would
+    // show without the panoramic projection, at the place where the camera image would be composed.
+    struct Screen {
+        // Turn of the camera from the center camera around the vertical axis, positive to the left
+        float angle;
+        // Horizontal and vertical scale of the camera's projection matrix
+        float xscale;
+        float yscale;
+        // Size of the camera's render target and the top left corner of its part that is shown, in pixels
+        float target_width;
+        float target_height;
+        float crop_x;
+        float crop_y;
+        // Top left corner and width of the screen in the panorama, in pixels
+        float x;
+        float y;
+        float width;
+    };
+
+    struct Projection {
+        float vertical_fov;
+        // Horizontal FoV of one monitor, for the cylindrical projection
+        float monitor_fov;
+        uint32_t monitors;
+        float z_near;
+        float z_far;
+        // Screens of the planar projection, `monitors` of them are used
+        std::array<Screen, MAX_SCREENS> screens;
+        // Size of the panorama in pixels
+        float width;
+        float height;
+    };
+
+    // Length of the shader bytecode in tokens, including the end token.
+    // Returns 0 if the bytecode could not be parsed.
+    size_t bytecode_length(const uint32_t* fn);
+
+    // Rewrite vertex shader bytecode to use panoramic projection.
+    // Returns std::nullopt if the shader is not supported: if it does not fit in the instruction slots or
+    // the registers of its shader model with the injected code, or if it addresses the constant or the output
+    // registers relatively, in which case the registers it uses are not known. The original shader can't be used
+    // in the panoramic pass, so all screens have to be rendered in passes of their own then.
+    std::optional<RewrittenShader> rewrite_vertex_shader(const uint32_t* fn, Mode mode);
+
+    // Constant register contents for the injected projection code
+    std::array<float, CONSTANT_COUNT * 4> constants(Mode mode, const Projection& projection);
+
+    const char* to_string(Mode mode);
+    Mode from_string(const std::string_view& str);
+}
@@ -0,0 +1,228 @@
+#include "Profiler.hpp"
+#include "Hook.hpp"
+#include "Util.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <format>
+#include <tuple>
+#include <type_traits>
+
+// The table must match the vtable layout, otherwise the wrappers would call the wrong functions
+#define X(name, primitive_arg) static_assert(offsetof(IDirect3DDevice9Vtbl, name) == static_cast<size_t>(profiler::Method::name) * sizeof(void*), "D3D9_DEVICE_METHODS is out of order: " #name);
+D3D9_DEVICE_METHODS(X)
+#undef X
+static_assert(sizeof(IDirect3DDevice9Vtbl) == profiler::METHOD_COUNT * sizeof(void*), "D3D9_DEVICE_METHODS is missing methods");
+
+// Compilation unit global variables
+namespace g {
+    // Patched device vtable and its original entries, null if the profiler is not installed
+    static void** profiled_vtable;
+    static std::array<void*, profiler::METHOD_COUNT> original_vtable;
+
+    // Pass the device calls are attributed to
+    static size_t profiled_pass = profiler::OUTSIDE_PASSES;
+
+    static profiler::Frame profiled_frame;
+    static profiler::Frame previous_profiled_frame;
+}
+
+namespace profiler {
+    static int64_t now()
+    {
+        LARGE_INTEGER t;
+        QueryPerformanceCounter(&t);
+        return t.QuadPart;
+    }
+
+    static void record(Method method, size_t pass, uint32_t primitives, int64_t ticks)
+    {
+        auto& c = g::profiled_frame.methods[pass][static_cast<size_t>(method)];
+        c.calls++;
+        c.primitives += primitives;
+        c.ticks += ticks;
+        if (method == Method::Present) {
+            g::previous_profiled_frame = g::profiled_frame;
+            g::profiled_frame = {};
+        }
+    }
+
+    template <Method M, size_t PrimitiveArg, typename Fn>
+    struct Wrapper;
+
+    template <Method M, size_t PrimitiveArg, typename R, typename... Args>
+    struct Wrapper<M, PrimitiveArg, R(WINAPI*)(Args...)> {
+        static R WINAPI call(Args... args)
+        {
+            using Fn = R(WINAPI*)(Args...);
+            const auto original = reinterpret_cast<Fn>(g::original_vtable[static_cast<size_t>(M)]);
+            auto primitives = uint32_t { 0 };
+            if constexpr (PrimitiveArg != 0) {
+                primitives = static_cast<uint32_t>(std::get<PrimitiveArg>(std::tie(args...)));
+            }
+            // Present ends the pass of the plugin's own calls, so the pass is read before the call
+            const auto pass = g::profiled_pass;
+            const auto start = now();
+            if constexpr (std::is_void_v<R>) {
+                original(args...);
+                record(M, pass, primitives, now() - start);
+            } else {
+                auto ret = original(args...);
+                record(M, pass, primitives, now() - start);
+                return ret;
+            }
+        }
+    };
+
+    static const std::array<void*, METHOD_COUNT> wrappers = {
+#define X(name, primitive_arg) reinterpret_cast<void*>(&Wrapper<Method::name, primitive_arg, decltype(IDirect3DDevice9Vtbl::name)>::call),
+        D3D9_DEVICE_METHODS(X)
+#undef X
+    };
+
+    static constexpr std::array<const char*, METHOD_COUNT> method_names = {
+#define X(name, primitive_arg) #name,
+        D3D9_DEVICE_METHODS(X)
+#undef X
+    };
+
+    Counter Frame::total(size_t pass) const
+    {
+        auto ret = Counter {};
+        for (const auto& c : methods[pass]) {
+            ret += c;
+        }
+        return ret;
+    }
+
+    Counter Frame::draws(size_t pass) const
+    {
+        auto ret = Counter {};
+        for (const auto method : { Method::DrawPrimitive, Method::DrawIndexedPrimitive, Method::DrawPrimitiveUP, Method::DrawIndexedPrimitiveUP }) {
+            ret += methods[pass][static_cast<size_t>(method)];
+        }
+        return ret;
+    }
+
+    static bool write_vtable(void** vtable, const std::array<void*, METHOD_COUNT>& expected, const std::array<void*, METHOD_COUNT>& entries)
+    {
+        DWORD old_protect;
+        if (!VirtualProtect(vtable, METHOD_COUNT * sizeof(void*), PAGE_READWRITE, &old_protect)) {
+            dbg("Could not change the protection of the device vtable");
+            return false;
+        }
+        for (size_t i = 0; i < METHOD_COUNT; ++i) {
+            // Leave the entries patched by someone else after us alone
+            if (vtable[i] == expected[i]) {
+                vtable[i] = entries[i];
+            }
+        }
+        VirtualProtect(vtable, METHOD_COUNT * sizeof(void*), old_protect, &old_protect);
+        return true;
+    }
+
+    bool install(IDirect3DDevice9* dev)
+    {
+        if (g::profiled_vtable || !dev) {
+            return g::profiled_vtable != nullptr;
+        }
+        auto vtable = reinterpret_cast<void**>(get_vtable<IDirect3DDevice9Vtbl>(dev));
+        std::copy_n(vtable, METHOD_COUNT, g::original_vtable.begin());
+        g::profiled_frame = {};
+        g::previous_profiled_frame = {};
+        if (!write_vtable(vtable, g::original_vtable, wrappers)) {
+            return false;
+        }
+        g::profiled_vtable = vtable;
+        return true;
+    }
+
+    void uninstall()
+    {
+        if (g::profiled_vtable && write_vtable(g::profiled_vtable, wrappers, g::original_vtable)) {
+            g::profiled_vtable = nullptr;
+        }
+    }
+
+    bool is_installed()
+    {
+        return g::profiled_vtable != nullptr;
+    }
+
+    void begin_pass(RenderTarget tgt)
+    {
+        g::profiled_pass = tgt;
+        g::profiled_frame.passes[tgt]++;
+    }
+
+    void end_pass()
+    {
+        g::profiled_pass = OUTSIDE_PASSES;
+    }
+
+    const Frame& last_frame()
+    {
+        return g::previous_profiled_frame;
+    }
+
+    double ticks_to_ms(int64_t ticks)
+    {
+        static const auto frequency = [] {
+            LARGE_INTEGER f;
+            QueryPerformanceFrequency(&f);
+            return static_cast<double>(f.QuadPart);
+        }();
+        return static_cast<double>(ticks) * 1000.0 / frequency;
+    }
+
+    const char* to_string(Method method)
+    {
+        return method_names[static_cast<size_t>(method)];
+    }
+
+    std::vector<std::string> report(const Frame& frame)
+    {
+        auto methods = std::vector<size_t> {};
+        for (size_t i = 0; i < METHOD_COUNT; ++i) {
+            for (size_t pass = 0; pass < PASS_COUNT; ++pass) {
+                if (frame.methods[pass][i].calls > 0) {
+                    methods.push_back(i);
+                    break;
+                }
+            }
+        }
+        const auto ticks = [&](size_t method) {
+            auto ret = int64_t { 0 };
+            for (const auto& pass : frame.methods) {
+                ret += pass[method].ticks;
+            }
+            return ret;
+        };
+        std::ranges::sort(methods, [&](size_t a, size_t b) { return ticks(a) > ticks(b); });
+
+        // calls/primitives/milliseconds of the primary, left, right and outside passes
+        auto ret = std::vector<std::string> {};
+        ret.push_back(std::format("D3D9 device calls per pass (primary x{}, left x{}, right x{}, outside): calls/primitives/ms",
+            frame.passes[RenderTarget::Primary], frame.passes[RenderTarget::Left], frame.passes[RenderTarget::Right]));
+        const auto format_row = [](const char* name, const std::array<Counter, PASS_COUNT>& counters) {
+            auto row = std::format("{:<28}", name);
+            for (const auto& c : counters) {
+                row += std::format(" {:>6}/{:>8}/{:>7.3f}", c.calls, c.primitives, ticks_to_ms(c.ticks));
+            }
+            return row;
+        };
+        for (const auto method : methods) {
+            auto counters = std::array<Counter, PASS_COUNT> {};
+            for (size_t pass = 0; pass < PASS_COUNT; ++pass) {
+                counters[pass] = frame.methods[pass][method];
+            }
+            ret.push_back(format_row(method_names[method], counters));
+        }
+        auto totals = std::array<Counter, PASS_COUNT> {};
+        for (size_t pass = 0; pass < PASS_COUNT; ++pass) {
+            totals[pass] = frame.total(pass);
+        }
+        ret.push_back(format_row("Total", totals));
+        return ret;
+    }
+}
@@ -0,0 +1,203 @@
+#pragma once
+
+#include "D3D.hpp"
+#include "RenderTarget.hpp"
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// All IDirect3DDevice9Vtbl methods in vtable order.
+// The second argument is the index of the primitive count argument of the draw calls,
+// counting This as 0, or 0 if the method doesn't draw anything.
+// clang-format off
+#define D3D9_DEVICE_METHODS(X) \
+    X(QueryInterface, 0) \
+    X(AddRef, 0) \
+    X(Release, 0) \
+    X(TestCooperativeLevel, 0) \
+    X(GetAvailableTextureMem, 0) \
+    X(EvictManagedResources, 0) \
+    X(GetDirect3D, 0) \
+    X(GetDeviceCaps, 0) \
+    X(GetDisplayMode, 0) \
+    X(GetCreationParameters, 0) \
+    X(SetCursorProperties, 0) \
+    X(SetCursorPosition, 0) \
+    X(ShowCursor, 0) \
+    X(CreateAdditionalSwapChain, 0) \
+    X(GetSwapChain, 0) \
+    X(GetNumberOfSwapChains, 0) \
+    X(Reset, 0) \
+    X(Present, 0) \
+    X(GetBackBuffer, 0) \
+    X(GetRasterStatus, 0) \
+    X(SetDialogBoxMode, 0) \
+    X(SetGammaRamp, 0) \
+    X(GetGammaRamp, 0) \
+    X(CreateTexture, 0) \
+    X(CreateVolumeTexture, 0) \
+    X(CreateCubeTexture, 0) \
+    X(create_vertex_buffer, 0) \
+    X(CreateIndexBuffer, 0) \
+    X(create_render_target, 0) \
+    X(CreateDepthStencilSurface, 0) \
+    X(UpdateSurface, 0) \
+    X(UpdateTexture, 0) \
+    X(GetRenderTargetData, 0) \
+    X(GetFrontBufferData, 0) \
+    X(StretchRect, 0) \
+    X(ColorFill, 0) \
+    X(CreateOffscreenPlainSurface, 0) \
+    X(SetRenderTarget, 0) \
+    X(GetRenderTarget, 0) \
+    X(SetDepthStencilSurface, 0) \
+    X(GetDepthStencilSurface, 0) \
+    X(BeginScene, 0) \
+    X(EndScene, 0) \
+    X(Clear, 0) \
+    X(SetTransform, 0) \
+    X(GetTransform, 0) \
+    X(MultiplyTransform, 0) \
+    X(SetViewport, 0) \
+    X(GetViewport, 0) \
+    X(SetMaterial, 0) \
+    X(GetMaterial, 0) \
+    X(SetLight, 0) \
+    X(GetLight, 0) \
+    X(LightEnable, 0) \
+    X(GetLightEnable, 0) \
+    X(SetClipPlane, 0) \
+    X(GetClipPlane, 0) \
+    X(SetRenderState, 0) \
+    X(GetRenderState, 0) \
+    X(CreateStateBlock, 0) \
+    X(BeginStateBlock, 0) \
+    X(EndStateBlock, 0) \
+    X(SetClipStatus, 0) \
+    X(GetClipStatus, 0) \
+    X(GetTexture, 0) \
+    X(SetTexture, 0) \
+    X(GetTextureStageState, 0) \
+    X(SetTextureStageState, 0) \
+    X(GetSamplerState, 0) \
+    X(SetSamplerState, 0) \
+    X(ValidateDevice, 0) \
+    X(SetPaletteEntries, 0) \
+    X(GetPaletteEntries, 0) \
+    X(SetCurrentTexturePalette, 0) \
+    X(GetCurrentTexturePalette, 0) \
+    X(SetScissorRect, 0) \
+    X(GetScissorRect, 0) \
+    X(SetSoftwareVertexProcessing, 0) \
+    X(GetSoftwareVertexProcessing, 0) \
+    X(SetNPatchMode, 0) \
+    X(GetNPatchMode, 0) \
+    X(DrawPrimitive, 3) \
+    X(DrawIndexedPrimitive, 6) \
+    X(DrawPrimitiveUP, 2) \
+    X(DrawIndexedPrimitiveUP, 4) \
+    X(ProcessVertices, 0) \
+    X(CreateVertexDeclaration, 0) \
+    X(SetVertexDeclaration, 0) \
+    X(GetVertexDeclaration, 0) \
+    X(SetFVF, 0) \
+    X(GetFVF, 0) \
+    X(CreateVertexShader, 0) \
+    X(SetVertexShader, 0) \
+    X(GetVertexShader, 0) \
+    X(SetVertexShaderConstantF, 0) \
+    X(GetVertexShaderConstantF, 0) \
+    X(SetVertexShaderConstantI, 0) \
+    X(GetVertexShaderConstantI, 0) \
+    X(SetVertexShaderConstantB, 0) \
+    X(GetVertexShaderConstantB, 0) \
+    X(SetStreamSource, 0) \
+    X(GetStreamSource, 0) \
+    X(SetStreamSourceFreq, 0) \
+    X(GetStreamSourceFreq, 0) \
+    X(SetIndices, 0) \
+    X(GetIndices, 0) \
+    X(CreatePixelShader, 0) \
+    X(SetPixelShader, 0) \
+    X(GetPixelShader, 0) \
+    X(SetPixelShaderConstantF, 0) \
+    X(GetPixelShaderConstantF, 0) \
+    X(SetPixelShaderConstantI, 0) \
+    X(GetPixelShaderConstantI, 0) \
+    X(SetPixelShaderConstantB, 0) \
+    X(GetPixelShaderConstantB, 0) \
+    X(DrawRectPatch, 0) \
+    X(DrawTriPatch, 0) \
+    X(DeletePatch, 0) \
+    X(CreateQuery, 0)
+// clang-format on
+
+// Profiler of the D3D9 device calls. Counts the calls, primitives and time of every device method,
+// separately for each camera pass and for the work done outside of them (menus, compositing, Present).
+//
+// The profiler replaces the entries of the device vtable with wrappers generated from the table above,
+// so it sees the calls from the game and from the plugin itself. When it's disabled the vtable is
+// left untouched and there is no cost at all. The time is measured around the call, so it includes
+// the hooks of the plugin, and for Present the compositing of the screens.
+namespace profiler {
+    enum class Method : uint32_t {
+#define X(name, primitive_arg) name,
+        D3D9_DEVICE_METHODS(X)
+#undef X
+    };
+
+    constexpr size_t METHOD_COUNT = 0
+#define X(name, primitive_arg) +1
+        D3D9_DEVICE_METHODS(X)
+#undef X
+        ;
+
+    // The camera passes and everything outside of them
+    constexpr size_t PASS_COUNT = 4;
+    constexpr size_t OUTSIDE_PASSES = 3;
+
+    struct Counter {
+        uint32_t calls;
+        uint32_t primitives;
+        int64_t ticks;
+
+        Counter& operator+=(const Counter& rhs)
+        {
+            calls += rhs.calls;
+            primitives += rhs.primitives;
+            ticks += rhs.ticks;
+            return *this;
+        }
+    };
+
+    struct Frame {
+        std::array<std::array<Counter, METHOD_COUNT>, PASS_COUNT> methods;
+        // How many times each camera pass was rendered during the frame
+        std::array<uint32_t, PASS_COUNT> passes;
+
+        // All device calls of a pass
+        Counter total(size_t pass) const;
+        // Draw calls of a pass
+        Counter draws(size_t pass) const;
+    };
+
+    // Patches the vtable of the device. Must be called after the other device hooks are created,
+    // so that they hook the original functions and not the wrappers.
+    bool install(IDirect3DDevice9* dev);
+    void uninstall();
+    bool is_installed();
+
+    // Calls between these are attributed to the camera pass
+    void begin_pass(RenderTarget tgt);
+    void end_pass();
+
+    // Counters of the last presented frame
+    const Frame& last_frame();
+    double ticks_to_ms(int64_t ticks);
+    const char* to_string(Method method);
+
+    // Per method breakdown of a frame, the most expensive methods first
+    std::vector<std::string> report(const Frame& frame);
+}
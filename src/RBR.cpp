@@ -1,9 +1,13 @@
 #include "RBR.hpp"
 #include "Dx.hpp"
 #include "Globals.hpp"
+#include "Profiler.hpp"
 #include "Util.hpp"
 
+#include <algorithm>
+#include <ext/matrix_transform.hpp>
 #include <ranges>
+#include <vector>
 
 // Compilation unit global variables
 namespace g {
@@ -14,6 +18,37 @@ namespace g {
     static rbr::GameMode previous_game_mode;
     static uint32_t current_stage_id;
     static bool is_rendering_3d;
+
+    // Location of a copy of the orientation in the RBR camera object, as a 3x3 matrix
+    // with `stride` bytes between the rows. Transposed copies are the inverse rotation.
+    struct CameraOrientation {
+        uint32_t offset;
+        uint32_t stride;
+        bool transposed;
+    };
+    static std::vector<CameraOrientation> camera_orientations;
+    static uint32_t camera_orientation_searches;
+    static bool camera_rotation_failed;
+    static bool is_camera_rotated;
+    // Orientations of the camera before it was rotated, the first one is the view of the game camera
+    static std::vector<glm::mat3> saved_camera_orientations;
+    // Renderer object the game renders the 3D scene with, which holds the camera
+    static uintptr_t renderer;
+
+    // FoV written to the camera and the FoV of each camera for culling, in the game's units
+    static float camera_fov_value;
+    static float culling_fov[3];
+
+    // Inputs of the last image of a side screen, and how many times in a row it was rendered with them
+    struct SideImage {
+        glm::mat4 view_projection;
+        uint32_t scene_hash;
+        uint32_t renders;
+    };
+    static std::optional<SideImage> side_images[3];
+    // Config the side images were rendered with, and whether the side screens were cleared when there's no scene
+    static Config side_images_cfg;
+    static bool side_images_cleared[3];
 }
 
 namespace rbr {
@@ -63,6 +98,53 @@ namespace rbr {
     static PrepareCameraFn apply_camera_fov = reinterpret_cast<PrepareCameraFn>(get_address(0x4BF690));
     static PostPrepareCameraFn post_prepare_camera = reinterpret_cast<PostPrepareCameraFn>(get_address(0x487320));
 
+    static constexpr std::pair<GameMode, std::string_view> game_mode_names[] = {
+        { Driving, "driving" },
+        { Pause, "pause" },
+        { MainMenu, "main_menu" },
+        { Blackout, "blackout" },
+        { Loading, "loading" },
+        { Exiting, "exiting" },
+        { Quit, "quit" },
+        { Replay, "replay" },
+        { End, "end" },
+        { PreStage, "pre_stage" },
+        { Starting, "starting" },
+    };
+
+    std::optional<GameMode> game_mode_from_string(std::string_view str)
+    {
+        for (const auto& [mode, name] : game_mode_names) {
+            if (name == str) {
+                return mode;
+            }
+        }
+        return std::nullopt;
+    }
+
+    const char* to_string(GameMode mode)
+    {
+        for (const auto& [m, name] : game_mode_names) {
+            if (m == mode) {
+                return name.data();
+            }
+        }
+        return "";
+    }
+
+    const char* to_string(PassOrder order)
+    {
+        switch (order) {
+            case LatencyOptimized: return "latency";
+            default: return "config";
+        }
+    }
+
+    PassOrder pass_order_from_string(std::string_view str)
+    {
+        return str == "latency" ? LatencyOptimized : ConfigOrder;
+    }
+
     uintptr_t get_render_function_addr()
     {
         return RENDER_FUNCTION_ADDR;
@@ -88,6 +170,11 @@ namespace rbr {
         return g::is_rendering_3d;
     }
 
+    bool is_camera_rotated()
+    {
+        return g::is_camera_rotated;
+    }
+
     bool is_using_cockpit_camera()
     {
         if (!g::camera_type_ptr) {
@@ -123,13 +210,61 @@ namespace rbr {
         }
     }
 
+    static float get_far_plane(size_t camera)
+    {
+        constexpr auto default_far_plane = 10000.0f;
+        const auto far_plane = static_cast<float>(g::cfg.cameras[camera].far_plane);
+        return far_plane > 0.0f ? far_plane : default_far_plane;
+    }
+
+    static constexpr uintptr_t CAMERA_OFFSET = 0x70;
+    static constexpr uintptr_t CAMERA_FOV_OFFSET = 0x2c0;
+    static constexpr float WIDE_CULLING_FOV = 2.4f;
+    static constexpr float CULLING_FOV_MARGIN = 0.2f;
+
+    // Let the game update its object culling for a FoV, and then write `fov_value` back to the camera
+    static void apply_culling_fov(uintptr_t p, float culling_fov, float fov_value)
+    {
+        float* current_fov_ptr = reinterpret_cast<float*>(p + CAMERA_OFFSET + CAMERA_FOV_OFFSET);
+        const auto camera_post_prepare_this = reinterpret_cast<void*>(p + CAMERA_OFFSET);
+        const auto camera_fov_this = *reinterpret_cast<void**>(p + 0xcf4);
+
+        *current_fov_ptr = culling_fov;
+        post_prepare_camera(camera_post_prepare_this, 0.0);
+
+        // Fix wiper animation
+        // The function at 0x10067254 must not be called when patching the FoV
+        // for the wiper animation to run correctly.
+        // Therefore, nop (0x90) out the call at 0x10067254 when calling `apply_camera_fov` and
+        // restore it back to correctly call it in g::hooks::render
+        static uint8_t* wiper_anim_loc;
+        static uint8_t orig_bytes[5];
+
+        if (!wiper_anim_loc) {
+            wiper_anim_loc = reinterpret_cast<uint8_t*>(rbr::get_hedgehog_address(0x10067254));
+            memcpy(orig_bytes, wiper_anim_loc, 5);
+        }
+
+        for (int i = 0; i < 5; ++i) {
+            write_byte(wiper_anim_loc + i, 0x90);
+        }
+
+        apply_camera_fov(camera_fov_this, 0.0);
+
+        for (int i = 0; i < 5; ++i) {
+            write_byte(wiper_anim_loc + i, orig_bytes[i]);
+        }
+
+        *current_fov_ptr = fov_value;
+    }
+
     // Read camera FoV from the currently selected RBR camera
     // and recreate the projection matrix with the correct FoV
     void update_current_camera_fov(uintptr_t p)
     {
         float* original_fov_ptr;
-        float* current_fov_ptr = reinterpret_cast<float*>(p + 0x70 + 0x2c0);
-        float* z_near_ptr = reinterpret_cast<float*>(p + 0x70 + 0x290);
+        float* current_fov_ptr = reinterpret_cast<float*>(p + CAMERA_OFFSET + CAMERA_FOV_OFFSET);
+        float* z_near_ptr = reinterpret_cast<float*>(p + CAMERA_OFFSET + 0x290);
 
         // The 3 cameras (bumper, bonnet, internal) whose FoV can be set via Pacenote plugin
         // The FoV is read from these values by the game, and written into `current_fov_ptr` in memory
@@ -169,6 +304,9 @@ namespace rbr {
             fov = 0.4f;
         }
 
+        const auto aspect = static_cast<double>(g::cfg.cameras[0].w()) / static_cast<double>(g::cfg.cameras[0].h());
+        const auto monitor_fov = 2.0 * std::atan(std::tan(fov / 2.0) * aspect);
+
         // Re-calculate the correct angle for the new FoV for the side views
         for (size_t i = 0; i < g::cfg.cameras.size(); ++i) {
             auto cfov = fov + static_cast<float>(g::cfg.cameras[i].fov);
@@ -176,12 +314,45 @@ namespace rbr {
                 cfov,
                 static_cast<float>(g::cfg.cameras[0].w()),
                 static_cast<float>(g::cfg.cameras[0].h()),
-                *z_near_ptr, 10000.0f);
+                *z_near_ptr, get_far_plane(i));
 
             if (i != RenderTarget::Primary) {
-                const auto aspect = static_cast<double>(g::cfg.cameras[0].w()) / static_cast<double>(g::cfg.cameras[0].h());
-                g::cfg.cameras[i].angle = 2.0 * std::atan(std::tan(fov / 2.0) * aspect);
+                g::cfg.cameras[i].angle = monitor_fov;
             }
+
+            // Culling FoV for rendering the camera with its own orientation, with a margin for
+            // the objects that the game culls by their origin
+            const auto camera_monitor_fov = 2.0f * std::atan(std::tan(cfov / 2.0f) * static_cast<float>(aspect));
+            g::culling_fov[i] = glm::degrees(std::min(camera_monitor_fov + CULLING_FOV_MARGIN, WIDE_CULLING_FOV));
+        }
+        g::camera_fov_value = original_fov_ptr_value;
+
+        g::panorama_projection = {
+            .vertical_fov = fov,
+            .monitor_fov = static_cast<float>(monitor_fov),
+            .monitors = static_cast<uint32_t>(std::min<size_t>(g::cfg.cameras.size(), panorama::MAX_SCREENS)),
+            .z_near = *z_near_ptr,
+            .z_far = get_far_plane(RenderTarget::Primary),
+        };
+        // The screens are placed in the panorama like the cameras are composed to the back buffer
+        const auto xmin = std::ranges::min(g::cfg.cameras, {}, [](const auto& c) { return c.extent[0]; }).extent[0];
+        g::panorama_projection.width = 0.0f;
+        g::panorama_projection.height = static_cast<float>(g::cfg.cameras[0].h());
+        for (uint32_t i = 0; i < g::panorama_projection.monitors; ++i) {
+            const auto& c = g::cfg.cameras[i];
+            g::panorama_projection.screens[i] = {
+                .angle = dx::get_camera_angle(static_cast<RenderTarget>(i)),
+                .xscale = g::projection_matrix[i][0][0],
+                .yscale = g::projection_matrix[i][1][1],
+                .target_width = static_cast<float>(g::cfg.cameras[0].w()),
+                .target_height = static_cast<float>(g::cfg.cameras[0].h()),
+                .crop_x = static_cast<float>(c.crop.x),
+                .crop_y = static_cast<float>(c.crop.y),
+                .x = static_cast<float>(c.extent[0] + std::abs(xmin)),
+                .y = static_cast<float>(c.extent[1]),
+                .width = static_cast<float>(c.extent[2]),
+            };
+            g::panorama_projection.width += static_cast<float>(c.extent[2]);
         }
 
         const auto mode = rbr::get_game_mode();
@@ -192,43 +363,160 @@ namespace rbr {
             // from the peripheral view. As we're using a separate projection matrix, this has no effect
             // on the actual projection, just for the RBR rendering optimization logic that starts culling
             // objects that are not visible.
-            const auto camera_post_prepare_this = reinterpret_cast<void*>(p + 0x70);
-            const auto camera_fov_this = *reinterpret_cast<void**>(p + 0xcf4);
-
             // 2.4 seems to work very well with all kinds of FoVs for some reason
             // It really like a sweet spot with the least amount of objects popping out
             // We can't go 3 times the normal FoV because RBR does not like very wide FoVs.
             // With very wide FoVs the objects start to disappear the same way as they do with a small FoV.
-            *current_fov_ptr = glm::degrees(2.4f);
-            post_prepare_camera(camera_post_prepare_this, 0.0);
-
-            // Fix wiper animation
-            // The function at 0x10067254 must not be called when patching the FoV
-            // for the wiper animation to run correctly.
-            // Therefore, nop (0x90) out the call at 0x10067254 when calling `apply_camera_fov` and
-            // restore it back to correctly call it in g::hooks::render
-            static uint8_t* wiper_anim_loc;
-            static uint8_t orig_bytes[5];
-
-            if (!wiper_anim_loc) {
-                wiper_anim_loc = reinterpret_cast<uint8_t*>(rbr::get_hedgehog_address(0x10067254));
-                memcpy(orig_bytes, wiper_anim_loc, 5);
+            apply_culling_fov(p, glm::degrees(WIDE_CULLING_FOV), original_fov_ptr_value);
+        }
+    }
+
+    static glm::mat3 read_orientation(uintptr_t camera, const g::CameraOrientation& o)
+    {
+        glm::mat3 m;
+        for (uint32_t c = 0; c < 3; ++c) {
+            for (uint32_t r = 0; r < 3; ++r) {
+                m[c][r] = *reinterpret_cast<const float*>(camera + o.offset + c * o.stride + r * sizeof(float));
             }
+        }
+        return o.transposed ? glm::transpose(m) : m;
+    }
+
+    static void write_orientation(uintptr_t camera, const g::CameraOrientation& o, const glm::mat3& orientation)
+    {
+        const auto m = o.transposed ? glm::transpose(orientation) : orientation;
+        for (uint32_t c = 0; c < 3; ++c) {
+            for (uint32_t r = 0; r < 3; ++r) {
+                *reinterpret_cast<float*>(camera + o.offset + c * o.stride + r * sizeof(float)) = m[c][r];
+            }
+        }
+    }
 
-            for (int i = 0; i < 5; ++i) {
-                write_byte(wiper_anim_loc + i, 0x90);
+    static bool is_same_orientation(const glm::mat3& a, const glm::mat3& b, float epsilon)
+    {
+        for (int c = 0; c < 3; ++c) {
+            for (int r = 0; r < 3; ++r) {
+                if (std::abs(a[c][r] - b[c][r]) > epsilon) {
+                    return false;
+                }
             }
+        }
+        return true;
+    }
 
-            apply_camera_fov(camera_fov_this, 0.0);
+    // The layout of the camera object is not known, so the copies of the camera orientation are
+    // found by comparing the camera to the view matrix the game set for the primary pass
+    static void find_camera_orientation(uintptr_t p)
+    {
+        constexpr uint32_t MAX_SEARCHES = 600;
+        if (!g::camera_orientations.empty() || g::camera_rotation_failed) {
+            return;
+        }
 
-            for (int i = 0; i < 5; ++i) {
-                write_byte(wiper_anim_loc + i, orig_bytes[i]);
+        if (!dx::get_pass_view()) {
+            return;
+        }
+        const auto view = glm::mat3(dx::get_pass_view().value());
+        // A view that is almost axis aligned has zeroes that match all kinds of memory
+        const auto significant = std::ranges::count_if(std::views::iota(0, 9), [&view](int i) { return std::abs(view[i / 3][i % 3]) > 0.05f; });
+        if (significant < 6) {
+            return;
+        }
+
+        const auto camera = p + CAMERA_OFFSET;
+        for (const auto stride : { 12u, 16u }) {
+            for (uint32_t offset = 0; offset + 2 * stride + 3 * sizeof(float) <= CAMERA_FOV_OFFSET; offset += sizeof(float)) {
+                for (const auto transposed : { false, true }) {
+                    const auto o = g::CameraOrientation { offset, stride, transposed };
+                    if (is_same_orientation(read_orientation(camera, o), view, 1e-4f)) {
+                        g::camera_orientations.push_back(o);
+                    }
+                }
             }
+        }
 
-            *current_fov_ptr = original_fov_ptr_value;
+        if (!g::camera_orientations.empty()) {
+            for (const auto& o : g::camera_orientations) {
+                dbg(std::format("Found camera orientation at 0x{:x}, stride {}{}", o.offset, o.stride, o.transposed ? ", transposed" : ""));
+            }
+        } else if (++g::camera_orientation_searches >= MAX_SEARCHES) {
+            g::camera_rotation_failed = true;
+            dbg("Could not find the camera orientation, rendering the side screens with the primary camera");
         }
     }
 
+    std::optional<glm::mat3> get_camera_orientation()
+    {
+        if (g::camera_orientations.empty() || g::camera_rotation_failed || !g::renderer) {
+            return std::nullopt;
+        }
+        if (!g::saved_camera_orientations.empty()) {
+            return g::saved_camera_orientations.front();
+        }
+        return read_orientation(g::renderer + CAMERA_OFFSET, g::camera_orientations.front());
+    }
+
+    static bool should_rotate_camera()
+    {
+        return g::cfg.rotate_game_camera
+            && !g::camera_rotation_failed
+            && !g::camera_orientations.empty()
+            && !is_on_btb_stage()
+            && !dx::is_panorama_enabled()
+            && (g::game_mode == GameMode::Driving || g::game_mode == GameMode::Replay || g::game_mode == GameMode::Pause || g::game_mode == GameMode::PreStage);
+    }
+
+    // Turn the game camera towards the screen of the pass, so that the game culls the objects
+    // against the screen's own FoV instead of the FoV of all screens combined
+    static void rotate_camera(uintptr_t p, RenderTarget tgt)
+    {
+        if (!should_rotate_camera()) {
+            return;
+        }
+        const auto camera = p + CAMERA_OFFSET;
+        const auto rotation = glm::mat3(glm::rotate(glm::identity<glm::mat4>(), dx::get_camera_angle(tgt), { 0, 1, 0 }));
+        g::saved_camera_orientations.clear();
+        for (const auto& o : g::camera_orientations) {
+            g::saved_camera_orientations.push_back(read_orientation(camera, o));
+            write_orientation(camera, o, rotation * g::saved_camera_orientations.back());
+        }
+        apply_culling_fov(p, g::culling_fov[tgt], g::camera_fov_value);
+        g::is_camera_rotated = tgt != RenderTarget::Primary;
+    }
+
+    static void restore_camera(uintptr_t p, RenderTarget tgt)
+    {
+        if (tgt == RenderTarget::Primary) {
+            find_camera_orientation(p);
+        }
+        if (g::saved_camera_orientations.empty()) {
+            return;
+        }
+
+        // If the game did not use the rotated camera, the offsets found are not the camera orientation.
+        // The camera is compared to its own orientation of this frame, as the primary pass may not have run yet.
+        // Without a view set in the pass the rotation can't be checked, and is not trusted.
+        if (g::is_camera_rotated) {
+            const auto rotation = glm::mat3(glm::rotate(glm::identity<glm::mat4>(), dx::get_camera_angle(tgt), { 0, 1, 0 }));
+            const auto& view = dx::get_pass_view();
+            if (!view) {
+                g::camera_rotation_failed = true;
+                dbg("The game did not set the view of the rotated camera, rendering the side screens with the primary camera");
+            } else if (!is_same_orientation(glm::mat3(view.value()), rotation * g::saved_camera_orientations.front(), 1e-3f)) {
+                g::camera_rotation_failed = true;
+                dbg("The game did not use the rotated camera, rendering the side screens with the primary camera");
+            }
+        }
+
+        const auto camera = p + CAMERA_OFFSET;
+        for (const auto& [o, m] : std::views::zip(g::camera_orientations, g::saved_camera_orientations)) {
+            write_orientation(camera, o, m);
+        }
+        g::saved_camera_orientations.clear();
+        apply_culling_fov(p, glm::degrees(WIDE_CULLING_FOV), g::camera_fov_value);
+        g::is_camera_rotated = false;
+    }
+
     static bool init_or_update_game_data(uintptr_t ptr)
     {
         static bool window_resized = false;
@@ -263,10 +551,61 @@ namespace rbr {
         return should_draw;
     }
 
+    // In the game modes where nothing moves unless the camera does, a side pass is skipped if the camera and
+    // the primary pass are the same as when the screen was last rendered, and the screen keeps its image.
+    // When the primary pass is rendered last, the side passes compare against the previous frame's.
+    // Without a scene, the side screens are cleared once and not rendered.
+    static bool skip_static_side_pass(RenderTarget tgt)
+    {
+        // With the camera rotated, the game culls each side pass on its own, so the primary pass
+        // does not have all the objects the side screens show
+        if (!g::cfg.reuse_static_side_images || should_rotate_camera()) {
+            return false;
+        }
+        if (g::game_mode == GameMode::Loading || g::game_mode == GameMode::Blackout) {
+            if (!g::side_images_cleared[tgt]) {
+                dx::clear_camera(tgt);
+                g::side_images_cleared[tgt] = true;
+            }
+            g::side_images[tgt].reset();
+            return true;
+        }
+        g::side_images_cleared[tgt] = false;
+
+        const auto& image = g::side_images[tgt];
+        // Half of an interlaced image is filled in from the previous one, so it takes two passes to settle
+        const auto renders = g::cfg.side_monitors_interlace != interlace::Off ? 2u : 1u;
+        const auto view_projection = dx::get_camera_view_projection(tgt);
+        if (image && view_projection && image->renders >= renders && image->view_projection == view_projection.value() && image->scene_hash == dx::get_scene_hash()) {
+            g::frame_stats.side_passes_reused++;
+            return true;
+        }
+        return false;
+    }
+
+    static void save_side_image(RenderTarget tgt)
+    {
+        auto& image = g::side_images[tgt];
+        if (!g::cfg.reuse_static_side_images || should_rotate_camera() || (g::game_mode != GameMode::Pause && g::game_mode != GameMode::MainMenu && g::game_mode != GameMode::Replay)) {
+            image.reset();
+            return;
+        }
+        const auto view_projection = dx::get_camera_view_projection(tgt);
+        const auto scene_hash = dx::get_scene_hash();
+        if (!view_projection) {
+            image.reset();
+        } else if (image && image->view_projection == view_projection.value() && image->scene_hash == scene_hash) {
+            image->renders++;
+        } else {
+            image = g::SideImage { view_projection.value(), scene_hash, 1 };
+        }
+    }
+
     // RBR 3D scene draw function is rerouted here
     void __fastcall render(void* p)
     {
         auto do_rendering = init_or_update_game_data(reinterpret_cast<uintptr_t>(p));
+        g::renderer = reinterpret_cast<uintptr_t>(p);
 
         if (g::d3d_dev->GetRenderTarget(0, &g::original_render_target) != D3D_OK) [[unlikely]] {
             dbg("Could not get render original target");
@@ -281,19 +620,66 @@ namespace rbr {
 
         g::is_rendering_3d = true;
 
-        static RenderTarget render_target_to_skip = RenderTarget::Left;
+        // The side monitors take turns, so that one of them is rendered in each frame with the default divisor of 2
+        static uint32_t frame;
+        const auto divisor = static_cast<uint32_t>(g::cfg.side_monitors_frame_divisor);
+        const auto skip_side_monitors = g::cfg.side_monitors_half_hz && (!g::cfg.side_monitors_half_hz_btb_only || rbr::is_on_btb_stage());
+        if (g::cfg.reuse_static_side_images && g::cfg != g::side_images_cfg) {
+            // Any setting may change what the side screens look like
+            std::ranges::fill(g::side_images, std::nullopt);
+            g::side_images_cfg = g::cfg;
+        }
+
+        // The panoramic projection renders all screens in the primary pass
+        static std::vector<RenderTarget> passes;
+        static std::vector<RenderTarget> reprojected;
+        passes.clear();
+        reprojected.clear();
+        for (size_t i = 0; i < (dx::is_panorama_enabled() ? 1 : g::cfg.cameras.size()); ++i) {
+            passes.push_back(static_cast<RenderTarget>(i));
+        }
+        if (g::cfg.camera_pass_order == LatencyOptimized) {
+            // The game camera is sampled once per frame before the render call, so the primary image
+            // is the freshest at Present when it's rendered right before it
+            std::ranges::rotate(passes, passes.begin() + 1);
+        }
 
-        for (const auto& [i, c] : std::views::enumerate(g::cfg.cameras)) {
-            if (g::cfg.side_monitors_half_hz && i == render_target_to_skip) {
-                if (!g::cfg.side_monitors_half_hz_btb_only || (g::cfg.side_monitors_half_hz_btb_only && rbr::is_on_btb_stage())) {
-                    continue;
+        for (const auto tgt : passes) {
+            if (tgt != RenderTarget::Primary && skip_static_side_pass(tgt)) {
+                continue;
+            }
+            if (skip_side_monitors && tgt != RenderTarget::Primary && (frame % divisor) != ((tgt - 1) % divisor)) {
+                if (g::cfg.side_monitors_reprojection) {
+                    reprojected.push_back(tgt);
                 }
+                continue;
             }
-            dx::set_render_target(static_cast<RenderTarget>(i));
+            profiler::begin_pass(tgt);
+            dx::set_render_target(tgt);
+            const auto interlaced = dx::begin_interlaced_pass(tgt);
+            rotate_camera(reinterpret_cast<uintptr_t>(p), tgt);
+            dx::begin_game_pass(tgt);
             g::hooks::render.call(p);
+            dx::end_game_pass();
+            restore_camera(reinterpret_cast<uintptr_t>(p), tgt);
+            if (interlaced) {
+                // Also saves the reconstructed image for reprojection
+                dx::end_interlaced_pass(tgt);
+            } else if (skip_side_monitors && g::cfg.side_monitors_reprojection && tgt != RenderTarget::Primary) {
+                dx::save_reprojection_history(tgt);
+            }
+            if (tgt != RenderTarget::Primary) {
+                save_side_image(tgt);
+            }
+            profiler::end_pass();
         };
 
-        render_target_to_skip = (render_target_to_skip == RenderTarget::Right) ? RenderTarget::Left : RenderTarget::Right;
+        // After the passes, so that the skipped screens are turned with the newest game camera in any pass order
+        for (const auto tgt : reprojected) {
+            dx::reproject(tgt);
+        }
+
+        frame++;
         dx::set_render_target(RenderTarget::Primary, false);
         g::is_rendering_3d = false;
     }
@@ -4,6 +4,8 @@
 
 #include <cstdint>
 #include <d3d9.h>
+#include <optional>
+#include <string_view>
 
 namespace rbr {
     enum GameMode : uint32_t {
@@ -20,6 +22,20 @@ namespace rbr {
         Starting = 12,
     };
 
+    std::optional<GameMode> game_mode_from_string(std::string_view str);
+    const char* to_string(GameMode mode);
+
+    // Order of the camera passes in a frame. The screen rendered last has the newest image at Present.
+    enum PassOrder : uint32_t {
+        // The cameras in the order they are configured, the primary first
+        ConfigOrder = 0,
+        // The side screens first and the primary last
+        LatencyOptimized = 1,
+    };
+
+    const char* to_string(PassOrder order);
+    PassOrder pass_order_from_string(std::string_view str);
+
     uintptr_t get_render_function_addr();
     uintptr_t get_hedgehog_address(uintptr_t);
     GameMode get_game_mode();
@@ -27,6 +43,11 @@ namespace rbr {
     bool is_loading_btb_stage();
     bool is_rendering_3d();
     bool is_using_cockpit_camera();
+    // Whether the game camera is turned towards the screen of the current pass
+    bool is_camera_rotated();
+    // Orientation of the game camera read from the camera object, without the rotation of the pass.
+    // Known once the orientation has been found in the camera object.
+    std::optional<glm::mat3> get_camera_orientation();
     uint32_t get_current_stage_id();
 
     void update_current_camera_fov(uintptr_t p);
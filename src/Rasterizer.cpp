@@ -0,0 +1,314 @@
+#include "Rasterizer.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <functional>
+#include <optional>
+
+#include <vec4.hpp>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#endif
+
+namespace rasterizer {
+    // Vertices closer to the camera plane than this are treated as crossing the near plane
+    constexpr float MIN_W = 1e-5f;
+
+    // Edge function a * x + b * y + c, positive on the inner side of the edge
+    struct Edge {
+        float a;
+        float b;
+        float c;
+    };
+
+    struct Triangle {
+        std::array<Edge, 3> edges;
+        float z;
+        int32_t xmin;
+        int32_t xmax;
+        int32_t ymin;
+        int32_t ymax;
+    };
+
+    // Pixels a box touches, and its nearest depth
+    struct Rect {
+        int32_t xmin;
+        int32_t xmax;
+        int32_t ymin;
+        int32_t ymax;
+        float z;
+    };
+
+    static std::optional<glm::vec3> to_screen(const glm::mat4& m, const glm::vec3& p, uint32_t width, uint32_t height)
+    {
+        const auto c = m * glm::vec4(p, 1.0f);
+        if (!(c.w > MIN_W) || c.z < 0.0f) {
+            return std::nullopt;
+        }
+        return glm::vec3 { (c.x / c.w * 0.5f + 0.5f) * width, (0.5f - c.y / c.w * 0.5f) * height, c.z / c.w };
+    }
+
+    static std::optional<Triangle> setup(const glm::mat4& m, const glm::vec3* v, uint32_t width, uint32_t height)
+    {
+        std::array<glm::vec3, 3> s;
+        for (size_t i = 0; i < 3; ++i) {
+            const auto p = to_screen(m, v[i], width, height);
+            if (!p || !std::isfinite(p->x) || !std::isfinite(p->y)) {
+                return std::nullopt;
+            }
+            s[i] = p.value();
+        }
+        const auto area = (s[1].x - s[0].x) * (s[2].y - s[0].y) - (s[2].x - s[0].x) * (s[1].y - s[0].y);
+        if (std::abs(area) < 1e-6f) {
+            return std::nullopt;
+        }
+        if (area < 0.0f) {
+            std::swap(s[1], s[2]);
+        }
+        auto t = Triangle {};
+        for (size_t i = 0; i < 3; ++i) {
+            const auto& p = s[i];
+            const auto& q = s[(i + 1) % 3];
+            const auto a = p.y - q.y;
+            const auto b = q.x - p.x;
+            // Moved inwards by half a pixel along both axes, so that the edge function at a pixel center
+            // is its value at the corner of the pixel furthest outside, and only pixels fully inside pass
+            t.edges[i] = { a, b, -(a * p.x + b * p.y) - 0.5f * (std::abs(a) + std::abs(b)) };
+        }
+        t.z = std::min(std::max({ s[0].z, s[1].z, s[2].z }), 1.0f);
+        const auto [xmin, xmax] = std::minmax({ s[0].x, s[1].x, s[2].x });
+        const auto [ymin, ymax] = std::minmax({ s[0].y, s[1].y, s[2].y });
+        t.xmin = std::max(static_cast<int32_t>(std::floor(xmin)), 0);
+        t.xmax = std::min(static_cast<int32_t>(std::ceil(xmax)), static_cast<int32_t>(width) - 1);
+        t.ymin = std::max(static_cast<int32_t>(std::floor(ymin)), 0);
+        t.ymax = std::min(static_cast<int32_t>(std::ceil(ymax)), static_cast<int32_t>(height) - 1);
+        if (t.xmin > t.xmax || t.ymin > t.ymax) {
+            return std::nullopt;
+        }
+        return t;
+    }
+
+    static std::optional<Rect> project(const glm::mat4& m, const culling::Aabb& box, uint32_t width, uint32_t height)
+    {
+        auto min = glm::vec3(INFINITY);
+        auto max = glm::vec3(-INFINITY);
+        for (uint32_t i = 0; i < 8; ++i) {
+            const auto corner = glm::vec3 { (i & 1) ? box.max.x : box.min.x, (i & 2) ? box.max.y : box.min.y, (i & 4) ? box.max.z : box.min.z };
+            const auto p = to_screen(m, corner, width, height);
+            if (!p) {
+                return std::nullopt;
+            }
+            min = glm::min(min, p.value());
+            max = glm::max(max, p.value());
+        }
+        if (!std::isfinite(min.x) || !std::isfinite(min.y) || !std::isfinite(max.x) || !std::isfinite(max.y)) {
+            return std::nullopt;
+        }
+        auto r = Rect {
+            .xmin = std::max(static_cast<int32_t>(std::floor(min.x)), 0),
+            .xmax = std::min(static_cast<int32_t>(std::ceil(max.x)) - 1, static_cast<int32_t>(width) - 1),
+            .ymin = std::max(static_cast<int32_t>(std::floor(min.y)), 0),
+            .ymax = std::min(static_cast<int32_t>(std::ceil(max.y)) - 1, static_cast<int32_t>(height) - 1),
+            .z = min.z,
+        };
+        // Partly off the screen is fine, as long as the part on it is hidden
+        if (r.xmin > r.xmax || r.ymin > r.ymax) {
+            return std::nullopt;
+        }
+        return r;
+    }
+
+    Mesh assemble(uint32_t primitive_type, uint32_t primitive_count, std::span<const glm::vec3> positions, std::span<const uint32_t> indices)
+    {
+        // D3DPRIMITIVETYPE values
+        const auto list = primitive_type == 4;
+        const auto strip = primitive_type == 5;
+        const auto index_count = list ? primitive_count * 3 : primitive_count + 2;
+        if ((!list && !strip) || primitive_count == 0 || indices.size() < index_count) {
+            return {};
+        }
+        auto mesh = Mesh {};
+        mesh.reserve(static_cast<size_t>(primitive_count) * 3);
+        for (uint32_t i = 0; i < primitive_count; ++i) {
+            const auto first = list ? i * 3 : i;
+            for (uint32_t j = 0; j < 3; ++j) {
+                const auto index = indices[first + j];
+                if (index >= positions.size()) {
+                    return {};
+                }
+                mesh.push_back(positions[index]);
+            }
+        }
+        return mesh;
+    }
+
+    DepthBuffer::DepthBuffer(uint32_t w, uint32_t h)
+        : width((std::max(w, 8u) + 7) & ~7u)
+        , height(std::max(h, 1u))
+        , depth(static_cast<size_t>(width) * height, 1.0f)
+    {
+    }
+
+    void DepthBuffer::clear()
+    {
+        std::ranges::fill(depth, 1.0f);
+    }
+
+    void DepthBuffer::draw_scalar(const glm::mat4& m, std::span<const glm::vec3> triangles)
+    {
+        for (size_t i = 0; i + 2 < triangles.size(); i += 3) {
+            const auto t = setup(m, &triangles[i], width, height);
+            if (!t) {
+                continue;
+            }
+            const auto& [e0, e1, e2] = t->edges;
+            for (auto y = t->ymin; y <= t->ymax; ++y) {
+                const auto py = static_cast<float>(y) + 0.5f;
+                auto* row = depth.data() + static_cast<size_t>(y) * width;
+                for (auto x = t->xmin; x <= t->xmax; ++x) {
+                    const auto px = static_cast<float>(x) + 0.5f;
+                    if (e0.a * px + (e0.b * py + e0.c) >= 0.0f && e1.a * px + (e1.b * py + e1.c) >= 0.0f && e2.a * px + (e2.b * py + e2.c) >= 0.0f) {
+                        row[x] = std::min(row[x], t->z);
+                    }
+                }
+            }
+        }
+    }
+
+    void DepthBuffer::draw(const glm::mat4& m, std::span<const glm::vec3> triangles)
+    {
+#if defined(__AVX__)
+        const auto lanes = _mm256_setr_ps(0.5f, 1.5f, 2.5f, 3.5f, 4.5f, 5.5f, 6.5f, 7.5f);
+        const auto zero = _mm256_setzero_ps();
+        for (size_t i = 0; i + 2 < triangles.size(); i += 3) {
+            const auto t = setup(m, &triangles[i], width, height);
+            if (!t) {
+                continue;
+            }
+            const auto& [e0, e1, e2] = t->edges;
+            const auto a0 = _mm256_set1_ps(e0.a);
+            const auto a1 = _mm256_set1_ps(e1.a);
+            const auto a2 = _mm256_set1_ps(e2.a);
+            const auto z = _mm256_set1_ps(t->z);
+            for (auto y = t->ymin; y <= t->ymax; ++y) {
+                const auto py = static_cast<float>(y) + 0.5f;
+                // Rows of the three edge functions at the pixel center of x = 0
+                const auto c0 = _mm256_set1_ps(e0.b * py + e0.c);
+                const auto c1 = _mm256_set1_ps(e1.b * py + e1.c);
+                const auto c2 = _mm256_set1_ps(e2.b * py + e2.c);
+                auto* row = depth.data() + static_cast<size_t>(y) * width;
+                // The pixels outside of the bounds are outside of one of the edges, and the row is a multiple of 8 wide
+                for (auto x = t->xmin & ~7; x <= t->xmax; x += 8) {
+                    const auto px = _mm256_add_ps(_mm256_set1_ps(static_cast<float>(x)), lanes);
+                    const auto in0 = _mm256_cmp_ps(_mm256_add_ps(_mm256_mul_ps(a0, px), c0), zero, _CMP_GE_OQ);
+                    const auto in1 = _mm256_cmp_ps(_mm256_add_ps(_mm256_mul_ps(a1, px), c1), zero, _CMP_GE_OQ);
+                    const auto in2 = _mm256_cmp_ps(_mm256_add_ps(_mm256_mul_ps(a2, px), c2), zero, _CMP_GE_OQ);
+                    const auto inside = _mm256_and_ps(_mm256_and_ps(in0, in1), in2);
+                    const auto d = _mm256_loadu_ps(row + x);
+                    _mm256_storeu_ps(row + x, _mm256_blendv_ps(d, _mm256_min_ps(d, z), inside));
+                }
+            }
+        }
+#else
+        draw_scalar(m, triangles);
+#endif
+    }
+
+    bool DepthBuffer::is_occluded_scalar(const glm::mat4& m, const culling::Aabb& box) const
+    {
+        const auto r = project(m, box, width, height);
+        if (!r) {
+            return false;
+        }
+        for (auto y = r->ymin; y <= r->ymax; ++y) {
+            const auto* row = depth.data() + static_cast<size_t>(y) * width;
+            for (auto x = r->xmin; x <= r->xmax; ++x) {
+                if (row[x] >= r->z) {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+    bool DepthBuffer::is_occluded(const glm::mat4& m, const culling::Aabb& box) const
+    {
+#if defined(__AVX__)
+        const auto r = project(m, box, width, height);
+        if (!r) {
+            return false;
+        }
+        const auto lanes = _mm256_setr_ps(0.0f, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f);
+        const auto xmin = _mm256_set1_ps(static_cast<float>(r->xmin));
+        const auto xmax = _mm256_set1_ps(static_cast<float>(r->xmax));
+        const auto z = _mm256_set1_ps(r->z);
+        for (auto y = r->ymin; y <= r->ymax; ++y) {
+            const auto* row = depth.data() + static_cast<size_t>(y) * width;
+            for (auto x = r->xmin & ~7; x <= r->xmax; x += 8) {
+                const auto px = _mm256_add_ps(_mm256_set1_ps(static_cast<float>(x)), lanes);
+                const auto in_rect = _mm256_and_ps(_mm256_cmp_ps(px, xmin, _CMP_GE_OQ), _mm256_cmp_ps(px, xmax, _CMP_LE_OQ));
+                const auto visible = _mm256_cmp_ps(_mm256_loadu_ps(row + x), z, _CMP_GE_OQ);
+                if (_mm256_movemask_ps(_mm256_and_ps(in_rect, visible)) != 0) {
+                    return false;
+                }
+            }
+        }
+        return true;
+#else
+        return is_occluded_scalar(m, box);
+#endif
+    }
+
+    size_t MeshKeyHash::operator()(const MeshKey& key) const
+    {
+        auto h = std::hash<const void*> {}(key.vertex_buffer) ^ (std::hash<const void*> {}(key.index_buffer) << 1);
+        for (const auto v : { static_cast<uint32_t>(key.base_vertex), key.first_vertex, key.vertex_count, key.start_index,
+                 key.primitive_type, key.primitive_count, key.stride, key.position_offset }) {
+            h ^= std::hash<uint32_t> {}(v) + 0x9e3779b9 + (h << 6) + (h >> 2);
+        }
+        return h;
+    }
+
+    const Mesh& MeshCache::insert(const MeshKey& key, Mesh mesh)
+    {
+        if (vertex_count + mesh.size() > MAX_CACHED_VERTICES || by_buffer.size() >= MAX_CACHED_MESHES) {
+            clear();
+        }
+        if (const auto it = meshes.find(key); it != meshes.end()) {
+            vertex_count -= it->second.size();
+        }
+        vertex_count += mesh.size();
+        by_buffer.emplace(key.vertex_buffer, key);
+        if (key.index_buffer) {
+            by_buffer.emplace(key.index_buffer, key);
+        }
+        auto& ret = meshes[key];
+        ret = std::move(mesh);
+        return ret;
+    }
+
+    void MeshCache::invalidate(const void* buffer)
+    {
+        const auto [first, last] = by_buffer.equal_range(buffer);
+        if (first == last) {
+            return;
+        }
+        for (auto it = first; it != last; ++it) {
+            if (const auto mesh = meshes.find(it->second); mesh != meshes.end()) {
+                vertex_count -= mesh->second.size();
+                meshes.erase(mesh);
+            }
+        }
+        // The entries of the other buffer of the meshes are left behind, and skipped when that buffer is written to
+        by_buffer.erase(first, last);
+    }
+
+    void MeshCache::clear()
+    {
+        meshes.clear();
+        by_buffer.clear();
+        vertex_count = 0;
+    }
+}
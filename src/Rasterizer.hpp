@@ -0,0 +1,92 @@
+#pragma once
+
+#include "Culling.hpp"
+
+#include <cstdint>
+#include <span>
+#include <unordered_map>
+#include <vector>
+
+#include <mat4x4.hpp>
+#include <vec3.hpp>
+
+// Software occlusion culling. The large opaque draws of a camera pass are rasterized into a small depth
+// buffer on the CPU, and the bounding boxes of the draws after them are tested against it before they are
+// submitted. The rasterizer is conservative in depth: each triangle is written with the depth of its
+// furthest vertex, and a box is occluded only if its nearest point is behind every pixel it touches.
+// It is conservative in coverage too: a triangle only writes the pixels it covers entirely, which leaves
+// the pixels on the shared edges of a mesh unwritten.
+// Does not depend on the game or D3D, and uses AVX if the build targets it.
+namespace rasterizer {
+    // Triangle list in object space, three vertices per triangle
+    using Mesh = std::vector<glm::vec3>;
+
+    // Triangles of a draw of a D3DPRIMITIVETYPE, from the positions of its vertex range and indices relative
+    // to the start of the range. Only triangle lists and strips are supported, anything else gives no triangles.
+    Mesh assemble(uint32_t primitive_type, uint32_t primitive_count, std::span<const glm::vec3> positions, std::span<const uint32_t> indices);
+
+    class DepthBuffer {
+        uint32_t width;
+        uint32_t height;
+        // Row major, D3D depth from 0 (near) to 1 (far)
+        std::vector<float> depth;
+
+    public:
+        // The width is rounded up to a multiple of 8
+        DepthBuffer(uint32_t width, uint32_t height);
+
+        void clear();
+        void draw(const glm::mat4& clip_from_object, std::span<const glm::vec3> triangles);
+        void draw_scalar(const glm::mat4& clip_from_object, std::span<const glm::vec3> triangles);
+
+        // Whether the box is behind the occluders drawn so far. Boxes crossing the near plane
+        // or outside of the screen are never occluded.
+        bool is_occluded(const glm::mat4& clip_from_object, const culling::Aabb& box) const;
+        bool is_occluded_scalar(const glm::mat4& clip_from_object, const culling::Aabb& box) const;
+
+        const std::vector<float>& pixels() const { return depth; }
+    };
+
+    // Meshes of the draws used as occluders, by the buffers and the range they are drawn from
+    struct MeshKey {
+        const void* vertex_buffer;
+        const void* index_buffer;
+        int32_t base_vertex;
+        uint32_t first_vertex;
+        uint32_t vertex_count;
+        uint32_t start_index;
+        uint32_t primitive_type;
+        uint32_t primitive_count;
+        uint32_t stride;
+        uint32_t position_offset;
+
+        bool operator==(const MeshKey&) const = default;
+    };
+
+    struct MeshKeyHash {
+        size_t operator()(const MeshKey& key) const;
+    };
+
+    // Cached occluder vertices at most, 12 bytes each, and draws
+    constexpr size_t MAX_CACHED_VERTICES = 1 << 20;
+    constexpr size_t MAX_CACHED_MESHES = 1 << 16;
+
+    class MeshCache {
+        std::unordered_map<MeshKey, Mesh, MeshKeyHash> meshes;
+        std::unordered_multimap<const void*, MeshKey> by_buffer;
+        size_t vertex_count = 0;
+
+    public:
+        const Mesh* find(const MeshKey& key) const
+        {
+            const auto it = meshes.find(key);
+            return it != meshes.end() ? &it->second : nullptr;
+        }
+        // An empty mesh marks a draw that can't be used as an occluder. Drops all the meshes if they grow too large.
+        const Mesh& insert(const MeshKey& key, Mesh mesh);
+
+        // Drops the meshes drawn from a buffer that is written to, or created at the address of a released one
+        void invalidate(const void* buffer);
+        void clear();
+    };
+}
@@ -9,14 +9,42 @@ bool create_render_target(
     D3DFORMAT depth_stencil_fmt,
     D3DMULTISAMPLE_TYPE msaa,
     uint32_t w,
-    uint32_t h)
+    uint32_t h,
+    IDirect3DTexture9** texture)
 {
     dbg(std::format("create_render_target: surface: {:x} depth_surface: {:x} fmt: {} depth_fmt: {} msaa: {} w: {} h: {}", (uintptr_t)surface, (uintptr_t)depth_stencil_surface, (int)fmt, (int)depth_stencil_fmt, (int)msaa, w, h));
-    HRESULT ret = dev->CreateRenderTarget(w, h, fmt, msaa, 0, false, surface, nullptr);
-    ret |= dev->CreateDepthStencilSurface(w, h, depth_stencil_fmt, msaa, 0, TRUE, depth_stencil_surface, nullptr);
+    // The outputs are only set when everything was created, so that a failure doesn't leave half of it behind
+    IDirect3DTexture9* tex = nullptr;
+    IDirect3DSurface9* rt = nullptr;
+    IDirect3DSurface9* ds = nullptr;
+    HRESULT ret;
+    if (texture && msaa == D3DMULTISAMPLE_NONE) {
+        // Render target that can also be sampled, so that it can be composed without a copy
+        ret = dev->CreateTexture(w, h, 1, D3DUSAGE_RENDERTARGET, fmt, D3DPOOL_DEFAULT, &tex, nullptr);
+        if (SUCCEEDED(ret)) {
+            ret = tex->GetSurfaceLevel(0, &rt);
+        }
+    } else {
+        ret = dev->CreateRenderTarget(w, h, fmt, msaa, 0, false, &rt, nullptr);
+    }
+    if (SUCCEEDED(ret)) {
+        ret = dev->CreateDepthStencilSurface(w, h, depth_stencil_fmt, msaa, 0, TRUE, &ds, nullptr);
+    }
     if (FAILED(ret)) {
         dbg("D3D initialization failed: CreateRenderTarget");
+        if (rt) {
+            rt->Release();
+        }
+        if (tex) {
+            tex->Release();
+        }
         return false;
     }
+
+    *surface = rt;
+    *depth_stencil_surface = ds;
+    if (texture) {
+        *texture = tex;
+    }
     return true;
 }
@@ -16,4 +16,5 @@ bool create_render_target(
     D3DFORMAT depth_stencil_fmt,
     D3DMULTISAMPLE_TYPE msaa,
     uint32_t w,
-    uint32_t h);
+    uint32_t h,
+    IDirect3DTexture9** texture = nullptr);
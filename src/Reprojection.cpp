@@ -0,0 +1,51 @@
+#include "Reprojection.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace reprojection {
+    glm::mat3 homography(const glm::mat4& old_view, const glm::mat4& new_view, const glm::mat4& projection, uint32_t w, uint32_t h)
+    {
+        const auto fw = static_cast<float>(w);
+        const auto fh = static_cast<float>(h);
+
+        // glm matrices are column major, so these read transposed
+        // Pixel coordinates to normalized device coordinates
+        const auto pixel_to_ndc = glm::mat3(
+            2.0f / fw, 0.0f, 0.0f,
+            0.0f, -2.0f / fh, 0.0f,
+            -1.0f, 1.0f, 1.0f);
+        // Normalized device coordinates to texture coordinates
+        const auto ndc_to_uv = glm::mat3(
+            0.5f, 0.0f, 0.0f,
+            0.0f, -0.5f, 0.0f,
+            0.5f, 0.5f, 1.0f);
+        const auto unproject = glm::mat3(
+            1.0f / projection[0][0], 0.0f, 0.0f,
+            0.0f, 1.0f / projection[1][1], 0.0f,
+            0.0f, 0.0f, 1.0f);
+        const auto project = glm::mat3(
+            projection[0][0], 0.0f, 0.0f,
+            0.0f, projection[1][1], 0.0f,
+            0.0f, 0.0f, 1.0f);
+
+        // View direction in the new camera space to the old camera space
+        const auto rotation = glm::mat3(old_view) * glm::transpose(glm::mat3(new_view));
+
+        return ndc_to_uv * project * rotation * unproject * pixel_to_ndc;
+    }
+
+    void warp(const uint32_t* src, uint32_t* dst, uint32_t w, uint32_t h, const glm::mat3& homography)
+    {
+        for (uint32_t y = 0; y < h; ++y) {
+            for (uint32_t x = 0; x < w; ++x) {
+                const auto q = homography * glm::vec3(x + 0.5f, y + 0.5f, 1.0f);
+                const auto u = q.x / q.z;
+                const auto v = q.y / q.z;
+                const auto sx = std::clamp(static_cast<int64_t>(std::floor(u * w)), int64_t { 0 }, static_cast<int64_t>(w) - 1);
+                const auto sy = std::clamp(static_cast<int64_t>(std::floor(v * h)), int64_t { 0 }, static_cast<int64_t>(h) - 1);
+                dst[y * w + x] = src[sy * w + sx];
+            }
+        }
+    }
+}
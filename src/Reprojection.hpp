@@ -0,0 +1,21 @@
+#pragma once
+
+#include <cstdint>
+
+#include <mat3x3.hpp>
+#include <mat4x4.hpp>
+
+// Rotational reprojection of a previously rendered camera image.
+// When a side camera's pass is skipped, its last image is warped with the rotation
+// the camera has made since, which hides most of the judder of the stale image.
+namespace reprojection {
+    // Homography that maps continuous pixel coordinates of the new image to
+    // homogeneous texture coordinates of the old image. `old_view` and `new_view` are the
+    // world to view transformations of the camera and `projection` its projection matrix.
+    // Only the rotation of the view matrices is used.
+    glm::mat3 homography(const glm::mat4& old_view, const glm::mat4& new_view, const glm::mat4& projection, uint32_t w, uint32_t h);
+
+    // CPU reference of the warp done on the GPU for the tests, with nearest neighbour sampling and
+    // clamping at the image edges. `src` and `dst` are w * h pixels.
+    void warp(const uint32_t* src, uint32_t* dst, uint32_t w, uint32_t h, const glm::mat3& homography);
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstdint>
+
+// Per frame performance counters, collected during the frame and shown in the statistics menu
+struct FrameStats {
+    // Clears skipped by the clear policy
+    uint32_t clears_avoided;
+    // Side passes skipped because the camera and the scene stood still
+    uint32_t side_passes_reused;
+    // Draws skipped by the frustum culling, and their primitives
+    uint32_t draws_culled;
+    uint32_t primitives_culled;
+    // Offscreen passes skipped because an earlier camera pass of the frame rendered them, and their draws
+    uint32_t offscreen_passes_skipped;
+    uint32_t offscreen_draws_skipped;
+    uint32_t offscreen_primitives_skipped;
+    // Writes to the dynamic buffers that were already in the buffers, and their bytes
+    uint32_t uploads_skipped;
+    uint64_t upload_bytes_skipped;
+    // Vertex shader constant sets of the game when batched, and the calls they were uploaded in
+    uint32_t shader_constant_sets;
+    uint32_t shader_constant_uploads;
+    // Occlusion queries issued, their results read and the results with no visible pixels
+    uint32_t occlusion_queries;
+    uint32_t occlusion_results;
+    uint32_t occlusion_hits;
+    // Draws skipped because they were hidden in an earlier frame, and their primitives
+    uint32_t occlusion_draws_skipped;
+    uint32_t occlusion_primitives_skipped;
+    // Draws rasterized as occluders on the CPU and their triangles, and the draws skipped because they were behind them
+    uint32_t occluders_drawn;
+    uint32_t occluder_triangles;
+    uint32_t draws_occluded;
+    uint32_t primitives_occluded;
+    // CPU time from the start of each camera pass to Present, zero if the camera was not rendered
+    float pass_to_present_ms[3];
+    // Frames unfinished by the GPU before this frame, the time waited for them, and the time from Present
+    // until the GPU finished the last finished frame
+    uint32_t frames_in_flight;
+    float frames_in_flight_wait_ms;
+    float present_to_gpu_finish_ms;
+};
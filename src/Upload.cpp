@@ -0,0 +1,144 @@
+#include "Upload.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+namespace upload {
+    static Range hull(const Range& a, const Range& b)
+    {
+        if (a.empty()) {
+            return b;
+        }
+        return { std::min(a.begin, b.begin), std::max(a.end, b.end) };
+    }
+
+    static Range intersection(const Range& a, const Range& b)
+    {
+        return { std::max(a.begin, b.begin), std::min(a.end, b.end) };
+    }
+
+    static bool touches(const Range& a, const Range& b)
+    {
+        return !a.empty() && a.begin <= b.end && b.begin <= a.end;
+    }
+
+    Write Deduplicator::pay_back(Buffer& b)
+    {
+        // The discard renames the buffer, and the gaps in the range hold whatever the shadow has
+        b.borrowed = false;
+        b.valid = b.since_discard;
+        return { b.since_discard.begin, b.since_discard.end - b.since_discard.begin, LOCK_DISCARD, b.shadow.data() + b.since_discard.begin };
+    }
+
+    uint8_t* Deduplicator::lock(const void* buffer, uint32_t buffer_size, uint32_t offset, uint32_t size, uint32_t flags, std::optional<Write>& flush)
+    {
+        auto& b = buffers[buffer];
+        if (b.shadow.size() != buffer_size) {
+            b = Buffer {};
+            b.shadow.resize(buffer_size);
+        }
+        b.locked_this_frame = true;
+
+        const auto r = Range { offset, size == 0 ? buffer_size : std::min(offset + size, buffer_size) };
+        if (r.empty() || b.pending) {
+            // Invalid or nested locks go to the buffer as they are
+            if (b.borrowed) {
+                flush = pay_back(b);
+            }
+            b.valid = {};
+            b.known = false;
+            return nullptr;
+        }
+        // The part of the range the game has not written since its discard is undefined to it, so it's
+        // safe to fill in from the shadow even if the shadow does not match the buffer there
+        const auto written = intersection(r, b.since_discard);
+        if ((flags & LOCK_DISCARD) || b.valid.contains(r) || (b.known && (written.empty() || b.valid.contains(written)))) {
+            // Parts of the range the game does not write keep their contents
+            b.pending = r;
+            b.pending_flags = flags;
+            b.staging.assign(b.shadow.begin() + r.begin, b.shadow.begin() + r.end);
+            return b.staging.data();
+        }
+
+        // What is written now is not known, and the buffer must hold what the game has written since its discard
+        if (b.borrowed) {
+            flush = pay_back(b);
+        }
+        if (b.valid.overlaps(r)) {
+            b.valid = {};
+        }
+        b.since_discard = hull(b.since_discard, r);
+        b.known = false;
+        return nullptr;
+    }
+
+    Unlock Deduplicator::unlock(const void* buffer)
+    {
+        const auto it = buffers.find(buffer);
+        if (it == buffers.end() || !it->second.pending) {
+            return {};
+        }
+        auto& b = it->second;
+        const auto r = b.pending.value();
+        const auto size = r.end - r.begin;
+        b.pending.reset();
+
+        const auto same = b.valid.contains(r) && std::memcmp(b.staging.data(), b.shadow.data() + r.begin, size) == 0;
+        if (b.pending_flags & LOCK_DISCARD) {
+            b.since_discard = r;
+            b.known = true;
+            if (same) {
+                b.borrowed = true;
+                return { true, size };
+            }
+            std::ranges::copy(b.staging, b.shadow.begin() + r.begin);
+            b.borrowed = false;
+            b.valid = r;
+            return { true, 0, Write { r.begin, size, b.pending_flags, b.shadow.data() + r.begin } };
+        }
+
+        b.since_discard = hull(b.since_discard, r);
+        if (same) {
+            return { true, size };
+        }
+        std::ranges::copy(b.staging, b.shadow.begin() + r.begin);
+        if (b.borrowed) {
+            // The draws before the skipped discard may be using the range, so the buffer is renamed with the new data
+            return { true, 0, pay_back(b) };
+        }
+        b.valid = touches(b.valid, r) ? hull(b.valid, r) : r;
+        return { true, 0, Write { r.begin, size, b.pending_flags, b.shadow.data() + r.begin } };
+    }
+
+    std::optional<Write> Deduplicator::forget(const void* buffer)
+    {
+        const auto it = buffers.find(buffer);
+        if (it == buffers.end() || it->second.pending) {
+            return std::nullopt;
+        }
+        auto ret = std::optional<Write> {};
+        if (it->second.borrowed) {
+            // The write points to the shadow, which is kept until the next call
+            ret = pay_back(it->second);
+            it->second.locked_this_frame = false;
+            it->second.valid = {};
+            it->second.known = false;
+            return ret;
+        }
+        buffers.erase(it);
+        return ret;
+    }
+
+    void Deduplicator::end_frame()
+    {
+        std::erase_if(buffers, [](const auto& entry) {
+            const auto& b = entry.second;
+            return !b.locked_this_frame && !b.borrowed && !b.pending;
+        });
+        for (auto& [buffer, b] : buffers) {
+            b.valid = {};
+            b.known = false;
+            b.locked_this_frame = false;
+        }
+    }
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+// Deduplication of the writes to dynamic vertex and index buffers. The game writes its particles, rain
+// and dust again in every camera pass, so the locks of the dynamic buffers are redirected to memory of
+// our own, and the data is only uploaded to the buffer at unlock if it differs from what the buffer holds.
+// Not thread safe: the locks must come from one thread, as they do with a device created without
+// D3DCREATE_MULTITHREADED. The deduplication is not used with a multithreaded device.
+namespace upload {
+    // D3DLOCK flags
+    constexpr uint32_t LOCK_NOOVERWRITE = 0x1000;
+    constexpr uint32_t LOCK_DISCARD = 0x2000;
+
+    struct Range {
+        uint32_t begin;
+        uint32_t end;
+
+        bool empty() const { return begin >= end; }
+        bool contains(const Range& r) const { return !empty() && r.begin >= begin && r.end <= end; }
+        bool overlaps(const Range& r) const { return begin < r.end && r.begin < end; }
+    };
+
+    // Write to a buffer with a lock of `size` bytes at `offset`
+    struct Write {
+        uint32_t offset;
+        uint32_t size;
+        uint32_t flags;
+        const uint8_t* data;
+    };
+
+    struct Unlock {
+        // Whether the lock was redirected
+        bool intercepted;
+        // Bytes that were already in the buffer and not uploaded again
+        uint32_t bytes_skipped;
+        std::optional<Write> write;
+    };
+
+    class Deduplicator {
+        struct Buffer {
+            // Copy of the buffer, equal to the buffer in the `valid` range
+            std::vector<uint8_t> shadow;
+            std::vector<uint8_t> staging;
+            Range valid;
+            // Range written by the game since its last discard. The rest of the buffer is undefined to the game.
+            Range since_discard;
+            // Whether all the writes since the last discard were redirected, so that the shadow has them
+            bool known;
+            // A discard was skipped, so the buffer was not renamed and the draws before it may still use it
+            bool borrowed;
+            std::optional<Range> pending;
+            uint32_t pending_flags;
+            bool locked_this_frame;
+        };
+        std::unordered_map<const void*, Buffer> buffers;
+
+        // Rewrite of what the game has written since its discard, to rename a borrowed buffer
+        static Write pay_back(Buffer& b);
+
+    public:
+        // Lock of a dynamic buffer for writing. Returns the memory the game writes to if the lock is redirected,
+        // or null if the lock goes to the buffer, in which case `flush` has to be written to the buffer first if set.
+        uint8_t* lock(const void* buffer, uint32_t buffer_size, uint32_t offset, uint32_t size, uint32_t flags, std::optional<Write>& flush);
+        Unlock unlock(const void* buffer);
+
+        // Stops tracking a buffer. Returns the write needed to leave the buffer as the game expects it.
+        std::optional<Write> forget(const void* buffer);
+
+        // The buffers may be recreated between the frames, so what they hold is only known within a frame
+        void end_frame();
+
+        bool empty() const { return buffers.empty(); }
+    };
+}
@@ -0,0 +1,281 @@
+#include "Upscale.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+
+namespace upscale {
+    const char* const easu_shader_source = R"(
+sampler2D input : register(s0);
+float4 c0 : register(c0);
+float4 c1 : register(c1);
+
+float3 fetch(float2 p)
+{
+    p = clamp(p, 0.0, c0.xy - 1.0) + c1.zw;
+    return tex2Dlod(input, float4((p + 0.5) * c0.zw, 0.0, 0.0)).rgb;
+}
+
+float luma(float3 c)
+{
+    return 0.25 * c.r + 0.5 * c.g + 0.25 * c.b;
+}
+
+void edge(inout float2 dir, inout float len, float w, float la, float lb, float lc, float ld, float le)
+{
+    float dir_x = ld - lb;
+    float len_x = saturate(abs(dir_x) / max(max(abs(ld - lc), abs(lc - lb)), 1.0e-5));
+    float dir_y = le - la;
+    float len_y = saturate(abs(dir_y) / max(max(abs(le - lc), abs(lc - la)), 1.0e-5));
+    dir += float2(dir_x, dir_y) * w;
+    len += (len_x * len_x + len_y * len_y) * w;
+}
+
+void tap(inout float3 color, inout float weight, float2 off, float2 dir, float2 len2, float lob, float clp, float3 c)
+{
+    float2 v = float2(dot(off, dir), dot(off, float2(-dir.y, dir.x))) * len2;
+    float d2 = min(dot(v, v), clp);
+    float wb = 0.4 * d2 - 1.0;
+    float wa = lob * d2 - 1.0;
+    wb *= wb;
+    wa *= wa;
+    wb = 1.5625 * wb - 0.5625;
+    float w = wb * wa;
+    color += c * w;
+    weight += w;
+}
+
+float4 main(float2 vpos : VPOS) : COLOR
+{
+    float2 p = (floor(vpos) + 0.5) * c1.xy - 0.5;
+    float2 fp = floor(p);
+    float2 f = p - fp;
+
+    //   b c
+    // e f g h
+    // i j k l
+    //   n o
+    float3 b = fetch(fp + float2(0, -1));
+    float3 c = fetch(fp + float2(1, -1));
+    float3 e = fetch(fp + float2(-1, 0));
+    float3 ff = fetch(fp + float2(0, 0));
+    float3 g = fetch(fp + float2(1, 0));
+    float3 h = fetch(fp + float2(2, 0));
+    float3 i = fetch(fp + float2(-1, 1));
+    float3 j = fetch(fp + float2(0, 1));
+    float3 k = fetch(fp + float2(1, 1));
+    float3 l = fetch(fp + float2(2, 1));
+    float3 n = fetch(fp + float2(0, 2));
+    float3 o = fetch(fp + float2(1, 2));
+
+    float lb = luma(b), lc = luma(c), le = luma(e), lf = luma(ff), lg = luma(g), lh = luma(h);
+    float li = luma(i), lj = luma(j), lk = luma(k), ll = luma(l), ln = luma(n), lo = luma(o);
+
+    float2 dir = 0.0;
+    float len = 0.0;
+    edge(dir, len, (1.0 - f.x) * (1.0 - f.y), lb, le, lf, lg, lj);
+    edge(dir, len, f.x * (1.0 - f.y), lc, lf, lg, lh, lk);
+    edge(dir, len, (1.0 - f.x) * f.y, lf, li, lj, lk, ln);
+    edge(dir, len, f.x * f.y, lg, lj, lk, ll, lo);
+
+    float dir2 = dot(dir, dir);
+    dir = dir2 < 1.0 / 32768.0 ? float2(1.0, 0.0) : dir * rsqrt(dir2);
+    len *= 0.5;
+    len *= len;
+    float stretch = 1.0 / max(abs(dir.x), abs(dir.y));
+    float2 len2 = float2(1.0 + (stretch - 1.0) * len, 1.0 - 0.5 * len);
+    float lob = 0.5 + (0.25 - 0.04 - 0.5) * len;
+    float clp = 1.0 / lob;
+
+    float3 color = 0.0;
+    float weight = 0.0;
+    tap(color, weight, float2(0, -1) - f, dir, len2, lob, clp, b);
+    tap(color, weight, float2(1, -1) - f, dir, len2, lob, clp, c);
+    tap(color, weight, float2(-1, 0) - f, dir, len2, lob, clp, e);
+    tap(color, weight, float2(0, 0) - f, dir, len2, lob, clp, ff);
+    tap(color, weight, float2(1, 0) - f, dir, len2, lob, clp, g);
+    tap(color, weight, float2(2, 0) - f, dir, len2, lob, clp, h);
+    tap(color, weight, float2(-1, 1) - f, dir, len2, lob, clp, i);
+    tap(color, weight, float2(0, 1) - f, dir, len2, lob, clp, j);
+    tap(color, weight, float2(1, 1) - f, dir, len2, lob, clp, k);
+    tap(color, weight, float2(2, 1) - f, dir, len2, lob, clp, l);
+    tap(color, weight, float2(0, 2) - f, dir, len2, lob, clp, n);
+    tap(color, weight, float2(1, 2) - f, dir, len2, lob, clp, o);
+
+    // Deringing: stay within the range of the nearest input pixels
+    float3 mn = min(min(ff, g), min(j, k));
+    float3 mx = max(max(ff, g), max(j, k));
+    return float4(clamp(color / weight, mn, mx), 1.0);
+}
+)";
+
+    using Color = std::array<float, 3>;
+
+    static Color unpack(uint32_t p)
+    {
+        return {
+            static_cast<float>((p >> 16) & 0xff) / 255.0f,
+            static_cast<float>((p >> 8) & 0xff) / 255.0f,
+            static_cast<float>(p & 0xff) / 255.0f,
+        };
+    }
+
+    static uint32_t pack(const Color& c)
+    {
+        const auto channel = [](float v) { return static_cast<uint32_t>(std::lround(std::clamp(v, 0.0f, 1.0f) * 255.0f)); };
+        return 0xff000000u | (channel(c[0]) << 16) | (channel(c[1]) << 8) | channel(c[2]);
+    }
+
+    static float luma(const Color& c)
+    {
+        return 0.25f * c[0] + 0.5f * c[1] + 0.25f * c[2];
+    }
+
+    static Color fetch(const uint32_t* src, int w, int h, int x, int y)
+    {
+        return unpack(src[std::clamp(y, 0, h - 1) * w + std::clamp(x, 0, w - 1)]);
+    }
+
+    float sharpness_from_stops(float stops)
+    {
+        return std::exp2(-stops);
+    }
+
+    // Accumulates the edge direction and length around one of the four center pixels.
+    // `la` is above, `lb` left, `lc` the pixel itself, `ld` right and `le` below.
+    static void edge(float& dir_x, float& dir_y, float& len, float w, float la, float lb, float lc, float ld, float le)
+    {
+        const auto dx = ld - lb;
+        const auto len_x = std::clamp(std::abs(dx) / std::max(std::max(std::abs(ld - lc), std::abs(lc - lb)), 1.0e-5f), 0.0f, 1.0f);
+        const auto dy = le - la;
+        const auto len_y = std::clamp(std::abs(dy) / std::max(std::max(std::abs(le - lc), std::abs(lc - la)), 1.0e-5f), 0.0f, 1.0f);
+        dir_x += dx * w;
+        dir_y += dy * w;
+        len += (len_x * len_x + len_y * len_y) * w;
+    }
+
+    void easu(const uint32_t* src, uint32_t src_w, uint32_t src_h, uint32_t* dst, uint32_t dst_w, uint32_t dst_h)
+    {
+        // Tap offsets from the top left center pixel, in the same order as in the shader
+        //   b c
+        // e f g h
+        // i j k l
+        //   n o
+        constexpr int offsets[12][2] = {
+            { 0, -1 }, { 1, -1 },
+            { -1, 0 }, { 0, 0 }, { 1, 0 }, { 2, 0 },
+            { -1, 1 }, { 0, 1 }, { 1, 1 }, { 2, 1 },
+            { 0, 2 }, { 1, 2 },
+        };
+        enum { B, C, E, F, G, H, I, J, K, L, N, O };
+
+        const auto sw = static_cast<int>(src_w);
+        const auto sh = static_cast<int>(src_h);
+        const auto scale_x = static_cast<float>(src_w) / static_cast<float>(dst_w);
+        const auto scale_y = static_cast<float>(src_h) / static_cast<float>(dst_h);
+
+        for (uint32_t y = 0; y < dst_h; ++y) {
+            for (uint32_t x = 0; x < dst_w; ++x) {
+                const auto px = (static_cast<float>(x) + 0.5f) * scale_x - 0.5f;
+                const auto py = (static_cast<float>(y) + 0.5f) * scale_y - 0.5f;
+                const auto fpx = std::floor(px);
+                const auto fpy = std::floor(py);
+                const auto fx = px - fpx;
+                const auto fy = py - fpy;
+
+                Color c[12];
+                float l[12];
+                for (int t = 0; t < 12; ++t) {
+                    c[t] = fetch(src, sw, sh, static_cast<int>(fpx) + offsets[t][0], static_cast<int>(fpy) + offsets[t][1]);
+                    l[t] = luma(c[t]);
+                }
+
+                float dir_x = 0.0f, dir_y = 0.0f, len = 0.0f;
+                edge(dir_x, dir_y, len, (1.0f - fx) * (1.0f - fy), l[B], l[E], l[F], l[G], l[J]);
+                edge(dir_x, dir_y, len, fx * (1.0f - fy), l[C], l[F], l[G], l[H], l[K]);
+                edge(dir_x, dir_y, len, (1.0f - fx) * fy, l[F], l[I], l[J], l[K], l[N]);
+                edge(dir_x, dir_y, len, fx * fy, l[G], l[J], l[K], l[L], l[O]);
+
+                const auto dir2 = dir_x * dir_x + dir_y * dir_y;
+                if (dir2 < 1.0f / 32768.0f) {
+                    dir_x = 1.0f;
+                    dir_y = 0.0f;
+                } else {
+                    const auto rcp = 1.0f / std::sqrt(dir2);
+                    dir_x *= rcp;
+                    dir_y *= rcp;
+                }
+                len *= 0.5f;
+                len *= len;
+                const auto stretch = 1.0f / std::max(std::abs(dir_x), std::abs(dir_y));
+                const auto len2_x = 1.0f + (stretch - 1.0f) * len;
+                const auto len2_y = 1.0f - 0.5f * len;
+                const auto lob = 0.5f + (0.25f - 0.04f - 0.5f) * len;
+                const auto clp = 1.0f / lob;
+
+                Color color = { 0.0f, 0.0f, 0.0f };
+                float weight = 0.0f;
+                for (int t = 0; t < 12; ++t) {
+                    const auto ox = static_cast<float>(offsets[t][0]) - fx;
+                    const auto oy = static_cast<float>(offsets[t][1]) - fy;
+                    const auto vx = (ox * dir_x + oy * dir_y) * len2_x;
+                    const auto vy = (ox * -dir_y + oy * dir_x) * len2_y;
+                    const auto d2 = std::min(vx * vx + vy * vy, clp);
+                    auto wb = 0.4f * d2 - 1.0f;
+                    auto wa = lob * d2 - 1.0f;
+                    wb *= wb;
+                    wa *= wa;
+                    wb = 1.5625f * wb - 0.5625f;
+                    const auto w = wb * wa;
+                    for (int ch = 0; ch < 3; ++ch) {
+                        color[ch] += c[t][ch] * w;
+                    }
+                    weight += w;
+                }
+
+                // Deringing: stay within the range of the nearest input pixels
+                for (int ch = 0; ch < 3; ++ch) {
+                    const auto mn = std::min(std::min(c[F][ch], c[G][ch]), std::min(c[J][ch], c[K][ch]));
+                    const auto mx = std::max(std::max(c[F][ch], c[G][ch]), std::max(c[J][ch], c[K][ch]));
+                    color[ch] = std::clamp(color[ch] / weight, mn, mx);
+                }
+                dst[y * dst_w + x] = pack(color);
+            }
+        }
+    }
+
+    void rcas(const uint32_t* src, uint32_t* dst, uint32_t w, uint32_t h, float sharpness)
+    {
+        const auto iw = static_cast<int>(w);
+        const auto ih = static_cast<int>(h);
+
+        for (int y = 0; y < ih; ++y) {
+            for (int x = 0; x < iw; ++x) {
+                //   b
+                // d e f
+                //   h
+                const auto b = fetch(src, iw, ih, x, y - 1);
+                const auto d = fetch(src, iw, ih, x - 1, y);
+                const auto e = fetch(src, iw, ih, x, y);
+                const auto f = fetch(src, iw, ih, x + 1, y);
+                const auto hh = fetch(src, iw, ih, x, y + 1);
+
+                auto lobe = -1.0f;
+                for (int ch = 0; ch < 3; ++ch) {
+                    const auto mn4 = std::min(std::min(b[ch], d[ch]), std::min(f[ch], hh[ch]));
+                    const auto mx4 = std::max(std::max(b[ch], d[ch]), std::max(f[ch], hh[ch]));
+                    const auto hit_min = std::min(mn4, e[ch]) / std::max(4.0f * mx4, 1.0e-5f);
+                    const auto hit_max = (1.0f - std::max(mx4, e[ch])) / std::min(4.0f * mn4 - 4.0f, -1.0e-5f);
+                    lobe = std::max(lobe, std::max(-hit_min, hit_max));
+                }
+                lobe = std::max(-0.1875f, std::min(lobe, 0.0f)) * sharpness;
+
+                Color out;
+                for (int ch = 0; ch < 3; ++ch) {
+                    out[ch] = (lobe * (b[ch] + d[ch] + f[ch] + hh[ch]) + e[ch]) / (4.0f * lobe + 1.0f);
+                }
+                dst[y * iw + x] = pack(out);
+            }
+        }
+    }
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstdint>
+
+// Edge adaptive spatial upscaling and contrast adaptive sharpening, in the spirit of
+// AMD FidelityFX Super Resolution 1 (EASU + RCAS). Used in the compositing pass for
+// cameras that are rendered at a reduced resolution.
+//
+// The shaders and the CPU reference implement the same math, so the CPU version
+// can be used for checking the image quality and the throughput without the game.
+namespace upscale {
+    // HLSL source of the upscaling pixel shader, drawn with the compositor vertex shader.
+    // s0 is the input texture (point sampled)
+    // c0 = (input width, input height, 1 / texture width, 1 / texture height)
+    // c1 = (input width / output width, input height / output height, input left, input top)
+    //
+    // The sharpening is done by the compositor pixel shader.
+    extern const char* const easu_shader_source;
+
+    // Sharpness amount from stops, 0 being the sharpest
+    float sharpness_from_stops(float stops);
+
+    // CPU references. Pixels are packed as 0xAARRGGBB like D3DFMT_A8R8G8B8,
+    // alpha is not filtered and is set to opaque.
+    void easu(const uint32_t* src, uint32_t src_w, uint32_t src_h, uint32_t* dst, uint32_t dst_w, uint32_t dst_h);
+    void rcas(const uint32_t* src, uint32_t* dst, uint32_t w, uint32_t h, float sharpness);
+}
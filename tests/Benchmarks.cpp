@@ -0,0 +1,173 @@
+// Timings of the core modules, the SIMD kernels against their scalar versions
+#include "Constants.hpp"
+#include "Culling.hpp"
+#include "Rasterizer.hpp"
+#include "Upscale.hpp"
+
+#include <array>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include <ext/matrix_clip_space.hpp>
+#include <trigonometric.hpp>
+
+namespace {
+    // Nanoseconds per call of `f` for `count` items, over `iterations` runs
+    template <typename F>
+    double time_ns(uint32_t count, uint32_t iterations, F&& f)
+    {
+        const auto start = std::chrono::steady_clock::now();
+        for (uint32_t i = 0; i < iterations; ++i) {
+            f();
+        }
+        const auto ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+        return ns / (static_cast<double>(std::max(count, 1u)) * iterations);
+    }
+
+    void culling_benchmark(uint32_t box_count, uint32_t iterations)
+    {
+        using namespace culling;
+
+        // Boxes scattered around a camera looking down +z, most of them outside of the view
+        auto rng = std::mt19937 { 1 };
+        auto position = std::uniform_real_distribution<float> { -100.0f, 100.0f };
+        auto size = std::uniform_real_distribution<float> { 0.1f, 5.0f };
+        auto boxes = std::vector<Aabb>(box_count);
+        for (auto& b : boxes) {
+            b.min = { position(rng), position(rng), position(rng) };
+            b.max = b.min + glm::vec3(size(rng), size(rng), size(rng));
+        }
+        const auto frustum = frustum_from_clip(glm::perspectiveLH_ZO(glm::radians(60.0f), 16.0f / 9.0f, 0.1f, 1000.0f));
+
+        auto outside = uint32_t { 0 };
+        const auto scalar_ns = time_ns(box_count, iterations, [&] {
+            for (const auto& b : boxes) {
+                outside += is_outside_scalar(frustum, b) ? 1 : 0;
+            }
+        });
+        const auto simd_ns = time_ns(box_count, iterations, [&] {
+            for (const auto& b : boxes) {
+                outside += is_outside(frustum, b) ? 1 : 0;
+            }
+        });
+        std::printf("Box vs frustum, %u boxes: scalar %.2f ns, SIMD %.2f ns per box (%u outside)\n", box_count, scalar_ns, simd_ns,
+            outside / (2 * iterations));
+    }
+
+    void rasterizer_benchmark(uint32_t triangle_count, uint32_t box_count, uint32_t iterations)
+    {
+        using namespace rasterizer;
+
+        // Large triangles close to a camera looking down +z, and smaller boxes further away
+        auto rng = std::mt19937 { 1 };
+        auto center = std::uniform_real_distribution<float> { -15.0f, 15.0f };
+        auto near_z = std::uniform_real_distribution<float> { 10.0f, 30.0f };
+        auto far_z = std::uniform_real_distribution<float> { 20.0f, 100.0f };
+        auto spread = std::uniform_real_distribution<float> { -40.0f, 40.0f };
+        auto size = std::uniform_real_distribution<float> { 1.0f, 6.0f };
+        auto offset = std::uniform_real_distribution<float> { -1.0f, 1.0f };
+        auto triangles = Mesh {};
+        for (uint32_t i = 0; i < triangle_count; ++i) {
+            const auto c = glm::vec3 { center(rng), center(rng), near_z(rng) };
+            const auto s = size(rng);
+            for (int j = 0; j < 3; ++j) {
+                triangles.push_back(c + glm::vec3 { offset(rng) * s, offset(rng) * s, offset(rng) });
+            }
+        }
+        auto boxes = std::vector<culling::Aabb>(box_count);
+        for (auto& b : boxes) {
+            b.min = { spread(rng), spread(rng), far_z(rng) };
+            b.max = b.min + glm::vec3(size(rng), size(rng), size(rng)) * 0.25f;
+        }
+        const auto clip = glm::perspectiveLH_ZO(glm::radians(60.0f), 16.0f / 9.0f, 0.1f, 1000.0f);
+
+        auto buffer = DepthBuffer { 256, 144 };
+        const auto scalar_draw_ns = time_ns(triangle_count, iterations, [&] { buffer.clear(); buffer.draw_scalar(clip, triangles); });
+        const auto simd_draw_ns = time_ns(triangle_count, iterations, [&] { buffer.clear(); buffer.draw(clip, triangles); });
+        auto occluded = uint32_t { 0 };
+        const auto scalar_test_ns = time_ns(box_count, iterations, [&] {
+            for (const auto& b : boxes) {
+                occluded += buffer.is_occluded_scalar(clip, b) ? 1 : 0;
+            }
+        });
+        const auto simd_test_ns = time_ns(box_count, iterations, [&] {
+            for (const auto& b : boxes) {
+                occluded += buffer.is_occluded(clip, b) ? 1 : 0;
+            }
+        });
+        std::printf("Occluders, %u triangles: scalar %.1f ns, SIMD %.1f ns per triangle\n", triangle_count, scalar_draw_ns, simd_draw_ns);
+        std::printf("Occludees, %u boxes: scalar %.1f ns, SIMD %.1f ns per box (%u occluded)\n", box_count, scalar_test_ns, simd_test_ns,
+            occluded / (2 * iterations));
+    }
+
+    void constants_benchmark(uint32_t draws, uint32_t iterations)
+    {
+        using namespace constants;
+
+        // The sets of a draw of the base game shaders, as in ConstantsTest
+        struct Set {
+            uint32_t start;
+            uint32_t count;
+        };
+        constexpr Set sets[] = { { 0, 4 }, { 4, 1 }, { 5, 1 }, { 6, 1 }, { 7, 1 }, { 20, 4 } };
+        const auto data = std::vector<float>(4 * REGISTER_COUNT, 1.0f);
+
+        // Stands in for the device: copies the registers like the runtime does, and counts the calls. It has no call
+        // overhead, so the difference in time is the cost of the staging itself.
+        static std::array<float, 4 * REGISTER_COUNT> device;
+        auto calls = uint64_t { 0 };
+        const auto upload = [&calls](uint32_t start, const float* p, uint32_t count) {
+            std::memcpy(device.data() + 4 * start, p, count * 4 * sizeof(float));
+            calls++;
+        };
+
+        const auto direct_ns = time_ns(draws, iterations, [&] {
+            for (uint32_t i = 0; i < draws; ++i) {
+                for (const auto& s : sets) {
+                    upload(s.start, data.data() + 4 * s.start, s.count);
+                }
+            }
+        });
+        const auto direct_calls = calls;
+        calls = 0;
+        auto file = RegisterFile {};
+        const auto batched_ns = time_ns(draws, iterations, [&] {
+            for (uint32_t i = 0; i < draws; ++i) {
+                for (const auto& s : sets) {
+                    file.set(s.start, data.data() + 4 * s.start, s.count);
+                }
+                file.flush(upload);
+            }
+        });
+        const auto per_draw = [draws, iterations](uint64_t n) { return static_cast<double>(n) / (static_cast<double>(draws) * iterations); };
+        std::printf("Vertex shader constants, %u draws: direct %.1f calls, %.1f ns, batched %.1f calls, %.1f ns per draw\n", draws,
+            per_draw(direct_calls), direct_ns, per_draw(calls), batched_ns);
+    }
+
+    void upscale_benchmark(uint32_t src_w, uint32_t src_h, uint32_t dst_w, uint32_t dst_h, uint32_t iterations)
+    {
+        auto rng = std::mt19937 { 1 };
+        auto src = std::vector<uint32_t>(src_w * src_h);
+        for (auto& p : src) {
+            p = 0xff000000u | (rng() & 0xffffff);
+        }
+        auto upscaled = std::vector<uint32_t>(dst_w * dst_h);
+        auto sharpened = std::vector<uint32_t>(dst_w * dst_h);
+        const auto pixels = dst_w * dst_h;
+        const auto easu_ns = time_ns(pixels, iterations, [&] { upscale::easu(src.data(), src_w, src_h, upscaled.data(), dst_w, dst_h); });
+        const auto rcas_ns = time_ns(pixels, iterations, [&] { upscale::rcas(upscaled.data(), sharpened.data(), dst_w, dst_h, upscale::sharpness_from_stops(0.25f)); });
+        std::printf("Upscaling %ux%u to %ux%u: EASU %.1f ns, RCAS %.1f ns per output pixel (%.1f Mpixel/s)\n", src_w, src_h, dst_w, dst_h, easu_ns,
+            rcas_ns, 1e3 / (easu_ns + rcas_ns));
+    }
+}
+
+int main()
+{
+    culling_benchmark(4096, 1000);
+    rasterizer_benchmark(2000, 10000, 20);
+    constants_benchmark(2000, 1000);
+    upscale_benchmark(960, 540, 1920, 1080, 3);
+}
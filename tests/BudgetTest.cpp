@@ -0,0 +1,92 @@
+#include "Check.hpp"
+
+#include "Budget.hpp"
+
+using namespace budget;
+
+namespace {
+    constexpr uint32_t W = 1920;
+    constexpr uint32_t H = 1080;
+    constexpr uint64_t PIXELS = static_cast<uint64_t>(W) * H;
+    constexpr uint64_t MB = 1024 * 1024;
+
+    Layout three_screens(uint32_t side_samples, uint32_t side_extra_textures)
+    {
+        return Layout {
+            .w = W,
+            .h = H,
+            .depth_bytes = 4,
+            .screens = {
+                { 4, 4 },
+                { side_samples, 4, side_extra_textures },
+                { side_samples, 4, side_extra_textures },
+            },
+            .fixed_bytes = 3 * PIXELS * 4,
+            .allow_16bit_color = true,
+        };
+    }
+
+    void test_estimate()
+    {
+        // Multisampled color and depth, and the resolve texture
+        const auto primary = PIXELS * 8 * 4 + PIXELS * 4;
+        // Single sampled color and depth
+        const auto side = PIXELS * 8;
+        CHECK(estimate(three_screens(1, 0)) == 3 * PIXELS * 4 + primary + 2 * side);
+
+        // The history and upscaled images are full size textures in the color format of the screen
+        CHECK(estimate(three_screens(1, 2)) == estimate(three_screens(1, 0)) + 2 * 2 * PIXELS * 4);
+        CHECK(estimate(three_screens(2, 1)) == estimate(three_screens(2, 0)) + 2 * PIXELS * 4);
+    }
+
+    void test_fit_order()
+    {
+        const auto layout = three_screens(8, 2);
+        const auto full = estimate(layout);
+
+        // Fits as it is
+        auto d = fit(layout, full);
+        CHECK(d.fits);
+        CHECK(d.steps.empty());
+
+        // Each step is taken only when the earlier ones were not enough
+        d = fit(layout, full - 1);
+        CHECK(d.fits);
+        CHECK((d.steps == std::vector<Step> { ReduceSideMsaa }));
+        CHECK(d.layout.screens[1].samples == 4);
+        CHECK(d.layout.screens[0].samples == 4);
+
+        d = fit(layout, estimate(three_screens(1, 2)));
+        CHECK(d.fits);
+        CHECK((d.steps == std::vector<Step> { ReduceSideMsaa, ReduceSideMsaa, DisableSideMsaa }));
+
+        // 16-bit color also shrinks the extra textures of the side screens
+        d = fit(layout, estimate(three_screens(1, 2)) - 1);
+        CHECK(d.fits);
+        CHECK(d.steps.back() == SideColor16Bit);
+        CHECK(d.estimated_bytes == estimate(three_screens(1, 2)) - 2 * PIXELS * 2 * 3);
+
+        // The primary screen is never downgraded
+        d = fit(layout, 100 * MB);
+        CHECK(!d.fits);
+        CHECK(d.layout.screens[0].samples == 4);
+        CHECK(d.layout.screens[0].color_bytes == 4);
+    }
+
+    void test_16bit_not_allowed()
+    {
+        auto layout = three_screens(1, 1);
+        layout.allow_16bit_color = false;
+        const auto d = fit(layout, estimate(layout) - 1);
+        CHECK(!d.fits);
+        CHECK(d.steps.empty());
+    }
+}
+
+int main()
+{
+    test_estimate();
+    test_fit_order();
+    test_16bit_not_allowed();
+    return check::result();
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstdio>
+
+// Assertions of the tests. A failed check is reported and fails the test, and the rest of the checks still run.
+namespace check {
+    inline int failures = 0;
+
+    inline void report(bool ok, const char* expression, const char* file, int line)
+    {
+        if (!ok) {
+            std::fprintf(stderr, "%s:%d: check failed: %s\n", file, line, expression);
+            failures++;
+        }
+    }
+
+    // Exit code of the test
+    inline int result()
+    {
+        if (failures > 0) {
+            std::fprintf(stderr, "%d checks failed\n", failures);
+        }
+        return failures > 0 ? 1 : 0;
+    }
+}
+
+#define CHECK(expression) ::check::report(static_cast<bool>(expression), #expression, __FILE__, __LINE__)
@@ -0,0 +1,311 @@
+#include "Check.hpp"
+
+#include "Compositor.hpp"
+
+#include <cmath>
+#include <vector>
+
+using namespace compositor;
+
+namespace {
+    constexpr int32_t SURFACE_W = 1920;
+    constexpr int32_t SURFACE_H = 1080;
+
+    bool operator==(const Rect& a, const Rect& b)
+    {
+        return a.left == b.left && a.top == b.top && a.right == b.right && a.bottom == b.bottom;
+    }
+
+    bool is_kept(const PassClip& clip, float x, float y)
+    {
+        for (const auto& p : clip.planes) {
+            if (p[0] * x + p[1] * y + p[3] < 0.0f) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void test_pass_clip_matches_present()
+    {
+        // Uncropped render targets are not clipped
+        CHECK(!pass_clip({ 0, 0, SURFACE_W, SURFACE_H }, 1.0, SURFACE_W, SURFACE_H));
+
+        const Rect visible_areas[] = {
+            { 320, 0, 1600, 1080 },
+            { 0, 0, 1280, 1024 },
+            { 640, 56, 1920, 1080 },
+            { 101, 33, 1777, 1001 },
+        };
+        for (const auto& visible : visible_areas) {
+            for (const auto scale : { 1.0, 0.75, 0.5, 0.33 }) {
+                const auto clip = pass_clip(visible, scale, SURFACE_W, SURFACE_H);
+                CHECK(clip.has_value());
+                if (!clip) {
+                    continue;
+                }
+                // The scissor rect is the area Present reads
+                const auto src = place(visible, scale, 0, 0, 0).src;
+                CHECK(clip->scissor == src);
+
+                // The clip planes keep the pixels Present reads, and cut the ones a pixel or more away from them
+                const auto w = static_cast<int32_t>(std::lround(SURFACE_W * scale));
+                const auto h = static_cast<int32_t>(std::lround(SURFACE_H * scale));
+                auto misclipped = 0;
+                for (int32_t y = 0; y < h; y += 7) {
+                    for (int32_t x = 0; x < w; ++x) {
+                        const auto ndc_x = 2.0f * (x + 0.5f) / w - 1.0f;
+                        const auto ndc_y = 1.0f - 2.0f * (y + 0.5f) / h;
+                        const auto inside = x >= src.left && x < src.right && y >= src.top && y < src.bottom;
+                        const auto outside = x < src.left - 1 || x > src.right || y < src.top - 1 || y > src.bottom;
+                        if ((inside && !is_kept(*clip, ndc_x, ndc_y)) || (outside && is_kept(*clip, ndc_x, ndc_y))) {
+                            misclipped++;
+                        }
+                    }
+                }
+                CHECK(misclipped == 0);
+            }
+        }
+    }
+
+    void test_planes_for_cropped_edges()
+    {
+        CHECK(pass_clip({ 320, 0, 1600, 1080 }, 1.0, SURFACE_W, SURFACE_H)->planes.size() == 2);
+        CHECK(pass_clip({ 0, 0, 1920, 1000 }, 1.0, SURFACE_W, SURFACE_H)->planes.size() == 1);
+        CHECK(pass_clip({ 1, 1, 1919, 1079 }, 1.0, SURFACE_W, SURFACE_H)->planes.size() == 4);
+    }
+
+    void test_screens_tile_back_buffer()
+    {
+        // A narrower left screen cropped from the inner side of its render target, placed left of the origin
+        struct Screen {
+            Rect visible;
+            int32_t x, y;
+        };
+        const Screen screens[] = {
+            { { 0, 0, 1920, 1080 }, 0, 0 },
+            { { 640, 0, 1920, 1080 }, -1280, 0 },
+            { { 0, 0, 1920, 1080 }, 1920, 0 },
+        };
+        const auto xmin = -1280;
+        auto covered = 0;
+        auto right = 0;
+        for (const auto index : { 1, 0, 2 }) {
+            const auto& s = screens[index];
+            for (const auto scale : { 1.0, 0.5 }) {
+                const auto p = place(s.visible, scale, s.x, s.y, xmin);
+                CHECK(p.dst.w() == s.visible.w());
+                CHECK(p.dst.h() == s.visible.h());
+                CHECK(p.src == scale_rect(s.visible, scale));
+            }
+            const auto dst = place(s.visible, 1.0, s.x, s.y, xmin).dst;
+            CHECK(dst.left == right);
+            right = dst.right;
+            covered += dst.w() * dst.h();
+        }
+        CHECK(right == 1280 + 1920 + 1920);
+        CHECK(covered == right * SURFACE_H);
+    }
+
+    void test_covers()
+    {
+        // Three screens side by side
+        const Rect tiled[] = { { 0, 0, 1280, 1080 }, { 1280, 0, 3200, 1080 }, { 3200, 0, 5120, 1080 } };
+        CHECK(covers(tiled, 5120, 1080));
+        CHECK(!covers(tiled, 5120, 1200));
+
+        // Overlapping screens with the same total area as the target leave a gap
+        const Rect overlap[] = { { 0, 0, 1920, 1080 }, { 1280, 0, 3200, 1080 }, { 3200, 0, 4480, 1080 } };
+        CHECK(!covers(overlap, 5120, 1080));
+        // And cover it when the overlap is taken up by a wider screen
+        const Rect overlap_wide[] = { { 0, 0, 1920, 1080 }, { 1280, 0, 3200, 1080 }, { 3200, 0, 5120, 1080 } };
+        CHECK(covers(overlap_wide, 5120, 1080));
+
+        // Stacked halves, one of them past the edge of the target
+        const Rect stacked[] = { { 0, 540, 1920, 2000 }, { -100, 0, 1920, 540 } };
+        CHECK(covers(stacked, 1920, 1080));
+        const Rect gap[] = { { 0, 541, 1920, 1080 }, { 0, 0, 1920, 540 } };
+        CHECK(!covers(gap, 1920, 1080));
+        CHECK(!covers({}, 1920, 1080));
+    }
+
+    // Device that records the calls and rasterizes the draws on the CPU. The pixel shader is reduced to
+    // sampling the nearest texel and multiplying it by the brightness.
+    class StandInDevice : public Device {
+    public:
+        struct Image {
+            uint32_t w, h;
+            std::vector<float> pixels;
+        };
+
+        std::vector<Image> sources;
+        std::vector<uint32_t> bound;
+        std::vector<std::vector<Vertex>> draws;
+        Image target;
+        // Times each target pixel was written
+        std::vector<int> writes;
+        bool fail_bind = false;
+
+        StandInDevice(uint32_t w, uint32_t h)
+            : target { w, h, std::vector<float>(w * h, -1.0f) }
+            , writes(w * h, 0)
+        {
+        }
+
+        bool bind_source(uint32_t index) override
+        {
+            if (fail_bind || index >= sources.size()) {
+                return false;
+            }
+            bound.push_back(index);
+            return true;
+        }
+
+        bool draw_triangles(const Vertex* vertices, uint32_t triangle_count) override
+        {
+            draws.emplace_back(vertices, vertices + triangle_count * 3);
+            for (uint32_t t = 0; t < triangle_count; ++t) {
+                rasterize(vertices + t * 3);
+            }
+            return true;
+        }
+
+    private:
+        void rasterize(const Vertex* v)
+        {
+            // Pixel centers are at integer coordinates. They are nudged off the diagonals of the quads,
+            // so that each pixel falls in exactly one triangle.
+            const auto sx = [&](const Vertex& p) { return (p.x + 1.0f) * 0.5f * target.w; };
+            const auto sy = [&](const Vertex& p) { return (1.0f - p.y) * 0.5f * target.h; };
+            const auto edge = [](float ax, float ay, float bx, float by, float px, float py) {
+                return (bx - ax) * (py - ay) - (by - ay) * (px - ax);
+            };
+            const float x0 = sx(v[0]), y0 = sy(v[0]), x1 = sx(v[1]), y1 = sy(v[1]), x2 = sx(v[2]), y2 = sy(v[2]);
+            const auto area = edge(x0, y0, x1, y1, x2, y2);
+            for (uint32_t j = 0; j < target.h; ++j) {
+                for (uint32_t i = 0; i < target.w; ++i) {
+                    const auto px = i + 0.001f;
+                    const auto py = j + 0.002f;
+                    const auto b0 = edge(x1, y1, x2, y2, px, py) / area;
+                    const auto b1 = edge(x2, y2, x0, y0, px, py) / area;
+                    const auto b2 = edge(x0, y0, x1, y1, px, py) / area;
+                    if (b0 < 0.0f || b1 < 0.0f || b2 < 0.0f) {
+                        continue;
+                    }
+                    const auto u = b0 * v[0].u + b1 * v[1].u + b2 * v[2].u;
+                    const auto w = b0 * v[0].v + b1 * v[1].v + b2 * v[2].v;
+                    const auto& source = sources[static_cast<uint32_t>(v[0].source)];
+                    const auto tx = std::min(static_cast<uint32_t>(u * source.w), source.w - 1);
+                    const auto ty = std::min(static_cast<uint32_t>(w * source.h), source.h - 1);
+                    target.pixels[j * target.w + i] = source.pixels[ty * source.w + tx] * v[0].brightness;
+                    writes[j * target.w + i]++;
+                }
+            }
+        }
+    };
+
+    StandInDevice::Image gradient(uint32_t w, uint32_t h, float base)
+    {
+        auto ret = StandInDevice::Image { w, h, std::vector<float>(w * h) };
+        for (uint32_t y = 0; y < h; ++y) {
+            for (uint32_t x = 0; x < w; ++x) {
+                ret.pixels[y * w + x] = base + static_cast<float>(y * w + x);
+            }
+        }
+        return ret;
+    }
+
+    void test_compose_with_one_draw()
+    {
+        // Three screens side by side, the middle one cropped from a larger render target
+        constexpr uint32_t TW = 40;
+        constexpr uint32_t TH = 10;
+        auto device = StandInDevice(TW, TH);
+        device.sources = { gradient(12, 10, 0.0f), gradient(24, 14, 1000.0f), gradient(12, 10, 2000.0f) };
+        const Layer layers[] = {
+            { .source = 0, .source_w = 12, .source_h = 10, .src = { 0, 0, 12, 10 }, .dst = { 0, 0, 12, 10 } },
+            { .source = 1, .source_w = 24, .source_h = 14, .src = { 4, 2, 20, 12 }, .dst = { 12, 0, 28, 10 }, .brightness = 0.5f },
+            { .source = 2, .source_w = 12, .source_h = 10, .src = { 0, 0, 12, 10 }, .dst = { 28, 0, 40, 10 }, .sharpness = 0.25f, .antialias = true },
+        };
+        CHECK(compose(device, layers, TW, TH));
+        CHECK(device.draws.size() == 1);
+        CHECK(device.draws[0].size() == 18);
+        CHECK((device.bound == std::vector<uint32_t> { 0, 1, 2 }));
+
+        // Every pixel is written once, with the texel of the same position in its source
+        auto wrong = 0;
+        for (uint32_t y = 0; y < TH; ++y) {
+            for (uint32_t x = 0; x < TW; ++x) {
+                const auto& l = x < 12 ? layers[0] : x < 28 ? layers[1] : layers[2];
+                const auto& source = device.sources[l.source];
+                const auto sx = static_cast<uint32_t>(l.src.left) + x - static_cast<uint32_t>(l.dst.left);
+                const auto sy = static_cast<uint32_t>(l.src.top) + y;
+                const auto expected = source.pixels[sy * source.w + sx] * l.brightness;
+                if (device.writes[y * TW + x] != 1 || device.target.pixels[y * TW + x] != expected) {
+                    wrong++;
+                }
+            }
+        }
+        CHECK(wrong == 0);
+
+        // The per-quad operations are passed to the pixel shader
+        const auto& last = device.draws[0].back();
+        CHECK(last.source == 2.0f);
+        CHECK(last.sharpness == 0.25f);
+        CHECK(last.antialias == 1.0f);
+        CHECK(device.draws[0][6].brightness == 0.5f);
+    }
+
+    void test_compose_scaled()
+    {
+        // A half resolution image is stretched to twice its size, each texel covering 2x2 pixels
+        auto device = StandInDevice(8, 6);
+        device.sources = { gradient(16, 16, 0.0f) };
+        const Layer layer = { .source = 0, .source_w = 16, .source_h = 16, .src = { 0, 0, 4, 3 }, .dst = { 0, 0, 8, 6 } };
+        CHECK(compose(device, std::span(&layer, 1), 8, 6));
+        auto wrong = 0;
+        for (uint32_t y = 0; y < 6; ++y) {
+            for (uint32_t x = 0; x < 8; ++x) {
+                wrong += device.target.pixels[y * 8 + x] != static_cast<float>((y / 2) * 16 + x / 2) ? 1 : 0;
+            }
+        }
+        CHECK(wrong == 0);
+    }
+
+    void test_compose_failures()
+    {
+        const Layer valid = { .source = 0, .source_w = 4, .source_h = 4, .src = { 0, 0, 4, 4 }, .dst = { 0, 0, 4, 4 } };
+
+        // Nothing to draw is not an error
+        auto device = StandInDevice(4, 4);
+        device.sources = { gradient(4, 4, 0.0f) };
+        CHECK(compose(device, {}, 4, 4));
+        CHECK(device.draws.empty());
+
+        // Invalid layers and targets are rejected before anything is drawn
+        auto empty_src = valid;
+        empty_src.src = { 2, 0, 2, 4 };
+        auto bad_source = valid;
+        bad_source.source = MAX_SOURCES;
+        CHECK(!compose(device, std::span(&empty_src, 1), 4, 4));
+        CHECK(!compose(device, std::span(&bad_source, 1), 4, 4));
+        CHECK(!compose(device, std::span(&valid, 1), 0, 4));
+        CHECK(device.draws.empty());
+
+        device.fail_bind = true;
+        CHECK(!compose(device, std::span(&valid, 1), 4, 4));
+        CHECK(device.draws.empty());
+    }
+}
+
+int main()
+{
+    test_pass_clip_matches_present();
+    test_planes_for_cropped_edges();
+    test_screens_tile_back_buffer();
+    test_covers();
+    test_compose_with_one_draw();
+    test_compose_scaled();
+    test_compose_failures();
+    return check::result();
+}
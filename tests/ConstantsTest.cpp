@@ -0,0 +1,120 @@
+#include "Check.hpp"
+
+#include "Constants.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <random>
+#include <vector>
+
+using namespace constants;
+
+namespace {
+    // Stands in for the constant registers of the device
+    struct Device {
+        std::array<float, 4 * REGISTER_COUNT> registers {};
+        uint32_t calls = 0;
+
+        void set(uint32_t start, const float* data, uint32_t count)
+        {
+            std::memcpy(registers.data() + 4 * start, data, count * 4 * sizeof(float));
+            calls++;
+        }
+    };
+
+    void test_ranges()
+    {
+        const auto data = std::vector<float>(4 * REGISTER_COUNT, 1.0f);
+        auto file = RegisterFile {};
+        CHECK(!file.is_dirty());
+
+        // Adjacent and overlapping sets are uploaded as one range, across the 64 register words too
+        CHECK(file.set(0, data.data(), 4));
+        CHECK(file.set(4, data.data(), 2));
+        CHECK(file.set(62, data.data(), 4));
+        CHECK(file.set(64, data.data(), 1));
+        CHECK(file.set(20, data.data(), 4));
+        CHECK(file.set(0, data.data(), 0));
+        CHECK(file.is_dirty());
+        auto ranges = std::vector<std::array<uint32_t, 2>> {};
+        CHECK(file.flush([&](uint32_t start, const float*, uint32_t count) { ranges.push_back({ start, count }); }) == 3);
+        CHECK((ranges == std::vector<std::array<uint32_t, 2>> { { 0, 6 }, { 20, 4 }, { 62, 4 } }));
+        CHECK(!file.is_dirty());
+        CHECK(file.flush([](uint32_t, const float*, uint32_t) {}) == 0);
+
+        // The last register, and sets out of range that the caller has to make itself
+        CHECK(file.set(REGISTER_COUNT - 1, data.data(), 1));
+        CHECK(!file.set(REGISTER_COUNT - 1, data.data(), 2));
+        CHECK(!file.set(REGISTER_COUNT, data.data(), 1));
+    }
+
+    void test_game_pattern()
+    {
+        // The sets of a draw of the base game shaders: the transformation, the lighting registers one at a time, and
+        // the sky and fog transformation. The registers from c0 on go to the device in one call.
+        struct Set {
+            uint32_t start;
+            uint32_t count;
+        };
+        constexpr Set sets[] = { { 0, 4 }, { 4, 1 }, { 5, 1 }, { 6, 1 }, { 7, 1 }, { 20, 4 } };
+        constexpr uint32_t DRAWS = 1000;
+
+        auto direct = Device {};
+        auto batched = Device {};
+        auto file = RegisterFile {};
+        auto data = std::vector<float>(4 * REGISTER_COUNT);
+        for (uint32_t draw = 0; draw < DRAWS; ++draw) {
+            for (const auto& set : sets) {
+                std::fill_n(data.begin() + 4 * set.start, 4 * set.count, static_cast<float>(draw));
+                direct.set(set.start, data.data() + 4 * set.start, set.count);
+                CHECK(file.set(set.start, data.data() + 4 * set.start, set.count));
+            }
+            file.flush([&](uint32_t start, const float* p, uint32_t n) { batched.set(start, p, n); });
+        }
+        CHECK(direct.registers == batched.registers);
+        CHECK(direct.calls == DRAWS * std::size(sets));
+        CHECK(batched.calls == DRAWS * 2);
+    }
+
+    void test_random_sequences()
+    {
+        // Random sets with a flush at each draw leave the device as the sets made directly would,
+        // with at most as many calls
+        auto rng = std::mt19937 { 1 };
+        auto start = std::uniform_int_distribution<uint32_t> { 0, REGISTER_COUNT - 1 };
+        auto count = std::uniform_int_distribution<uint32_t> { 0, 8 };
+        auto value = std::uniform_real_distribution<float> { -1.0f, 1.0f };
+        auto draw = std::bernoulli_distribution { 0.2 };
+
+        auto direct = Device {};
+        auto batched = Device {};
+        auto file = RegisterFile {};
+        auto data = std::vector<float>(4 * 8);
+        for (int i = 0; i < 100000; ++i) {
+            for (auto& v : data) {
+                v = value(rng);
+            }
+            const auto s = start(rng);
+            const auto c = std::min(count(rng), REGISTER_COUNT - s);
+            direct.set(s, data.data(), c);
+            CHECK(file.set(s, data.data(), c));
+            if (draw(rng)) {
+                file.flush([&](uint32_t start, const float* p, uint32_t n) { batched.set(start, p, n); });
+                if (direct.registers != batched.registers) {
+                    CHECK(direct.registers == batched.registers);
+                    break;
+                }
+            }
+        }
+        CHECK(batched.calls <= direct.calls);
+    }
+}
+
+int main()
+{
+    test_ranges();
+    test_game_pattern();
+    test_random_sequences();
+    return check::result();
+}
@@ -0,0 +1,115 @@
+#include "Check.hpp"
+
+#include "Culling.hpp"
+
+#include <cmath>
+#include <random>
+#include <vector>
+
+#include <ext/matrix_clip_space.hpp>
+#include <trigonometric.hpp>
+
+using namespace culling;
+
+namespace {
+    void test_bounds()
+    {
+        // Position after a 4 byte element in 20 byte vertices
+        struct Vertex {
+            float u;
+            glm::vec3 position;
+            float v;
+        };
+        const std::vector<Vertex> vertices = { { 0, { 1, -2, 3 }, 0 }, { 0, { -1, 5, 0 }, 0 }, { 0, { 0, 0, 9 }, 0 } };
+        const auto box = bounds(reinterpret_cast<const uint8_t*>(vertices.data()), 3, sizeof(Vertex), sizeof(float));
+        CHECK(box && box->min == glm::vec3(-1, -2, 0) && box->max == glm::vec3(1, 5, 9));
+
+        CHECK(!bounds(reinterpret_cast<const uint8_t*>(vertices.data()), 0, sizeof(Vertex), sizeof(float)));
+        const std::vector<Vertex> invalid = { { 0, { NAN, 0, 0 }, 0 } };
+        CHECK(!bounds(reinterpret_cast<const uint8_t*>(invalid.data()), 1, sizeof(Vertex), sizeof(float)));
+    }
+
+    void test_frustum()
+    {
+        // Camera at the origin looking down +z with a 90 degree FoV
+        const auto frustum = frustum_from_clip(glm::perspectiveLH_ZO(glm::radians(90.0f), 1.0f, 1.0f, 100.0f));
+        const auto box = [](glm::vec3 center) { return Aabb { center - glm::vec3(0.5f), center + glm::vec3(0.5f) }; };
+        for (const auto simd : { false, true }) {
+            const auto outside = [&](const Aabb& b) { return simd ? is_outside(frustum, b) : is_outside_scalar(frustum, b); };
+            CHECK(!outside(box({ 0, 0, 10 })));
+            CHECK(!outside(box({ 10, 0, 10 })));
+            CHECK(outside(box({ 12, 0, 10 })));
+            CHECK(outside(box({ 0, -12, 10 })));
+            CHECK(outside(box({ 0, 0, -10 })));
+            CHECK(outside(box({ 0, 0, 101 })));
+            CHECK(!outside(Aabb { { -1000, -1000, -1000 }, { 1000, 1000, 1000 } }));
+        }
+
+        auto rng = std::mt19937 { 1 };
+        auto position = std::uniform_real_distribution<float> { -100.0f, 100.0f };
+        auto size = std::uniform_real_distribution<float> { 0.1f, 5.0f };
+        for (int i = 0; i < 10000; ++i) {
+            const auto min = glm::vec3 { position(rng), position(rng), position(rng) };
+            const auto b = Aabb { min, min + glm::vec3(size(rng), size(rng), size(rng)) };
+            CHECK(is_outside(frustum, b) == is_outside_scalar(frustum, b));
+        }
+    }
+
+    void test_vertex_count()
+    {
+        CHECK(vertex_count(1, 5) == 5);
+        CHECK(vertex_count(2, 5) == 10);
+        CHECK(vertex_count(3, 5) == 6);
+        CHECK(vertex_count(4, 5) == 15);
+        CHECK(vertex_count(5, 5) == 7);
+        CHECK(vertex_count(6, 5) == 7);
+        CHECK(vertex_count(0, 5) == 0);
+    }
+
+    void test_bounds_cache()
+    {
+        int buffers[2];
+        const auto box = Aabb { glm::vec3(0), glm::vec3(1) };
+        // 100 vertices of 16 bytes from vertex 10 and from vertex 200
+        const auto low = VertexRange { &buffers[0], 10, 100, 16, 0 };
+        const auto high = VertexRange { &buffers[0], 200, 100, 16, 0 };
+        const auto other = VertexRange { &buffers[1], 10, 100, 16, 0 };
+
+        auto cache = BoundsCache {};
+        cache.insert(low, box);
+        cache.insert(high, box);
+        cache.insert(other, box);
+        cache.insert(other, box);
+        CHECK(cache.size() == 3);
+
+        // A write to bytes 0..160 ends before the low range starts at byte 160
+        cache.invalidate(&buffers[0], 0, 160);
+        CHECK(cache.find(low) && cache.find(high));
+        cache.invalidate(&buffers[0], 1000, 16);
+        CHECK(!cache.find(low) && cache.find(high) && cache.size() == 2);
+        // To the end of the buffer
+        cache.invalidate(&buffers[0], 3000, 0);
+        CHECK(!cache.find(high) && cache.find(other) && cache.size() == 1);
+        // The whole buffer, as when a new buffer is created at its address
+        cache.invalidate(&buffers[1], 0, 0);
+        CHECK(!cache.find(other) && cache.size() == 0);
+
+        // Dropped all at once when full
+        for (uint32_t i = 0; i <= MAX_CACHED_RANGES; ++i) {
+            cache.insert({ &buffers[0], i, 1, 16, 0 }, box);
+            CHECK(cache.size() <= MAX_CACHED_RANGES);
+        }
+        CHECK(cache.size() == 1 && cache.find({ &buffers[0], MAX_CACHED_RANGES, 1, 16, 0 }));
+        cache.clear();
+        CHECK(cache.size() == 0);
+    }
+}
+
+int main()
+{
+    test_bounds();
+    test_frustum();
+    test_vertex_count();
+    test_bounds_cache();
+    return check::result();
+}
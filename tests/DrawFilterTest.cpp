@@ -0,0 +1,75 @@
+#include "Check.hpp"
+
+#include "DrawFilter.hpp"
+
+using namespace drawfilter;
+
+namespace {
+    constexpr uint32_t TRIANGLE_LIST = 4;
+    constexpr uint32_t CAMERA = 0;
+    constexpr uint32_t DRIVING = 1;
+    constexpr uint32_t MENU = 2;
+
+    void test_btb_shadow_rule()
+    {
+        // Shader 39 is only skipped in the non-indexed draws on BTB stages
+        const auto shader = ShaderInfo { .index = 39 };
+        auto table = Table {};
+        table.compile({});
+        table.select(CAMERA, DRIVING, true);
+        CHECK(table.should_skip(shader, false, TRIANGLE_LIST, 100));
+        CHECK(!table.should_skip(shader, true, TRIANGLE_LIST, 100));
+        CHECK(!table.should_skip(ShaderInfo { .index = 38 }, false, TRIANGLE_LIST, 100));
+        table.select(CAMERA, DRIVING, false);
+        CHECK(table.empty());
+
+        // A pass rule of the user overrides it
+        table.compile({ Rule { .action = Pass, .shader_index = 39 } });
+        table.select(CAMERA, DRIVING, true);
+        CHECK(!table.should_skip(shader, false, TRIANGLE_LIST, 100));
+    }
+
+    void test_draw_kinds()
+    {
+        const auto shader = ShaderInfo { .index = 3 };
+        auto table = Table {};
+        table.compile({ Rule { .shader_index = 3, .draws = Indexed } });
+        table.select(CAMERA, DRIVING, false);
+        CHECK(table.should_skip(shader, true, TRIANGLE_LIST, 100));
+        CHECK(!table.should_skip(shader, false, TRIANGLE_LIST, 100));
+    }
+
+    void test_update()
+    {
+        // The rules follow the game mode and the stage type between the camera passes
+        const auto shader = ShaderInfo { .index = 5 };
+        auto table = Table {};
+        table.compile({ Rule { .shader_index = 5, .cameras = 1u << CAMERA, .game_modes = 1u << DRIVING, .stages = RBRStage } });
+        // Nothing before the first camera pass
+        table.update(DRIVING, false);
+        CHECK(table.empty());
+
+        table.select(CAMERA, MENU, false);
+        CHECK(!table.should_skip(shader, false, TRIANGLE_LIST, 100));
+        table.update(DRIVING, false);
+        CHECK(table.should_skip(shader, false, TRIANGLE_LIST, 100));
+        table.update(DRIVING, true);
+        CHECK(!table.should_skip(shader, false, TRIANGLE_LIST, 100));
+        table.update(DRIVING, false);
+        CHECK(table.should_skip(shader, false, TRIANGLE_LIST, 100));
+
+        // The camera of the last selection is kept
+        table.select(CAMERA + 1, DRIVING, false);
+        table.update(MENU, false);
+        table.update(DRIVING, false);
+        CHECK(!table.should_skip(shader, false, TRIANGLE_LIST, 100));
+    }
+}
+
+int main()
+{
+    test_btb_shadow_rule();
+    test_draw_kinds();
+    test_update();
+    return check::result();
+}
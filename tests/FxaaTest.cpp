@@ -0,0 +1,138 @@
+#include "Check.hpp"
+
+#include "Fxaa.hpp"
+
+#include <cstdlib>
+#include <vector>
+
+using namespace fxaa;
+
+namespace {
+    constexpr uint32_t W = 8;
+    constexpr uint32_t H = 8;
+
+    constexpr uint32_t BLACK = 0xff000000u;
+    constexpr uint32_t WHITE = 0xffffffffu;
+    constexpr uint32_t ORANGE = 0xffff8000u;
+    constexpr uint32_t BLUE = 0xff0040ffu;
+
+    // Outputs of the filter, checked by eye when they were recorded: edges along the pixel grid are left alone,
+    // and the pixels along the diagonal and the stair edge are blended with their neighbours across the edge
+    const uint32_t DIAGONAL_GOLDEN[W * H] = {
+        0xff050505, 0xffababab, 0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff,
+        0xff000000, 0xff313131, 0xffcfcfcf, 0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff,
+        0xff000000, 0xff000000, 0xff313131, 0xffcfcfcf, 0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff,
+        0xff000000, 0xff000000, 0xff000000, 0xff313131, 0xffcfcfcf, 0xffffffff, 0xffffffff, 0xffffffff,
+        0xff000000, 0xff000000, 0xff000000, 0xff000000, 0xff313131, 0xffcfcfcf, 0xffffffff, 0xffffffff,
+        0xff000000, 0xff000000, 0xff000000, 0xff000000, 0xff000000, 0xff313131, 0xffcfcfcf, 0xffffffff,
+        0xff000000, 0xff000000, 0xff000000, 0xff000000, 0xff000000, 0xff000000, 0xff313131, 0xffababab,
+        0xff000000, 0xff000000, 0xff000000, 0xff000000, 0xff000000, 0xff000000, 0xff000000, 0xff050505,
+    };
+    const uint32_t STAIRS_GOLDEN[W * H] = {
+        0xff0040ff, 0xff0040ff, 0xffbf7040, 0xffff8000, 0xffff8000, 0xffff8000, 0xffff8000, 0xffff8000,
+        0xff0040ff, 0xff0541fa, 0xffb46d4b, 0xffff8000, 0xffff8000, 0xffff8000, 0xffff8000, 0xffff8000,
+        0xff0040ff, 0xff0040ff, 0xff4e53b1, 0xfff87e07, 0xffff8000, 0xffff8000, 0xffff8000, 0xffff8000,
+        0xff0040ff, 0xff0040ff, 0xff0541fa, 0xffb46d4b, 0xffff8000, 0xffff8000, 0xffff8000, 0xffff8000,
+        0xff0040ff, 0xff0040ff, 0xff0040ff, 0xff4e53b1, 0xfff87e07, 0xffff8000, 0xffff8000, 0xffff8000,
+        0xff0040ff, 0xff0040ff, 0xff0040ff, 0xff0541fa, 0xffb46d4b, 0xffff8000, 0xffff8000, 0xffff8000,
+        0xff0040ff, 0xff0040ff, 0xff0040ff, 0xff0040ff, 0xff4e53b1, 0xfff87e07, 0xffff8000, 0xffff8000,
+        0xff0040ff, 0xff0040ff, 0xff0040ff, 0xff0040ff, 0xff5255ad, 0xffff8000, 0xffff8000, 0xffff8000,
+    };
+
+    template <typename Pixel>
+    std::vector<uint32_t> image(Pixel&& pixel)
+    {
+        std::vector<uint32_t> ret(W * H);
+        for (uint32_t y = 0; y < H; ++y) {
+            for (uint32_t x = 0; x < W; ++x) {
+                ret[y * W + x] = pixel(x, y);
+            }
+        }
+        return ret;
+    }
+
+    std::vector<uint32_t> filter(const std::vector<uint32_t>& src)
+    {
+        std::vector<uint32_t> ret(src.size());
+        apply(src.data(), ret.data(), W, H);
+        return ret;
+    }
+
+    // Number of pixels that differ from the golden image by more than one step in a channel,
+    // which leaves room for the rounding of another compiler
+    int mismatches(const std::vector<uint32_t>& image, const uint32_t* golden)
+    {
+        auto ret = 0;
+        for (uint32_t i = 0; i < W * H; ++i) {
+            for (const auto shift : { 24, 16, 8, 0 }) {
+                if (std::abs(static_cast<int>((image[i] >> shift) & 0xff) - static_cast<int>((golden[i] >> shift) & 0xff)) > 1) {
+                    ret++;
+                    break;
+                }
+            }
+        }
+        return ret;
+    }
+
+    void test_golden_images()
+    {
+        const auto diagonal = image([](uint32_t x, uint32_t y) { return x > y ? WHITE : BLACK; });
+        CHECK(mismatches(filter(diagonal), DIAGONAL_GOLDEN) == 0);
+        const auto stairs = image([](uint32_t x, uint32_t y) { return x >= y / 2 + 2 ? ORANGE : BLUE; });
+        CHECK(mismatches(filter(stairs), STAIRS_GOLDEN) == 0);
+    }
+
+    void test_grid_aligned_edges()
+    {
+        // The blur runs along the edge, so edges along the rows and columns stay sharp
+        const auto vertical = image([](uint32_t x, uint32_t) { return x >= 4 ? WHITE : BLACK; });
+        CHECK(filter(vertical) == vertical);
+        const auto horizontal = image([](uint32_t, uint32_t y) { return y >= 3 ? WHITE : BLACK; });
+        CHECK(filter(horizontal) == horizontal);
+    }
+
+    void test_low_contrast()
+    {
+        // Flat areas and contrast under the threshold are left alone
+        const auto flat = image([](uint32_t, uint32_t) { return ORANGE; });
+        CHECK(filter(flat) == flat);
+        const auto noise = image([](uint32_t x, uint32_t y) { return (x * 7 + y * 3) % 5 < 2 ? 0xff808080u : 0xff838383u; });
+        CHECK(filter(noise) == noise);
+    }
+
+    void test_symmetry()
+    {
+        // Mirroring the image across its diagonal mirrors the result
+        const auto diagonal = image([](uint32_t x, uint32_t y) { return x > y ? WHITE : BLACK; });
+        const auto mirrored = image([](uint32_t x, uint32_t y) { return y > x ? WHITE : BLACK; });
+        const auto a = filter(diagonal);
+        const auto b = filter(mirrored);
+        auto asymmetric = 0;
+        for (uint32_t y = 0; y < H; ++y) {
+            for (uint32_t x = 0; x < W; ++x) {
+                asymmetric += a[y * W + x] != b[x * W + y] ? 1 : 0;
+            }
+        }
+        CHECK(asymmetric == 0);
+    }
+
+    void test_alpha_is_opaque()
+    {
+        const auto transparent = image([](uint32_t x, uint32_t y) { return x > y ? 0x00ffffffu : 0x40000000u; });
+        auto translucent = 0;
+        for (const auto p : filter(transparent)) {
+            translucent += (p >> 24) != 0xff ? 1 : 0;
+        }
+        CHECK(translucent == 0);
+    }
+}
+
+int main()
+{
+    test_golden_images();
+    test_grid_aligned_edges();
+    test_low_contrast();
+    test_symmetry();
+    test_alpha_is_opaque();
+    return check::result();
+}
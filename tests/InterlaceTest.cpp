@@ -0,0 +1,152 @@
+#include "Check.hpp"
+
+#include "Interlace.hpp"
+
+#include <string>
+#include <vector>
+
+using namespace interlace;
+
+namespace {
+    constexpr uint32_t W = 64;
+    constexpr uint32_t H = 36;
+
+    constexpr Mode MODES[] = { Lines, Checkerboard };
+
+    // Pixels rendered with a parity, as rows of 'x' for rendered and '.' for skipped
+    std::string draw(Mode mode, uint32_t parity, uint32_t w, uint32_t h)
+    {
+        std::string ret;
+        for (uint32_t y = 0; y < h; ++y) {
+            for (uint32_t x = 0; x < w; ++x) {
+                ret += is_rendered(mode, parity, x, y) ? 'x' : '.';
+            }
+            ret += '\n';
+        }
+        return ret;
+    }
+
+    uint32_t pixel(uint32_t x, uint32_t y)
+    {
+        return 0xff000000u | (x * 0x010203u + y * 0x030201u);
+    }
+
+    void test_patterns()
+    {
+        CHECK(draw(Lines, 0, 8, 6) ==
+            "xxxxxxxx\n"
+            "xxxxxxxx\n"
+            "........\n"
+            "........\n"
+            "xxxxxxxx\n"
+            "xxxxxxxx\n");
+        CHECK(draw(Checkerboard, 0, 8, 6) ==
+            "xx..xx..\n"
+            "xx..xx..\n"
+            "..xx..xx\n"
+            "..xx..xx\n"
+            "xx..xx..\n"
+            "xx..xx..\n");
+        CHECK(draw(Checkerboard, 1, 8, 2) ==
+            "..xx..xx\n"
+            "..xx..xx\n");
+        CHECK(draw(Off, 1, 4, 1) == "xxxx\n");
+    }
+
+    void test_whole_quads()
+    {
+        // The GPU shades 2x2 quads, and each of them is either rendered or skipped as a whole
+        for (const auto mode : MODES) {
+            for (uint32_t parity = 0; parity < 2; ++parity) {
+                auto split = 0;
+                auto rendered = 0;
+                for (uint32_t y = 0; y < H; y += 2) {
+                    for (uint32_t x = 0; x < W; x += 2) {
+                        const auto first = is_rendered(mode, parity, x, y);
+                        if (first != is_rendered(mode, parity, x + 1, y) || first != is_rendered(mode, parity, x, y + 1) || first != is_rendered(mode, parity, x + 1, y + 1)) {
+                            split++;
+                        }
+                        rendered += first ? 1 : 0;
+                    }
+                }
+                CHECK(split == 0);
+                CHECK(rendered * 2 == static_cast<int>((W / 2) * (H / 2)));
+            }
+        }
+    }
+
+    void test_parities_complement()
+    {
+        for (const auto mode : MODES) {
+            auto both = 0;
+            auto neither = 0;
+            for (uint32_t y = 0; y < H; ++y) {
+                for (uint32_t x = 0; x < W; ++x) {
+                    const auto even = is_rendered(mode, 0, x, y);
+                    const auto odd = is_rendered(mode, 1, x, y);
+                    both += even && odd ? 1 : 0;
+                    neither += !even && !odd ? 1 : 0;
+                }
+            }
+            CHECK(both == 0);
+            CHECK(neither == 0);
+        }
+    }
+
+    void test_mask_tiles_pattern()
+    {
+        // The mask texture is point sampled with wrapping, one texel per pixel
+        for (const auto mode : MODES) {
+            for (uint32_t parity = 0; parity < 2; ++parity) {
+                const auto mask = skipped_pixel_mask(mode, parity);
+                auto wrong = 0;
+                for (uint32_t y = 0; y < H; ++y) {
+                    for (uint32_t x = 0; x < W; ++x) {
+                        const auto alpha = mask[(y % PATTERN_SIZE) * PATTERN_SIZE + x % PATTERN_SIZE];
+                        wrong += (alpha == 0) != is_rendered(mode, parity, x, y) ? 1 : 0;
+                    }
+                }
+                CHECK(wrong == 0);
+            }
+        }
+    }
+
+    void test_reconstruct_static_image()
+    {
+        std::vector<uint32_t> image(W * H);
+        for (uint32_t y = 0; y < H; ++y) {
+            for (uint32_t x = 0; x < W; ++x) {
+                image[y * W + x] = pixel(x, y);
+            }
+        }
+
+        for (const auto mode : MODES) {
+            // The first pass has no history, the second one fills in the rest
+            const std::vector<uint32_t> empty(W * H, 0);
+            std::vector<uint32_t> first(W * H);
+            std::vector<uint32_t> second(W * H);
+            reconstruct(mode, 0, image.data(), empty.data(), first.data(), W, H);
+            reconstruct(mode, 1, image.data(), first.data(), second.data(), W, H);
+
+            auto first_wrong = 0;
+            for (uint32_t y = 0; y < H; ++y) {
+                for (uint32_t x = 0; x < W; ++x) {
+                    const auto expected = is_rendered(mode, 0, x, y) ? pixel(x, y) : 0u;
+                    first_wrong += first[y * W + x] != expected ? 1 : 0;
+                }
+            }
+            CHECK(first_wrong == 0);
+            CHECK(second == image);
+        }
+    }
+}
+
+int main()
+{
+    test_patterns();
+    test_whole_quads();
+    test_parities_complement();
+    test_mask_tiles_pattern();
+    test_reconstruct_static_image();
+    return check::result();
+}
@@ -0,0 +1,216 @@
+#include "Check.hpp"
+
+#include "Latency.hpp"
+
+#include <algorithm>
+#include <vector>
+
+using namespace latency;
+
+namespace {
+    constexpr uint32_t QUERY_TYPE_EVENT = 8;
+    constexpr long DEVICE_LOST = static_cast<long>(0x88760868);
+
+    // GPU on a fake clock that runs the frames one after another
+    struct Gpu {
+        int64_t time = 0;
+        int64_t free = 0;
+        // GetData result forced on all queries, i.e. a lost device
+        std::optional<long> forced_result;
+        uint32_t get_data_calls = 0;
+    };
+
+    // Stand-in of IDirect3DQuery9 with the methods FrameQueries uses
+    struct Query {
+        Gpu* gpu;
+        int* live;
+        std::optional<int64_t> finished;
+        uint32_t issued = 0;
+
+        void Issue(uint32_t flags)
+        {
+            CHECK(flags == ISSUE_END);
+            finished = gpu->free;
+            issued++;
+        }
+
+        long GetData(void* data, uint32_t size, uint32_t flags)
+        {
+            CHECK(data == nullptr && size == 0 && flags == GET_DATA_FLUSH);
+            gpu->get_data_calls++;
+            if (gpu->forced_result) {
+                return gpu->forced_result.value();
+            }
+            return finished && finished.value() <= gpu->time ? RESULT_OK : RESULT_PENDING;
+        }
+
+        void Release()
+        {
+            (*live)--;
+            delete this;
+        }
+    };
+
+    // Stand-in of IDirect3DDevice9 that fails to create the query with the given index
+    struct Device {
+        Gpu gpu;
+        int live = 0;
+        uint32_t create_calls = 0;
+        std::optional<uint32_t> fail_at;
+
+        long CreateQuery(uint32_t type, Query** query)
+        {
+            CHECK(type == QUERY_TYPE_EVENT);
+            if (fail_at && create_calls++ == fail_at.value()) {
+                return DEVICE_LOST;
+            }
+            *query = new Query { &gpu, &live };
+            live++;
+            return RESULT_OK;
+        }
+    };
+
+    void test_create()
+    {
+        auto device = Device {};
+        auto queries = FrameQueries<Query> {};
+        CHECK(queries.create(&device, QUERY_TYPE_EVENT));
+        CHECK(device.live == static_cast<int>(QUERY_COUNT));
+        // Only created once
+        CHECK(queries.create(&device, QUERY_TYPE_EVENT));
+        CHECK(device.live == static_cast<int>(QUERY_COUNT));
+        queries.release();
+        CHECK(device.live == 0);
+    }
+
+    void test_create_failure()
+    {
+        // The queries created before the failure are released, and it's not tried again
+        auto device = Device {};
+        device.fail_at = 2;
+        auto queries = FrameQueries<Query> {};
+        CHECK(!queries.create(&device, QUERY_TYPE_EVENT));
+        CHECK(queries.has_failed());
+        CHECK(device.live == 0);
+        CHECK(device.create_calls == 3);
+        CHECK(!queries.create(&device, QUERY_TYPE_EVENT));
+        CHECK(device.create_calls == 3);
+    }
+
+    struct Run {
+        double fps;
+        // Mean time from the start of a frame on the CPU until the GPU has finished it
+        double latency_ms;
+        uint32_t max_in_flight;
+    };
+
+    // GPU bound frames, where the driver also blocks Present once three frames are queued
+    Run run(uint32_t max_frames)
+    {
+        constexpr uint32_t FRAMES = 1000;
+        constexpr int64_t CPU_FRAME_NS = 6'000'000;
+        constexpr int64_t GPU_FRAME_NS = 10'000'000;
+        constexpr int64_t POLL_NS = 50'000;
+        constexpr uint32_t DRIVER_QUEUE = 3;
+
+        auto device = Device {};
+        auto& gpu = device.gpu;
+        auto queries = FrameQueries<Query> {};
+        CHECK(queries.create(&device, QUERY_TYPE_EVENT));
+
+        auto finished = std::vector<int64_t> {};
+        auto latency_sum = int64_t { 0 };
+        auto ret = Run {};
+        for (uint32_t frame = 0; frame < FRAMES; ++frame) {
+            // The game samples the input here
+            const auto start = gpu.time;
+            gpu.time += CPU_FRAME_NS;
+            if (frame >= DRIVER_QUEUE) {
+                gpu.time = std::max(gpu.time, finished[frame - DRIVER_QUEUE]);
+            }
+            gpu.free = std::max(gpu.time, gpu.free) + GPU_FRAME_NS;
+            finished.push_back(gpu.free);
+            latency_sum += gpu.free - start;
+
+            // Present
+            if (max_frames > 0) {
+                const auto wait = queries.present(max_frames, [&gpu] { return gpu.time; }, [&gpu] { gpu.time += POLL_NS; });
+                CHECK(!wait.timed_out);
+                ret.max_in_flight = std::max(ret.max_in_flight, wait.frames_in_flight);
+            }
+        }
+        queries.release();
+        CHECK(device.live == 0);
+        ret.fps = 1e9 * FRAMES / static_cast<double>(finished.back());
+        ret.latency_ms = static_cast<double>(latency_sum) / FRAMES / 1e6;
+        return ret;
+    }
+
+    void test_limit()
+    {
+        const auto unlimited = run(0);
+        const auto one = run(1);
+        const auto two = run(2);
+        // Without a limit the driver queue fills up, and the input is old by the time the frame is finished
+        CHECK(unlimited.latency_ms > 30.0);
+        // Two frames keep the GPU busy at a much lower latency
+        CHECK(two.fps > unlimited.fps * 0.98);
+        CHECK(two.latency_ms < unlimited.latency_ms * 0.75);
+        // One frame has the lowest latency, and the CPU and the GPU take turns
+        CHECK(one.latency_ms < two.latency_ms);
+        CHECK(one.fps < two.fps);
+        // The wait leaves fewer than the limit in flight, so Present sees at most one more
+        CHECK(one.max_in_flight <= 2);
+        CHECK(two.max_in_flight <= 3);
+    }
+
+    void test_errors_do_not_hold_the_frame()
+    {
+        // A lost device returns an error from GetData, which counts as finished
+        auto device = Device {};
+        device.gpu.free = 1'000'000'000;
+        device.gpu.forced_result = DEVICE_LOST;
+        auto queries = FrameQueries<Query> {};
+        CHECK(queries.create(&device, QUERY_TYPE_EVENT));
+        auto idles = 0;
+        const auto wait = queries.present(1, [&device] { return device.gpu.time; }, [&] {
+            device.gpu.time += 1'000'000;
+            idles++;
+        });
+        CHECK(!wait.timed_out);
+        CHECK(idles == 0);
+        CHECK(wait.frames_in_flight == 1);
+        queries.release();
+    }
+
+    void test_pending_times_out()
+    {
+        // S_FALSE is pending, so a query that never signals holds the frame until the timeout
+        auto device = Device {};
+        device.gpu.forced_result = RESULT_PENDING;
+        auto& gpu = device.gpu;
+        auto queries = FrameQueries<Query> {};
+        CHECK(queries.create(&device, QUERY_TYPE_EVENT));
+        const auto wait = queries.present(1, [&gpu] { return gpu.time; }, [&gpu] { gpu.time += 1'000'000; });
+        CHECK(wait.timed_out);
+        CHECK(wait.wait_ns > TIMEOUT_NS);
+        CHECK(gpu.get_data_calls > 50);
+
+        // The frames in flight were forgotten
+        gpu.forced_result.reset();
+        const auto next = queries.present(1, [&gpu] { return gpu.time; }, [&gpu] { gpu.time += 1'000'000; });
+        CHECK(next.frames_in_flight == 1);
+        CHECK(!next.timed_out);
+        queries.release();
+    }
+}
+
+int main()
+{
+    test_create();
+    test_create_failure();
+    test_limit();
+    test_errors_do_not_hold_the_frame();
+    test_pending_times_out();
+    return check::result();
+}
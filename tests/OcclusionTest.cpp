@@ -0,0 +1,111 @@
+#include "Check.hpp"
+
+#include "Occlusion.hpp"
+
+#include <algorithm>
+#include <vector>
+
+using namespace occlusion;
+
+namespace {
+    // Draws one frame of a single pass, with the queries of the draws returning the given pixel counts
+    template <typename F>
+    std::vector<Decision> frame(Tracker& tracker, const std::vector<Key>& keys, F&& pixels)
+    {
+        auto ret = std::vector<Decision> {};
+        tracker.begin_pass();
+        for (const auto& key : keys) {
+            ret.push_back(tracker.draw(key, 8));
+        }
+        tracker.poll(pixels);
+        tracker.end_frame();
+        return ret;
+    }
+
+    void test_keys()
+    {
+        int buffers[2];
+        const auto a = Key { .vertex_buffer = &buffers[0], .primitives = 100 };
+        // The same geometry drawn again, from another buffer and at another base vertex
+        auto other_range = a;
+        other_range.first = 300;
+        auto other_buffer = a;
+        other_buffer.vertex_buffer = &buffers[1];
+        auto other_base = a;
+        other_base.base_vertex = 1000;
+
+        auto tracker = Tracker {};
+        // Only the first draw is hidden
+        const auto first = frame(tracker, { a, other_range, other_buffer, other_base }, [](uint32_t query) -> std::optional<uint32_t> { return query == 0 ? 0u : 10u; });
+        CHECK(first.size() == 4 && first[0].query && first[1].query && first[2].query && first[3].query);
+        const auto second = frame(tracker, { a, other_range, other_buffer, other_base }, [](uint32_t) -> std::optional<uint32_t> { return 10u; });
+        CHECK(second[0].skip);
+        CHECK(!second[1].skip && !second[2].skip && !second[3].skip);
+    }
+
+    void test_occurrences()
+    {
+        // Two draws with the same key in a pass are told apart by their order
+        const auto a = Key { .primitives = 100 };
+        auto tracker = Tracker {};
+        frame(tracker, { a, a }, [](uint32_t query) -> std::optional<uint32_t> { return query == 1 ? 0u : 10u; });
+        const auto decisions = frame(tracker, { a, a }, [](uint32_t) -> std::optional<uint32_t> { return 10u; });
+        CHECK(!decisions[0].skip && decisions[1].skip);
+        CHECK(tracker.size() == 2);
+
+        // Forgotten on reset
+        tracker.reset();
+        const auto after_reset = frame(tracker, { a, a }, [](uint32_t) -> std::optional<uint32_t> { return 10u; });
+        CHECK(!after_reset[0].skip && !after_reset[1].skip);
+    }
+
+    void test_moving_camera()
+    {
+        // The camera moves on every frame, so the transformations the game sets for the draws never repeat.
+        // The draws keep their keys all the same: the hidden ones stay skipped between the retests, and no
+        // draws pile up in the tracker.
+        constexpr uint32_t FRAMES = 400;
+        constexpr uint32_t RETEST_FRAMES = 8;
+        int buffers[3];
+        auto keys = std::vector<Key> {};
+        for (uint32_t i = 0; i < 12; ++i) {
+            keys.push_back(Key { .shader_index = 5, .vertex_buffer = &buffers[i % 3], .primitives = 200 + i % 2 });
+        }
+        // Draws hidden behind the cockpit
+        const auto hidden = [](uint32_t draw) { return draw % 4 == 0; };
+
+        auto tracker = Tracker {};
+        auto skipped = 0u;
+        auto queries = 0u;
+        auto max_size = size_t { 0 };
+        for (uint32_t f = 0; f < FRAMES; ++f) {
+            auto issued = std::vector<uint32_t>(QUERY_COUNT);
+            tracker.begin_pass();
+            for (uint32_t i = 0; i < keys.size(); ++i) {
+                const auto decision = tracker.draw(keys[i], RETEST_FRAMES);
+                skipped += decision.skip ? 1 : 0;
+                if (decision.query) {
+                    issued[decision.query.value()] = i;
+                    queries++;
+                }
+            }
+            tracker.poll([&](uint32_t query) -> std::optional<uint32_t> { return hidden(issued[query]) ? 0u : 10u; });
+            tracker.end_frame();
+            max_size = std::max(max_size, tracker.size());
+        }
+        const auto hidden_draws = 3u;
+        CHECK(max_size == keys.size());
+        // Each hidden draw is only drawn to retest it
+        CHECK(skipped >= hidden_draws * (FRAMES - FRAMES / RETEST_FRAMES - 1));
+        // The visible draws are queried on every frame, the hidden ones once per retest
+        CHECK(queries <= (keys.size() - hidden_draws) * FRAMES + hidden_draws * (FRAMES / RETEST_FRAMES + 1));
+    }
+}
+
+int main()
+{
+    test_keys();
+    test_occurrences();
+    test_moving_camera();
+    return check::result();
+}
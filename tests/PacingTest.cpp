@@ -0,0 +1,139 @@
+#include "Check.hpp"
+
+#include "Pacing.hpp"
+
+#include <cmath>
+#include <random>
+
+using namespace pacing;
+
+namespace {
+    constexpr int64_t CLOCK_READ_NS = 100;
+    constexpr int64_t TWO_PASSES_NS = 6'000'000;
+    constexpr int64_t THREE_PASSES_NS = 9'000'000;
+
+    // Fake clock where reading the time takes a moment and the sleeps wake up late by up to `max_oversleep_ns`
+    struct Clock {
+        int64_t time = 0;
+        std::mt19937 rng { 1 };
+        std::uniform_int_distribution<int64_t> oversleep;
+        uint32_t sleeps = 0;
+
+        explicit Clock(int64_t max_oversleep_ns)
+            : oversleep(0, max_oversleep_ns)
+        {
+        }
+
+        auto now()
+        {
+            return [this] { return time += CLOCK_READ_NS; };
+        }
+
+        auto sleep()
+        {
+            return [this](int64_t ns) {
+                time += ns + oversleep(rng);
+                sleeps++;
+            };
+        }
+    };
+
+    // One window of frames that alternate between the cost of two and three camera passes
+    std::optional<FrameTimes> run_window(Limiter& limiter, Clock& clock, double fps)
+    {
+        auto ret = std::optional<FrameTimes> {};
+        // The first frame has no frame time
+        for (uint32_t i = 0; i <= WINDOW_FRAMES && !ret; ++i) {
+            ret = limiter.wait(fps, clock.now(), clock.sleep());
+            clock.time += i % 2 == 0 ? TWO_PASSES_NS : THREE_PASSES_NS;
+        }
+        return ret;
+    }
+
+    void test_unlimited()
+    {
+        auto clock = Clock(1'500'000);
+        auto limiter = Limiter {};
+        const auto times = run_window(limiter, clock, 0.0);
+        CHECK(times.has_value());
+        CHECK(clock.sleeps == 0);
+        // The frame times follow the alternating cost
+        CHECK(times->frames == WINDOW_FRAMES);
+        CHECK(times->min_ms < 6.1);
+        CHECK(times->max_ms > 8.9);
+    }
+
+    void test_even_frame_times()
+    {
+        // 100 fps leaves room for the slower frames, and the late wake ups are absorbed by the spinning
+        auto clock = Clock(1'500'000);
+        auto limiter = Limiter {};
+        const auto times = run_window(limiter, clock, 100.0);
+        CHECK(times.has_value());
+        CHECK(std::abs(times->mean_ms - 10.0) < 0.01);
+        CHECK(times->stddev_ms < 0.05);
+        CHECK(times->max_ms - times->min_ms < 0.2);
+        CHECK(clock.sleeps > 0);
+
+        // The spin time has grown to cover the late wake ups, but no further than the limit
+        CHECK(limiter.spin_time() >= 1'500'000);
+        CHECK(limiter.spin_time() <= Limiter::MAX_SPIN_NS);
+    }
+
+    void test_spin_time_shrinks()
+    {
+        // With punctual sleeps the spin time shrinks back towards the minimum
+        auto clock = Clock(0);
+        auto limiter = Limiter {};
+        for (int i = 0; i < 4; ++i) {
+            run_window(limiter, clock, 60.0);
+        }
+        CHECK(limiter.spin_time() < 1'000'000);
+        CHECK(limiter.spin_time() >= Limiter::MIN_SPIN_NS);
+    }
+
+    void test_late_frame_starts_over()
+    {
+        // A frame that is late by more than a frame is not followed by a burst of frames to catch up
+        auto clock = Clock(0);
+        auto limiter = Limiter {};
+        limiter.wait(100.0, clock.now(), clock.sleep());
+        clock.time += 50'000'000;
+        const auto late = clock.time;
+        limiter.wait(100.0, clock.now(), clock.sleep());
+        CHECK(clock.time - late < 1'000'000);
+        clock.time += 1'000'000;
+        const auto next = clock.time;
+        limiter.wait(100.0, clock.now(), clock.sleep());
+        CHECK(clock.time - next > 8'000'000);
+    }
+
+    void test_window_statistics()
+    {
+        auto limiter = Limiter {};
+        auto time = int64_t { 0 };
+        const auto now = [&time] { return time; };
+        const auto sleep = [](int64_t) {};
+        auto windows = 0;
+        for (uint32_t i = 0; i <= 2 * WINDOW_FRAMES; ++i) {
+            if (const auto times = limiter.wait(0.0, now, sleep)) {
+                windows++;
+                CHECK(times->frames == WINDOW_FRAMES);
+                CHECK(std::abs(times->mean_ms - 5.0) < 1e-9);
+                CHECK(times->stddev_ms < 1e-9);
+            }
+            time += 5'000'000;
+        }
+        CHECK(windows == 2);
+    }
+}
+
+int main()
+{
+    test_unlimited();
+    test_even_frame_times();
+    test_spin_time_shrinks();
+    test_late_frame_starts_over();
+    test_window_statistics();
+    return check::result();
+}
@@ -0,0 +1,449 @@
+#include "Check.hpp"
+
+#include "Panorama.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <initializer_list>
+#include <map>
+#include <numbers>
+#include <vector>
+
+using namespace panorama;
+
+namespace {
+    using Vec4 = std::array<float, 4>;
+
+    enum RegisterType : uint32_t {
+        TEMP = 0,
+        INPUT = 1,
+        CONST = 2,
+        RASTOUT = 4,
+        ATTROUT = 5,
+        OUTPUT = 6,
+    };
+
+    constexpr uint32_t END = 0x0000ffff;
+    constexpr uint32_t RELATIVE = 1 << 13;
+
+    constexpr uint32_t reg(uint32_t type, uint32_t n)
+    {
+        return 0x80000000 | ((type & 0x7) << 28) | ((type & 0x18) << 8) | n;
+    }
+
+    constexpr uint32_t dst(uint32_t type, uint32_t n)
+    {
+        return reg(type, n) | (0xf << 16);
+    }
+
+    constexpr uint32_t src(uint32_t type, uint32_t n)
+    {
+        return reg(type, n) | (0xe4 << 16);
+    }
+
+    // Assembles a vertex shader of the given major version, with the instruction lengths from shader model 2 on
+    struct Shader {
+        uint32_t major;
+        std::vector<uint32_t> tokens;
+
+        explicit Shader(uint32_t major)
+            : major(major)
+            , tokens { 0xfffe0000 | (major << 8) | (major == 1 ? 1 : 0) }
+        {
+        }
+
+        Shader& operator()(uint32_t opcode, std::initializer_list<uint32_t> params)
+        {
+            tokens.push_back(opcode | (major >= 2 ? static_cast<uint32_t>(params.size()) << 24 : 0));
+            tokens.insert(tokens.end(), params);
+            return *this;
+        }
+
+        std::vector<uint32_t> end() const
+        {
+            auto ret = tokens;
+            ret.push_back(END);
+            return ret;
+        }
+    };
+
+    // oPos = v0 * c0..c3, the way the game's shaders transform the position, and a color from v1
+    Shader transform_shader(uint32_t major)
+    {
+        auto s = Shader { major };
+        if (major >= 3) {
+            s(31, { 0x80000000, dst(OUTPUT, 0) }); // dcl_position o0
+            s(31, { 0x8000000a, dst(OUTPUT, 1) }); // dcl_color o1
+        }
+        s(31, { 0x80000000, dst(INPUT, 0) }); // dcl_position v0
+        s(31, { 0x8000000a, dst(INPUT, 1) }); // dcl_color v1
+        s(20, { major >= 3 ? dst(OUTPUT, 0) : dst(RASTOUT, 0), src(INPUT, 0), src(CONST, 0) }); // m4x4
+        s(1, { major >= 3 ? dst(OUTPUT, 1) : dst(ATTROUT, 0), src(INPUT, 1) }); // mov
+        return s;
+    }
+
+    int sm1_parameter_count(uint32_t opcode)
+    {
+        switch (opcode) {
+            case 1: case 6: case 7: case 14: case 31: return 2;
+            case 2: case 5: case 9: case 10: case 11: case 12: case 20: return 3;
+            case 4: return 4;
+            case 81: return 5;
+            default: return -1;
+        }
+    }
+
+    // Runs the instructions the rewritten shaders use, and returns the position output
+    struct Machine {
+        std::array<Vec4, 32> r {};
+        std::array<Vec4, 16> v {};
+        std::array<Vec4, 96> c {};
+        std::map<uint32_t, Vec4> outputs;
+        bool failed = false;
+
+        Vec4 read(uint32_t token)
+        {
+            const auto type = ((token >> 28) & 0x7) | ((token >> 8) & 0x18);
+            const auto n = token & 0x7ff;
+            Vec4 value {};
+            switch (type) {
+                case TEMP: value = r[n]; break;
+                case INPUT: value = v[n]; break;
+                case CONST: value = c[n]; break;
+                default: failed = true;
+            }
+            Vec4 ret;
+            for (size_t i = 0; i < 4; ++i) {
+                ret[i] = value[(token >> (16 + 2 * i)) & 0x3];
+                if (((token >> 24) & 0xf) == 1) {
+                    ret[i] = -ret[i];
+                }
+            }
+            return ret;
+        }
+
+        void write(uint32_t token, const Vec4& value)
+        {
+            const auto type = ((token >> 28) & 0x7) | ((token >> 8) & 0x18);
+            const auto n = token & 0x7ff;
+            auto& out = type == TEMP ? r[n] : outputs[type << 16 | n];
+            for (size_t i = 0; i < 4; ++i) {
+                if (token & (1 << (16 + i))) {
+                    out[i] = value[i];
+                }
+            }
+        }
+
+        static float dot(const Vec4& a, const Vec4& b)
+        {
+            return a[0] * b[0] + a[1] * b[1] + a[2] * b[2] + a[3] * b[3];
+        }
+
+        void run(const std::vector<uint32_t>& fn)
+        {
+            const auto major = (fn[0] >> 8) & 0xff;
+            size_t i = 1;
+            while (i < fn.size() && fn[i] != END) {
+                const auto opcode = fn[i] & 0xffff;
+                const auto count = major >= 2 ? static_cast<int>((fn[i] >> 24) & 0xf) : sm1_parameter_count(opcode);
+                if (count < 0) {
+                    failed = true;
+                    return;
+                }
+                const auto* p = &fn[i + 1];
+                const auto unary = [&](auto f) {
+                    const auto a = read(p[1]);
+                    write(p[0], { f(a[0]), f(a[1]), f(a[2]), f(a[3]) });
+                };
+                const auto binary = [&](auto f) {
+                    const auto a = read(p[1]);
+                    const auto b = read(p[2]);
+                    write(p[0], { f(a[0], b[0]), f(a[1], b[1]), f(a[2], b[2]), f(a[3], b[3]) });
+                };
+                switch (opcode) {
+                    case 1: unary([](float a) { return a; }); break;
+                    case 2: binary([](float a, float b) { return a + b; }); break;
+                    case 4: {
+                        const auto a = read(p[1]);
+                        const auto b = read(p[2]);
+                        const auto d = read(p[3]);
+                        write(p[0], { a[0] * b[0] + d[0], a[1] * b[1] + d[1], a[2] * b[2] + d[2], a[3] * b[3] + d[3] });
+                        break;
+                    }
+                    case 5: binary([](float a, float b) { return a * b; }); break;
+                    case 6: unary([](float a) { return 1.0f / a; }); break;
+                    case 7: unary([](float a) { return 1.0f / std::sqrt(std::abs(a)); }); break;
+                    case 10: binary([](float a, float b) { return std::min(a, b); }); break;
+                    case 11: binary([](float a, float b) { return std::max(a, b); }); break;
+                    case 12: binary([](float a, float b) { return a < b ? 1.0f : 0.0f; }); break;
+                    case 20: {
+                        const auto a = read(p[1]);
+                        const auto n = p[2] & 0x7ff;
+                        write(p[0], { dot(a, c[n]), dot(a, c[n + 1]), dot(a, c[n + 2]), dot(a, c[n + 3]) });
+                        break;
+                    }
+                    case 31: break;
+                    default: failed = true; return;
+                }
+                i += 1 + count;
+            }
+        }
+    };
+
+    // Machine with the view matrix as the identity and the projection constants set
+    Machine machine(Mode mode, const Projection& projection)
+    {
+        auto m = Machine {};
+        for (size_t i = 0; i < 4; ++i) {
+            m.c[i][i] = 1.0f;
+        }
+        const auto constants = panorama::constants(mode, projection);
+        for (size_t i = 0; i < CONSTANT_COUNT; ++i) {
+            std::copy_n(constants.begin() + 4 * i, 4, m.c[CONSTANT_REGISTER + i].begin());
+        }
+        return m;
+    }
+
+    // Runs a rewritten transform shader for a view space position
+    std::optional<Vec4> run(Machine& m, const std::vector<uint32_t>& fn, Mode mode, const Vec4& position)
+    {
+        const auto rewritten = rewrite_vertex_shader(fn.data(), mode);
+        if (!rewritten) {
+            return std::nullopt;
+        }
+        m.v[0] = position;
+        m.v[1] = { 0.25f, 0.5f, 0.75f, 1.0f };
+        m.outputs.clear();
+        m.run(rewritten->bytecode);
+        const auto major = (fn[0] >> 8) & 0xff;
+        const auto color = m.outputs[major >= 3 ? (OUTPUT << 16 | 1) : (ATTROUT << 16)];
+        if (m.failed || color != m.v[1]) {
+            return std::nullopt;
+        }
+        return m.outputs[major >= 3 ? (OUTPUT << 16) : (RASTOUT << 16)];
+    }
+
+    std::optional<Vec4> project(const std::vector<uint32_t>& fn, Mode mode, const Projection& projection, const Vec4& position)
+    {
+        auto m = machine(mode, projection);
+        return run(m, fn, mode, position);
+    }
+
+    constexpr float TARGET_W = 1920.0f;
+    constexpr float TARGET_H = 1080.0f;
+    constexpr float Z_NEAR = 0.1f;
+    constexpr float Z_FAR = 1000.0f;
+
+    // A center screen with narrower side screens, the left one showing the inner part of its image
+    // and the right one turned further out
+    Projection planar_projection()
+    {
+        const auto yscale = 1.0f / std::tan(std::numbers::pi_v<float> / 6.0f);
+        const auto xscale = yscale * TARGET_H / TARGET_W;
+        const auto monitor_fov = 2.0f * std::atan(1.0f / xscale);
+        const auto screen = [&](float angle, float crop_x, float x, float width) {
+            return Screen { angle, xscale, yscale, TARGET_W, TARGET_H, crop_x, 0.0f, x, 0.0f, width };
+        };
+        return {
+            .vertical_fov = std::numbers::pi_v<float> / 3.0f,
+            .monitor_fov = monitor_fov,
+            .monitors = 3,
+            .z_near = Z_NEAR,
+            .z_far = Z_FAR,
+            .screens = {
+                screen(0.0f, 0.0f, 1280.0f, 1920.0f),
+                screen(monitor_fov, 640.0f, 0.0f, 1280.0f),
+                screen(-monitor_fov - 0.1f, 0.0f, 3200.0f, 1280.0f),
+            },
+            .width = 4480.0f,
+            .height = TARGET_H,
+        };
+    }
+
+    // View space position of a pixel of a screen's camera image at the given depth
+    Vec4 position_of_pixel(const Screen& s, float px, float py, float depth)
+    {
+        const auto nx = 2.0f * px / s.target_width - 1.0f;
+        const auto ny = 1.0f - 2.0f * py / s.target_height;
+        const auto qx = nx / s.xscale * depth;
+        const auto qy = ny / s.yscale * depth;
+        // Camera space to the center camera's view space
+        return { qx * std::cos(s.angle) - depth * std::sin(s.angle), qy, qx * std::sin(s.angle) + depth * std::cos(s.angle), 1.0f };
+    }
+
+    bool near(float a, float b, float tolerance = 1e-4f)
+    {
+        return std::abs(a - b) < tolerance;
+    }
+
+    void test_planar()
+    {
+        const auto projection = planar_projection();
+        for (const auto major : { 1u, 2u, 3u }) {
+            const auto fn = transform_shader(major).end();
+            for (const auto& s : projection.screens) {
+                // Pixels of the shown part land on the same pixel of the screen in the panorama
+                for (const auto& [u, v] : { std::pair { 0.5f, 0.5f }, std::pair { 0.2f, 0.8f }, std::pair { 0.9f, 0.1f } }) {
+                    const auto px = s.crop_x + u * s.width;
+                    const auto py = v * s.target_height;
+                    const auto depth = 25.0f;
+                    const auto out = project(fn, Planar, projection, position_of_pixel(s, px, py, depth));
+                    CHECK(out.has_value());
+                    if (!out) {
+                        continue;
+                    }
+                    const auto [x, y, z, w] = *out;
+                    CHECK(near(w, depth, 1e-3f));
+                    CHECK(near((x / w + 1.0f) / 2.0f * projection.width, s.x + px - s.crop_x, 0.05f));
+                    CHECK(near((1.0f - y / w) / 2.0f * projection.height, s.y + py, 0.05f));
+                    CHECK(near(z / w, Z_FAR / (Z_FAR - Z_NEAR) * (1.0f - Z_NEAR / depth)));
+                }
+            }
+        }
+    }
+
+    void test_planar_single_screen()
+    {
+        // Without side screens everything is projected with the center camera, also far to the side
+        auto projection = planar_projection();
+        projection.monitors = 1;
+        projection.width = 1920.0f;
+        projection.screens[0].x = 0.0f;
+        const auto fn = transform_shader(1).end();
+        const auto out = project(fn, Planar, projection, { 10.0f, 0.0f, 1.0f, 1.0f });
+        CHECK(out.has_value());
+        if (out) {
+            CHECK(near((*out)[0] / (*out)[3], 10.0f * projection.screens[0].xscale));
+        }
+    }
+
+    void test_cylindrical()
+    {
+        auto projection = planar_projection();
+        const auto xscale = 1.0f / (3.0f * projection.monitor_fov / 2.0f);
+        const auto yscale = 1.0f / std::tan(projection.vertical_fov / 2.0f);
+        const auto fn = transform_shader(2).end();
+        for (const auto theta : { -2.5f, -0.7f, 0.0f, 0.3f, 1.2f, 2.9f }) {
+            const auto r = 7.0f;
+            const auto out = project(fn, Cylindrical, projection, { r * std::sin(theta), 1.5f, r * std::cos(theta), 1.0f });
+            CHECK(out.has_value());
+            if (out) {
+                const auto [x, y, z, w] = *out;
+                CHECK(near(w, r, 1e-3f));
+                CHECK(near(x / w, theta * xscale, 1e-4f));
+                CHECK(near(y / w, 1.5f * yscale / r));
+            }
+        }
+    }
+
+    void test_shared_constants()
+    {
+        // Shaders that read different numbers of constant registers take the projection from the same ones, so the
+        // constants set once are right for all of them
+        const auto projection = planar_projection();
+        for (const auto mode : { Cylindrical, Planar }) {
+            const auto small = transform_shader(2).end();
+            auto large_shader = transform_shader(2);
+            large_shader(1, { dst(TEMP, 0), src(CONST, 40) });
+            const auto large = large_shader.end();
+
+            auto m = machine(mode, projection);
+            m.c[40] = { 5.0f, 6.0f, 7.0f, 8.0f };
+            const auto position = Vec4 { 1.0f, 2.0f, 20.0f, 1.0f };
+            const auto expected = project(small, mode, projection, position);
+            CHECK(expected.has_value());
+            for (const auto& fn : { small, large, small }) {
+                const auto out = run(m, fn, mode, position);
+                CHECK(out.has_value() && out == expected);
+            }
+        }
+    }
+
+    void test_bytecode_length()
+    {
+        const auto fn = transform_shader(1).end();
+        CHECK(bytecode_length(fn.data()) == fn.size());
+        // Comments are skipped
+        auto commented = Shader { 2 };
+        commented.tokens.push_back(0x0002fffe);
+        commented.tokens.push_back(0x12345678);
+        commented.tokens.push_back(END);
+        commented(1, { dst(TEMP, 0), src(INPUT, 0) });
+        CHECK(bytecode_length(commented.end().data()) == commented.tokens.size() + 1);
+        // Pixel shaders and unknown shader model 1 instructions
+        const uint32_t pixel_shader[] = { 0xffff0200, END };
+        CHECK(bytecode_length(pixel_shader) == 0);
+        const uint32_t unknown[] = { 0xfffe0101, 0x00000060, END };
+        CHECK(bytecode_length(unknown) == 0);
+    }
+
+    void test_relative_addressing()
+    {
+        // A constant addressed with a0 may be any register from the base on
+        for (const auto major : { 1u, 2u }) {
+            auto s = transform_shader(major);
+            if (major == 1) {
+                s(1, { dst(TEMP, 0), src(CONST, 10) | RELATIVE });
+            } else {
+                s(1, { dst(TEMP, 0), src(CONST, 10) | RELATIVE, 0xb0000000 | (0x00 << 16) });
+            }
+            CHECK(!rewrite_vertex_shader(s.end().data(), Planar));
+        }
+
+        // The address register token of a relatively addressed input is not a register the shader uses
+        auto s = transform_shader(3);
+        s(1, { dst(TEMP, 1), src(INPUT, 0) | RELATIVE, reg(15, 0) }); // mov r1, v[aL]
+        const auto rewritten = rewrite_vertex_shader(s.end().data(), Planar);
+        CHECK(rewritten.has_value());
+        if (rewritten) {
+            CHECK(bytecode_length(rewritten->bytecode.data()) == rewritten->bytecode.size());
+        }
+    }
+
+    void test_limits()
+    {
+        // The injected planar projection takes 21 instruction slots, the transform shader 5
+        const auto with_slots = [](uint32_t major, uint32_t slots) {
+            auto s = transform_shader(major);
+            for (uint32_t i = 5; i < slots; ++i) {
+                s(1, { dst(TEMP, 0), src(INPUT, 0) });
+            }
+            return s;
+        };
+        CHECK(rewrite_vertex_shader(with_slots(1, 128 - 21).end().data(), Planar).has_value());
+        CHECK(!rewrite_vertex_shader(with_slots(1, 128 - 20).end().data(), Planar));
+        CHECK(rewrite_vertex_shader(with_slots(2, 128).end().data(), Planar).has_value());
+
+        // exp is a macro of 10 slots in vs_1_1
+        auto exp = with_slots(1, 128 - 21 - 10);
+        exp(14, { dst(TEMP, 0), src(INPUT, 0) });
+        CHECK(rewrite_vertex_shader(exp.end().data(), Planar).has_value());
+        exp(1, { dst(TEMP, 0), src(INPUT, 0) });
+        CHECK(!rewrite_vertex_shader(exp.end().data(), Planar));
+
+        // Four free temporary registers and the constants of the injected code are needed
+        auto temps = transform_shader(1);
+        temps(1, { dst(TEMP, 8), src(INPUT, 0) });
+        CHECK(!rewrite_vertex_shader(temps.end().data(), Planar));
+        auto constants = transform_shader(1);
+        constants(1, { dst(TEMP, 0), src(CONST, 95 - CONSTANT_COUNT) });
+        CHECK(rewrite_vertex_shader(constants.end().data(), Planar).has_value());
+        constants(1, { dst(TEMP, 0), src(CONST, 96 - CONSTANT_COUNT) });
+        CHECK(!rewrite_vertex_shader(constants.end().data(), Planar));
+
+        CHECK(!rewrite_vertex_shader(transform_shader(1).end().data(), Off));
+    }
+}
+
+int main()
+{
+    test_planar();
+    test_planar_single_screen();
+    test_cylindrical();
+    test_shared_constants();
+    test_bytecode_length();
+    test_relative_addressing();
+    test_limits();
+    return check::result();
+}
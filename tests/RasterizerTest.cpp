@@ -0,0 +1,217 @@
+#include "Check.hpp"
+
+#include "Rasterizer.hpp"
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+#include <ext/matrix_clip_space.hpp>
+#include <trigonometric.hpp>
+
+using namespace rasterizer;
+
+namespace {
+    constexpr uint32_t WIDTH = 256;
+    constexpr uint32_t HEIGHT = 144;
+
+    // Camera at the origin looking down +z, with a 90 degree vertical FoV so that a point at (x, y, z)
+    // is on the edge of the screen when |y| = z
+    const auto CLIP = glm::perspectiveLH_ZO(glm::radians(90.0f), static_cast<float>(WIDTH) / HEIGHT, 0.1f, 1000.0f);
+    const auto ASPECT = static_cast<float>(WIDTH) / HEIGHT;
+
+    // Two triangles covering the rectangle from (x0, y0) to (x1, y1) at depth z
+    Mesh quad(float x0, float y0, float x1, float y1, float z)
+    {
+        return {
+            { x0, y0, z }, { x1, y0, z }, { x1, y1, z },
+            { x0, y0, z }, { x1, y1, z }, { x0, y1, z },
+        };
+    }
+
+    // One triangle covering the screen to the left of x at depth z, so that no shared edge crosses the screen
+    Mesh left_of(float x, float z)
+    {
+        const auto l = z * ASPECT * 10.0f;
+        return { { x, -l, z }, { x, l, z }, { x - l, 0.0f, z } };
+    }
+
+    float pixel(const DepthBuffer& buffer, uint32_t x, uint32_t y)
+    {
+        return buffer.pixels()[static_cast<size_t>(y) * WIDTH + x];
+    }
+
+    void test_assemble()
+    {
+        const std::vector<glm::vec3> positions = { { 0, 0, 1 }, { 1, 0, 1 }, { 0, 1, 1 }, { 1, 1, 1 } };
+
+        const std::vector<uint32_t> list = { 0, 1, 2, 2, 1, 3 };
+        const auto triangles = assemble(4, 2, positions, list);
+        CHECK(triangles.size() == 6);
+        CHECK(triangles[3] == positions[2] && triangles[5] == positions[3]);
+
+        const std::vector<uint32_t> strip = { 0, 1, 2, 3 };
+        const auto stripped = assemble(5, 2, positions, strip);
+        CHECK(stripped.size() == 6);
+        CHECK(stripped[3] == positions[1] && stripped[4] == positions[2] && stripped[5] == positions[3]);
+
+        // Fans, too few indices and indices outside of the vertex range
+        CHECK(assemble(6, 2, positions, strip).empty());
+        CHECK(assemble(4, 3, positions, list).empty());
+        const std::vector<uint32_t> outside = { 0, 1, 4 };
+        CHECK(assemble(4, 1, positions, outside).empty());
+    }
+
+    void test_coverage()
+    {
+        // The left half of the screen at a depth of 10
+        const auto z = 10.0f;
+        const auto half = left_of(0.0f, z);
+        for (const auto simd : { false, true }) {
+            auto buffer = DepthBuffer { WIDTH, HEIGHT };
+            if (simd) {
+                buffer.draw(CLIP, half);
+            } else {
+                buffer.draw_scalar(CLIP, half);
+            }
+            auto left = uint32_t { 0 };
+            auto right = uint32_t { 0 };
+            for (uint32_t y = 0; y < HEIGHT; ++y) {
+                for (uint32_t x = 0; x < WIDTH; ++x) {
+                    (x < WIDTH / 2 ? left : right) += pixel(buffer, x, y) < 1.0f ? 1 : 0;
+                }
+            }
+            CHECK(left == WIDTH / 2 * HEIGHT);
+            CHECK(right == 0);
+            CHECK(pixel(buffer, 0, 0) > 0.0f && pixel(buffer, 0, 0) < 1.0f);
+        }
+
+        // The pixels on the diagonal shared by the two triangles of a quad are covered by neither
+        auto buffer = DepthBuffer { WIDTH, HEIGHT };
+        buffer.draw(CLIP, quad(-z * ASPECT, -z, z * ASPECT, z, z));
+        const auto unwritten = std::ranges::count(buffer.pixels(), 1.0f);
+        CHECK(unwritten > 0 && unwritten < 3 * WIDTH);
+    }
+
+    void test_partial_pixels()
+    {
+        // Screen x of 100.5 at a depth of 10, half way through pixel 100
+        const auto z = 10.0f;
+        const auto x = (100.5f / (WIDTH / 2) - 1.0f) * z * ASPECT;
+        const auto edge = left_of(x, z);
+        // A sliver narrower than a pixel, which covers no pixel entirely
+        const auto sliver = quad(0.0f, -z, z * ASPECT * 0.5f / WIDTH, z, z);
+        for (const auto simd : { false, true }) {
+            auto buffer = DepthBuffer { WIDTH, HEIGHT };
+            if (simd) {
+                buffer.draw(CLIP, edge);
+                buffer.draw(CLIP, sliver);
+            } else {
+                buffer.draw_scalar(CLIP, edge);
+                buffer.draw_scalar(CLIP, sliver);
+            }
+            for (uint32_t y = 0; y < HEIGHT; ++y) {
+                CHECK(pixel(buffer, 99, y) < 1.0f);
+                CHECK(pixel(buffer, 100, y) == 1.0f);
+                CHECK(pixel(buffer, WIDTH / 2, y) == 1.0f);
+            }
+        }
+    }
+
+    void test_simd_matches_scalar()
+    {
+        auto rng = std::mt19937 { 1 };
+        auto position = std::uniform_real_distribution<float> { -20.0f, 20.0f };
+        auto depth = std::uniform_real_distribution<float> { 5.0f, 40.0f };
+        auto triangles = Mesh {};
+        for (int i = 0; i < 300 * 3; ++i) {
+            triangles.push_back({ position(rng), position(rng), depth(rng) });
+        }
+        auto scalar = DepthBuffer { WIDTH, HEIGHT };
+        auto simd = DepthBuffer { WIDTH, HEIGHT };
+        scalar.draw_scalar(CLIP, triangles);
+        simd.draw(CLIP, triangles);
+        CHECK(scalar.pixels() == simd.pixels());
+
+        for (int i = 0; i < 1000; ++i) {
+            const auto min = glm::vec3 { position(rng), position(rng), depth(rng) + 20.0f };
+            const auto box = culling::Aabb { min, min + glm::vec3(1.0f) };
+            CHECK(simd.is_occluded(CLIP, box) == simd.is_occluded_scalar(CLIP, box));
+        }
+    }
+
+    void test_boxes()
+    {
+        // A wall covering the screen at a depth of 10
+        auto buffer = DepthBuffer { WIDTH, HEIGHT };
+        buffer.draw(CLIP, left_of(100.0f, 10.0f));
+
+        const auto behind = culling::Aabb { { -1.0f, -1.0f, 20.0f }, { 1.0f, 1.0f, 22.0f } };
+        const auto in_front = culling::Aabb { { -1.0f, -1.0f, 5.0f }, { 1.0f, 1.0f, 7.0f } };
+        const auto through = culling::Aabb { { -1.0f, -1.0f, 8.0f }, { 1.0f, 1.0f, 12.0f } };
+        const auto near_plane = culling::Aabb { { -1.0f, -1.0f, -5.0f }, { 1.0f, 1.0f, 22.0f } };
+        const auto off_screen = culling::Aabb { { 500.0f, -1.0f, 20.0f }, { 502.0f, 1.0f, 22.0f } };
+        for (const auto simd : { false, true }) {
+            const auto occluded = [&](const culling::Aabb& box) {
+                return simd ? buffer.is_occluded(CLIP, box) : buffer.is_occluded_scalar(CLIP, box);
+            };
+            CHECK(occluded(behind));
+            CHECK(!occluded(in_front));
+            CHECK(!occluded(through));
+            CHECK(!occluded(near_plane));
+            CHECK(!occluded(off_screen));
+        }
+
+        // Nothing is occluded by an empty buffer
+        buffer.clear();
+        CHECK(!buffer.is_occluded(CLIP, behind));
+    }
+
+    void test_mesh_cache()
+    {
+        int vertex_buffers[2];
+        int index_buffer;
+        const auto key = [&](int vb, const void* ib) {
+            return MeshKey { .vertex_buffer = &vertex_buffers[vb], .index_buffer = ib, .primitive_type = 4, .primitive_count = 2 };
+        };
+        auto cache = MeshCache {};
+        cache.insert(key(0, &index_buffer), quad(0, 0, 1, 1, 1));
+        cache.insert(key(1, nullptr), quad(0, 0, 1, 1, 1));
+        CHECK(cache.find(key(0, &index_buffer)) && cache.find(key(0, &index_buffer))->size() == 6);
+        CHECK(!cache.find(key(0, nullptr)));
+
+        // Writing the index buffer drops the meshes drawn with it, but not the others
+        cache.invalidate(&index_buffer);
+        CHECK(!cache.find(key(0, &index_buffer)));
+        CHECK(cache.find(key(1, nullptr)));
+        cache.invalidate(&vertex_buffers[1]);
+        CHECK(!cache.find(key(1, nullptr)));
+
+        cache.insert(key(0, nullptr), {});
+        CHECK(cache.find(key(0, nullptr)) && cache.find(key(0, nullptr))->empty());
+        cache.clear();
+        CHECK(!cache.find(key(0, nullptr)));
+
+        // Dropped all at once when there are too many meshes or vertices
+        for (uint32_t i = 0; i <= MAX_CACHED_MESHES; ++i) {
+            auto k = key(0, nullptr);
+            k.first_vertex = i;
+            cache.insert(k, {});
+        }
+        CHECK(!cache.find(key(0, nullptr)));
+        cache.insert(key(0, nullptr), Mesh(MAX_CACHED_VERTICES / 2));
+        cache.insert(key(1, nullptr), Mesh(MAX_CACHED_VERTICES / 2 + 1));
+        CHECK(!cache.find(key(0, nullptr)) && cache.find(key(1, nullptr)));
+    }
+}
+
+int main()
+{
+    test_assemble();
+    test_coverage();
+    test_partial_pixels();
+    test_simd_matches_scalar();
+    test_boxes();
+    test_mesh_cache();
+    return check::result();
+}
@@ -0,0 +1,75 @@
+#include "Check.hpp"
+
+#include "Reprojection.hpp"
+
+#include <cmath>
+#include <vector>
+
+#include <ext/matrix_clip_space.hpp>
+#include <ext/matrix_transform.hpp>
+#include <trigonometric.hpp>
+
+using namespace reprojection;
+
+namespace {
+    constexpr uint32_t W = 64;
+    constexpr uint32_t H = 36;
+
+    const auto PROJECTION = glm::perspectiveLH_ZO(glm::radians(60.0f), static_cast<float>(W) / H, 0.1f, 100.0f);
+
+    glm::vec2 map(const glm::mat3& m, float x, float y)
+    {
+        const auto q = m * glm::vec3(x, y, 1.0f);
+        return { q.x / q.z, q.y / q.z };
+    }
+
+    bool near(glm::vec2 a, glm::vec2 b)
+    {
+        return std::abs(a.x - b.x) < 1e-4f && std::abs(a.y - b.y) < 1e-4f;
+    }
+
+    void test_homography()
+    {
+        // Without a rotation each pixel maps to its own texture coordinates
+        const auto view = glm::lookAtLH(glm::vec3(1, 2, 3), glm::vec3(4, 2, 7), glm::vec3(0, 1, 0));
+        const auto same = homography(view, view, PROJECTION, W, H);
+        CHECK(near(map(same, 0.0f, 0.0f), { 0.0f, 0.0f }));
+        CHECK(near(map(same, W * 0.25f, H * 0.75f), { 0.25f, 0.75f }));
+        // The translation of the view does not matter
+        const auto moved = homography(glm::translate(view, glm::vec3(5, 0, 0)), view, PROJECTION, W, H);
+        CHECK(near(map(moved, W * 0.25f, H * 0.75f), { 0.25f, 0.75f }));
+
+        // After the camera turns to the right, the center of the new image was right of the center in the old one
+        const auto angle = glm::radians(10.0f);
+        const auto turned = glm::rotate(glm::identity<glm::mat4>(), -angle, glm::vec3(0, 1, 0));
+        const auto h = homography(glm::identity<glm::mat4>(), turned, PROJECTION, W, H);
+        const auto expected_u = 0.5f + 0.5f * PROJECTION[0][0] * std::tan(angle);
+        CHECK(near(map(h, W * 0.5f, H * 0.5f), { expected_u, 0.5f }));
+    }
+
+    void test_warp()
+    {
+        auto src = std::vector<uint32_t>(W * H);
+        for (uint32_t i = 0; i < src.size(); ++i) {
+            src[i] = i;
+        }
+        auto dst = std::vector<uint32_t>(W * H);
+        warp(src.data(), dst.data(), W, H, homography(glm::identity<glm::mat4>(), glm::identity<glm::mat4>(), PROJECTION, W, H));
+        CHECK(dst == src);
+
+        // A pixel to the right, and clamped at the right edge
+        const auto shift = glm::mat3(
+            1.0f / W, 0.0f, 0.0f,
+            0.0f, 1.0f / H, 0.0f,
+            1.0f / W, 0.0f, 1.0f);
+        warp(src.data(), dst.data(), W, H, shift);
+        CHECK(dst[0] == 1 && dst[W - 2] == W - 1 && dst[W - 1] == W - 1 && dst[W] == W + 1);
+    }
+}
+
+int main()
+{
+    test_homography();
+    test_warp();
+    return check::result();
+}
@@ -0,0 +1,132 @@
+#include "Check.hpp"
+
+#include "Upscale.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <ranges>
+#include <vector>
+
+using namespace upscale;
+
+namespace {
+    uint32_t channel(uint32_t pixel, int ch)
+    {
+        return (pixel >> (16 - 8 * ch)) & 0xff;
+    }
+
+    void test_flat_image()
+    {
+        // A flat image stays flat at any scale
+        const std::vector<uint32_t> src(40 * 30, 0xff4080c0u);
+        for (const auto [w, h] : { std::pair { 60u, 45u }, std::pair { 80u, 60u }, std::pair { 53u, 37u } }) {
+            std::vector<uint32_t> dst(w * h);
+            easu(src.data(), 40, 30, dst.data(), w, h);
+            CHECK(std::ranges::all_of(dst, [](uint32_t p) { return p == 0xff4080c0u; }));
+        }
+    }
+
+    void test_deringing()
+    {
+        // Every output pixel is within the range of the 2x2 input pixels around it
+        constexpr uint32_t SW = 32;
+        constexpr uint32_t SH = 24;
+        constexpr uint32_t DW = 48;
+        constexpr uint32_t DH = 36;
+        auto rng = std::mt19937 { 7 };
+        std::vector<uint32_t> src(SW * SH);
+        for (auto& p : src) {
+            p = 0xff000000u | (rng() & 0xffffff);
+        }
+        std::vector<uint32_t> dst(DW * DH);
+        easu(src.data(), SW, SH, dst.data(), DW, DH);
+
+        const auto at = [&src](int x, int y) {
+            return src[std::clamp(y, 0, static_cast<int>(SH) - 1) * SW + std::clamp(x, 0, static_cast<int>(SW) - 1)];
+        };
+        auto outside = 0;
+        for (uint32_t y = 0; y < DH; ++y) {
+            for (uint32_t x = 0; x < DW; ++x) {
+                const auto px = static_cast<int>(std::floor((x + 0.5f) * SW / DW - 0.5f));
+                const auto py = static_cast<int>(std::floor((y + 0.5f) * SH / DH - 0.5f));
+                const uint32_t quad[] = { at(px, py), at(px + 1, py), at(px, py + 1), at(px + 1, py + 1) };
+                for (int ch = 0; ch < 3; ++ch) {
+                    const auto [mn, mx] = std::ranges::minmax(quad | std::views::transform([ch](uint32_t p) { return channel(p, ch); }));
+                    const auto v = channel(dst[y * DW + x], ch);
+                    outside += v < mn || v > mx ? 1 : 0;
+                }
+            }
+        }
+        CHECK(outside == 0);
+    }
+
+    void test_edge_without_halos()
+    {
+        // A vertical edge between two grays goes from one to the other on every row without over- or undershoot
+        constexpr uint32_t SW = 16;
+        constexpr uint32_t SH = 8;
+        std::vector<uint32_t> src(SW * SH);
+        for (uint32_t y = 0; y < SH; ++y) {
+            for (uint32_t x = 0; x < SW; ++x) {
+                src[y * SW + x] = x < SW / 2 ? 0xff404040u : 0xffc0c0c0u;
+            }
+        }
+        std::vector<uint32_t> dst(2 * SW * 2 * SH);
+        easu(src.data(), SW, SH, dst.data(), 2 * SW, 2 * SH);
+        auto halos = 0;
+        for (uint32_t y = 0; y < 2 * SH; ++y) {
+            for (uint32_t x = 0; x < 2 * SW; ++x) {
+                const auto v = channel(dst[y * 2 * SW + x], 1);
+                halos += v < 0x40 || v > 0xc0 ? 1 : 0;
+                if (x > 0) {
+                    halos += v < channel(dst[y * 2 * SW + x - 1], 1) ? 1 : 0;
+                }
+            }
+            // Still an edge, not a blur across the image
+            CHECK(channel(dst[y * 2 * SW + SW - 3], 1) == 0x40);
+            CHECK(channel(dst[y * 2 * SW + SW + 2], 1) == 0xc0);
+        }
+        CHECK(halos == 0);
+    }
+
+    void test_rcas()
+    {
+        constexpr uint32_t W = 24;
+        constexpr uint32_t H = 16;
+        auto rng = std::mt19937 { 3 };
+        std::vector<uint32_t> src(W * H);
+        for (auto& p : src) {
+            p = 0xff000000u | (rng() & 0xffffff);
+        }
+        std::vector<uint32_t> dst(W * H);
+
+        // No sharpening is the identity
+        rcas(src.data(), dst.data(), W, H, 0.0f);
+        CHECK(dst == src);
+
+        // Sharpening a soft edge makes its ends steeper and leaves the flat parts as they are
+        for (uint32_t y = 0; y < H; ++y) {
+            for (uint32_t x = 0; x < W; ++x) {
+                const auto v = std::clamp<int>(0x40 + (static_cast<int>(x) - 10) * 0x20, 0x40, 0xc0);
+                src[y * W + x] = 0xff000000u | static_cast<uint32_t>(v) * 0x010101u;
+            }
+        }
+        rcas(src.data(), dst.data(), W, H, sharpness_from_stops(0.0f));
+        const auto row = [&dst](uint32_t x) { return channel(dst[8 * W + x], 1); };
+        CHECK(row(10) < 0x40 && row(14) > 0xc0);
+        CHECK(row(0) == 0x40 && row(8) == 0x40 && row(16) == 0xc0 && row(W - 1) == 0xc0);
+        // Less sharpening, less steep
+        rcas(src.data(), dst.data(), W, H, sharpness_from_stops(2.0f));
+        CHECK(row(10) < 0x40 && row(10) > 0x30);
+    }
+}
+
+int main()
+{
+    test_flat_image();
+    test_deringing();
+    test_edge_without_halos();
+    test_rcas();
+    return check::result();
+}